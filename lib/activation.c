@@ -0,0 +1,8 @@
+#include "activation.h"
+#include "constants.h"
+#include "kernels.h"
+
+
+// The scalar kernels take no target attribute, so they're built for
+// whatever the compiler targets by default.
+JCKY_ACTIVATION_KERNELS(, scalar)
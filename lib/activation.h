@@ -0,0 +1,111 @@
+#ifndef ACTIVATION_H
+#define ACTIVATION_H
+
+
+#include <math.h>
+
+#include "constants.h"
+
+
+// The activation functions of the hidden layers (see --activation). The
+// sigmoid keeps its own accuracy tiers (see sigmoid.h); the others are
+// each given here as three expressions of one value x:
+//
+//   forward          - the activation a of z = x
+//   from activation  - the derivative at z, given a = x
+//   from z           - the derivative at z = x
+//
+// The macros below wrap the expressions in the loops of the kernels, and
+// every kernel set instantiates them once with its own target attribute,
+// so there's a copy of each kernel per instruction set and per function,
+// and no call per element. The expressions are plain arithmetic and
+// selects, which the compiler turns into compares and blends, so the
+// loops have no branches and are vectorized at -O3 (given the Makefile's
+// KERNEL_CFLAGS, which the compiler needs to evaluate every lane of a
+// select). Only tanh calls libm,
+// in its forward pass and its derivative from z, like the exact sigmoid.
+#define JCKY_LEAKY_RELU_SLOPE 0.01
+
+#define JCKY_RELU(x) ((x) > 0.0 ? (x) : (nn_type)0.0)
+#define JCKY_RELU_PRIME(x) ((x) > 0.0 ? (nn_type)1.0 : (nn_type)0.0)
+#define JCKY_LEAKY_RELU(x) ((x) > 0.0 ? (x) : (nn_type)JCKY_LEAKY_RELU_SLOPE * (x))
+#define JCKY_LEAKY_RELU_PRIME(x) ((x) > 0.0 ? (nn_type)1.0 : (nn_type)JCKY_LEAKY_RELU_SLOPE)
+#define JCKY_TANH(x) ((nn_type)tanh(x))
+#define JCKY_TANH_PRIME_FROM_ACTIVATION(x) (1.0 - ((x) * (x)))
+#define JCKY_TANH_PRIME(x) (1.0 - (JCKY_TANH(x) * JCKY_TANH(x)))
+#define JCKY_SIGMOID_PRIME_FROM_ACTIVATION(x) ((x) * (1.0 - (x)))
+#define JCKY_SIGMOID_PRIME(x) (exp(x) / pow(exp(x) + 1, 2))
+
+// activation = forward(z), over rows * cols values, like sigmoidify
+#define JCKY_ACTIVATE_KERNEL(attribute, name, suffix, forward)          \
+    attribute void activate_##name##_##suffix(                         \
+        nn_type *activation,                                           \
+        nn_type *z_matrix,                                             \
+        int rows,                                                      \
+        int cols)                                                      \
+    {                                                                  \
+        long int i;                                                    \
+        const long int size = (long int)rows * cols;                   \
+        nn_type x;                                                     \
+        for (i=0; i<size; i++) {                                       \
+            x = z_matrix[i];                                           \
+            activation[i] = forward(x);                                \
+        }                                                              \
+    }
+
+// delta = delta . derivative(source), over 'len' values
+#define JCKY_DERIVE_KERNEL(attribute, name, suffix, derivative)         \
+    attribute void derive_##name##_##suffix(                           \
+        nn_type *delta,                                                \
+        nn_type *derivative_source,                                    \
+        const long int len)                                            \
+    {                                                                  \
+        long int i;                                                    \
+        nn_type x;                                                     \
+        for (i=0; i<len; i++) {                                        \
+            x = derivative_source[i];                                  \
+            delta[i] *= derivative(x);                                 \
+        }                                                              \
+    }
+
+// Every activation kernel of one kernel set. The derivatives of the ReLU
+// functions read the same from z and from the activation, since both
+// have the sign of z.
+#define JCKY_ACTIVATION_KERNELS(attribute, suffix)                                           \
+    JCKY_ACTIVATE_KERNEL(attribute, relu, suffix, JCKY_RELU)                                \
+    JCKY_ACTIVATE_KERNEL(attribute, leaky_relu, suffix, JCKY_LEAKY_RELU)                    \
+    JCKY_ACTIVATE_KERNEL(attribute, tanh, suffix, JCKY_TANH)                                \
+    JCKY_DERIVE_KERNEL(attribute, sigmoid_activation, suffix, JCKY_SIGMOID_PRIME_FROM_ACTIVATION) \
+    JCKY_DERIVE_KERNEL(attribute, sigmoid_z, suffix, JCKY_SIGMOID_PRIME)                    \
+    JCKY_DERIVE_KERNEL(attribute, relu, suffix, JCKY_RELU_PRIME)                            \
+    JCKY_DERIVE_KERNEL(attribute, leaky_relu, suffix, JCKY_LEAKY_RELU_PRIME)                \
+    JCKY_DERIVE_KERNEL(attribute, tanh_activation, suffix, JCKY_TANH_PRIME_FROM_ACTIVATION) \
+    JCKY_DERIVE_KERNEL(attribute, tanh_z, suffix, JCKY_TANH_PRIME)
+
+#define JCKY_ACTIVATION_KERNEL_DECLARATIONS(suffix)                                          \
+    void activate_relu_##suffix(nn_type *activation, nn_type *z_matrix, int rows, int cols); \
+    void activate_leaky_relu_##suffix(nn_type *activation, nn_type *z_matrix, int rows, int cols); \
+    void activate_tanh_##suffix(nn_type *activation, nn_type *z_matrix, int rows, int cols); \
+    void derive_sigmoid_activation_##suffix(nn_type *delta, nn_type *derivative_source, const long int len); \
+    void derive_sigmoid_z_##suffix(nn_type *delta, nn_type *derivative_source, const long int len); \
+    void derive_relu_##suffix(nn_type *delta, nn_type *derivative_source, const long int len); \
+    void derive_leaky_relu_##suffix(nn_type *delta, nn_type *derivative_source, const long int len); \
+    void derive_tanh_activation_##suffix(nn_type *delta, nn_type *derivative_source, const long int len); \
+    void derive_tanh_z_##suffix(nn_type *delta, nn_type *derivative_source, const long int len);
+
+// The entries of a kernel table, indexed by the activations enum, and for
+// the derivatives by the derivative_sources enum too. The sigmoid's entry
+// of .activate is its exact tier, though sigmoid layers go through
+// .sigmoidify, which has every tier.
+#define JCKY_ACTIVATE_TABLE(suffix)                                     \
+    {sigmoidify_scalar, activate_relu_##suffix,                         \
+     activate_leaky_relu_##suffix, activate_tanh_##suffix}
+
+#define JCKY_DERIVE_TABLE(suffix)                                                   \
+    {{derive_sigmoid_activation_##suffix, derive_sigmoid_z_##suffix},              \
+     {derive_relu_##suffix, derive_relu_##suffix},                                 \
+     {derive_leaky_relu_##suffix, derive_leaky_relu_##suffix},                     \
+     {derive_tanh_activation_##suffix, derive_tanh_z_##suffix}}
+
+
+#endif
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define JCKY_ARENA_MAPPING 1
+#else
+#define JCKY_ARENA_MAPPING 0
+#endif
+
+#include "arena.h"
+#include "constants.h"
+#include "threads.h"
+
+
+// The number of pages arena_placement asks about at a time
+#define JCKY_PAGE_NODE_QUERY 512
+
+unsigned char jcky_pages = JCKY_PAGES_DEFAULT_ID;
+unsigned char jcky_numa = JCKY_NUMA_DEFAULT_ID;
+
+
+unsigned char jcky_select_memory(const unsigned char pages, const unsigned char numa, const unsigned char master) {
+    if (!JCKY_ARENA_MAPPING && (pages != JCKY_PAGES_DEFAULT_ID || numa != JCKY_NUMA_DEFAULT_ID)) {
+        if (master) printf(KRED "Error: The page and NUMA policies are only supported on Linux.\n" KNRM);
+        return 1;
+    }
+
+    jcky_pages = pages;
+    jcky_numa = numa;
+    return 0;
+}
+
+
+#if JCKY_ARENA_MAPPING
+// Maps the block of the arena, or leaves it NULL when the OS refuses.
+// Transparent huge pages only back the huge page aligned parts of a
+// mapping, so the block is cut out of a mapping one huge page longer.
+static void map_arena(jcky_arena *arena) {
+    char *map, *block;
+    size_t lead;
+    const size_t page = (jcky_pages == JCKY_PAGES_DEFAULT_ID) ? JCKY_PAGE_SIZE : JCKY_HUGE_PAGE_SIZE;
+    const size_t len = (arena->size + page - 1) & ~(page - 1);
+
+#ifdef MAP_HUGETLB
+    if (jcky_pages == JCKY_PAGES_EXPLICIT_ID) {
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (map != MAP_FAILED) {
+            arena->block = map;
+            arena->map_size = len;
+            arena->explicit_huge = 1;
+            return;
+        }
+    }
+#endif
+
+    if (jcky_pages == JCKY_PAGES_DEFAULT_ID) {
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) return;
+        block = map;
+    }
+    else {
+        map = mmap(NULL, len + JCKY_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) return;
+        block = (char *)(((unsigned long int)map + JCKY_HUGE_PAGE_SIZE - 1) & ~((unsigned long int)JCKY_HUGE_PAGE_SIZE - 1));
+        lead = block - map;
+        if (lead > 0) munmap(map, lead);
+        munmap(block + len, JCKY_HUGE_PAGE_SIZE - lead);
+#ifdef MADV_HUGEPAGE
+        madvise(block, len, MADV_HUGEPAGE);
+#endif
+    }
+
+    arena->block = block;
+    arena->map_size = len;
+}
+
+
+// Asks for the pages of the block to be spread over every node the rank
+// may use. When the kernel has no NUMA support the pages stay where the
+// first touch puts them.
+static void interleave_pages(jcky_arena *arena) {
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy)
+    unsigned long int nodes = 0;
+    const unsigned long int max_node = (8 * sizeof(nodes)) + 1;
+
+    if (syscall(SYS_get_mempolicy, NULL, &nodes, max_node, NULL, MPOL_F_MEMS_ALLOWED) != 0) return;
+    syscall(SYS_mbind, arena->block, arena->map_size, MPOL_INTERLEAVE, &nodes, max_node, 0);
+#endif
+}
+
+
+// Writes to every page, which is what places it. With the local policy
+// each page is written by the kernel thread whose share of an elementwise
+// kernel over the arena would cover it; otherwise by the calling thread.
+static void first_touch(jcky_arena *arena) {
+    const long int pages = arena->map_size / JCKY_PAGE_SIZE;
+    char *block = arena->block;
+
+    #pragma omp parallel num_threads((jcky_numa == JCKY_NUMA_LOCAL_ID) ? jcky_kernel_threads : 1)
+    {
+        long int first, last, p;
+        jcky_thread_range(pages, 1, &first, &last);
+        for (p=first; p<last; p++) block[p * JCKY_PAGE_SIZE] = 0;
+    }
+}
+#endif
+
+
+jcky_arena create_arena(const size_t size) {
+    jcky_arena arena;
+    void *block = NULL;
+
+    arena.size = jcky_arena_slice_size(size);
+    arena.used = 0;
+    arena.map_size = 0;
+    arena.explicit_huge = 0;
+    arena.block = NULL;
+    if (arena.size == 0) return arena;
+
+#if JCKY_ARENA_MAPPING
+    if ((jcky_pages != JCKY_PAGES_DEFAULT_ID || jcky_numa != JCKY_NUMA_DEFAULT_ID) && arena.size >= JCKY_ARENA_MAP_MIN) {
+        map_arena(&arena);
+        if (arena.block != NULL) {
+            if (jcky_numa == JCKY_NUMA_INTERLEAVE_ID) interleave_pages(&arena);
+            first_touch(&arena);
+            return arena;
+        }
+    }
+#endif
+
+    if (posix_memalign(&block, JCKY_ARENA_ALIGN, arena.size) != 0) {
+        block = NULL;
+        arena.size = 0;
+    }
+    arena.block = (char *)block;
+
+    return arena;
+}
+
+
+void destroy_arena(jcky_arena *arena) {
+#if JCKY_ARENA_MAPPING
+    if (arena->map_size > 0) munmap(arena->block, arena->map_size);
+    else free(arena->block);
+#else
+    free(arena->block);
+#endif
+    arena->block = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->map_size = 0;
+}
+
+
+void * arena_alloc(jcky_arena *arena, const size_t bytes) {
+    char *slice;
+    const size_t slice_size = jcky_arena_slice_size(bytes);
+
+    if (slice_size > arena->size - arena->used) return NULL;
+
+    slice = arena->block + arena->used;
+    arena->used += slice_size;
+
+    return (void *)slice;
+}
+
+
+#if JCKY_ARENA_MAPPING
+// The bytes of the mapping backed by transparent huge pages, as the
+// kernel reports them for the mappings it overlaps. Neighbouring arenas
+// with the same flags can share a mapping, so the count is capped at the
+// arena's own length.
+static unsigned long int transparent_huge_bytes(const jcky_arena *arena) {
+    FILE *smaps;
+    char line[256];
+    unsigned long int start, end, kilobytes, huge_bytes = 0;
+    const unsigned long int first = (unsigned long int)arena->block;
+    const unsigned long int last = first + arena->map_size;
+    unsigned char overlaps = 0;
+
+    smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL) return 0;
+
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' ')) {
+            overlaps = (start < last && end > first);
+        }
+        else if (overlaps && sscanf(line, "AnonHugePages: %lu kB", &kilobytes) == 1) {
+            huge_bytes += kilobytes * 1024;
+        }
+    }
+    fclose(smaps);
+
+    return (huge_bytes < arena->map_size) ? huge_bytes : arena->map_size;
+}
+#endif
+
+
+// Counts the node of each of 'pages' pages from 'first' in 'placement',
+// asking the kernel without moving any of them. Returns nonzero when it
+// can't be asked.
+static unsigned char count_page_nodes(const unsigned long int first, const unsigned long int pages,
+                                      jcky_placement *placement)
+{
+#if JCKY_ARENA_MAPPING && defined(SYS_move_pages)
+    unsigned long int i;
+    void *address[JCKY_PAGE_NODE_QUERY];
+    int status[JCKY_PAGE_NODE_QUERY];
+
+    for (i=0; i<pages; i++) address[i] = (void *)(first + (i * JCKY_PAGE_SIZE));
+    if (syscall(SYS_move_pages, 0, pages, address, NULL, status, 0) != 0) return 1;
+
+    for (i=0; i<pages; i++) {
+        if (status[i] >= 0 && status[i] < JCKY_MAX_NUMA_NODES) placement->node_pages[status[i]]++;
+        else placement->unknown_pages++;
+    }
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+
+void arena_placement(const jcky_arena *arena, jcky_placement *placement) {
+    unsigned long int first, pages, i, chunk;
+
+    if (arena->block == NULL) return;
+
+    first = (unsigned long int)arena->block & ~((unsigned long int)JCKY_PAGE_SIZE - 1);
+    pages = ((unsigned long int)arena->block + arena->size - first + JCKY_PAGE_SIZE - 1) / JCKY_PAGE_SIZE;
+    placement->bytes += arena->size;
+    placement->pages += pages;
+
+#if JCKY_ARENA_MAPPING
+    placement->mapped_bytes += arena->map_size;
+    if (arena->explicit_huge) {
+        placement->huge_bytes += arena->map_size;
+        placement->reserved_bytes += arena->map_size;
+    }
+    else if (arena->map_size > 0) {
+        placement->huge_bytes += transparent_huge_bytes(arena);
+    }
+#endif
+
+    for (i=0; i<pages; i+=chunk) {
+        chunk = (pages - i < JCKY_PAGE_NODE_QUERY) ? pages - i : JCKY_PAGE_NODE_QUERY;
+        if (count_page_nodes(first + (i * JCKY_PAGE_SIZE), chunk, placement)) placement->unknown_pages += chunk;
+    }
+}
+
+
+void print_placement(const char *label, const jcky_placement *placement) {
+    int node;
+
+    printf("    %-24s%lu KiB (%lu KiB mapped, %lu KiB in huge pages, %lu KiB reserved)\n", label,
+           placement->bytes / 1024, placement->mapped_bytes / 1024, placement->huge_bytes / 1024,
+           placement->reserved_bytes / 1024);
+    printf("    %-24s", "");
+    for (node=0; node<JCKY_MAX_NUMA_NODES; node++) {
+        if (placement->node_pages[node] > 0) printf("%lu on node %i, ", placement->node_pages[node], node);
+    }
+    printf("%lu untouched or unknown (%i KiB pages)\n", placement->unknown_pages, JCKY_PAGE_SIZE / 1024);
+}
@@ -0,0 +1,95 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <stddef.h>
+
+
+// An arena is one block of memory that hands out slices, in order, and
+// is freed all at once. The owner sizes it up front from the shapes of
+// the buffers it will hold (adding up jcky_arena_slice_size of each),
+// so building a neural net makes one allocation per arena instead of
+// one per array, and its arrays sit next to each other in the order
+// they're used.
+//
+// Every slice starts on a cache line and is padded to a whole number of
+// cache lines, so no two slices share a line (and no two threads writing
+// to different slices fight over one), and every vector load from the
+// start of a slice is aligned.
+#define JCKY_ARENA_ALIGN 64
+
+// The page policy (see --pages and --numa) applies to arenas of at least
+// JCKY_ARENA_MAP_MIN bytes, which are then mapped straight from the OS
+// rather than taken from the heap, so that they own their pages:
+//
+//   pages transparent  - the mapping is aligned to and rounded up to
+//                        whole huge pages, and the kernel is asked to
+//                        back it with transparent huge pages.
+//   pages explicit     - the mapping comes from the reserved huge page
+//                        pool (vm.nr_hugepages). When the pool can't
+//                        hold it, it falls back to transparent huge pages.
+//   numa local         - every page is first touched by the kernel thread
+//                        whose share of the elementwise kernels covers it
+//                        (see jcky_thread_range), so it's placed on that
+//                        thread's node.
+//   numa interleave    - the pages are spread round robin across the
+//                        nodes the rank may use.
+//
+// Mapped arenas are first touched when they're created, so their pages
+// are placed (and faulted in) before training starts. Smaller arenas span
+// a handful of pages, whose placement hardly matters, and stay on the
+// heap. With the default policies every arena stays on the heap.
+#define JCKY_ARENA_MAP_MIN (64 * 1024)
+#define JCKY_PAGE_SIZE 4096
+#define JCKY_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define JCKY_MAX_NUMA_NODES 64
+
+extern unsigned char jcky_pages;
+extern unsigned char jcky_numa;
+
+typedef struct jcky_arena {
+    char *block;
+    size_t size, used;
+    // The length of the mapping, or 0 when the block is on the heap, and
+    // whether the mapping came from the reserved huge page pool.
+    size_t map_size;
+    unsigned char explicit_huge;
+} jcky_arena;
+
+// Where the pages of one or more arenas landed (see arena_placement):
+// the bytes the arenas hold, the bytes of their mappings, and how many
+// of those are huge pages, from the reserved pool or not. A page that
+// hasn't been touched yet, or whose node can't be queried (as on
+// platforms without NUMA), counts as unknown.
+typedef struct jcky_placement {
+    unsigned long int bytes, mapped_bytes, huge_bytes, reserved_bytes;
+    unsigned long int pages, unknown_pages;
+    unsigned long int node_pages[JCKY_MAX_NUMA_NODES];
+} jcky_placement;
+
+// The room a slice of 'bytes' bytes takes up in an arena
+static inline size_t jcky_arena_slice_size(const size_t bytes) {
+    return (bytes + JCKY_ARENA_ALIGN - 1) & ~((size_t)JCKY_ARENA_ALIGN - 1);
+}
+
+// Sets the page policies of the arenas created from then on. Returns
+// nonzero, after printing why on the master, when the platform doesn't
+// support them.
+unsigned char jcky_select_memory(const unsigned char pages, const unsigned char numa, const unsigned char master);
+
+// The block of a zero sized arena is NULL.
+jcky_arena create_arena(const size_t size);
+void destroy_arena(jcky_arena *arena);
+
+// Returns the next slice of 'bytes' bytes, or NULL when the arena wasn't
+// sized to hold it.
+void * arena_alloc(jcky_arena *arena, const size_t bytes);
+
+// Adds the pages of the arena to 'placement', which must start zeroed.
+void arena_placement(const jcky_arena *arena, jcky_placement *placement);
+// Prints one line of the configuration: the size of the arenas, how much
+// of it is in huge pages, and how many pages landed on each node.
+void print_placement(const char *label, const jcky_placement *placement);
+
+
+#endif
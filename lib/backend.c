@@ -0,0 +1,400 @@
+#include <stdlib.h>
+
+#include "backend.h"
+#include "constants.h"
+#include "gemm.h"
+#include "kernels.h"
+#include "matrix_helpers.h"
+
+#ifdef JCKY_CBLAS
+#include <cblas.h>
+
+#ifdef JCKY_SINGLE_PRECISION
+#define JCKY_CBLAS_GEMM cblas_sgemm
+#else
+#define JCKY_CBLAS_GEMM cblas_dgemm
+#endif
+#endif
+
+
+backend reference_backend = {
+    .id = JCKY_BACKEND_REFERENCE_ID,
+    .name = JCKY_BACKEND_REFERENCE,
+    .forward = forward_reference,
+    .delta = delta_reference,
+    .delta_transposed = delta_transposed_reference,
+    .update = update_reference,
+    .backward = backward_reference,
+    .forward_half = forward_half_reference,
+    .delta_half = delta_half_reference
+};
+
+#ifdef JCKY_CBLAS
+backend cblas_backend = {
+    .id = JCKY_BACKEND_CBLAS_ID,
+    .name = JCKY_BACKEND_CBLAS,
+    .forward = forward_cblas,
+    .delta = delta_cblas,
+    .delta_transposed = delta_transposed_cblas,
+    .update = update_cblas,
+    .backward = backward_cblas,
+    .forward_half = NULL,
+    .delta_half = NULL
+};
+#endif
+
+
+unsigned char jcky_backend_supported(const unsigned char id) {
+    if (id == JCKY_BACKEND_REFERENCE_ID) return 1;
+#ifdef JCKY_CBLAS
+    if (id == JCKY_BACKEND_CBLAS_ID) return 1;
+#endif
+    return 0;
+}
+
+
+// Rows of W per tile of the fused backward pass: as many as fit in
+// JCKY_BACKWARD_TILE_BYTES, in whole micro-kernel panels. Rows rather
+// than columns keep each tile contiguous; a column tile of a matrix
+// with a power of two row pitch maps onto a handful of cache sets.
+static int backward_tile_rows(const int weight_cols) {
+    int rows = JCKY_BACKWARD_TILE_BYTES / (weight_cols * (int)sizeof(nn_type));
+    int mr = jcky_kernels->gemm_mr;
+    rows = (rows / mr) * mr;
+    return (rows < mr) ? mr : rows;
+}
+
+
+backend * jcky_get_backend(const unsigned char id) {
+    switch (id) {
+#ifdef JCKY_CBLAS
+        case JCKY_BACKEND_CBLAS_ID:
+            return &cblas_backend;
+#endif
+        default:
+            return &reference_backend;
+    }
+}
+
+
+// The bias is added in the GEMM epilogue. The layout only changes the
+// strides the GEMM reads and writes the batch matrices with.
+void forward_reference(
+    nn_type *z_matrix,
+    nn_type *weight,
+    nn_type *activation,
+    nn_type *bias,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+
+    jcky_gemm(weight_rows, batch_size, weight_cols,
+              1.0,
+              weight, weight_cols, 1,
+              activation, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_cols),
+              0.0,
+              z_matrix, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+              bias);
+}
+
+
+// The weight matrix is read through its transpose.
+void delta_reference(
+    nn_type *delta,
+    nn_type *weight_downstream,
+    nn_type *delta_downstream,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+
+    jcky_gemm(weight_cols, batch_size, weight_rows,
+              1.0,
+              weight_downstream, 1, weight_cols,
+              delta_downstream, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+              0.0,
+              delta, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_cols),
+              NULL);
+}
+
+
+void delta_transposed_reference(
+    nn_type *delta,
+    nn_type *weight_transposed,
+    nn_type *delta_downstream,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+
+    jcky_gemm(weight_cols, batch_size, weight_rows,
+              1.0,
+              weight_transposed, weight_rows, 1,
+              delta_downstream, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+              0.0,
+              delta, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_cols),
+              NULL);
+}
+
+
+// A rank 'batch size' update, accumulated straight into the weights.
+void update_reference(
+    nn_type *activation,
+    nn_type *weight,
+    nn_type *delta,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout)
+{
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+
+    jcky_gemm(weight_rows, weight_cols, batch_size,
+              -(eta / batch_size),
+              delta, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+              activation, JCKY_SAMPLE_STRIDE(layout, weight_cols), node_stride,
+              1.0,
+              weight, weight_cols, 1,
+              NULL);
+}
+
+
+
+void backward_reference(
+    nn_type *delta_upstream,
+    nn_type *weight,
+    nn_type *delta,
+    nn_type *activation,
+    nn_type *bias,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout)
+{
+    int i, rows;
+    const int tile_rows = backward_tile_rows(weight_cols);
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+    nn_type *weight_tile, *delta_tile;
+
+    adjust_bias(bias, delta, weight_rows, batch_size, eta, layout);
+
+    for (i=0; i<weight_rows; i+=tile_rows) {
+        rows = (weight_rows - i < tile_rows) ? weight_rows - i : tile_rows;
+        weight_tile = weight + (i * weight_cols);
+        delta_tile = delta + (i * node_stride);
+
+        if (delta_upstream != NULL) {
+            jcky_gemm(weight_cols, batch_size, rows,
+                      1.0,
+                      weight_tile, 1, weight_cols,
+                      delta_tile, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+                      (i == 0) ? 0.0 : 1.0,
+                      delta_upstream, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_cols),
+                      NULL);
+        }
+        jcky_gemm(rows, weight_cols, batch_size,
+                  -(eta / batch_size),
+                  delta_tile, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+                  activation, JCKY_SAMPLE_STRIDE(layout, weight_cols), node_stride,
+                  1.0,
+                  weight_tile, weight_cols, 1,
+                  NULL);
+    }
+}
+
+
+void forward_half_reference(
+    nn_type *z_matrix,
+    jcky_half *weight,
+    unsigned char storage,
+    nn_type *activation,
+    nn_type *bias,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+
+    jcky_gemm_half(weight_rows, batch_size, weight_cols,
+                   1.0,
+                   weight, weight_cols, 1, storage,
+                   activation, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_cols),
+                   0.0,
+                   z_matrix, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+                   bias);
+}
+
+
+void delta_half_reference(
+    nn_type *delta,
+    jcky_half *weight_downstream,
+    unsigned char storage,
+    nn_type *delta_downstream,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+
+    jcky_gemm_half(weight_cols, batch_size, weight_rows,
+                   1.0,
+                   weight_downstream, 1, weight_cols, storage,
+                   delta_downstream, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_rows),
+                   0.0,
+                   delta, node_stride, JCKY_SAMPLE_STRIDE(layout, weight_cols),
+                   NULL);
+}
+
+
+#ifdef JCKY_CBLAS
+// In the batch-major layout the batch matrices are column-major, so the
+// products that write one go through the column-major interface and
+// read the row-major weights through their transpose. The weight
+// updates write the row-major weights, so they stay row-major and read
+// the batch matrices through their transpose instead.
+#define JCKY_CBLAS_ORDER(batch_major) ((batch_major) ? CblasColMajor : CblasRowMajor)
+#define JCKY_CBLAS_FLIP(batch_major, trans) \
+    ((batch_major) ? (((trans) == CblasTrans) ? CblasNoTrans : CblasTrans) : (trans))
+
+
+// BLAS has no bias epilogue, so the bias is broadcast into z first and
+// the product is accumulated on top of it.
+void forward_cblas(
+    nn_type *z_matrix,
+    nn_type *weight,
+    nn_type *activation,
+    nn_type *bias,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    int i, j;
+    const unsigned char batch_major = (layout == JCKY_BATCH_MAJOR_LAYOUT_ID);
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+    const int sample_stride = JCKY_SAMPLE_STRIDE(layout, weight_rows);
+
+    for (i=0; i<weight_rows; i++) {
+        for (j=0; j<batch_size; j++) {
+            z_matrix[(i * node_stride) + (j * sample_stride)] = bias[i];
+        }
+    }
+
+    JCKY_CBLAS_GEMM(JCKY_CBLAS_ORDER(batch_major), JCKY_CBLAS_FLIP(batch_major, CblasNoTrans), CblasNoTrans,
+                    weight_rows, batch_size, weight_cols,
+                    1.0, weight, weight_cols,
+                    activation, batch_major ? weight_cols : batch_size,
+                    1.0, z_matrix, batch_major ? weight_rows : batch_size);
+}
+
+
+void delta_cblas(
+    nn_type *delta,
+    nn_type *weight_downstream,
+    nn_type *delta_downstream,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    const unsigned char batch_major = (layout == JCKY_BATCH_MAJOR_LAYOUT_ID);
+
+    JCKY_CBLAS_GEMM(JCKY_CBLAS_ORDER(batch_major), JCKY_CBLAS_FLIP(batch_major, CblasTrans), CblasNoTrans,
+                    weight_cols, batch_size, weight_rows,
+                    1.0, weight_downstream, weight_cols,
+                    delta_downstream, batch_major ? weight_rows : batch_size,
+                    0.0, delta, batch_major ? weight_cols : batch_size);
+}
+
+
+void delta_transposed_cblas(
+    nn_type *delta,
+    nn_type *weight_transposed,
+    nn_type *delta_downstream,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    unsigned char layout)
+{
+    const unsigned char batch_major = (layout == JCKY_BATCH_MAJOR_LAYOUT_ID);
+
+    JCKY_CBLAS_GEMM(JCKY_CBLAS_ORDER(batch_major), JCKY_CBLAS_FLIP(batch_major, CblasNoTrans), CblasNoTrans,
+                    weight_cols, batch_size, weight_rows,
+                    1.0, weight_transposed, weight_rows,
+                    delta_downstream, batch_major ? weight_rows : batch_size,
+                    0.0, delta, batch_major ? weight_cols : batch_size);
+}
+
+
+void update_cblas(
+    nn_type *activation,
+    nn_type *weight,
+    nn_type *delta,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout)
+{
+    const unsigned char batch_major = (layout == JCKY_BATCH_MAJOR_LAYOUT_ID);
+
+    JCKY_CBLAS_GEMM(CblasRowMajor,
+                    JCKY_CBLAS_FLIP(batch_major, CblasNoTrans), JCKY_CBLAS_FLIP(batch_major, CblasTrans),
+                    weight_rows, weight_cols, batch_size,
+                    -(eta / batch_size), delta, batch_major ? weight_rows : batch_size,
+                    activation, batch_major ? weight_cols : batch_size,
+                    1.0, weight, weight_cols);
+}
+
+
+void backward_cblas(
+    nn_type *delta_upstream,
+    nn_type *weight,
+    nn_type *delta,
+    nn_type *activation,
+    nn_type *bias,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout)
+{
+    int i, rows;
+    const int tile_rows = backward_tile_rows(weight_cols);
+    const unsigned char batch_major = (layout == JCKY_BATCH_MAJOR_LAYOUT_ID);
+    nn_type *weight_tile, *delta_tile;
+
+    adjust_bias(bias, delta, weight_rows, batch_size, eta, layout);
+
+    for (i=0; i<weight_rows; i+=tile_rows) {
+        rows = (weight_rows - i < tile_rows) ? weight_rows - i : tile_rows;
+        weight_tile = weight + (i * weight_cols);
+        delta_tile = delta + (i * JCKY_NODE_STRIDE(layout, batch_size));
+
+        if (delta_upstream != NULL) {
+            JCKY_CBLAS_GEMM(JCKY_CBLAS_ORDER(batch_major), JCKY_CBLAS_FLIP(batch_major, CblasTrans), CblasNoTrans,
+                            weight_cols, batch_size, rows,
+                            1.0, weight_tile, weight_cols,
+                            delta_tile, batch_major ? weight_rows : batch_size,
+                            (i == 0) ? 0.0 : 1.0, delta_upstream, batch_major ? weight_cols : batch_size);
+        }
+        JCKY_CBLAS_GEMM(CblasRowMajor,
+                        JCKY_CBLAS_FLIP(batch_major, CblasNoTrans), JCKY_CBLAS_FLIP(batch_major, CblasTrans),
+                        rows, weight_cols, batch_size,
+                        -(eta / batch_size), delta_tile, batch_major ? weight_rows : batch_size,
+                        activation, batch_major ? weight_cols : batch_size,
+                        1.0, weight_tile, weight_cols);
+    }
+}
+#endif
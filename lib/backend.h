@@ -0,0 +1,110 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+
+#include "constants.h"
+#include "half.h"
+
+
+// A backend provides the three matrix products of a training step.
+// Dimensions follow the weight matrix W of the layer: it has
+// 'weight_rows' rows (nodes in the layer) and 'weight_cols' columns
+// (nodes in the upstream layer). Activations, z-matrices and deltas
+// have one column per entry in the batch, stored in the given
+// batch layout (see JCKY_NODE_STRIDE in constants.h).
+//
+// The reference backend is always built. Vendor backends are only
+// built when their library is available (see the Makefile), so ask
+// jcky_backend_supported before using one.
+
+// Target size of the tile of W swept by the fused backward pass. It
+// should fit in L2 alongside the packing buffers of the GEMM.
+#define JCKY_BACKWARD_TILE_BYTES (1024 * 1024)
+
+typedef struct backend {
+    unsigned char id;
+    char *name;
+
+    // z = W * activation + bias
+    void (*forward)(nn_type *z_matrix, nn_type *weight, nn_type *activation, nn_type *bias,
+                    int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+
+    // delta = transpose(W) * delta_downstream, where W is the
+    // downstream layer's weight matrix.
+    void (*delta)(nn_type *delta, nn_type *weight_downstream, nn_type *delta_downstream,
+                  int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+
+    // The same product from a transposed copy of W, which is
+    // 'weight_cols' x 'weight_rows' (see --transposed-shadow).
+    void (*delta_transposed)(nn_type *delta, nn_type *weight_transposed, nn_type *delta_downstream,
+                             int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+
+    // W = W - (eta / batch_size) * delta * transpose(activation)
+    void (*update)(nn_type *activation, nn_type *weight, nn_type *delta,
+                   int weight_rows, int weight_cols, int batch_size, nn_type eta,
+                   unsigned char layout);
+
+    // The delta and update products of one layer fused into one sweep
+    // over W, a tile of rows at a time (see JCKY_BACKWARD_TILE_BYTES):
+    //    delta_upstream = transpose(W) * delta
+    //    bias = bias - (eta / batch_size) * (sum of delta over the batch)
+    //    W = W - (eta / batch_size) * delta * transpose(activation)
+    // Each tile adds its share to delta_upstream and is then updated
+    // while it's still in cache. The delta reads W before it's updated,
+    // as in the split products. 'delta_upstream' may be NULL for the
+    // first layer.
+    void (*backward)(nn_type *delta_upstream, nn_type *weight, nn_type *delta, nn_type *activation,
+                     nn_type *bias, int weight_rows, int weight_cols, int batch_size, nn_type eta,
+                     unsigned char layout);
+
+    // forward and delta with the weights read from a 16 bit copy in the
+    // given storage format (see half.h), accumulating in nn_type.
+    // Backends that can't read 16 bit weights leave these NULL.
+    void (*forward_half)(nn_type *z_matrix, jcky_half *weight, unsigned char storage, nn_type *activation,
+                         nn_type *bias, int weight_rows, int weight_cols, int batch_size,
+                         unsigned char layout);
+    void (*delta_half)(nn_type *delta, jcky_half *weight_downstream, unsigned char storage,
+                       nn_type *delta_downstream, int weight_rows, int weight_cols, int batch_size,
+                       unsigned char layout);
+} backend;
+
+unsigned char jcky_backend_supported(const unsigned char id);
+backend * jcky_get_backend(const unsigned char id);
+
+// Reference backend, built on the GEMM engine in gemm.c
+void forward_reference(nn_type *z_matrix, nn_type *weight, nn_type *activation, nn_type *bias,
+                       int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+void delta_reference(nn_type *delta, nn_type *weight_downstream, nn_type *delta_downstream,
+                     int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+void delta_transposed_reference(nn_type *delta, nn_type *weight_transposed, nn_type *delta_downstream,
+                                int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+void update_reference(nn_type *activation, nn_type *weight, nn_type *delta,
+                      int weight_rows, int weight_cols, int batch_size, nn_type eta,
+                      unsigned char layout);
+void backward_reference(nn_type *delta_upstream, nn_type *weight, nn_type *delta, nn_type *activation,
+                        nn_type *bias, int weight_rows, int weight_cols, int batch_size, nn_type eta,
+                        unsigned char layout);
+void forward_half_reference(nn_type *z_matrix, jcky_half *weight, unsigned char storage, nn_type *activation,
+                            nn_type *bias, int weight_rows, int weight_cols, int batch_size,
+                            unsigned char layout);
+void delta_half_reference(nn_type *delta, jcky_half *weight_downstream, unsigned char storage,
+                          nn_type *delta_downstream, int weight_rows, int weight_cols, int batch_size,
+                          unsigned char layout);
+
+#ifdef JCKY_CBLAS
+void forward_cblas(nn_type *z_matrix, nn_type *weight, nn_type *activation, nn_type *bias,
+                   int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+void delta_cblas(nn_type *delta, nn_type *weight_downstream, nn_type *delta_downstream,
+                 int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+void delta_transposed_cblas(nn_type *delta, nn_type *weight_transposed, nn_type *delta_downstream,
+                            int weight_rows, int weight_cols, int batch_size, unsigned char layout);
+void update_cblas(nn_type *activation, nn_type *weight, nn_type *delta,
+                  int weight_rows, int weight_cols, int batch_size, nn_type eta,
+                  unsigned char layout);
+void backward_cblas(nn_type *delta_upstream, nn_type *weight, nn_type *delta, nn_type *activation,
+                    nn_type *bias, int weight_rows, int weight_cols, int batch_size, nn_type eta,
+                    unsigned char layout);
+#endif
+
+
+#endif
@@ -1,30 +1,106 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
+#include "batch.h"
+#include "constants.h"
 #include "file_helpers.h"
+#include "sparse.h"
 
 
-void create_batch_with_sequence_file(
+size_t batch_builder_size(const unsigned int data_len, const unsigned char layout) {
+    if (layout == JCKY_BATCH_MAJOR_LAYOUT_ID) return 0;
+    return jcky_arena_slice_size( (size_t)JCKY_BATCH_TILE * data_len * sizeof( nn_type ) );
+}
+
+
+jcky_batch_builder create_batch_builder(jcky_arena *arena, const unsigned int data_len, const unsigned char layout) {
+    jcky_batch_builder builder;
+
+    builder.layout = layout;
+    builder.data_len = data_len;
+    builder.tile = (layout == JCKY_BATCH_MAJOR_LAYOUT_ID) ? NULL :
+        (nn_type *)arena_alloc(arena, (size_t)JCKY_BATCH_TILE * data_len * sizeof( nn_type ));
+
+    return builder;
+}
+
+
+// Copies the 'records' records in the tile into columns 'first' onwards
+// of a feature-major batch.
+static void copy_tile(
+    jcky_batch_builder *builder,
+    nn_type *batch,
+    const unsigned int batch_size,
+    const unsigned int first,
+    const unsigned int records)
+{
+    unsigned int block, block_end, j, r;
+    nn_type *column;
+    const unsigned int data_len = builder->data_len;
+    const nn_type *tile = builder->tile;
+
+    for (block=0; block<data_len; block+=JCKY_BATCH_TILE_INPUTS) {
+        block_end = (data_len - block < JCKY_BATCH_TILE_INPUTS) ? data_len : block + JCKY_BATCH_TILE_INPUTS;
+        for (j=block; j<block_end; j++) {
+            column = batch + ((unsigned long int)j * batch_size) + first;
+            for (r=0; r<records; r++) {
+                column[r] = tile[((unsigned long int)r * data_len) + j];
+            }
+        }
+    }
+}
+
+
+// Reads the 'batch_size' records numbered in 'records', or from 'first'
+// on when it's NULL, into place, or through the tile, and adds them to
+// the sparse batch, if there is one.
+static void build_batch(
+    jcky_batch_builder *builder,
     nn_type *batch,
     nn_type *targets,
     jcky_file *file,
     const unsigned int batch_size,
-    const unsigned int iteration,
-    unsigned int *sequence)
+    const unsigned int *records,
+    const unsigned int first,
+    jcky_sparse_batch *sparse)
 {
-    nn_type *batch_tmp = malloc( file->data_len * sizeof(nn_type) );
-    const unsigned int offset = iteration * batch_size;
-    unsigned short int i;
-    unsigned int j;
-	for (i=0; i<batch_size; i++) {
-        jcky_read_record(file, sequence[offset + i], batch_tmp, targets + (i * file->targets_len));
-
-        for (j=0; j<file->data_len; j++) {
-            batch[(j*batch_size) + i] = batch_tmp[j];
+    unsigned int i, r, tile_records;
+    nn_type *record;
+
+    if (sparse != NULL) sparse_batch_clear(sparse);
+
+    for (i=0; i<batch_size; i+=tile_records) {
+        tile_records = (builder->layout == JCKY_BATCH_MAJOR_LAYOUT_ID) ? batch_size :
+                       (batch_size - i < JCKY_BATCH_TILE) ? batch_size - i : JCKY_BATCH_TILE;
+
+        for (r=0; r<tile_records; r++) {
+            record = (builder->layout == JCKY_BATCH_MAJOR_LAYOUT_ID) ?
+                     batch + ((unsigned long int)(i + r) * file->data_len) :
+                     builder->tile + ((unsigned long int)r * file->data_len);
+            jcky_read_record(file, (records != NULL) ? records[i + r] : first + i + r, record,
+                             targets + ((unsigned long int)(i + r) * file->targets_len));
+            if (sparse != NULL) sparse_batch_add_sample(sparse, record);
         }
+
+        if (builder->layout != JCKY_BATCH_MAJOR_LAYOUT_ID) copy_tile(builder, batch, batch_size, i, tile_records);
     }
 
-    free(batch_tmp);
+    if (sparse != NULL) sparse_batch_finish(sparse);
+}
+
+
+void create_batch_with_sequence_file(
+    nn_type *batch,
+    nn_type *targets,
+    jcky_file *file,
+    const unsigned int batch_size,
+    const unsigned int iteration,
+    unsigned int *sequence,
+    jcky_batch_builder *builder,
+    jcky_sparse_batch *sparse)
+{
+    build_batch(builder, batch, targets, file, batch_size, sequence + (iteration * batch_size), 0, sparse);
 }
 
 
@@ -35,19 +111,11 @@ void create_batch_no_sequence_file(
     const unsigned int batch_size,
     const unsigned int iteration,
     unsigned short int rank,
-    unsigned int process_offset)
+    unsigned int process_offset,
+    jcky_batch_builder *builder,
+    jcky_sparse_batch *sparse)
 {
-    nn_type *batch_tmp = malloc( file->data_len * sizeof(nn_type) );
     const unsigned int offset = (iteration * batch_size) + (rank * process_offset);
-    unsigned short int i;
-    unsigned int j;
-	for (i=0; i<batch_size; i++) {
-        jcky_read_record(file, offset + i, batch_tmp, targets + (i * file->targets_len));
-
-        for (j=0; j<file->data_len; j++) {
-            batch[(j*batch_size) + i] = batch_tmp[j];
-        }
-    }
 
-    free(batch_tmp);
+    build_batch(builder, batch, targets, file, batch_size, NULL, offset, sparse);
 }
@@ -2,16 +2,51 @@
 #define BATCH_H
 
 
+#include <stddef.h>
+
+#include "arena.h"
 #include "file_helpers.h"
+#include "sparse.h"
+
+
+// A feature-major batch gives each record a column, so a record can't be
+// read straight into place. The builder reads JCKY_BATCH_TILE records at
+// a time into its tile, one after another as they're stored, then copies
+// the tile into the columns of the batch JCKY_BATCH_TILE_INPUTS inputs at
+// a time: every block it reads from the tile fits in the L1 cache, and
+// every row of the batch it writes to gets JCKY_BATCH_TILE values in a
+// row. A batch-major batch is read straight into place and has no tile.
+//
+// The tile is sliced from an arena when the builder is created, so
+// building a batch never allocates.
+#define JCKY_BATCH_TILE 16
+#define JCKY_BATCH_TILE_INPUTS 64
+
+typedef struct jcky_batch_builder {
+    unsigned char layout;
+    unsigned int data_len;
+    nn_type *tile;
+} jcky_batch_builder;
+
+// The room the builder of records of 'data_len' values takes up in an arena
+size_t batch_builder_size(const unsigned int data_len, const unsigned char layout);
+jcky_batch_builder create_batch_builder(jcky_arena *arena, const unsigned int data_len, const unsigned char layout);
 
 
+// Fills 'batch' with 'batch_size' records and 'targets' with their
+// targets, one record after another. The builder's layout says how the
+// batch is laid out (see batch_layouts): feature-major gives each record
+// a column, batch-major a row, which is the record as read. When 'sparse'
+// isn't NULL it's filled with the nonzero values of the batch as well.
 void create_batch_with_sequence_file(
     nn_type *batch,
     nn_type *targets,
     jcky_file *file,
     const unsigned int batch_size,
     const unsigned int iteration,
-    unsigned int *sequence
+    unsigned int *sequence,
+    jcky_batch_builder *builder,
+    jcky_sparse_batch *sparse
 );
 
 
@@ -22,7 +57,9 @@ void create_batch_no_sequence_file(
     const unsigned int batch_size,
     const unsigned int iteration,
     unsigned short int rank,
-    unsigned int process_offset
+    unsigned int process_offset,
+    jcky_batch_builder *builder,
+    jcky_sparse_batch *sparse
 );
 
 
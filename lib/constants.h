@@ -2,7 +2,19 @@
 #define CONSTANTS_H
 
 
+// Build with 'make FLOAT=1' to train in single precision. Everything
+// that stores, sends or computes with nn_type follows this typedef:
+// JCKY_NN_TYPE tags the files jockey writes, and JCKY_MPI_NN_TYPE is
+// the MPI datatype used to ship the neural network.
+#ifdef JCKY_SINGLE_PRECISION
+typedef float nn_type;
+#define JCKY_NN_TYPE JCKY_FLOAT
+#define JCKY_MPI_NN_TYPE MPI_FLOAT
+#else
 typedef double nn_type;
+#define JCKY_NN_TYPE JCKY_DOUBLE
+#define JCKY_MPI_NN_TYPE MPI_DOUBLE
+#endif
 
 #define JCKY_VERSION "0.0.0"
 
@@ -20,6 +32,105 @@ typedef double nn_type;
 #define JCKY_LOGICAL_LAYOUT "logical"
 enum memory_layouts{JCKY_CONTIGUOUS_LAYOUT_ID, JCKY_LOGICAL_LAYOUT_ID};
 
+#define JCKY_KERNELS_AUTO "auto"
+#define JCKY_KERNELS_SCALAR "scalar"
+#define JCKY_KERNELS_AVX2 "avx2"
+#define JCKY_KERNELS_AVX512 "avx512"
+enum kernel_sets{JCKY_KERNELS_AUTO_ID, JCKY_KERNELS_SCALAR_ID, JCKY_KERNELS_AVX2_ID, JCKY_KERNELS_AVX512_ID};
+
+// --threads auto, which is resolved once the ranks on each node are known
+#define JCKY_THREADS_AUTO "auto"
+#define JCKY_THREADS_AUTO_ID 0
+
+#define JCKY_THREAD_MODE_KERNELS "kernels"
+#define JCKY_THREAD_MODE_DATA "data"
+#define JCKY_THREAD_MODE_HOGWILD "hogwild"
+enum thread_modes{JCKY_THREAD_MODE_KERNELS_ID, JCKY_THREAD_MODE_DATA_ID, JCKY_THREAD_MODE_HOGWILD_ID};
+
+#define JCKY_PAGES_DEFAULT "default"
+#define JCKY_PAGES_TRANSPARENT "transparent"
+#define JCKY_PAGES_EXPLICIT "explicit"
+enum page_policies{JCKY_PAGES_DEFAULT_ID, JCKY_PAGES_TRANSPARENT_ID, JCKY_PAGES_EXPLICIT_ID};
+
+#define JCKY_NUMA_DEFAULT "default"
+#define JCKY_NUMA_LOCAL "local"
+#define JCKY_NUMA_INTERLEAVE "interleave"
+enum numa_policies{JCKY_NUMA_DEFAULT_ID, JCKY_NUMA_LOCAL_ID, JCKY_NUMA_INTERLEAVE_ID};
+
+#define JCKY_READER_STDIO "stdio"
+#define JCKY_READER_MMAP "mmap"
+enum readers{JCKY_READER_STDIO_ID, JCKY_READER_MMAP_ID};
+
+#define JCKY_DERIVATIVE_ACTIVATION "activation"
+#define JCKY_DERIVATIVE_Z "z"
+enum derivative_sources{JCKY_DERIVATIVE_ACTIVATION_ID, JCKY_DERIVATIVE_Z_ID, JCKY_DERIVATIVE_SOURCES};
+
+#define JCKY_BACKEND_REFERENCE "reference"
+#define JCKY_BACKEND_CBLAS "cblas"
+enum backends{JCKY_BACKEND_REFERENCE_ID, JCKY_BACKEND_CBLAS_ID};
+
+#define JCKY_SIGMOID_EXACT "exact"
+#define JCKY_SIGMOID_POLY "poly"
+#define JCKY_SIGMOID_TABLE "table"
+enum sigmoid_tiers{JCKY_SIGMOID_EXACT_ID, JCKY_SIGMOID_POLY_ID, JCKY_SIGMOID_TABLE_ID, JCKY_SIGMOID_TIERS};
+
+#define JCKY_OUTPUT_SIGMOID "sigmoid"
+#define JCKY_OUTPUT_SOFTMAX "softmax"
+enum outputs{JCKY_OUTPUT_SIGMOID_ID, JCKY_OUTPUT_SOFTMAX_ID};
+
+#define JCKY_ACTIVATION_SIGMOID "sigmoid"
+#define JCKY_ACTIVATION_RELU "relu"
+#define JCKY_ACTIVATION_LEAKY_RELU "leaky-relu"
+#define JCKY_ACTIVATION_TANH "tanh"
+enum activations{JCKY_ACTIVATION_SIGMOID_ID, JCKY_ACTIVATION_RELU_ID, JCKY_ACTIVATION_LEAKY_RELU_ID, JCKY_ACTIVATION_TANH_ID,
+                 JCKY_ACTIVATIONS};
+
+#define JCKY_STORAGE_NATIVE "native"
+#define JCKY_STORAGE_BF16 "bf16"
+#define JCKY_STORAGE_FP16 "fp16"
+enum storages{JCKY_STORAGE_NATIVE_ID, JCKY_STORAGE_BF16_ID, JCKY_STORAGE_FP16_ID};
+
+#define JCKY_INPUT_DENSE "dense"
+#define JCKY_INPUT_SPARSE "sparse"
+enum input_formats{JCKY_INPUT_DENSE_ID, JCKY_INPUT_SPARSE_ID};
+
+#define JCKY_INFERENCE_NATIVE "native"
+#define JCKY_INFERENCE_INT8 "int8"
+enum inference_engines{JCKY_INFERENCE_NATIVE_ID, JCKY_INFERENCE_INT8_ID};
+
+// How a matrix with one row per node and one column per entry in the
+// batch (a batch of inputs, activations, z-values and deltas) is stored.
+// Feature-major keeps each node's values for the whole batch together,
+// batch-major keeps each sample's values together. The strides give the
+// distance between consecutive nodes of one sample, and between
+// consecutive samples of one node.
+#define JCKY_FEATURE_MAJOR_LAYOUT "feature-major"
+#define JCKY_BATCH_MAJOR_LAYOUT "batch-major"
+enum batch_layouts{JCKY_FEATURE_MAJOR_LAYOUT_ID, JCKY_BATCH_MAJOR_LAYOUT_ID};
+#define JCKY_NODE_STRIDE(layout, batch_size) (((layout) == JCKY_BATCH_MAJOR_LAYOUT_ID) ? 1 : (batch_size))
+#define JCKY_SAMPLE_STRIDE(layout, nodes) (((layout) == JCKY_BATCH_MAJOR_LAYOUT_ID) ? (nodes) : 1)
+
+#define JCKY_BACKWARD_SPLIT "split"
+#define JCKY_BACKWARD_FUSED "fused"
+enum backward_passes{JCKY_BACKWARD_SPLIT_ID, JCKY_BACKWARD_FUSED_ID};
+
+#define JCKY_OPTIMIZER_SGD "sgd"
+#define JCKY_OPTIMIZER_MOMENTUM "momentum"
+#define JCKY_OPTIMIZER_ADAM "adam"
+enum optimizers{JCKY_OPTIMIZER_SGD_ID, JCKY_OPTIMIZER_MOMENTUM_ID, JCKY_OPTIMIZER_ADAM_ID};
+
+// The nets an optimizer keeps next to nns[] (see meta_neural_net): the
+// step of the batch, then its state, which is the velocity for momentum
+// and the first and second moments for Adam.
+#define JCKY_OPTIMIZER_STEP 0
+#define JCKY_OPTIMIZER_VELOCITY 1
+#define JCKY_OPTIMIZER_MOMENT 1
+#define JCKY_OPTIMIZER_SECOND_MOMENT 2
+
+#define JCKY_ADAM_BETA1 0.9
+#define JCKY_ADAM_BETA2 0.999
+#define JCKY_ADAM_EPSILON 1e-8
+
 #define JCKY_DEFAULT_FILE_NAME "data.jockey"
 enum type_identifiers{JCKY_FLOAT, JCKY_DOUBLE};
 
@@ -28,9 +139,12 @@ enum type_identifiers{JCKY_FLOAT, JCKY_DOUBLE};
 
 #define DEFAULT_NUM_HIDDEN_LAYERS 2
 #define DEFAULT_NUM_NODES_IN_HIDDEN_LAYERS 60
+#define JCKY_MAX_HIDDEN_LAYERS 32
 #define DEFAULT_BATCH_SIZE 5
 #define DEFAULT_LEARNING_RATE 1.5
+#define DEFAULT_MOMENTUM 0.9
 #define DEFAULT_EPOCHS 100
+#define DEFAULT_PREFETCH_THREADS 1
 
 #define JCKY_TIMING
 #define JCKY_TIMING_FILENAME "timing.jockey.csv"
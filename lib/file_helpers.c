@@ -1,12 +1,37 @@
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "constants.h"
 #include "file_helpers.h"
 #include "neural_net.h"
 
 
+// Writes the 8 byte header shared by data and model files: a 4 byte
+// identifier, the type byte of nn_type, and the jockey version.
+void jcky_write_header(FILE *file, const char *identifier) {
+    char version[] = JCKY_VERSION;
+    unsigned char type = jcky_type_byte();
+
+    // Parse the version number
+    char *major_version_c = strtok(version, ".");
+    char *minor_version_c = strtok(NULL, ".");
+    char *patch_version_c = strtok(NULL, ".");
+    const unsigned char major_version = (unsigned char)strtol(strtok(major_version_c, " "), NULL, 10);
+    const unsigned char minor_version = (unsigned char)strtol(strtok(minor_version_c, " "), NULL, 10);
+    const unsigned char patch_version = (unsigned char)strtol(strtok(patch_version_c, " "), NULL, 10);
+
+    fwrite(identifier, sizeof(char), 4, file);
+    fwrite(&type, sizeof(unsigned char), 1, file);
+    fwrite(&major_version, sizeof(unsigned char), 1, file);
+    fwrite(&minor_version, sizeof(unsigned char), 1, file);
+    fwrite(&patch_version, sizeof(unsigned char), 1, file);
+}
+
+
 char jcky_write_file(
     nn_type **data,
     nn_type **targets,
@@ -16,8 +41,6 @@ char jcky_write_file(
     char *filename)
 {
     FILE *file;
-    char version[] = JCKY_VERSION;
-    unsigned char type;
     unsigned int i;
 
     if (filename == NULL) {
@@ -25,35 +48,9 @@ char jcky_write_file(
         return 1;
     }
 
-    // Parse the version number
-    char *major_version_c = strtok(version, ".");
-    char *minor_version_c = strtok(NULL, ".");
-    char *patch_version_c = strtok(NULL, ".");
-    const unsigned char major_version = (unsigned char)strtol(strtok(major_version_c, " "), NULL, 10);
-    const unsigned char minor_version = (unsigned char)strtol(strtok(minor_version_c, " "), NULL, 10);
-    const unsigned char patch_version = (unsigned char)strtol(strtok(patch_version_c, " "), NULL, 10);
-
-    // Get the nn_type
-    switch (sizeof(nn_type)) {
-        case sizeof(float):
-            type = (unsigned char)JCKY_FLOAT;
-            break;
-        case sizeof(double):
-            type = (unsigned char)JCKY_DOUBLE;
-            break;
-        default:
-            printf(KRED "\nError: Invalid nn_type. Must be one of: float, double.\n" KNRM);
-            return 1;
-    }
-
-    type <<= ((sizeof(unsigned char) * 8) / 2);
     file = fopen(filename, "wb");
     if (file != NULL) {
-        fwrite("JCKY", sizeof(char), 4, file);
-        fwrite(&type, sizeof(unsigned char), 1, file);
-        fwrite(&major_version, sizeof(unsigned char), 1, file);
-        fwrite(&minor_version, sizeof(unsigned char), 1, file);
-        fwrite(&patch_version, sizeof(unsigned char), 1, file);
+        jcky_write_header(file, JCKY_DATA_IDENTIFIER);
         fwrite(&data_len, sizeof(unsigned int), 1, file);
         fwrite(&targets_len, sizeof(unsigned int), 1, file);
         fwrite(&records, sizeof(unsigned int), 1, file);
@@ -72,18 +69,102 @@ char jcky_write_file(
 }
 
 
+// The type identifier of nn_type, in the high half of the byte, as it
+// is written in the header of data and model files.
+unsigned char jcky_type_byte() {
+    return (unsigned char)JCKY_NN_TYPE << ((sizeof(unsigned char) * 8) / 2);
+}
+
+
+// Maps the type byte of a file header to the size of one value, or 0
+// if the type is unknown.
+unsigned char jcky_datum_size(const unsigned char type_byte) {
+    switch (type_byte >> ((sizeof(unsigned char) * 8) / 2)) {
+        case (unsigned char)JCKY_FLOAT:
+            return (unsigned char)sizeof(float);
+        case (unsigned char)JCKY_DOUBLE:
+            return (unsigned char)sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+
+// Reads 'len' values of 'datum_size' bytes (a float or a double) into
+// dest. When the file's type differs from nn_type the values are read
+// in chunks through a stack buffer and converted.
+void jcky_fread_nn_type(nn_type *dest, const unsigned char datum_size, unsigned long int len, FILE *stream) {
+    union {
+        float f[JCKY_CONVERT_CHUNK];
+        double d[JCKY_CONVERT_CHUNK];
+    } buffer;
+    unsigned long int i, chunk;
+
+    if (datum_size == sizeof(nn_type)) {
+        fread(dest, sizeof(nn_type), len, stream);
+        return;
+    }
+
+    while (len > 0) {
+        chunk = (len < JCKY_CONVERT_CHUNK) ? len : JCKY_CONVERT_CHUNK;
+        fread(&buffer, datum_size, chunk, stream);
+        if (datum_size == sizeof(float)) {
+            for (i=0; i<chunk; i++) dest[i] = (nn_type)buffer.f[i];
+        }
+        else {
+            for (i=0; i<chunk; i++) dest[i] = (nn_type)buffer.d[i];
+        }
+        dest += chunk;
+        len -= chunk;
+    }
+}
+
+
+// Copies 'len' values of 'datum_size' bytes out of a mapped file into
+// dest, converting them when the file's type differs from nn_type. The
+// values in the file aren't aligned, so each is copied by its bytes.
+void jcky_copy_nn_type(nn_type *dest, const unsigned char *src, const unsigned char datum_size, unsigned long int len) {
+    unsigned long int i;
+    float f;
+    double d;
+
+    if (datum_size == sizeof(nn_type)) {
+        memcpy(dest, src, len * sizeof(nn_type));
+    }
+    else if (datum_size == sizeof(float)) {
+        for (i=0; i<len; i++) {
+            memcpy(&f, src + (i * sizeof(float)), sizeof(float));
+            dest[i] = (nn_type)f;
+        }
+    }
+    else {
+        for (i=0; i<len; i++) {
+            memcpy(&d, src + (i * sizeof(double)), sizeof(double));
+            dest[i] = (nn_type)d;
+        }
+    }
+}
+
+
+// The targets of a record follow its data, so one seek reaches both.
 void jcky_read_record(jcky_file *file, const unsigned int record, nn_type *batch, nn_type *targets) {
-    const unsigned long int offset = file->offset + (file->bytes_per_record * record);
+    const unsigned long int offset = file->offset + ((unsigned long int)file->bytes_per_record * record);
+
+    if (file->map != NULL) {
+        jcky_copy_nn_type(batch, file->map + offset, file->datum_size, file->data_len);
+        jcky_copy_nn_type(targets, file->map + offset + file->bytes_per_data, file->datum_size, file->targets_len);
+        return;
+    }
+
     fseek(file->stream, offset, SEEK_SET);
-    fread(batch, file->datum_size, file->data_len, file->stream);
-    fseek(file->stream, offset + file->bytes_per_data, SEEK_SET);
-    fread(targets, file->datum_size, file->targets_len, file->stream);
+    jcky_fread_nn_type(batch, file->datum_size, file->data_len, file->stream);
+    jcky_fread_nn_type(targets, file->datum_size, file->targets_len, file->stream);
 }
 
 
 jcky_file jcky_open_file(char *filename) {
     char identifier[4];
-    unsigned char type_byte, type;
+    unsigned char type_byte;
     unsigned char major_version, minor_version, patch_version;
     unsigned int records, data_len, targets_len, bytes_per_record;
     unsigned long int expected_file_size;
@@ -91,36 +172,23 @@ jcky_file jcky_open_file(char *filename) {
     unsigned long int offset = (unsigned long int)jcky_file_byte_offset();
     jcky_file file;
 
+    file.map = NULL;
+    file.map_size = 0;
     file.stream = fopen(filename, "rb");
     if (file.stream != NULL) {
         fread(identifier, sizeof(char), 4, file.stream);
-        if (strncmp(identifier, "JCKY", 4) != 0) {
+        if (strncmp(identifier, JCKY_DATA_IDENTIFIER, 4) != 0) {
             printf(KRED "Error: %s is not a valid jockey file (missing identifier).\n" KNRM, filename);
             jcky_close_file(&file);
         }
         else {
+            // Files of either type can be read. When the type differs
+            // from nn_type, jcky_read_record converts each value.
             fread(&type_byte, sizeof(unsigned char), 1, file.stream);
-            type = type_byte >> ((sizeof(unsigned char) * 8) / 2);
-            switch (type) {
-                // Can maybe revist this at some point?
-                // In theory we can just catch mismatches and cast appropriately.
-                case (unsigned char)JCKY_FLOAT:
-                    if (sizeof(nn_type) != sizeof(float)) {
-                        printf(KRED "Error: %s has incorrect data type. File uses float, but Jockey is compiled with double.\n" KNRM, filename);
-                        jcky_close_file(&file);
-                    }
-                    bytes_per_record = sizeof(float);
-                    break;
-                case (unsigned char)JCKY_DOUBLE:
-                    if (sizeof(nn_type) != sizeof(double)) {
-                        printf(KRED "Error: %s has incorrect data type. File uses double, but Jockey is compiled with float.\n" KNRM, filename);
-                        jcky_close_file(&file);
-                    }
-                    bytes_per_record = sizeof(double);
-                    break;
-                default:
-                    printf(KRED "Error: Invalid type identifier in %s.\n" KNRM, filename);
-                    jcky_close_file(&file);
+            bytes_per_record = jcky_datum_size(type_byte);
+            if (bytes_per_record == 0) {
+                printf(KRED "Error: Invalid type identifier in %s.\n" KNRM, filename);
+                jcky_close_file(&file);
             }
 
             if (file.stream != NULL) {
@@ -132,7 +200,7 @@ jcky_file jcky_open_file(char *filename) {
                 fread(&data_len, sizeof(unsigned int), 1, file.stream);
                 fread(&targets_len, sizeof(unsigned int), 1, file.stream);
                 fread(&records, sizeof(unsigned int), 1, file.stream);
-                expected_file_size = (sizeof(nn_type) * records * (data_len + targets_len)) + offset;
+                expected_file_size = ((unsigned long int)bytes_per_record * records * (data_len + targets_len)) + offset;
                 if (expected_file_size > LONG_MAX) {
                     printf(KYEL "Warning: Unable verify correct file length for %s.\n" KNRM, filename);
                 }
@@ -163,9 +231,41 @@ jcky_file jcky_open_file(char *filename) {
 }
 
 
+char jcky_map_file(jcky_file *file, char *filename) {
+    struct stat status;
+    void *map;
+
+    if (fstat(fileno(file->stream), &status) != 0 || status.st_size == 0) {
+        printf(KRED "Error: Unable to map %s.\n" KNRM, filename);
+        return 1;
+    }
+
+    map = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fileno(file->stream), 0);
+    if (map == MAP_FAILED) {
+        printf(KRED "Error: Unable to map %s.\n" KNRM, filename);
+        return 1;
+    }
+
+    file->map = (const unsigned char *)map;
+    file->map_size = (unsigned long int)status.st_size;
+    return 0;
+}
+
+
+void jcky_advise_file(jcky_file *file, const unsigned char access) {
+    if (file->map == NULL) return;
+#if defined(MADV_RANDOM) && defined(MADV_SEQUENTIAL)
+    madvise((void *)file->map, file->map_size, (access == JCKY_ACCESS_RANDOM) ? MADV_RANDOM : MADV_SEQUENTIAL);
+#endif
+}
+
+
 char jcky_close_file(jcky_file *file) {
     char ret = (char)fclose(file->stream);
+    if (file->map != NULL) munmap((void *)file->map, file->map_size);
     file->stream = NULL;
+    file->map = NULL;
+    file->map_size = 0;
     return ret;
 }
 
@@ -5,6 +5,17 @@
 
 #include "constants.h"
 
+// Number of values converted at a time when reading a file whose type
+// differs from nn_type.
+#define JCKY_CONVERT_CHUNK 1024
+
+// Identifiers at the start of the header of each kind of file
+#define JCKY_DATA_IDENTIFIER "JCKY"
+#define JCKY_MODEL_IDENTIFIER "JCKM"
+#define JCKY_HEADER_LEN 8
+
+// How the records of a file are about to be read (see jcky_advise_file)
+enum file_access{JCKY_ACCESS_SEQUENTIAL, JCKY_ACCESS_RANDOM};
 
 typedef struct jcky_file {
     FILE *stream;
@@ -12,6 +23,14 @@ typedef struct jcky_file {
     unsigned char datum_size;
     unsigned int bytes_per_record, bytes_per_data;
     unsigned int records, data_len, targets_len;
+
+    // With the mmap reader (see jcky_map_file) the whole file is mapped
+    // read only, and records are copied straight out of the mapping, with
+    // no seek or read per record and no shared file position. The mapping
+    // is shared, so every rank on a node that reads the same file reads
+    // the same pages of the page cache. Otherwise 'map' is NULL.
+    const unsigned char *map;
+    unsigned long int map_size;
 } jcky_file;
 
 char jcky_write_file(
@@ -21,11 +40,22 @@ char jcky_write_file(
     const unsigned int data_len,
     const unsigned int targets_len,
     char *filename);
+unsigned char jcky_type_byte();
+void jcky_write_header(FILE *file, const char *identifier);
+unsigned char jcky_datum_size(const unsigned char type_byte);
+void jcky_fread_nn_type(nn_type *dest, const unsigned char datum_size, unsigned long int len, FILE *stream);
+void jcky_copy_nn_type(nn_type *dest, const unsigned char *src, const unsigned char datum_size, unsigned long int len);
 void jcky_read_record(jcky_file *file, const unsigned int record, nn_type *batch, nn_type *targets);
 char jcky_test_file(char *filename);
 unsigned int jcky_get_num_inputs(jcky_file file);
 unsigned int jcky_get_num_outputs(jcky_file file);
 jcky_file jcky_open_file(char *filename);
+// Maps an open file for the mmap reader. Returns nonzero, after printing
+// why, when it can't be mapped.
+char jcky_map_file(jcky_file *file, char *filename);
+// Tells the OS how the records of a mapped file are about to be read, so
+// it reads ahead of a sequential pass, and doesn't for a shuffled one.
+void jcky_advise_file(jcky_file *file, const unsigned char access);
 char jcky_close_file(jcky_file *file);
 unsigned char jcky_file_byte_offset();
 
@@ -0,0 +1,378 @@
+#include <stdlib.h>
+
+#include "constants.h"
+#include "gemm.h"
+#include "half.h"
+#include "kernels.h"
+#include "threads.h"
+
+
+// Packing buffers. These grow on demand and are reused between calls
+// so that the steady state never allocates. Each thread has its own, so
+// threads can run separate products at once (see --thread-mode).
+static __thread nn_type *packed_a = NULL;
+static __thread nn_type *packed_b = NULL;
+static __thread unsigned long int packed_a_len = 0;
+static __thread unsigned long int packed_b_len = 0;
+
+
+static nn_type * reserve(nn_type **buffer, unsigned long int *len, unsigned long int needed) {
+    if (needed > *len) {
+        free(*buffer);
+        *buffer = (nn_type*)malloc( needed * sizeof( nn_type ) );
+        *len = needed;
+    }
+    return *buffer;
+}
+
+
+// Copies an mc x kc block of A into row panels MR tall. Within a panel
+// the MR entries of each column are contiguous, which is the order the
+// micro-kernel consumes them in. The last panel is padded with zeros.
+static void pack_a(
+    const int mc,
+    const int kc,
+    const nn_type *a,
+    const int rsa,
+    const int csa,
+    const int panel_mr,
+    nn_type *dest)
+{
+    int i, ir, p, mr;
+
+    for (ir=0; ir<mc; ir+=panel_mr) {
+        mr = (mc - ir < panel_mr) ? mc - ir : panel_mr;
+        for (p=0; p<kc; p++) {
+            for (i=0; i<mr; i++) {
+                dest[i] = a[((ir + i) * rsa) + (p * csa)];
+            }
+            for (; i<panel_mr; i++) {
+                dest[i] = 0.0;
+            }
+            dest += panel_mr;
+        }
+    }
+}
+
+
+// pack_a for a 16 bit A, widening each value to nn_type.
+static void pack_a_half(
+    const int mc,
+    const int kc,
+    const jcky_half *a,
+    const int rsa,
+    const int csa,
+    const unsigned char storage,
+    const int panel_mr,
+    nn_type *dest)
+{
+    int i, ir, p, mr;
+
+    for (ir=0; ir<mc; ir+=panel_mr) {
+        mr = (mc - ir < panel_mr) ? mc - ir : panel_mr;
+        for (p=0; p<kc; p++) {
+            for (i=0; i<mr; i++) {
+                dest[i] = jcky_half_to_nn_type(a[((ir + i) * rsa) + (p * csa)], storage);
+            }
+            for (; i<panel_mr; i++) {
+                dest[i] = 0.0;
+            }
+            dest += panel_mr;
+        }
+    }
+}
+
+
+// Copies a kc x nc block of B into column panels NR wide. Within a panel
+// the NR entries of each row are contiguous. The last panel is padded
+// with zeros.
+static void pack_b(
+    const int kc,
+    const int nc,
+    const nn_type *b,
+    const int rsb,
+    const int csb,
+    const int panel_nr,
+    nn_type *dest)
+{
+    int j, jr, p, nr;
+
+    for (jr=0; jr<nc; jr+=panel_nr) {
+        nr = (nc - jr < panel_nr) ? nc - jr : panel_nr;
+        for (p=0; p<kc; p++) {
+            for (j=0; j<nr; j++) {
+                dest[j] = b[(p * rsb) + ((jr + j) * csb)];
+            }
+            for (; j<panel_nr; j++) {
+                dest[j] = 0.0;
+            }
+            dest += panel_nr;
+        }
+    }
+}
+
+
+void jcky_gemm_store_tile(
+    const nn_type *ab,
+    const int ldab,
+    const nn_type alpha,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias,
+    const int mr,
+    const int nr)
+{
+    int i, j;
+    nn_type value;
+
+    for (i=0; i<mr; i++) {
+        for (j=0; j<nr; j++) {
+            value = alpha * ab[(i * ldab) + j];
+            if (beta != 0.0) value += beta * c[(i * rsc) + (j * csc)];
+            if (bias != NULL) value += bias[i];
+            c[(i * rsc) + (j * csc)] = value;
+        }
+    }
+}
+
+
+// Computes an MR x NR tile of A * B from packed panels, keeping the
+// accumulators in registers, then applies the epilogue
+//    C = alpha * AB + beta * C + bias
+// to the mr x nr corner of the tile that lies inside C.
+void gemm_micro_kernel_scalar(
+    const int kc,
+    const nn_type alpha,
+    const nn_type *a,
+    const nn_type *b,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias,
+    const int mr,
+    const int nr)
+{
+    int i, j, p;
+    nn_type ab[JCKY_GEMM_MR * JCKY_GEMM_NR] = {0.0};
+
+    for (p=0; p<kc; p++) {
+        for (i=0; i<JCKY_GEMM_MR; i++) {
+            for (j=0; j<JCKY_GEMM_NR; j++) {
+                ab[(i * JCKY_GEMM_NR) + j] += a[i] * b[j];
+            }
+        }
+        a += JCKY_GEMM_MR;
+        b += JCKY_GEMM_NR;
+    }
+
+    jcky_gemm_store_tile(ab, JCKY_GEMM_NR, alpha, beta, c, rsc, csc, bias, mr, nr);
+}
+
+
+static void gemm_range(const int threads, const long int len, const int align, long int *first, long int *last) {
+    if (threads == 1) {
+        *first = 0;
+        *last = len;
+        return;
+    }
+    jcky_thread_range(len, align, first, last);
+}
+
+
+// The blocked loop nest shared by jcky_gemm and jcky_gemm_half. 'a'
+// holds nn_type values, or 16 bit values in the given storage format.
+// When it runs on more than one thread, in a parallel region of
+// 'threads' threads, the threads pack a share of each block of A and B
+// and compute a share of its register tiles, with a barrier between the
+// two (see threads.h). On one thread it does all of the work, even when
+// it's called from a parallel region of the data mode.
+static void gemm_blocks(
+    const int threads,
+    const int m,
+    const int n,
+    const int k,
+    const nn_type alpha,
+    const void *a,
+    const int rsa,
+    const int csa,
+    const unsigned char storage,
+    const nn_type *b,
+    const int rsb,
+    const int csb,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias,
+    nn_type *block_a,
+    nn_type *block_b)
+{
+    int ic, jc, pc, ir, jr;
+    int mc, nc, kc, mr, nr;
+    long int first, last, tile, tiles_m;
+    nn_type beta_block;
+    const nn_type *bias_block;
+    const int panel_mr = jcky_kernels->gemm_mr;
+    const int panel_nr = jcky_kernels->gemm_nr;
+    const gemm_micro_kernel_func micro_kernel = jcky_kernels->gemm_micro_kernel;
+
+    for (jc=0; jc<n; jc+=JCKY_GEMM_NC) {
+        nc = (n - jc < JCKY_GEMM_NC) ? n - jc : JCKY_GEMM_NC;
+
+        for (pc=0; pc<k; pc+=JCKY_GEMM_KC) {
+            kc = (k - pc < JCKY_GEMM_KC) ? k - pc : JCKY_GEMM_KC;
+
+            // Only the first block along k scales the existing C, and
+            // only the last one adds the bias.
+            beta_block = (pc == 0) ? beta : 1.0;
+            bias_block = (pc + kc == k) ? bias : NULL;
+
+            // This thread's panels of B. They're only read after the
+            // barrier that follows the first block of A.
+            gemm_range(threads, nc, panel_nr, &first, &last);
+            if (first < last) {
+                pack_b(kc, last - first, b + (pc * rsb) + ((jc + first) * csb), rsb, csb, panel_nr,
+                       block_b + (first * kc));
+            }
+
+            for (ic=0; ic<m; ic+=JCKY_GEMM_MC) {
+                mc = (m - ic < JCKY_GEMM_MC) ? m - ic : JCKY_GEMM_MC;
+
+                gemm_range(threads, mc, panel_mr, &first, &last);
+                if (first < last && storage == JCKY_STORAGE_NATIVE_ID) {
+                    pack_a(last - first, kc, (const nn_type *)a + ((ic + first) * rsa) + (pc * csa),
+                           rsa, csa, panel_mr, block_a + (first * kc));
+                }
+                else if (first < last) {
+                    pack_a_half(last - first, kc, (const jcky_half *)a + ((ic + first) * rsa) + (pc * csa),
+                                rsa, csa, storage, panel_mr, block_a + (first * kc));
+                }
+                if (threads > 1) jcky_thread_barrier();
+
+                // The tiles are numbered down each column of tiles first,
+                // so a thread's tiles share as few slivers of B as they can.
+                tiles_m = (mc + panel_mr - 1) / panel_mr;
+                gemm_range(threads, tiles_m * ((nc + panel_nr - 1) / panel_nr), 1, &first, &last);
+                for (tile=first; tile<last; tile++) {
+                    jr = (int)(tile / tiles_m) * panel_nr;
+                    ir = (int)(tile % tiles_m) * panel_mr;
+                    nr = (nc - jr < panel_nr) ? nc - jr : panel_nr;
+                    mr = (mc - ir < panel_mr) ? mc - ir : panel_mr;
+                    micro_kernel(
+                        kc,
+                        alpha,
+                        block_a + (ir * kc),
+                        block_b + (jr * kc),
+                        beta_block,
+                        c + ((ic + ir) * rsc) + ((jc + jr) * csc),
+                        rsc,
+                        csc,
+                        (bias_block != NULL) ? bias_block + ic + ir : NULL,
+                        mr,
+                        nr);
+                }
+
+                // The packed blocks are about to be overwritten
+                if (threads > 1) jcky_thread_barrier();
+            }
+        }
+    }
+}
+
+
+static void gemm(
+    const int m,
+    const int n,
+    const int k,
+    const nn_type alpha,
+    const void *a,
+    const int rsa,
+    const int csa,
+    const unsigned char storage,
+    const nn_type *b,
+    const int rsb,
+    const int csb,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias)
+{
+    double start;
+    nn_type *block_a, *block_b;
+    const int panel_nr = jcky_kernels->gemm_nr;
+    const int threads = (2.0 * m * n * k >= JCKY_PARALLEL_MIN_FLOPS) ? jcky_kernel_threads : 1;
+
+    block_a = reserve(&packed_a, &packed_a_len,
+        (unsigned long int)JCKY_GEMM_MC * JCKY_GEMM_KC);
+    block_b = reserve(&packed_b, &packed_b_len,
+        (unsigned long int)JCKY_GEMM_KC * ((n < JCKY_GEMM_NC) ? n + panel_nr : JCKY_GEMM_NC));
+
+    if (threads == 1) {
+        gemm_blocks(threads, m, n, k, alpha, a, rsa, csa, storage, b, rsb, csb, beta, c, rsc, csc, bias,
+                    block_a, block_b);
+        return;
+    }
+
+    start = jcky_parallel_start();
+    #pragma omp parallel num_threads(threads)
+    gemm_blocks(threads, m, n, k, alpha, a, rsa, csa, storage, b, rsb, csb, beta, c, rsc, csc, bias,
+                block_a, block_b);
+    jcky_parallel_end(start);
+}
+
+
+void jcky_gemm(
+    const int m,
+    const int n,
+    const int k,
+    const nn_type alpha,
+    const nn_type *a,
+    const int rsa,
+    const int csa,
+    const nn_type *b,
+    const int rsb,
+    const int csb,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias)
+{
+    gemm(m, n, k, alpha, a, rsa, csa, JCKY_STORAGE_NATIVE_ID, b, rsb, csb, beta, c, rsc, csc, bias);
+}
+
+
+void jcky_gemm_half(
+    const int m,
+    const int n,
+    const int k,
+    const nn_type alpha,
+    const jcky_half *a,
+    const int rsa,
+    const int csa,
+    const unsigned char storage,
+    const nn_type *b,
+    const int rsb,
+    const int csb,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias)
+{
+    gemm(m, n, k, alpha, a, rsa, csa, storage, b, rsb, csb, beta, c, rsc, csc, bias);
+}
+
+
+void jcky_gemm_free_workspace() {
+    free(packed_a);
+    free(packed_b);
+    packed_a = NULL;
+    packed_b = NULL;
+    packed_a_len = 0;
+    packed_b_len = 0;
+}
@@ -0,0 +1,87 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+
+#include "constants.h"
+#include "half.h"
+
+
+// Cache blocking parameters. A packed MC x KC block of A is sized to
+// stay resident in L2, and a packed KC x NR sliver of B in L1, while the
+// NC wide panel of B streams from L3. MC must be a multiple of the MR,
+// and NC a multiple of the NR, of every micro-kernel in kernels.c.
+#define JCKY_GEMM_MC 96
+#define JCKY_GEMM_KC 256
+#define JCKY_GEMM_NC 4096
+
+// Register tile computed by the scalar micro-kernel. The SIMD
+// micro-kernels declare their own tile in their kernels table.
+#define JCKY_GEMM_MR 4
+#define JCKY_GEMM_NR 8
+
+
+// Computes
+//    C = alpha * A * B + beta * C + bias
+// where A is m x k, B is k x n and C is m x n. Each matrix is described
+// by a row stride and a column stride, so element (i, j) of A lives at
+// a[(i * rsa) + (j * csa)]. This lets the same engine multiply by a
+// transposed operand without copying it. The optional bias vector has
+// one entry per row of C and is added in the micro-kernel epilogue. When
+// beta is zero C is never read.
+void jcky_gemm(
+    const int m,
+    const int n,
+    const int k,
+    const nn_type alpha,
+    const nn_type *a,
+    const int rsa,
+    const int csa,
+    const nn_type *b,
+    const int rsb,
+    const int csb,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias);
+
+// jcky_gemm with A stored in a 16 bit format (see half.h). A is
+// widened to nn_type as it's packed, so the micro-kernels and the
+// accumulation are the same as for jcky_gemm.
+void jcky_gemm_half(
+    const int m,
+    const int n,
+    const int k,
+    const nn_type alpha,
+    const jcky_half *a,
+    const int rsa,
+    const int csa,
+    const unsigned char storage,
+    const nn_type *b,
+    const int rsb,
+    const int csb,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias);
+
+// Writes the mr x nr corner of an accumulated register tile (with a
+// leading dimension of ldab) into C. Shared by all of the micro-kernels.
+void jcky_gemm_store_tile(
+    const nn_type *ab,
+    const int ldab,
+    const nn_type alpha,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias,
+    const int mr,
+    const int nr);
+
+// Frees the packing buffers of the calling thread.
+void jcky_gemm_free_workspace();
+
+
+#endif
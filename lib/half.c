@@ -0,0 +1,26 @@
+#include "constants.h"
+#include "half.h"
+
+
+void jcky_to_half(jcky_half *dest, const nn_type *src, const unsigned long int len, const unsigned char storage) {
+    unsigned long int i;
+
+    if (storage == JCKY_STORAGE_BF16_ID) {
+        for (i=0; i<len; i++) dest[i] = jcky_float_to_bf16((float)src[i]);
+    }
+    else {
+        for (i=0; i<len; i++) dest[i] = jcky_float_to_fp16((float)src[i]);
+    }
+}
+
+
+void jcky_from_half(nn_type *dest, const jcky_half *src, const unsigned long int len, const unsigned char storage) {
+    unsigned long int i;
+
+    if (storage == JCKY_STORAGE_BF16_ID) {
+        for (i=0; i<len; i++) dest[i] = (nn_type)jcky_bf16_to_float(src[i]);
+    }
+    else {
+        for (i=0; i<len; i++) dest[i] = (nn_type)jcky_fp16_to_float(src[i]);
+    }
+}
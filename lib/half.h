@@ -0,0 +1,101 @@
+#ifndef HALF_H
+#define HALF_H
+
+
+#include "constants.h"
+
+
+// 16 bit storage formats for the weights (see the storages enum). The
+// neural network itself is always kept in nn_type; a 16 bit copy of the
+// weights is read by the matrix products instead, which widen each value
+// back to nn_type as they pack it and accumulate in nn_type. The changes
+// sent to the master at the end of an epoch travel in the same format.
+//
+//   bf16 - The top half of a float: the float's 8 bit exponent with a
+//          7 bit mantissa. Same range as float, ~3 significant digits.
+//   fp16 - IEEE 754 half precision: 5 bit exponent and 10 bit mantissa.
+//          ~4 significant digits, but values below 6e-8 flush to zero
+//          and values above 65504 overflow.
+//
+// Both conversions from float round to nearest even.
+typedef unsigned short int jcky_half;
+
+typedef union jcky_float_bits {
+    float f;
+    unsigned int u;
+} jcky_float_bits;
+
+
+static inline float jcky_bf16_to_float(const jcky_half h) {
+    jcky_float_bits bits;
+    bits.u = (unsigned int)h << 16;
+    return bits.f;
+}
+
+
+static inline jcky_half jcky_float_to_bf16(const float f) {
+    jcky_float_bits bits;
+    bits.f = f;
+    // Keep NaNs quiet rather than rounding them up to infinity
+    if ((bits.u & 0x7fffffff) > 0x7f800000) return (jcky_half)((bits.u >> 16) | 0x40);
+    return (jcky_half)((bits.u + 0x7fff + ((bits.u >> 16) & 1)) >> 16);
+}
+
+
+// Scaling the shifted bits by 2^112 rebiases the exponent from 15 to 127,
+// and handles subnormal halves for free.
+static inline float jcky_fp16_to_float(const jcky_half h) {
+    jcky_float_bits bits, magic;
+    magic.u = (254 - 15) << 23;
+    bits.u = (unsigned int)(h & 0x7fff) << 13;
+    bits.f *= magic.f;
+    if (bits.f >= 65536.0f) bits.u |= 255 << 23;
+    bits.u |= (unsigned int)(h & 0x8000) << 16;
+    return bits.f;
+}
+
+
+static inline jcky_half jcky_float_to_fp16(const float f) {
+    jcky_float_bits bits, denormal_magic;
+    unsigned int sign, odd;
+    jcky_half h;
+
+    bits.f = f;
+    sign = bits.u & 0x80000000;
+    bits.u ^= sign;
+
+    if (bits.u >= (127 + 16) << 23) {
+        // Overflow to infinity, NaN stays NaN
+        h = (bits.u > 255 << 23) ? 0x7e00 : 0x7c00;
+    }
+    else if (bits.u < (127 - 14) << 23) {
+        // Subnormal or zero: let the float addition do the rounding
+        denormal_magic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+        bits.f += denormal_magic.f;
+        h = (jcky_half)(bits.u - denormal_magic.u);
+    }
+    else {
+        odd = (bits.u >> 13) & 1;
+        bits.u += ((unsigned int)(15 - 127) << 23) + 0xfff + odd;
+        h = (jcky_half)(bits.u >> 13);
+    }
+
+    return h | (jcky_half)(sign >> 16);
+}
+
+
+static inline nn_type jcky_half_to_nn_type(const jcky_half h, const unsigned char storage) {
+    return (nn_type)((storage == JCKY_STORAGE_BF16_ID) ? jcky_bf16_to_float(h) : jcky_fp16_to_float(h));
+}
+
+
+static inline jcky_half jcky_nn_type_to_half(const nn_type value, const unsigned char storage) {
+    return (storage == JCKY_STORAGE_BF16_ID) ? jcky_float_to_bf16((float)value) : jcky_float_to_fp16((float)value);
+}
+
+
+void jcky_to_half(jcky_half *dest, const nn_type *src, const unsigned long int len, const unsigned char storage);
+void jcky_from_half(nn_type *dest, const jcky_half *src, const unsigned long int len, const unsigned char storage);
+
+
+#endif
@@ -5,8 +5,14 @@
 #include <string.h>
 #include <time.h>
 
+#include "activation.h"
+#include "arena.h"
 #include "constants.h"
+#include "backend.h"
 #include "helpers.h"
+#include "prefetch.h"
+#include "sigmoid.h"
+#include "threads.h"
 
 
 void welcome(jcky_cli *cli, unsigned char master) {
@@ -28,24 +34,34 @@ help_text() {
     printf("This program will write out two files during it's execution:\n");
     printf("  config.jockey - The layout, weights, and biases of the neural network.\n");
     printf("  %s - Detailed timing report of the program. This includes\n", JCKY_TIMING_FILENAME);
-    printf("      the following metrics (all in milliseconds):\n");
+    printf("      the following metrics (times are wall time, in seconds):\n");
     printf("          epoch_time:      Total time of the epoch.\n");
     printf("          copy:            Time to make a copy of the neural network used\n");
     printf("                           for processing.\n");
     printf("          shuffle:         Time to shuffle data and sync this information\n");
     printf("                           across the MPI network.\n");
     printf("          training:        Total training time.\n");
-    printf("          training_batch:  Average time to create a training batch.\n");
-    printf("          training_run:    Average time to push a training batch through the\n");
-    printf("                           neural network. This includes both feed forward\n");
-    printf("                           and backpropogation time.\n");
+    printf("          training_batch:  Total time, over the epoch, to create the training\n");
+    printf("                           batches. In the '%s' and '%s' thread modes, the\n",
+        JCKY_THREAD_MODE_DATA, JCKY_THREAD_MODE_HOGWILD);
+    printf("                           sum over the worker threads, which build their\n");
+    printf("                           batches within training_run.\n");
+    printf("          training_run:    Total time, over the epoch, to push the training\n");
+    printf("                           batches through the neural network. This includes\n");
+    printf("                           both feed forward and backpropogation time.\n");
     printf("          sync:            Time to syncronize the neural networks from the\n");
     printf("                           various MPI processes.\n");
-    printf("          testing:         Total training time.\n");
-    printf("          testing_batch:   Average time to create a testing batch.\n");
-    printf("          testing_run:     Average time to push a testing batch through the\n");
-    printf("                           neural network. This includes both feed forward\n");
-    printf("                           time (no backpropogation).\n");
+    printf("          testing:         Total testing time.\n");
+    printf("          testing_batch:   Total time, over the epoch, to create the testing\n");
+    printf("                           batches.\n");
+    printf("          testing_run:     Total time, over the epoch, to push the testing\n");
+    printf("                           batches through the neural network. This includes\n");
+    printf("                           only feed forward time (no backpropogation).\n");
+    printf("          backprop:        Total wall time spent in backpropogation, which\n");
+    printf("                           includes refreshing the transposed shadow.\n");
+    printf("          forward_gflops_layer_N:\n");
+    printf("                           Throughput, in GFLOP/s, of the matrix multiply in\n");
+    printf("                           the feed forward step of layer N.\n");
     printf("\n");
     printf("Usage:\n");
     printf("    jockey --help/-h\n");
@@ -68,8 +84,20 @@ help_text() {
     printf("        NOTE: Compile jockey without '#define JCKY_TIMING' to completly\n");
     printf("              disable timing.\n");
     printf("        Default: Save the timing of the program after each epoch.\n");
+    printf("    --report-drift\n");
+    printf("        Flag to also score the testing data with the exact sigmoid, native\n");
+    printf("        weight storage and native inference each epoch, and report how far the\n");
+    printf("        score from the selected sigmoid, storage and inference drifts from it.\n");
+    printf("        This doubles the testing time.\n");
+    printf("    --transposed-shadow\n");
+    printf("        Flag to keep a transposed copy of each weight matrix past the first,\n");
+    printf("        refreshed after each update, so that the deltas are pushed upstream\n");
+    printf("        with unit stride reads. Needs native storage and the '%s' backward\n", JCKY_BACKWARD_SPLIT);
+    printf("        pass. The refresh is included in the backprop time of the timing file.\n");
     printf("\n");
     printf("Options:\n");
+    printf("    Options take their value as the next argument, or after an '=' (for\n");
+    printf("    example '--kernels=avx2').\n");
     printf("    --training-filename/--training-file/--train (str)\n");
     printf("        Path to training file. Required (unless running with the --write flag).\n");
     printf("    --testing-filename/--testing-file/--test (str)\n");
@@ -84,15 +112,38 @@ help_text() {
     printf("    --hidden-nodes/-hn (int)\n");
     printf("        Number of nodes in each hidden layer.\n");
     printf("        Default: %i\n", DEFAULT_NUM_NODES_IN_HIDDEN_LAYERS);
+    printf("    --layers (list of int)\n");
+    printf("        Number of nodes in each hidden layer, in order from the inputs, separated\n");
+    printf("        by commas (for example '512,64'). Replaces --hidden-layers and\n");
+    printf("        --hidden-nodes, so the hidden layers can have different widths. The\n");
+    printf("        widths are stored in the model file. At most %i hidden layers.\n", JCKY_MAX_HIDDEN_LAYERS);
+    printf("        Default: --hidden-layers layers of --hidden-nodes nodes.\n");
     printf("    --batch-size/-bs (int)\n");
     printf("        Number of samples in each batch.\n");
     printf("        Default: %i\n", DEFAULT_BATCH_SIZE);
     printf("    --learning-rate/-lr (float)\n");
     printf("        Learning rate.\n");
     printf("        Default: %f\n", DEFAULT_LEARNING_RATE);
+    printf("    --optimizer (str)\n");
+    printf("        Optimizer of the weights and biases. Options are '%s', '%s' or '%s'.\n",
+        JCKY_OPTIMIZER_SGD, JCKY_OPTIMIZER_MOMENTUM, JCKY_OPTIMIZER_ADAM);
+    printf("          %s: Plain gradient descent.\n", JCKY_OPTIMIZER_SGD);
+    printf("          %s: Gradient descent with momentum (see --momentum).\n", JCKY_OPTIMIZER_MOMENTUM);
+    printf("          %s: Adam, which usually wants a learning rate near 0.001.\n", JCKY_OPTIMIZER_ADAM);
+    printf("        The optimizer's state is kept by each rank and thread, and isn't\n");
+    printf("        synced or saved. '%s' and '%s' need the '%s' backward pass.\n",
+        JCKY_OPTIMIZER_MOMENTUM, JCKY_OPTIMIZER_ADAM, JCKY_BACKWARD_SPLIT);
+    printf("        Default: %s\n", JCKY_OPTIMIZER_SGD);
+    printf("    --momentum (float)\n");
+    printf("        Momentum of the '%s' optimizer, from 0 up to (not including) 1.\n", JCKY_OPTIMIZER_MOMENTUM);
+    printf("        Default: %f\n", DEFAULT_MOMENTUM);
     printf("    --epochs/-e (int)\n");
     printf("        Number of epochs to run for.\n");
     printf("        Default: %i\n", DEFAULT_EPOCHS);
+    printf("    --target-score (float)\n");
+    printf("        Stop training after the first epoch whose total test score reaches this,\n");
+    printf("        and report the epochs and the wall time it took.\n");
+    printf("        Default: Run every epoch.\n");
     printf("    --seed/-s (int)\n");
     printf("        Randon seed used to initialize neural network.\n");
     printf("    --memory-layout/-ml (str)\n");
@@ -100,6 +151,175 @@ help_text() {
     printf("        'contiguous' or 'logical'. There should rarely, if ever, be a reason to\n");
     printf("        use this option.\n");
     printf("        Default: %s\n", JCKY_CONTIGUOUS_LAYOUT);
+    printf("    --batch-layout (str)\n");
+    printf("        Layout of each batch and of the activations and deltas computed from it.\n");
+    printf("        Options are '%s' or '%s'. '%s' gives each node a row,\n",
+        JCKY_FEATURE_MAJOR_LAYOUT, JCKY_BATCH_MAJOR_LAYOUT, JCKY_FEATURE_MAJOR_LAYOUT);
+    printf("        with the samples of the batch along it. '%s' gives each sample a row,\n",
+        JCKY_BATCH_MAJOR_LAYOUT);
+    printf("        so records are read straight into the batch and each sample's outputs\n");
+    printf("        are contiguous when they're scored.\n");
+    printf("        Default: %s\n", JCKY_FEATURE_MAJOR_LAYOUT);
+    printf("    --derivative (str)\n");
+    printf("        What backpropagation computes the sigmoid derivative from. Options are\n");
+    printf("        '%s' or '%s'. '%s' uses a * (1 - a) on the stored activations, and\n",
+        JCKY_DERIVATIVE_ACTIVATION, JCKY_DERIVATIVE_Z, JCKY_DERIVATIVE_ACTIVATION);
+    printf("        doesn't store the z-matrices at all. '%s' stores the z-matrices and\n", JCKY_DERIVATIVE_Z);
+    printf("        calls sigmoidPrime on them.\n");
+    printf("        Default: %s\n", JCKY_DERIVATIVE_ACTIVATION);
+    printf("    --sigmoid (str)\n");
+    printf("        Accuracy tier of the sigmoid. Options are '%s', '%s' or '%s'.\n",
+        JCKY_SIGMOID_EXACT, JCKY_SIGMOID_POLY, JCKY_SIGMOID_TABLE);
+    printf("          %s: 1 / (1 + exp(-z)) using libm. This is the reference.\n", JCKY_SIGMOID_EXACT);
+    printf("          %s:  Range-reduced polynomial exp, vectorized.\n", JCKY_SIGMOID_POLY);
+    printf("                Maximum absolute error: %g\n", JCKY_SIGMOID_POLY_MAX_ERROR);
+    printf("          %s: Interpolated lookup table, vectorized.\n", JCKY_SIGMOID_TABLE);
+    printf("                Maximum absolute error: %g\n", JCKY_SIGMOID_TABLE_MAX_ERROR);
+    printf("        Default: %s\n", JCKY_SIGMOID_EXACT);
+    printf("    --activation (str)\n");
+    printf("        Activation function of the hidden layers. Options are '%s', '%s',\n",
+        JCKY_ACTIVATION_SIGMOID, JCKY_ACTIVATION_RELU);
+    printf("        '%s' (slope %g below zero) or '%s'. Either one function for every\n",
+        JCKY_ACTIVATION_LEAKY_RELU, JCKY_LEAKY_RELU_SLOPE, JCKY_ACTIVATION_TANH);
+    printf("        hidden layer, or one per hidden layer separated by commas (for example\n");
+    printf("        '%s,%s'). The output layer is always a sigmoid layer, and --sigmoid\n",
+        JCKY_ACTIVATION_RELU, JCKY_ACTIVATION_SIGMOID);
+    printf("        applies to every sigmoid layer. The ReLU functions make no libm calls.\n");
+    printf("        Default: %s\n", JCKY_ACTIVATION_SIGMOID);
+    printf("    --output (str)\n");
+    printf("        Output layer and cost function. Options are '%s' or '%s'.\n",
+        JCKY_OUTPUT_SIGMOID, JCKY_OUTPUT_SOFTMAX);
+    printf("          %s: Sigmoid outputs with the quadratic cost.\n", JCKY_OUTPUT_SIGMOID);
+    printf("          %s: Softmax outputs with the cross-entropy cost, whose output delta\n", JCKY_OUTPUT_SOFTMAX);
+    printf("                   is written by the softmax itself. Suits one class per sample,\n");
+    printf("                   and usually wants a smaller learning rate.\n");
+    printf("        Default: %s\n", JCKY_OUTPUT_SIGMOID);
+    printf("    --backend (str)\n");
+    printf("        Provider of the matrix products in feed forward and backpropagation.\n");
+    printf("        Options are '%s' (built in, using the kernels below) or '%s'\n",
+        JCKY_BACKEND_REFERENCE, JCKY_BACKEND_CBLAS);
+    printf("        (a vendor BLAS such as OpenBLAS or BLIS). '%s' is only available when\n", JCKY_BACKEND_CBLAS);
+    printf("        jockey is built with 'make CBLAS=1'.\n");
+    printf("        Default: %s\n", JCKY_BACKEND_REFERENCE);
+    printf("    --backward (str)\n");
+    printf("        How backpropagation goes through each weight matrix. Options are '%s'\n", JCKY_BACKWARD_SPLIT);
+    printf("        or '%s'. '%s' pushes the deltas down through every layer first, then\n",
+        JCKY_BACKWARD_FUSED, JCKY_BACKWARD_SPLIT);
+    printf("        updates every layer. '%s' pushes the delta down through a tile of the\n", JCKY_BACKWARD_FUSED);
+    printf("        weights and updates it (and its biases) while it's still in cache, which\n");
+    printf("        pays off once a weight matrix no longer fits in L2. With 16 bit storage,\n");
+    printf("        '%s' reads the full precision weights for the deltas.\n", JCKY_BACKWARD_FUSED);
+    printf("        Default: %s\n", JCKY_BACKWARD_SPLIT);
+    printf("    --storage (str)\n");
+    printf("        Storage format of the weights read by the matrix products. Options are\n");
+    printf("        '%s', '%s' or '%s'. '%s' reads the weights directly. '%s' and '%s'\n",
+        JCKY_STORAGE_NATIVE, JCKY_STORAGE_BF16, JCKY_STORAGE_FP16,
+        JCKY_STORAGE_NATIVE, JCKY_STORAGE_BF16, JCKY_STORAGE_FP16);
+    printf("        keep a 16 bit copy of the weights for the products, which still\n");
+    printf("        accumulate (and update the weights) at full precision, and send the\n");
+    printf("        changes to the master in 16 bits. Needs the '%s' backend.\n", JCKY_BACKEND_REFERENCE);
+    printf("        Default: %s\n", JCKY_STORAGE_NATIVE);
+    printf("    --input-format (str)\n");
+    printf("        How the first layer reads each batch of inputs. Options are '%s' or\n", JCKY_INPUT_DENSE);
+    printf("        '%s'. '%s' also keeps the nonzero inputs of each batch, by sample\n",
+        JCKY_INPUT_SPARSE, JCKY_INPUT_SPARSE);
+    printf("        and by input, so the first layer's products skip the zero inputs, and\n");
+    printf("        the weights of inputs that are zero across the batch aren't updated\n");
+    printf("        at all. Suits inputs that are mostly zeros, such as images.\n");
+    printf("        Default: %s\n", JCKY_INPUT_DENSE);
+    printf("    --inference (str)\n");
+    printf("        Engine used to score the testing data. Options are '%s' or '%s'.\n",
+        JCKY_INFERENCE_NATIVE, JCKY_INFERENCE_INT8);
+    printf("        '%s' quantizes the weights (per row) and the inputs of each layer (per\n", JCKY_INFERENCE_INT8);
+    printf("        sample) to int8 after each sync, and accumulates their products in\n");
+    printf("        integers. Combine with --report-drift to see what it costs in score.\n");
+    printf("        Default: %s\n", JCKY_INFERENCE_NATIVE);
+    printf("    --kernels (str)\n");
+    printf("        Instruction set used by the matrix kernels. Options are '%s', '%s',\n", JCKY_KERNELS_AUTO, JCKY_KERNELS_SCALAR);
+    printf("        '%s' or '%s'. '%s' picks the widest instruction set supported by\n", JCKY_KERNELS_AVX2, JCKY_KERNELS_AVX512, JCKY_KERNELS_AUTO);
+    printf("        the CPU. Asking for an instruction set the CPU doesn't support is an error.\n");
+    printf("        Default: %s\n", JCKY_KERNELS_AUTO);
+    printf("    --threads (int or '%s')\n", JCKY_THREADS_AUTO);
+    printf("        Number of threads each MPI rank splits its matrix products and sigmoids\n");
+    printf("        across. Small products are left to one thread. The '%s' backend\n", JCKY_BACKEND_CBLAS);
+    printf("        threads its products itself (for OpenBLAS, see OPENBLAS_NUM_THREADS).\n");
+    printf("        '%s' shares the cores of each node between the ranks on it, so that\n", JCKY_THREADS_AUTO);
+    printf("        running one rank per node (or socket) with '%s' uses every core with\n", JCKY_THREADS_AUTO);
+    printf("        one copy of the neural network per node rather than per core. The\n");
+    printf("        timing file reports the utilization of each thread. Needs jockey to be\n");
+    printf("        built with OpenMP (the default), and an MPI library that provides the\n");
+    printf("        'funneled' threading level. Must be between 1 and %i.\n", JCKY_MAX_THREADS);
+    printf("        Default: 1\n");
+    printf("    --thread-mode (str)\n");
+    printf("        How the threads of each rank share the training. Options are '%s',\n", JCKY_THREAD_MODE_KERNELS);
+    printf("        '%s' or '%s'. '%s' splits each matrix product and sigmoid\n",
+        JCKY_THREAD_MODE_DATA, JCKY_THREAD_MODE_HOGWILD, JCKY_THREAD_MODE_KERNELS);
+    printf("        across the threads. '%s' gives each thread its own share of the rank's\n", JCKY_THREAD_MODE_DATA);
+    printf("        batches, which it trains a private copy of the neural network on, and\n");
+    printf("        averages the copies before the rank syncs. This suits small layers,\n");
+    printf("        whose products are too small to split. '%s' shares the batches the\n", JCKY_THREAD_MODE_HOGWILD);
+    printf("        same way, but every thread updates the rank's one copy as it goes,\n");
+    printf("        without any locks, so updates that collide can be lost. Each thread\n");
+    printf("        sees the others' progress at once, which can converge in fewer epochs\n");
+    printf("        than averaging, but the result depends on the timing of the threads.\n");
+    printf("        Either way testing runs on one thread. In the timing file the layer\n");
+    printf("        GFLOP/s are then per thread, the backprop time is summed over the\n");
+    printf("        threads, and the training run time includes reading the batches.\n");
+    printf("        Default: %s\n", JCKY_THREAD_MODE_KERNELS);
+    printf("    --pages (str)\n");
+    printf("        Pages of the neural networks, the batch matrices and the optimizer\n");
+    printf("        state. Options are '%s', '%s' or '%s'. '%s' leaves them\n",
+        JCKY_PAGES_DEFAULT, JCKY_PAGES_TRANSPARENT, JCKY_PAGES_EXPLICIT, JCKY_PAGES_DEFAULT);
+    printf("        on the heap. '%s' maps each buffer of at least %i KiB by itself and asks\n",
+        JCKY_PAGES_TRANSPARENT, JCKY_ARENA_MAP_MIN / 1024);
+    printf("        for transparent huge pages, which cuts the TLB misses of streaming the\n");
+    printf("        weights. '%s' takes them from the huge pages reserved with\n", JCKY_PAGES_EXPLICIT);
+    printf("        vm.nr_hugepages, and falls back to '%s' when there aren't enough.\n", JCKY_PAGES_TRANSPARENT);
+    printf("        Each mapped buffer is rounded up to whole %i MiB pages. The pages and\n",
+        JCKY_HUGE_PAGE_SIZE / (1024 * 1024));
+    printf("        nodes each buffer landed on are reported at startup. Linux only.\n");
+    printf("        Default: %s\n", JCKY_PAGES_DEFAULT);
+    printf("    --numa (str)\n");
+    printf("        Placement of the pages of the buffers --pages maps across the NUMA nodes.\n");
+    printf("        Options are '%s', '%s' or '%s'. '%s' leaves each page on the\n",
+        JCKY_NUMA_DEFAULT, JCKY_NUMA_LOCAL, JCKY_NUMA_INTERLEAVE, JCKY_NUMA_DEFAULT);
+    printf("        node of the thread that first writes it. '%s' writes each page first\n", JCKY_NUMA_LOCAL);
+    printf("        from the thread that will use it: the kernel thread (see --threads)\n");
+    printf("        whose share of the elementwise kernels covers it, or in the '%s' and\n", JCKY_THREAD_MODE_DATA);
+    printf("        '%s' modes the worker thread that owns the buffer. '%s' spreads\n",
+        JCKY_THREAD_MODE_HOGWILD, JCKY_NUMA_INTERLEAVE);
+    printf("        the pages across the nodes the rank may use, which evens out the\n");
+    printf("        bandwidth of buffers every thread reads. Either maps the buffers, even\n");
+    printf("        with the default pages. Linux only.\n");
+    printf("        Default: %s\n", JCKY_NUMA_DEFAULT);
+    printf("    --reader (str)\n");
+    printf("        How the training and testing files are read. Options are '%s' or '%s'.\n",
+        JCKY_READER_STDIO, JCKY_READER_MMAP);
+    printf("        '%s' seeks to and reads each record of a batch. '%s' maps each file\n",
+        JCKY_READER_STDIO, JCKY_READER_MMAP);
+    printf("        and copies the records straight out of the mapping, which saves the\n");
+    printf("        calls into the OS per record and lets worker threads (see --thread-mode)\n");
+    printf("        read their batches at the same time. The OS is told the training file\n");
+    printf("        is read in a random order and the testing file in order, so it only\n");
+    printf("        reads ahead of the testing pass. Ranks on the same node share the pages\n");
+    printf("        of a file they both read.\n");
+    printf("        Default: %s\n", JCKY_READER_STDIO);
+    printf("    --prefetch (int)\n");
+    printf("        Number of batches built ahead of the batch being trained or tested on,\n");
+    printf("        by loader threads (see --prefetch-threads), so reading the files overlaps\n");
+    printf("        the work on the batches. Each of them takes another batch and targets\n");
+    printf("        of memory. The timing file reports the time spent waiting for a batch\n");
+    printf("        and the mean number of batches ready. Needs the '%s' thread mode;\n",
+        JCKY_THREAD_MODE_KERNELS);
+    printf("        the worker threads of the others read their own batches. Since the\n");
+    printf("        loaders run alongside the rank's own thread, also needs an MPI library\n");
+    printf("        that provides the 'funneled' threading level.\n");
+    printf("        Default: 0 (build each batch when it's needed)\n");
+    printf("    --prefetch-threads (int)\n");
+    printf("        Number of loader threads that build the batches of --prefetch. With the\n");
+    printf("        '%s' reader they take turns at the file. Must be between 1 and %i.\n",
+        JCKY_READER_STDIO, JCKY_MAX_PREFETCH_THREADS);
+    printf("        Default: %i\n", DEFAULT_PREFETCH_THREADS);
     printf("    --blocks (int)\n");
     printf("        When syncing the neural network across the MPI network, send the data\n");
     printf("        in this many blocks. This only applies when using the 'contiguous'\n");
@@ -116,6 +336,62 @@ help_text() {
 }
 
 
+// Reads a comma separated list of hidden layer widths into cli.
+// Returns 1 if the list is empty, too long, or has a width below 1.
+static unsigned char parse_layer_list(jcky_cli *cli, char *val) {
+    int layers = 0;
+    long int width;
+    char *end;
+
+    if (val == NULL) return 1;
+
+    while (*val != '\0') {
+        width = strtol(val, &end, 10);
+        if (end == val || width < 1 || width > INT_MAX || layers == JCKY_MAX_HIDDEN_LAYERS) return 1;
+        cli->hidden_layer_widths[layers++] = (int)width;
+
+        if (*end == ',') end++;
+        else if (*end != '\0') return 1;
+        val = end;
+    }
+    if (layers == 0) return 1;
+
+    cli->layers_len = layers;
+    return 0;
+}
+
+
+// Reads a comma separated list of activation functions into cli.
+// Returns 1 if a name is unknown or the list is too long.
+static unsigned char parse_activation_list(jcky_cli *cli, char *val) {
+    int layers = 0;
+    unsigned char id;
+    size_t len;
+    char *end;
+    const char *names[JCKY_ACTIVATIONS] = {
+        JCKY_ACTIVATION_SIGMOID, JCKY_ACTIVATION_RELU, JCKY_ACTIVATION_LEAKY_RELU, JCKY_ACTIVATION_TANH
+    };
+
+    if (val == NULL) return 1;
+
+    while (1) {
+        end = strchr(val, ',');
+        len = (end == NULL) ? strlen(val) : (size_t)(end - val);
+        for (id=0; id<JCKY_ACTIVATIONS; id++) {
+            if (strlen(names[id]) == len && strncmp(val, names[id], len) == 0) break;
+        }
+        if (id == JCKY_ACTIVATIONS || layers == JCKY_MAX_HIDDEN_LAYERS) return 1;
+        cli->hidden_activations[layers++] = id;
+
+        if (end == NULL) break;
+        val = end + 1;
+    }
+
+    cli->activations_len = layers;
+    return 0;
+}
+
+
 unsigned char process_command_line(
     int argc,
     char **argv,
@@ -131,9 +407,33 @@ unsigned char process_command_line(
     cli->epochs = DEFAULT_EPOCHS;
     cli->learning_rate = DEFAULT_LEARNING_RATE;
     cli->memory_layout = (unsigned char)JCKY_CONTIGUOUS_LAYOUT_ID;
+    cli->kernels = (unsigned char)JCKY_KERNELS_AUTO_ID;
+    cli->derivative = (unsigned char)JCKY_DERIVATIVE_ACTIVATION_ID;
+    cli->sigmoid = (unsigned char)JCKY_SIGMOID_EXACT_ID;
+    cli->report_drift = 0;
+    cli->transposed_shadow = 0;
+    cli->backend = (unsigned char)JCKY_BACKEND_REFERENCE_ID;
+    cli->storage = (unsigned char)JCKY_STORAGE_NATIVE_ID;
+    cli->backward = (unsigned char)JCKY_BACKWARD_SPLIT_ID;
+    cli->batch_layout = (unsigned char)JCKY_FEATURE_MAJOR_LAYOUT_ID;
+    cli->inference = (unsigned char)JCKY_INFERENCE_NATIVE_ID;
+    cli->input_format = (unsigned char)JCKY_INPUT_DENSE_ID;
     cli->num_blocks = 0;
+    cli->threads = 1;
+    cli->thread_mode = (unsigned char)JCKY_THREAD_MODE_KERNELS_ID;
+    cli->pages = (unsigned char)JCKY_PAGES_DEFAULT_ID;
+    cli->numa = (unsigned char)JCKY_NUMA_DEFAULT_ID;
+    cli->reader = (unsigned char)JCKY_READER_STDIO_ID;
+    cli->prefetch = 0;
+    cli->prefetch_threads = DEFAULT_PREFETCH_THREADS;
     cli->number_of_hidden_layers = DEFAULT_NUM_HIDDEN_LAYERS;
     cli->number_of_nodes_in_hidden_layers = DEFAULT_NUM_NODES_IN_HIDDEN_LAYERS;
+    cli->layers_len = 0;
+    cli->activations_len = 0;
+    cli->output = (unsigned char)JCKY_OUTPUT_SIGMOID_ID;
+    cli->target_score = 0.0;
+    cli->optimizer = (unsigned char)JCKY_OPTIMIZER_SGD_ID;
+    cli->momentum = DEFAULT_MOMENTUM;
     cli->seed = -1;  // Signal to generate a random seed
     cli->testing_filename[0] = '\0';
     cli->training_filename[0] = '\0';
@@ -165,6 +465,14 @@ unsigned char process_command_line(
             cli->no_save = 1;
             continue;
         }
+        else if (strncmp(option, "--report-drift", 14) == 0) {
+            cli->report_drift = 1;
+            continue;
+        }
+        else if (strncmp(option, "--transposed-shadow", 19) == 0) {
+            cli->transposed_shadow = 1;
+            continue;
+        }
         else if (strncmp(option, "--help", 6) == 0 ||
                  strncmp(option, "-h", 2) == 0) {
             if (master) help_text();
@@ -178,7 +486,9 @@ unsigned char process_command_line(
         }
 
         // Options
-        char *val = argv[++i];
+        char *val = strchr(option, '=');
+        if (val != NULL) val++;
+        else val = argv[++i];
 
 		if (strncmp(option, "--hidden-layers", 15) == 0 ||
 			strncmp(option, "-hl", 3) == 0) {
@@ -188,6 +498,13 @@ unsigned char process_command_line(
 				 strncmp(option, "-hn", 3) == 0) {
 			cli->number_of_nodes_in_hidden_layers = (int)strtol( strtok(val, " "), NULL, 10);
 		}
+		else if (strncmp(option, "--layers", 8) == 0) {
+            if (parse_layer_list(cli, val)) {
+                if (master) printf(KRED "Error: Unknown option '%s' for layers.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+		}
 		else if (strncmp(option, "--batch-size", 12) == 0 ||
 				 strncmp(option, "-bs", 3) == 0) {
 			cli->batch_size = (int)strtol( strtok(val, " "), NULL, 10);
@@ -218,6 +535,284 @@ unsigned char process_command_line(
                 break;
             }
         }
+        else if (strncmp(option, "--derivative", 12) == 0) {
+            if (val != NULL && strcmp(val, JCKY_DERIVATIVE_ACTIVATION) == 0) {
+                cli->derivative = (unsigned char)JCKY_DERIVATIVE_ACTIVATION_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_DERIVATIVE_Z) == 0) {
+                cli->derivative = (unsigned char)JCKY_DERIVATIVE_Z_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for derivative.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--sigmoid", 9) == 0) {
+            if (val != NULL && strcmp(val, JCKY_SIGMOID_EXACT) == 0) {
+                cli->sigmoid = (unsigned char)JCKY_SIGMOID_EXACT_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_SIGMOID_POLY) == 0) {
+                cli->sigmoid = (unsigned char)JCKY_SIGMOID_POLY_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_SIGMOID_TABLE) == 0) {
+                cli->sigmoid = (unsigned char)JCKY_SIGMOID_TABLE_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for sigmoid.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--activation", 12) == 0) {
+            if (parse_activation_list(cli, val)) {
+                if (master) printf(KRED "Error: Unknown option '%s' for activation.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--output", 8) == 0) {
+            if (val != NULL && strcmp(val, JCKY_OUTPUT_SIGMOID) == 0) {
+                cli->output = (unsigned char)JCKY_OUTPUT_SIGMOID_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_OUTPUT_SOFTMAX) == 0) {
+                cli->output = (unsigned char)JCKY_OUTPUT_SOFTMAX_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for output.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--optimizer", 11) == 0) {
+            if (val != NULL && strcmp(val, JCKY_OPTIMIZER_SGD) == 0) {
+                cli->optimizer = (unsigned char)JCKY_OPTIMIZER_SGD_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_OPTIMIZER_MOMENTUM) == 0) {
+                cli->optimizer = (unsigned char)JCKY_OPTIMIZER_MOMENTUM_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_OPTIMIZER_ADAM) == 0) {
+                cli->optimizer = (unsigned char)JCKY_OPTIMIZER_ADAM_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for optimizer.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--momentum", 10) == 0) {
+            cli->momentum = (val == NULL) ? -1.0 : (nn_type)strtod(val, NULL);
+            if (cli->momentum < 0.0 || cli->momentum >= 1.0) {
+                if (master) printf(KRED "Error: Unknown option '%s' for momentum.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--target-score", 14) == 0) {
+            cli->target_score = (val == NULL) ? -1.0 : strtod(val, NULL);
+            if (cli->target_score <= 0.0) {
+                if (master) printf(KRED "Error: Unknown option '%s' for target-score.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--backend", 9) == 0) {
+            if (val != NULL && strcmp(val, JCKY_BACKEND_REFERENCE) == 0) {
+                cli->backend = (unsigned char)JCKY_BACKEND_REFERENCE_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_BACKEND_CBLAS) == 0) {
+                cli->backend = (unsigned char)JCKY_BACKEND_CBLAS_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for backend.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+            if (!jcky_backend_supported(cli->backend)) {
+                if (master) printf(KRED "Error: Jockey was built without the '%s' backend.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--backward", 10) == 0) {
+            if (val != NULL && strcmp(val, JCKY_BACKWARD_SPLIT) == 0) {
+                cli->backward = (unsigned char)JCKY_BACKWARD_SPLIT_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_BACKWARD_FUSED) == 0) {
+                cli->backward = (unsigned char)JCKY_BACKWARD_FUSED_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for backward.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--batch-layout", 14) == 0) {
+            if (val != NULL && strcmp(val, JCKY_FEATURE_MAJOR_LAYOUT) == 0) {
+                cli->batch_layout = (unsigned char)JCKY_FEATURE_MAJOR_LAYOUT_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_BATCH_MAJOR_LAYOUT) == 0) {
+                cli->batch_layout = (unsigned char)JCKY_BATCH_MAJOR_LAYOUT_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for batch layout.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--storage", 9) == 0) {
+            if (val != NULL && strcmp(val, JCKY_STORAGE_NATIVE) == 0) {
+                cli->storage = (unsigned char)JCKY_STORAGE_NATIVE_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_STORAGE_BF16) == 0) {
+                cli->storage = (unsigned char)JCKY_STORAGE_BF16_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_STORAGE_FP16) == 0) {
+                cli->storage = (unsigned char)JCKY_STORAGE_FP16_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for storage.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--input-format", 14) == 0) {
+            if (val != NULL && strcmp(val, JCKY_INPUT_DENSE) == 0) {
+                cli->input_format = (unsigned char)JCKY_INPUT_DENSE_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_INPUT_SPARSE) == 0) {
+                cli->input_format = (unsigned char)JCKY_INPUT_SPARSE_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for input format.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--inference", 11) == 0) {
+            if (val != NULL && strcmp(val, JCKY_INFERENCE_NATIVE) == 0) {
+                cli->inference = (unsigned char)JCKY_INFERENCE_NATIVE_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_INFERENCE_INT8) == 0) {
+                cli->inference = (unsigned char)JCKY_INFERENCE_INT8_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for inference.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--kernels", 9) == 0) {
+            if (val != NULL && strcmp(val, JCKY_KERNELS_AUTO) == 0) {
+                cli->kernels = (unsigned char)JCKY_KERNELS_AUTO_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_KERNELS_SCALAR) == 0) {
+                cli->kernels = (unsigned char)JCKY_KERNELS_SCALAR_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_KERNELS_AVX2) == 0) {
+                cli->kernels = (unsigned char)JCKY_KERNELS_AVX2_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_KERNELS_AVX512) == 0) {
+                cli->kernels = (unsigned char)JCKY_KERNELS_AVX512_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for kernels.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--thread-mode", 13) == 0) {
+            if (val != NULL && strcmp(val, JCKY_THREAD_MODE_KERNELS) == 0) {
+                cli->thread_mode = (unsigned char)JCKY_THREAD_MODE_KERNELS_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_THREAD_MODE_DATA) == 0) {
+                cli->thread_mode = (unsigned char)JCKY_THREAD_MODE_DATA_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_THREAD_MODE_HOGWILD) == 0) {
+                cli->thread_mode = (unsigned char)JCKY_THREAD_MODE_HOGWILD_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for thread mode.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--pages", 7) == 0) {
+            if (val != NULL && strcmp(val, JCKY_PAGES_DEFAULT) == 0) {
+                cli->pages = (unsigned char)JCKY_PAGES_DEFAULT_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_PAGES_TRANSPARENT) == 0) {
+                cli->pages = (unsigned char)JCKY_PAGES_TRANSPARENT_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_PAGES_EXPLICIT) == 0) {
+                cli->pages = (unsigned char)JCKY_PAGES_EXPLICIT_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for pages.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--numa", 6) == 0) {
+            if (val != NULL && strcmp(val, JCKY_NUMA_DEFAULT) == 0) {
+                cli->numa = (unsigned char)JCKY_NUMA_DEFAULT_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_NUMA_LOCAL) == 0) {
+                cli->numa = (unsigned char)JCKY_NUMA_LOCAL_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_NUMA_INTERLEAVE) == 0) {
+                cli->numa = (unsigned char)JCKY_NUMA_INTERLEAVE_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for numa.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--prefetch-threads", 18) == 0) {
+            cli->prefetch_threads = (val == NULL) ? 0 : (int)strtol(val, NULL, 10);
+            if (cli->prefetch_threads < 1 || cli->prefetch_threads > JCKY_MAX_PREFETCH_THREADS) {
+                if (master) printf(KRED "Error: Unknown option '%s' for prefetch-threads.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--prefetch", 10) == 0) {
+            cli->prefetch = (val == NULL) ? -1 : (int)strtol(val, NULL, 10);
+            if (cli->prefetch < 0) {
+                if (master) printf(KRED "Error: Unknown option '%s' for prefetch.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--reader", 8) == 0) {
+            if (val != NULL && strcmp(val, JCKY_READER_STDIO) == 0) {
+                cli->reader = (unsigned char)JCKY_READER_STDIO_ID;
+            }
+            else if (val != NULL && strcmp(val, JCKY_READER_MMAP) == 0) {
+                cli->reader = (unsigned char)JCKY_READER_MMAP_ID;
+            }
+            else {
+                if (master) printf(KRED "Error: Unknown option '%s' for reader.\n" KNRM, val);
+                err = 1;
+                break;
+            }
+        }
+        else if (strncmp(option, "--threads", 9) == 0) {
+            if (val != NULL && strcmp(val, JCKY_THREADS_AUTO) == 0) {
+                cli->threads = JCKY_THREADS_AUTO_ID;
+            }
+            else {
+                char *end = val;
+                long int tmp_threads = (val == NULL) ? 0 : strtol(val, &end, 10);
+                if (end == val || *end != '\0' || tmp_threads < 1 || tmp_threads > INT_MAX) {
+                    if (master) printf(KRED "Error: Unknown option '%s' for threads.\n" KNRM, val);
+                    err = 1;
+                    break;
+                }
+                cli->threads = (int)tmp_threads;
+            }
+        }
         else if (strncmp(option, "--blocks", 8) == 0) {
             unsigned long tmp_num_blocks = strtoul( strtok(val, " "), NULL, 10);
             if ((tmp_num_blocks < 1) || (tmp_num_blocks > UCHAR_MAX)) {
@@ -288,6 +883,36 @@ unsigned char process_command_line(
         }
 	}
 
+    if (!err && cli->layers_len > 0) {
+        cli->number_of_hidden_layers = cli->layers_len;
+    }
+    else if (!err) {
+        if (cli->number_of_hidden_layers < 1 || cli->number_of_hidden_layers > JCKY_MAX_HIDDEN_LAYERS ||
+            cli->number_of_nodes_in_hidden_layers < 1) {
+            if (master) {
+                printf(KRED "Error: There must be between 1 and %i hidden layers, of at least one node.\n" KNRM,
+                       JCKY_MAX_HIDDEN_LAYERS);
+            }
+            err = 1;
+        }
+        for (i=0; i<cli->number_of_hidden_layers && !err; i++) {
+            cli->hidden_layer_widths[i] = cli->number_of_nodes_in_hidden_layers;
+        }
+    }
+
+    // A single activation function applies to every hidden layer
+    if (!err && cli->activations_len > 1 && cli->activations_len != cli->number_of_hidden_layers) {
+        if (master) {
+            printf(KRED "Error: %i activation functions were given for %i hidden layers.\n" KNRM,
+                   cli->activations_len, cli->number_of_hidden_layers);
+        }
+        err = 1;
+    }
+    for (i=0; i<cli->number_of_hidden_layers && !err; i++) {
+        if (cli->activations_len == 0) cli->hidden_activations[i] = JCKY_ACTIVATION_SIGMOID_ID;
+        else if (cli->activations_len == 1) cli->hidden_activations[i] = cli->hidden_activations[0];
+    }
+
     if (!err) {
         if (master && (cli->memory_layout == JCKY_LOGICAL_LAYOUT_ID) && (cli->num_blocks || cli->block_size)) {
             printf(KYEL "Warning: 'blocks' and 'block-size' parameters have no effect when using logical memory layout.\n" KNRM);
@@ -298,6 +923,33 @@ unsigned char process_command_line(
             }
             err = 1;
         }
+        if (cli->storage != JCKY_STORAGE_NATIVE_ID && jcky_get_backend(cli->backend)->forward_half == NULL) {
+            if (master) {
+                printf(KRED "Error: The '%s' backend can only read native weights.\n" KNRM,
+                       jcky_get_backend(cli->backend)->name);
+            }
+            err = 1;
+        }
+        if (cli->transposed_shadow && (cli->storage != JCKY_STORAGE_NATIVE_ID || cli->backward != JCKY_BACKWARD_SPLIT_ID)) {
+            if (master) {
+                printf(KRED "Error: The transposed shadow needs native storage and the '%s' backward pass.\n" KNRM,
+                       JCKY_BACKWARD_SPLIT);
+            }
+            err = 1;
+        }
+        if (cli->optimizer != JCKY_OPTIMIZER_SGD_ID && cli->backward != JCKY_BACKWARD_SPLIT_ID) {
+            if (master) {
+                printf(KRED "Error: The '%s' and '%s' optimizers need the '%s' backward pass.\n" KNRM,
+                       JCKY_OPTIMIZER_MOMENTUM, JCKY_OPTIMIZER_ADAM, JCKY_BACKWARD_SPLIT);
+            }
+            err = 1;
+        }
+        if (cli->prefetch > 0 && cli->thread_mode != JCKY_THREAD_MODE_KERNELS_ID) {
+            if (master) {
+                printf(KRED "Error: Prefetching needs the '%s' thread mode.\n" KNRM, JCKY_THREAD_MODE_KERNELS);
+            }
+            err = 1;
+        }
         if (cli->action == JCKY_ACTION_RUN && (strlen(cli->training_filename) == 0 || strlen(cli->testing_filename) == 0)) {
             if (master) {
                 printf(KRED "Error: Must provide a training file and a testing file.\n" KNRM);
@@ -346,3 +998,15 @@ struct timespec diff_time(struct timespec start, struct timespec end) {
 
     return temp;
 }
+
+
+struct timespec add_time(struct timespec total, struct timespec time) {
+    total.tv_sec += time.tv_sec;
+    total.tv_nsec += time.tv_nsec;
+    if (total.tv_nsec >= 1000000000) {
+        total.tv_sec++;
+        total.tv_nsec -= 1000000000;
+    }
+
+    return total;
+}
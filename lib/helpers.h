@@ -7,9 +7,29 @@
 
 
 typedef struct jcky_cli {
-    int number_of_hidden_layers, number_of_nodes_in_hidden_layers, batch_size, seed;
+    int number_of_hidden_layers, number_of_nodes_in_hidden_layers, batch_size, seed, threads;
+    // The width of each hidden layer, set from --layers, or from
+    // --hidden-layers and --hidden-nodes otherwise. layers_len is the
+    // number of widths given to --layers, or 0 without it; the list sets
+    // the number of hidden layers once every option has been read, so it
+    // wins over --hidden-layers wherever that appears.
+    int hidden_layer_widths[JCKY_MAX_HIDDEN_LAYERS];
+    int layers_len;
+    // The activation function of each hidden layer, from --activation.
+    // After process_command_line there's one per hidden layer.
+    unsigned char hidden_activations[JCKY_MAX_HIDDEN_LAYERS];
+    int activations_len;
     nn_type learning_rate;
+    // The optimizer (see the optimizers enum) and its momentum
+    unsigned char optimizer;
+    nn_type momentum;
+    // Training stops once the test score reaches this, unless it's 0
+    double target_score;
     unsigned char memory_layout, num_blocks, action, verbose, no_timing, no_save;
+    unsigned char kernels, backend, backward, derivative, sigmoid, storage, inference, report_drift;
+    unsigned char transposed_shadow, batch_layout, thread_mode, input_format, output;
+    unsigned char pages, numa, reader;
+    int prefetch, prefetch_threads;
     unsigned int block_size;
     unsigned short int epochs;
     char training_filename[128], testing_filename[128];
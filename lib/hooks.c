@@ -66,7 +66,8 @@ char write_file() {
     training_data = malloc( training_cnt * sizeof( nn_type* ));
     training_targets = malloc( training_cnt * sizeof( nn_type* ));
     for(i=0; i<training_cnt; i++) {
-        training_data[i] = mnist_training_data[i].data;
+        training_data[i] = (nn_type *)malloc( 28*28 * sizeof( nn_type ) );
+        for(j=0; j<28*28; j++) training_data[i][j] = (nn_type)mnist_training_data[i].data[j];
         training_targets[i] = (nn_type *)malloc( 10 * sizeof( nn_type ) );
         for(j=0; j<10; j++) training_targets[i][j] = (nn_type)((j == mnist_training_data[i].label) ? 1.0 : 0.0);
     }
@@ -74,7 +75,8 @@ char write_file() {
     testing_data = malloc( testing_cnt * sizeof( nn_type* ));
     testing_targets = malloc( testing_cnt * sizeof( nn_type* ));
     for(i=0; i<testing_cnt; i++) {
-        testing_data[i] = mnist_testing_data[i].data;
+        testing_data[i] = (nn_type *)malloc( 28*28 * sizeof( nn_type ) );
+        for(j=0; j<28*28; j++) testing_data[i][j] = (nn_type)mnist_testing_data[i].data[j];
         testing_targets[i] = (nn_type *)malloc( 10 * sizeof( nn_type ) );
         for(j=0; j<10; j++) testing_targets[i][j] = (nn_type)((j == mnist_testing_data[i].label) ? 1.0 : 0.0);
     }
@@ -90,9 +92,11 @@ char write_file() {
     else printf("Success!\n");
 
     for(i=0; i<training_cnt; i++) {
+        free(training_data[i]);
         free(training_targets[i]);
     }
     for(i=0; i<testing_cnt; i++) {
+        free(testing_data[i]);
         free(testing_targets[i]);
     }
     free(training_data);
@@ -119,6 +123,11 @@ char write_file() {
 //              where A and B are the outputs of the first and      //
 //              second inputs, respectively. This is stored as:     //
 //                  [A1, B1, A2, B2, A3, B3]                        //
+//              With --batch-layout batch-major, each input's       //
+//              outputs are contiguous instead:                     //
+//                  [A1, A2, A3, B1, B2, B3]                        //
+//              JCKY_NODE_STRIDE and JCKY_SAMPLE_STRIDE give the    //
+//              distance between outputs and between inputs.        //
 //          nn_type (float or double) - *targets                    //
 //              This is a matrix stored in row-major order. For     //
 //              example, the matrix:                                //
@@ -127,6 +136,8 @@ char write_file() {
 //              would represent the two target outputs A and B,     //
 //              and stored as:                                      //
 //                  [A1, A2, A3, B1, B2, B3]                        //
+//          unsigned char - layout                                  //
+//              The batch layout of 'outputs' (see batch_layouts).  //
 //                                                                  //
 //      You should return a value which represents the 'score' for  //
 //      this testing batch.                                         //
@@ -135,18 +146,21 @@ char write_file() {
 //      returns the count of correctly identified digits. Note that //
 //      this value will be summed across all MPI processes.         //
 // ---------------------------------------------------------------- //
-double get_score(unsigned short int batch_size, int number_of_outputs, nn_type *outputs, nn_type *targets) {
+double get_score(unsigned short int batch_size, int number_of_outputs, nn_type *outputs, nn_type *targets,
+                 unsigned char layout) {
     double score = 0.0;
     unsigned short int i;
     int j;
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+    const int sample_stride = JCKY_SAMPLE_STRIDE(layout, number_of_outputs);
 
     for (i=0; i<batch_size; i++) {
         nn_type max_output_value = 0.0, max_target_value = 0.0;
         int max_output_index = 0, max_target_index = 0;
 
         for (j=0; j<number_of_outputs; j++) {
-            if (outputs[(j*batch_size)+i] > max_output_value) {
-                max_output_value = outputs[(j*batch_size)+i];
+            if (outputs[(j*node_stride)+(i*sample_stride)] > max_output_value) {
+                max_output_value = outputs[(j*node_stride)+(i*sample_stride)];
                 max_output_index = j;
             }
 
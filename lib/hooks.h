@@ -6,7 +6,8 @@
 
 
 char write_file();
-double get_score(unsigned short int batch_size, int number_of_outputs, nn_type *outputs, nn_type *targets);
+double get_score(unsigned short int batch_size, int number_of_outputs, nn_type *outputs, nn_type *targets,
+                 unsigned char layout);
 
 
 #endif
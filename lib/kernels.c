@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "kernels.h"
+
+#ifdef JCKY_X86_KERNELS
+#include <cpuid.h>
+#endif
+
+
+kernels scalar_kernels = {
+    .id = JCKY_KERNELS_SCALAR_ID,
+    .name = JCKY_KERNELS_SCALAR,
+    .gemm_mr = 4,
+    .gemm_nr = 8,
+    .gemm_micro_kernel = gemm_micro_kernel_scalar,
+    .sigmoidify = {sigmoidify_scalar, sigmoidify_poly_scalar, sigmoidify_table_scalar},
+    .activate = JCKY_ACTIVATE_TABLE(scalar),
+    .derive = JCKY_DERIVE_TABLE(scalar),
+    .adjust_bias = adjust_bias_scalar,
+    .add_vectors = add_vectors_scalar,
+    .subtract_vectors = subtract_vectors_scalar,
+    .copy_vectors = copy_vectors_scalar,
+    .dot_int8 = dot_int8_scalar,
+    .momentum_update = momentum_update_scalar,
+    .adam_update = adam_update_scalar
+};
+
+#ifdef JCKY_X86_KERNELS
+// The exact sigmoid is bound by the libm call per element, so the
+// SIMD kernel sets share the scalar exact sigmoidify. Widening int8 to
+// 16 bits across a ZMM register needs AVX-512BW, which the AVX-512
+// check doesn't ask for, so both sets share the AVX2 int8 dot product.
+kernels avx2_kernels = {
+    .id = JCKY_KERNELS_AVX2_ID,
+    .name = JCKY_KERNELS_AVX2,
+    .gemm_mr = 4,
+    .gemm_nr = 2 * JCKY_AVX2_LANES,
+    .gemm_micro_kernel = gemm_micro_kernel_avx2,
+    .sigmoidify = {sigmoidify_scalar, sigmoidify_poly_avx2, sigmoidify_table_avx2},
+    .activate = JCKY_ACTIVATE_TABLE(avx2),
+    .derive = JCKY_DERIVE_TABLE(avx2),
+    .adjust_bias = adjust_bias_avx2,
+    .add_vectors = add_vectors_avx2,
+    .subtract_vectors = subtract_vectors_avx2,
+    .copy_vectors = copy_vectors_avx2,
+    .dot_int8 = dot_int8_avx2,
+    .momentum_update = momentum_update_avx2,
+    .adam_update = adam_update_avx2
+};
+
+kernels avx512_kernels = {
+    .id = JCKY_KERNELS_AVX512_ID,
+    .name = JCKY_KERNELS_AVX512,
+    .gemm_mr = 8,
+    .gemm_nr = JCKY_AVX512_LANES,
+    .gemm_micro_kernel = gemm_micro_kernel_avx512,
+    .sigmoidify = {sigmoidify_scalar, sigmoidify_poly_avx512, sigmoidify_table_avx512},
+    .activate = JCKY_ACTIVATE_TABLE(avx512),
+    .derive = JCKY_DERIVE_TABLE(avx512),
+    .adjust_bias = adjust_bias_avx512,
+    .add_vectors = add_vectors_avx512,
+    .subtract_vectors = subtract_vectors_avx512,
+    .copy_vectors = copy_vectors_avx512,
+    .dot_int8 = dot_int8_avx2,
+    .momentum_update = momentum_update_avx512,
+    .adam_update = adam_update_avx512
+};
+#endif
+
+kernels *jcky_kernels = &scalar_kernels;
+
+
+#ifdef JCKY_X86_KERNELS
+// Reads the XCR0 register, which tells us which register states the
+// operating system saves on a context switch.
+static unsigned long long int read_xcr0() {
+    unsigned int eax, edx;
+    __asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((unsigned long long int)edx << 32) | eax;
+}
+
+
+static unsigned char cpu_supports(const unsigned char id) {
+    unsigned int eax, ebx, ecx, edx;
+    unsigned long long int xcr0;
+
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+
+    // Leaf 1: AVX, FMA, and OSXSAVE (required to call xgetbv)
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) || !(ecx & bit_FMA)) return 0;
+
+    // The OS must save the XMM and YMM registers...
+    xcr0 = read_xcr0();
+    if ((xcr0 & 0x6) != 0x6) return 0;
+
+    // Leaf 7: AVX2 and AVX-512 Foundation
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if (id == JCKY_KERNELS_AVX2_ID) return (ebx & (1 << 5)) != 0;
+
+    // ...and for AVX-512 the opmask and upper ZMM registers too. The
+    // AVX-512 set takes its int8 dot from the AVX2 set, so it needs AVX2
+    // as well.
+    if (id == JCKY_KERNELS_AVX512_ID) {
+        return ((ebx & (1 << 5)) != 0) && ((ebx & (1 << 16)) != 0) && ((xcr0 & 0xE0) == 0xE0);
+    }
+
+    return 0;
+}
+#endif
+
+
+unsigned char jcky_kernels_supported(const unsigned char id) {
+    if (id == JCKY_KERNELS_SCALAR_ID) return 1;
+#ifdef JCKY_X86_KERNELS
+    return cpu_supports(id);
+#else
+    return 0;
+#endif
+}
+
+
+kernels * jcky_get_kernels(const unsigned char id) {
+    switch (id) {
+#ifdef JCKY_X86_KERNELS
+        case JCKY_KERNELS_AVX2_ID:
+            return &avx2_kernels;
+        case JCKY_KERNELS_AVX512_ID:
+            return &avx512_kernels;
+#endif
+        default:
+            return &scalar_kernels;
+    }
+}
+
+
+// Picks the kernels to use. 'auto' takes the widest instruction set the
+// CPU supports. Asking for a specific set the CPU does not support is an
+// error rather than a silent fallback, since the option exists to compare
+// the kernel sets against each other.
+unsigned char jcky_select_kernels(const unsigned char requested, const unsigned char master) {
+    unsigned char id = requested;
+
+    if (requested == JCKY_KERNELS_AUTO_ID) {
+        if (jcky_kernels_supported(JCKY_KERNELS_AVX512_ID)) id = JCKY_KERNELS_AVX512_ID;
+        else if (jcky_kernels_supported(JCKY_KERNELS_AVX2_ID)) id = JCKY_KERNELS_AVX2_ID;
+        else id = JCKY_KERNELS_SCALAR_ID;
+    }
+    else if (!jcky_kernels_supported(requested)) {
+        if (master) {
+            printf(KRED "Error: The '%s' kernels are not supported on this CPU.\n" KNRM,
+                   jcky_get_kernels(requested)->name);
+        }
+        return 1;
+    }
+
+    jcky_kernels = jcky_get_kernels(id);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+
+#include "activation.h"
+#include "constants.h"
+
+
+typedef void (*gemm_micro_kernel_func)(
+    const int kc,
+    const nn_type alpha,
+    const nn_type *a,
+    const nn_type *b,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias,
+    const int mr,
+    const int nr);
+
+// This table holds one implementation of each of the low level kernels
+// used by matrix_helpers.c and gemm.c. One table exists per instruction
+// set, and the best one the CPU supports is picked at startup (see
+// jcky_select_kernels). The GEMM micro-kernel comes with the size of the
+// register tile it computes, which decides how gemm.c packs its operands.
+// There is one sigmoidify per accuracy tier, indexed by the sigmoid_tiers
+// enum (see sigmoid.h). The other activation functions have one kernel
+// each in .activate, and .derive has the derivative of every function,
+// from each derivative source (see activation.h). dot_int8 takes the dot
+// product of one int8 row with 'count' int8 vectors of the same length,
+// stored one after another. The optimizer updates apply the step of a
+// batch to the weights and clear it, in one pass (see momentum_update and
+// adam_update in matrix_helpers.h).
+typedef struct kernels {
+    unsigned char id;
+    char *name;
+    int gemm_mr;
+    int gemm_nr;
+    gemm_micro_kernel_func gemm_micro_kernel;
+    void (*sigmoidify[JCKY_SIGMOID_TIERS])(nn_type *, nn_type *, int, int);
+    void (*activate[JCKY_ACTIVATIONS])(nn_type *, nn_type *, int, int);
+    void (*derive[JCKY_ACTIVATIONS][JCKY_DERIVATIVE_SOURCES])(nn_type *, nn_type *, const long int);
+    void (*adjust_bias)(nn_type *, nn_type *, int, int, nn_type);
+    void (*add_vectors)(nn_type *, nn_type *, const unsigned int);
+    void (*subtract_vectors)(nn_type *, nn_type *, const unsigned long int);
+    void (*copy_vectors)(nn_type *, nn_type *, const unsigned long int);
+    void (*dot_int8)(const signed char *, const signed char *, const int, const int, int *);
+    void (*momentum_update)(nn_type *, nn_type *, nn_type *, const unsigned long int, const nn_type, const nn_type);
+    void (*adam_update)(nn_type *, nn_type *, nn_type *, nn_type *, const unsigned long int,
+                        const nn_type, const nn_type, const nn_type, const nn_type);
+} kernels;
+
+// The kernels currently in use. This points at the scalar kernels until
+// jcky_select_kernels is called.
+extern kernels *jcky_kernels;
+
+unsigned char jcky_kernels_supported(const unsigned char id);
+kernels * jcky_get_kernels(const unsigned char id);
+unsigned char jcky_select_kernels(const unsigned char requested, const unsigned char master);
+
+// Scalar kernels. These build everywhere and are the reference
+// the SIMD kernels are checked against.
+void gemm_micro_kernel_scalar(
+    const int kc, const nn_type alpha, const nn_type *a, const nn_type *b, const nn_type beta,
+    nn_type *c, const int rsc, const int csc, const nn_type *bias, const int mr, const int nr);
+void sigmoidify_scalar(nn_type *activation, nn_type *z_matrix, int rows, int cols);
+void sigmoidify_poly_scalar(nn_type *activation, nn_type *z_matrix, int rows, int cols);
+void sigmoidify_table_scalar(nn_type *activation, nn_type *z_matrix, int rows, int cols);
+JCKY_ACTIVATION_KERNEL_DECLARATIONS(scalar)
+void adjust_bias_scalar(nn_type *bias, nn_type *delta, int dim, int batch_size, nn_type eta);
+void add_vectors_scalar(nn_type *trgt, nn_type *src, const unsigned int len);
+void subtract_vectors_scalar(nn_type *trgt, nn_type *src, const unsigned long int len);
+void copy_vectors_scalar(nn_type *trgt, nn_type *src, const unsigned long int len);
+void momentum_update_scalar(
+    nn_type *weight, nn_type *step, nn_type *velocity, const unsigned long int len,
+    const nn_type momentum, const nn_type eta);
+void adam_update_scalar(
+    nn_type *weight, nn_type *step, nn_type *moment, nn_type *second_moment, const unsigned long int len,
+    const nn_type beta1, const nn_type beta2, const nn_type step_size, const nn_type epsilon);
+void dot_int8_scalar(const signed char *weight, const signed char *vectors, const int len, const int count, int *dest);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JCKY_X86_KERNELS
+
+// Values of nn_type held by one vector register
+#define JCKY_AVX2_LANES (32 / sizeof(nn_type))
+#define JCKY_AVX512_LANES (64 / sizeof(nn_type))
+
+void gemm_micro_kernel_avx2(
+    const int kc, const nn_type alpha, const nn_type *a, const nn_type *b, const nn_type beta,
+    nn_type *c, const int rsc, const int csc, const nn_type *bias, const int mr, const int nr);
+void sigmoidify_poly_avx2(nn_type *activation, nn_type *z_matrix, int rows, int cols);
+void sigmoidify_table_avx2(nn_type *activation, nn_type *z_matrix, int rows, int cols);
+JCKY_ACTIVATION_KERNEL_DECLARATIONS(avx2)
+void adjust_bias_avx2(nn_type *bias, nn_type *delta, int dim, int batch_size, nn_type eta);
+void add_vectors_avx2(nn_type *trgt, nn_type *src, const unsigned int len);
+void subtract_vectors_avx2(nn_type *trgt, nn_type *src, const unsigned long int len);
+void copy_vectors_avx2(nn_type *trgt, nn_type *src, const unsigned long int len);
+void momentum_update_avx2(
+    nn_type *weight, nn_type *step, nn_type *velocity, const unsigned long int len,
+    const nn_type momentum, const nn_type eta);
+void adam_update_avx2(
+    nn_type *weight, nn_type *step, nn_type *moment, nn_type *second_moment, const unsigned long int len,
+    const nn_type beta1, const nn_type beta2, const nn_type step_size, const nn_type epsilon);
+void dot_int8_avx2(const signed char *weight, const signed char *vectors, const int len, const int count, int *dest);
+
+void gemm_micro_kernel_avx512(
+    const int kc, const nn_type alpha, const nn_type *a, const nn_type *b, const nn_type beta,
+    nn_type *c, const int rsc, const int csc, const nn_type *bias, const int mr, const int nr);
+void sigmoidify_poly_avx512(nn_type *activation, nn_type *z_matrix, int rows, int cols);
+void sigmoidify_table_avx512(nn_type *activation, nn_type *z_matrix, int rows, int cols);
+JCKY_ACTIVATION_KERNEL_DECLARATIONS(avx512)
+void adjust_bias_avx512(nn_type *bias, nn_type *delta, int dim, int batch_size, nn_type eta);
+void add_vectors_avx512(nn_type *trgt, nn_type *src, const unsigned int len);
+void subtract_vectors_avx512(nn_type *trgt, nn_type *src, const unsigned long int len);
+void copy_vectors_avx512(nn_type *trgt, nn_type *src, const unsigned long int len);
+void momentum_update_avx512(
+    nn_type *weight, nn_type *step, nn_type *velocity, const unsigned long int len,
+    const nn_type momentum, const nn_type eta);
+void adam_update_avx512(
+    nn_type *weight, nn_type *step, nn_type *moment, nn_type *second_moment, const unsigned long int len,
+    const nn_type beta1, const nn_type beta2, const nn_type step_size, const nn_type epsilon);
+#endif
+
+
+#endif
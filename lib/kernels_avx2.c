@@ -0,0 +1,402 @@
+#include "kernels.h"
+
+#ifdef JCKY_X86_KERNELS
+
+#include <immintrin.h>
+#include <math.h>
+
+#include "gemm.h"
+#include "sigmoid.h"
+
+#define JCKY_AVX2 __attribute__((target("avx2,fma")))
+
+// The kernels below are written once against these wrappers, which map
+// to the _pd or _ps intrinsics depending on nn_type. A vector holds
+// JCKY_AVX2_LANES values.
+#ifdef JCKY_SINGLE_PRECISION
+typedef __m256 vec;
+typedef __m256i vec_index;
+#define vec_load _mm256_loadu_ps
+#define vec_store _mm256_storeu_ps
+#define vec_set1 _mm256_set1_ps
+#define vec_zero _mm256_setzero_ps
+#define vec_broadcast _mm256_broadcast_ss
+#define vec_add _mm256_add_ps
+#define vec_sub _mm256_sub_ps
+#define vec_mul _mm256_mul_ps
+#define vec_div _mm256_div_ps
+#define vec_sqrt _mm256_sqrt_ps
+#define vec_min _mm256_min_ps
+#define vec_max _mm256_max_ps
+#define vec_andnot _mm256_andnot_ps
+#define vec_fmadd _mm256_fmadd_ps
+#define vec_fnmadd _mm256_fnmadd_ps
+#define vec_cmp _mm256_cmp_ps
+#define vec_blendv _mm256_blendv_ps
+#define vec_to_index _mm256_cvttps_epi32
+#define vec_from_index _mm256_cvtepi32_ps
+#define vec_gather(base, index) _mm256_i32gather_ps(base, index, sizeof(nn_type))
+#define vec_exp2_bits(t) _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_castps_si256(t), JCKY_EXP_SHIFT))
+#else
+typedef __m256d vec;
+typedef __m128i vec_index;
+#define vec_load _mm256_loadu_pd
+#define vec_store _mm256_storeu_pd
+#define vec_set1 _mm256_set1_pd
+#define vec_zero _mm256_setzero_pd
+#define vec_broadcast _mm256_broadcast_sd
+#define vec_add _mm256_add_pd
+#define vec_sub _mm256_sub_pd
+#define vec_mul _mm256_mul_pd
+#define vec_div _mm256_div_pd
+#define vec_sqrt _mm256_sqrt_pd
+#define vec_min _mm256_min_pd
+#define vec_max _mm256_max_pd
+#define vec_andnot _mm256_andnot_pd
+#define vec_fmadd _mm256_fmadd_pd
+#define vec_fnmadd _mm256_fnmadd_pd
+#define vec_cmp _mm256_cmp_pd
+#define vec_blendv _mm256_blendv_pd
+#define vec_to_index _mm256_cvttpd_epi32
+#define vec_from_index _mm256_cvtepi32_pd
+#define vec_gather(base, index) _mm256_i32gather_pd(base, index, sizeof(nn_type))
+#define vec_exp2_bits(t) _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(t), JCKY_EXP_SHIFT))
+#endif
+
+#define LANES JCKY_AVX2_LANES
+
+
+// 4 x (2 * LANES) register tile: each row of the tile is held in two
+// accumulators, and each step of k broadcasts one entry of A per row.
+JCKY_AVX2 void gemm_micro_kernel_avx2(
+    const int kc,
+    const nn_type alpha,
+    const nn_type *a,
+    const nn_type *b,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias,
+    const int mr,
+    const int nr)
+{
+    int p;
+    nn_type ab[4 * 2 * LANES];
+    vec a_i, b_0, b_1;
+    vec c_00 = vec_zero(), c_01 = vec_zero();
+    vec c_10 = vec_zero(), c_11 = vec_zero();
+    vec c_20 = vec_zero(), c_21 = vec_zero();
+    vec c_30 = vec_zero(), c_31 = vec_zero();
+
+    for (p=0; p<kc; p++) {
+        b_0 = vec_load(b);
+        b_1 = vec_load(b + LANES);
+
+        a_i = vec_broadcast(a);
+        c_00 = vec_fmadd(a_i, b_0, c_00);
+        c_01 = vec_fmadd(a_i, b_1, c_01);
+        a_i = vec_broadcast(a + 1);
+        c_10 = vec_fmadd(a_i, b_0, c_10);
+        c_11 = vec_fmadd(a_i, b_1, c_11);
+        a_i = vec_broadcast(a + 2);
+        c_20 = vec_fmadd(a_i, b_0, c_20);
+        c_21 = vec_fmadd(a_i, b_1, c_21);
+        a_i = vec_broadcast(a + 3);
+        c_30 = vec_fmadd(a_i, b_0, c_30);
+        c_31 = vec_fmadd(a_i, b_1, c_31);
+
+        a += 4;
+        b += 2 * LANES;
+    }
+
+    vec_store(ab,             c_00);
+    vec_store(ab + LANES,     c_01);
+    vec_store(ab + 2 * LANES, c_10);
+    vec_store(ab + 3 * LANES, c_11);
+    vec_store(ab + 4 * LANES, c_20);
+    vec_store(ab + 5 * LANES, c_21);
+    vec_store(ab + 6 * LANES, c_30);
+    vec_store(ab + 7 * LANES, c_31);
+
+    jcky_gemm_store_tile(ab, 2 * LANES, alpha, beta, c, rsc, csc, bias, mr, nr);
+}
+
+
+JCKY_AVX2 static inline nn_type horizontal_sum(vec v) {
+#ifdef JCKY_SINGLE_PRECISION
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#else
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+    return _mm_cvtsd_f64(sum);
+#endif
+}
+
+
+JCKY_AVX2 void adjust_bias_avx2(
+    nn_type *bias,
+    nn_type *delta,
+    int dim,
+    int batch_size,
+    nn_type eta)
+{
+    int i, j;
+    const nn_type scale = eta / batch_size;
+    nn_type accum;
+    vec vaccum;
+
+    for (i=0; i<dim; i++) {
+        vaccum = vec_zero();
+        for (j=0; j+LANES<=batch_size; j+=LANES) {
+            vaccum = vec_add(vaccum, vec_load(delta + j));
+        }
+        accum = horizontal_sum(vaccum);
+        for (; j<batch_size; j++) {
+            accum += delta[j];
+        }
+        bias[i] -= scale * accum;
+        delta += batch_size;
+    }
+}
+
+
+// See sigmoid.h for the algorithm and its error bound.
+JCKY_AVX2 static inline vec sigmoid_poly_avx2(vec z) {
+    const vec one = vec_set1(1.0);
+    const vec clamp = vec_set1(JCKY_SIGMOID_POLY_CLAMP);
+    const vec magic = vec_set1(JCKY_EXP_MAGIC);
+    vec x, t, n, r, p, scale;
+
+    x = vec_sub(vec_zero(), z);
+    x = vec_min(vec_max(x, vec_sub(vec_zero(), clamp)), clamp);
+    t = vec_fmadd(x, vec_set1(JCKY_LOG2E), magic);
+    n = vec_sub(t, magic);
+    r = vec_fnmadd(n, vec_set1(JCKY_LN2_HI), x);
+    r = vec_fnmadd(n, vec_set1(JCKY_LN2_LO), r);
+
+    p = vec_fmadd(r, vec_set1(1.0/720), vec_set1(1.0/120));
+    p = vec_fmadd(r, p, vec_set1(1.0/24));
+    p = vec_fmadd(r, p, vec_set1(1.0/6));
+    p = vec_fmadd(r, p, vec_set1(1.0/2));
+    p = vec_fmadd(r, p, one);
+    p = vec_fmadd(r, p, one);
+    scale = vec_exp2_bits(t);
+
+    return vec_div(one, vec_fmadd(p, scale, one));
+}
+
+
+JCKY_AVX2 void sigmoidify_poly_avx2(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols)
+{
+    int i, size = rows*cols;
+    for (i=0; i+LANES<=size; i+=LANES) {
+        vec_store(activation + i, sigmoid_poly_avx2(vec_load(z_matrix + i)));
+    }
+    for (; i<size; i++) {
+        activation[i] = sigmoid_poly(z_matrix[i]);
+    }
+}
+
+
+JCKY_AVX2 void sigmoidify_table_avx2(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols)
+{
+    int i, size = rows*cols;
+    const vec one = vec_set1(1.0);
+    const vec sign = vec_set1(-0.0);
+    const vec steps = vec_set1(JCKY_SIGMOID_TABLE_STEPS_PER_UNIT);
+    const vec end = vec_set1(JCKY_SIGMOID_TABLE_RANGE * JCKY_SIGMOID_TABLE_STEPS_PER_UNIT);
+    vec z, u, fraction, low, high, value;
+    vec_index index;
+
+    for (i=0; i+LANES<=size; i+=LANES) {
+        z = vec_load(z_matrix + i);
+        u = vec_min(vec_mul(vec_andnot(sign, z), steps), end);
+        index = vec_to_index(u);
+        fraction = vec_sub(u, vec_from_index(index));
+        low = vec_gather(jcky_sigmoid_table, index);
+        high = vec_gather(jcky_sigmoid_table + 1, index);
+        value = vec_fmadd(fraction, vec_sub(high, low), low);
+        value = vec_blendv(value, vec_sub(one, value), vec_cmp(z, vec_zero(), _CMP_LT_OQ));
+        vec_store(activation + i, value);
+    }
+    for (; i<size; i++) {
+        activation[i] = sigmoid_table(z_matrix[i]);
+    }
+}
+
+
+JCKY_AVX2 void add_vectors_avx2(nn_type *trgt, nn_type *src, const unsigned int len) {
+    unsigned int i;
+    for (i=0; i+LANES<=len; i+=LANES) {
+        vec_store(trgt + i, vec_add(vec_load(trgt + i), vec_load(src + i)));
+    }
+    for (; i<len; i++) {
+        trgt[i] += src[i];
+    }
+}
+
+
+JCKY_AVX2 void subtract_vectors_avx2(nn_type *trgt, nn_type *src, const unsigned long int len) {
+    unsigned long int i;
+    for (i=0; i+LANES<=len; i+=LANES) {
+        vec_store(trgt + i, vec_sub(vec_load(trgt + i), vec_load(src + i)));
+    }
+    for (; i<len; i++) {
+        trgt[i] -= src[i];
+    }
+}
+
+
+JCKY_AVX2 void copy_vectors_avx2(nn_type *trgt, nn_type *src, const unsigned long int len) {
+    unsigned long int i;
+    for (i=0; i+LANES<=len; i+=LANES) {
+        vec_store(trgt + i, vec_load(src + i));
+    }
+    for (; i<len; i++) {
+        trgt[i] = src[i];
+    }
+}
+
+
+JCKY_AVX2 static inline int horizontal_sum_epi32(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+
+// Sign extends 16 int8 values at a time to 16 bits and multiplies them
+// pairwise into 32 bit sums, which can't overflow for any len that fits
+// in an int. Four vectors are taken at a time, so each block of the
+// weight row is loaded and widened once for all four.
+JCKY_AVX2 void dot_int8_avx2(
+    const signed char *weight,
+    const signed char *vectors,
+    const int len,
+    const int count,
+    int *dest)
+{
+    int i, j, p;
+    const signed char *v_0, *v_1, *v_2, *v_3;
+    __m256i w, acc_0, acc_1, acc_2, acc_3;
+
+    for (j=0; j+4<=count; j+=4) {
+        v_0 = vectors + (j * len);
+        v_1 = v_0 + len;
+        v_2 = v_1 + len;
+        v_3 = v_2 + len;
+        acc_0 = acc_1 = acc_2 = acc_3 = _mm256_setzero_si256();
+        for (i=0; i+16<=len; i+=16) {
+            w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(weight + i)));
+            acc_0 = _mm256_add_epi32(acc_0, _mm256_madd_epi16(w, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(v_0 + i)))));
+            acc_1 = _mm256_add_epi32(acc_1, _mm256_madd_epi16(w, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(v_1 + i)))));
+            acc_2 = _mm256_add_epi32(acc_2, _mm256_madd_epi16(w, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(v_2 + i)))));
+            acc_3 = _mm256_add_epi32(acc_3, _mm256_madd_epi16(w, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(v_3 + i)))));
+        }
+        dest[j]     = horizontal_sum_epi32(acc_0);
+        dest[j + 1] = horizontal_sum_epi32(acc_1);
+        dest[j + 2] = horizontal_sum_epi32(acc_2);
+        dest[j + 3] = horizontal_sum_epi32(acc_3);
+        for (p=i; p<len; p++) {
+            dest[j]     += weight[p] * v_0[p];
+            dest[j + 1] += weight[p] * v_1[p];
+            dest[j + 2] += weight[p] * v_2[p];
+            dest[j + 3] += weight[p] * v_3[p];
+        }
+    }
+
+    for (; j<count; j++) {
+        v_0 = vectors + (j * len);
+        acc_0 = _mm256_setzero_si256();
+        for (i=0; i+16<=len; i+=16) {
+            w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(weight + i)));
+            acc_0 = _mm256_add_epi32(acc_0, _mm256_madd_epi16(w, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(v_0 + i)))));
+        }
+        dest[j] = horizontal_sum_epi32(acc_0);
+        for (; i<len; i++) {
+            dest[j] += weight[i] * v_0[i];
+        }
+    }
+}
+
+JCKY_AVX2 void momentum_update_avx2(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *velocity,
+    const unsigned long int len,
+    const nn_type momentum,
+    const nn_type eta)
+{
+    unsigned long int i;
+    const vec vmomentum = vec_set1(momentum);
+    const vec veta = vec_set1(eta);
+    vec v;
+
+    for (i=0; i+LANES<=len; i+=LANES) {
+        v = vec_fmadd(vmomentum, vec_load(velocity + i), vec_mul(veta, vec_load(step + i)));
+        vec_store(velocity + i, v);
+        vec_store(weight + i, vec_add(vec_load(weight + i), v));
+        vec_store(step + i, vec_zero());
+    }
+    for (; i<len; i++) {
+        velocity[i] = (momentum * velocity[i]) + (eta * step[i]);
+        weight[i] += velocity[i];
+        step[i] = 0.0;
+    }
+}
+
+
+JCKY_AVX2 void adam_update_avx2(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *moment,
+    nn_type *second_moment,
+    const unsigned long int len,
+    const nn_type beta1,
+    const nn_type beta2,
+    const nn_type step_size,
+    const nn_type epsilon)
+{
+    unsigned long int i;
+    const vec vbeta1 = vec_set1(beta1);
+    const vec vbeta2 = vec_set1(beta2);
+    const vec vrest1 = vec_set1(1.0 - beta1);
+    const vec vrest2 = vec_set1(1.0 - beta2);
+    const vec vstep_size = vec_set1(step_size);
+    const vec vepsilon = vec_set1(epsilon);
+    vec g, m, v;
+
+    for (i=0; i+LANES<=len; i+=LANES) {
+        g = vec_load(step + i);
+        m = vec_fmadd(vbeta1, vec_load(moment + i), vec_mul(vrest1, g));
+        v = vec_fmadd(vbeta2, vec_load(second_moment + i), vec_mul(vrest2, vec_mul(g, g)));
+        vec_store(moment + i, m);
+        vec_store(second_moment + i, v);
+        vec_store(weight + i, vec_fmadd(vstep_size, vec_div(m, vec_add(vec_sqrt(v), vepsilon)), vec_load(weight + i)));
+        vec_store(step + i, vec_zero());
+    }
+    for (; i<len; i++) {
+        moment[i] = (beta1 * moment[i]) + ((1.0 - beta1) * step[i]);
+        second_moment[i] = (beta2 * second_moment[i]) + ((1.0 - beta2) * step[i] * step[i]);
+        weight[i] += step_size * moment[i] / (sqrt(second_moment[i]) + epsilon);
+        step[i] = 0.0;
+    }
+}
+
+
+JCKY_ACTIVATION_KERNELS(JCKY_AVX2, avx2)
+
+#endif
@@ -0,0 +1,376 @@
+#include "kernels.h"
+
+#ifdef JCKY_X86_KERNELS
+
+#include <immintrin.h>
+
+#include "gemm.h"
+#include "sigmoid.h"
+
+#define JCKY_AVX512 __attribute__((target("avx512f")))
+
+// The kernels below are written once against these wrappers, which map
+// to the _pd or _ps intrinsics depending on nn_type. A vector holds
+// JCKY_AVX512_LANES values, and a mask has one bit per lane.
+#ifdef JCKY_SINGLE_PRECISION
+typedef __m512 vec;
+typedef __m512i vec_index;
+typedef __mmask16 vec_mask;
+#define vec_load _mm512_loadu_ps
+#define vec_store _mm512_storeu_ps
+#define vec_maskz_load _mm512_maskz_loadu_ps
+#define vec_mask_store _mm512_mask_storeu_ps
+#define vec_set1 _mm512_set1_ps
+#define vec_zero _mm512_setzero_ps
+#define vec_add _mm512_add_ps
+#define vec_sub _mm512_sub_ps
+#define vec_mask_sub _mm512_mask_sub_ps
+#define vec_mul _mm512_mul_ps
+#define vec_div _mm512_div_ps
+#define vec_sqrt _mm512_sqrt_ps
+#define vec_min _mm512_min_ps
+#define vec_max _mm512_max_ps
+#define vec_fmadd _mm512_fmadd_ps
+#define vec_fnmadd _mm512_fnmadd_ps
+#define vec_cmp_mask _mm512_cmp_ps_mask
+#define vec_abs(v) _mm512_castsi512_ps(_mm512_and_epi32(_mm512_castps_si512(v), _mm512_set1_epi32(0x7FFFFFFF)))
+#define vec_to_index _mm512_cvttps_epi32
+#define vec_from_index _mm512_cvtepi32_ps
+#define vec_gather(base, index) _mm512_i32gather_ps(index, base, sizeof(nn_type))
+#define vec_exp2_bits(t) _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_castps_si512(t), JCKY_EXP_SHIFT))
+#else
+typedef __m512d vec;
+typedef __m256i vec_index;
+typedef __mmask8 vec_mask;
+#define vec_load _mm512_loadu_pd
+#define vec_store _mm512_storeu_pd
+#define vec_maskz_load _mm512_maskz_loadu_pd
+#define vec_mask_store _mm512_mask_storeu_pd
+#define vec_set1 _mm512_set1_pd
+#define vec_zero _mm512_setzero_pd
+#define vec_add _mm512_add_pd
+#define vec_sub _mm512_sub_pd
+#define vec_mask_sub _mm512_mask_sub_pd
+#define vec_mul _mm512_mul_pd
+#define vec_div _mm512_div_pd
+#define vec_sqrt _mm512_sqrt_pd
+#define vec_min _mm512_min_pd
+#define vec_max _mm512_max_pd
+#define vec_fmadd _mm512_fmadd_pd
+#define vec_fnmadd _mm512_fnmadd_pd
+#define vec_cmp_mask _mm512_cmp_pd_mask
+#define vec_abs(v) _mm512_castsi512_pd(_mm512_and_epi64(_mm512_castpd_si512(v), _mm512_set1_epi64(0x7FFFFFFFFFFFFFFFLL)))
+#define vec_to_index _mm512_cvttpd_epi32
+#define vec_from_index _mm512_cvtepi32_pd
+#define vec_gather(base, index) _mm512_i32gather_pd(index, base, sizeof(nn_type))
+#define vec_exp2_bits(t) _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_castpd_si512(t), JCKY_EXP_SHIFT))
+#endif
+
+#define LANES JCKY_AVX512_LANES
+
+
+// 8 x LANES register tile: each row of the tile is one accumulator, and
+// each step of k broadcasts one entry of A per row.
+JCKY_AVX512 void gemm_micro_kernel_avx512(
+    const int kc,
+    const nn_type alpha,
+    const nn_type *a,
+    const nn_type *b,
+    const nn_type beta,
+    nn_type *c,
+    const int rsc,
+    const int csc,
+    const nn_type *bias,
+    const int mr,
+    const int nr)
+{
+    int p;
+    nn_type ab[8 * LANES];
+    vec b_0;
+    vec c_0 = vec_zero(), c_1 = vec_zero();
+    vec c_2 = vec_zero(), c_3 = vec_zero();
+    vec c_4 = vec_zero(), c_5 = vec_zero();
+    vec c_6 = vec_zero(), c_7 = vec_zero();
+
+    for (p=0; p<kc; p++) {
+        b_0 = vec_load(b);
+
+        c_0 = vec_fmadd(vec_set1(a[0]), b_0, c_0);
+        c_1 = vec_fmadd(vec_set1(a[1]), b_0, c_1);
+        c_2 = vec_fmadd(vec_set1(a[2]), b_0, c_2);
+        c_3 = vec_fmadd(vec_set1(a[3]), b_0, c_3);
+        c_4 = vec_fmadd(vec_set1(a[4]), b_0, c_4);
+        c_5 = vec_fmadd(vec_set1(a[5]), b_0, c_5);
+        c_6 = vec_fmadd(vec_set1(a[6]), b_0, c_6);
+        c_7 = vec_fmadd(vec_set1(a[7]), b_0, c_7);
+
+        a += 8;
+        b += LANES;
+    }
+
+    vec_store(ab,             c_0);
+    vec_store(ab + LANES,     c_1);
+    vec_store(ab + 2 * LANES, c_2);
+    vec_store(ab + 3 * LANES, c_3);
+    vec_store(ab + 4 * LANES, c_4);
+    vec_store(ab + 5 * LANES, c_5);
+    vec_store(ab + 6 * LANES, c_6);
+    vec_store(ab + 7 * LANES, c_7);
+
+    jcky_gemm_store_tile(ab, LANES, alpha, beta, c, rsc, csc, bias, mr, nr);
+}
+
+
+// Mask covering the first 'len' lanes, for loads and stores of a tail
+// shorter than a full vector.
+JCKY_AVX512 static inline vec_mask tail_mask(unsigned long int len) {
+    return (vec_mask)((1 << len) - 1);
+}
+
+
+JCKY_AVX512 static inline nn_type horizontal_sum(vec v) {
+#ifdef JCKY_SINGLE_PRECISION
+    __m256 half = _mm256_add_ps(_mm512_castps512_ps256(v),
+                                _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1)));
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(half), _mm256_extractf128_ps(half, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#else
+    __m256d half = _mm256_add_pd(_mm512_castpd512_pd256(v), _mm512_extractf64x4_pd(v, 1));
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(half), _mm256_extractf128_pd(half, 1));
+    sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+    return _mm_cvtsd_f64(sum);
+#endif
+}
+
+
+JCKY_AVX512 void adjust_bias_avx512(
+    nn_type *bias,
+    nn_type *delta,
+    int dim,
+    int batch_size,
+    nn_type eta)
+{
+    int i, j;
+    const nn_type scale = eta / batch_size;
+    vec vaccum;
+
+    for (i=0; i<dim; i++) {
+        vaccum = vec_zero();
+        for (j=0; j+LANES<=batch_size; j+=LANES) {
+            vaccum = vec_add(vaccum, vec_load(delta + j));
+        }
+        if (j < batch_size) {
+            vaccum = vec_add(vaccum, vec_maskz_load(tail_mask(batch_size - j), delta + j));
+        }
+        bias[i] -= scale * horizontal_sum(vaccum);
+        delta += batch_size;
+    }
+}
+
+
+// See sigmoid.h for the algorithm and its error bound.
+JCKY_AVX512 static inline vec sigmoid_poly_avx512(vec z) {
+    const vec one = vec_set1(1.0);
+    const vec clamp = vec_set1(JCKY_SIGMOID_POLY_CLAMP);
+    const vec magic = vec_set1(JCKY_EXP_MAGIC);
+    vec x, t, n, r, p, scale;
+
+    x = vec_sub(vec_zero(), z);
+    x = vec_min(vec_max(x, vec_sub(vec_zero(), clamp)), clamp);
+    t = vec_fmadd(x, vec_set1(JCKY_LOG2E), magic);
+    n = vec_sub(t, magic);
+    r = vec_fnmadd(n, vec_set1(JCKY_LN2_HI), x);
+    r = vec_fnmadd(n, vec_set1(JCKY_LN2_LO), r);
+
+    p = vec_fmadd(r, vec_set1(1.0/720), vec_set1(1.0/120));
+    p = vec_fmadd(r, p, vec_set1(1.0/24));
+    p = vec_fmadd(r, p, vec_set1(1.0/6));
+    p = vec_fmadd(r, p, vec_set1(1.0/2));
+    p = vec_fmadd(r, p, one);
+    p = vec_fmadd(r, p, one);
+    scale = vec_exp2_bits(t);
+
+    return vec_div(one, vec_fmadd(p, scale, one));
+}
+
+
+JCKY_AVX512 void sigmoidify_poly_avx512(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols)
+{
+    int i, size = rows*cols;
+    vec_mask mask;
+    for (i=0; i+LANES<=size; i+=LANES) {
+        vec_store(activation + i, sigmoid_poly_avx512(vec_load(z_matrix + i)));
+    }
+    if (i < size) {
+        mask = tail_mask(size - i);
+        vec_mask_store(activation + i, mask, sigmoid_poly_avx512(vec_maskz_load(mask, z_matrix + i)));
+    }
+}
+
+
+JCKY_AVX512 static inline vec sigmoid_table_avx512(vec z) {
+    const vec one = vec_set1(1.0);
+    const vec steps = vec_set1(JCKY_SIGMOID_TABLE_STEPS_PER_UNIT);
+    const vec end = vec_set1(JCKY_SIGMOID_TABLE_RANGE * JCKY_SIGMOID_TABLE_STEPS_PER_UNIT);
+    vec u, fraction, low, high, value;
+    vec_index index;
+
+    u = vec_min(vec_mul(vec_abs(z), steps), end);
+    index = vec_to_index(u);
+    fraction = vec_sub(u, vec_from_index(index));
+    low = vec_gather(jcky_sigmoid_table, index);
+    high = vec_gather(jcky_sigmoid_table + 1, index);
+    value = vec_fmadd(fraction, vec_sub(high, low), low);
+
+    return vec_mask_sub(value, vec_cmp_mask(z, vec_zero(), _CMP_LT_OQ), one, value);
+}
+
+
+JCKY_AVX512 void sigmoidify_table_avx512(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols)
+{
+    int i, size = rows*cols;
+    vec_mask mask;
+    for (i=0; i+LANES<=size; i+=LANES) {
+        vec_store(activation + i, sigmoid_table_avx512(vec_load(z_matrix + i)));
+    }
+    if (i < size) {
+        mask = tail_mask(size - i);
+        vec_mask_store(activation + i, mask, sigmoid_table_avx512(vec_maskz_load(mask, z_matrix + i)));
+    }
+}
+
+
+JCKY_AVX512 void add_vectors_avx512(nn_type *trgt, nn_type *src, const unsigned int len) {
+    unsigned int i;
+    vec_mask mask;
+    for (i=0; i+LANES<=len; i+=LANES) {
+        vec_store(trgt + i, vec_add(vec_load(trgt + i), vec_load(src + i)));
+    }
+    if (i < len) {
+        mask = tail_mask(len - i);
+        vec_mask_store(trgt + i, mask, vec_add(vec_maskz_load(mask, trgt + i), vec_maskz_load(mask, src + i)));
+    }
+}
+
+
+JCKY_AVX512 void subtract_vectors_avx512(nn_type *trgt, nn_type *src, const unsigned long int len) {
+    unsigned long int i;
+    vec_mask mask;
+    for (i=0; i+LANES<=len; i+=LANES) {
+        vec_store(trgt + i, vec_sub(vec_load(trgt + i), vec_load(src + i)));
+    }
+    if (i < len) {
+        mask = tail_mask(len - i);
+        vec_mask_store(trgt + i, mask, vec_sub(vec_maskz_load(mask, trgt + i), vec_maskz_load(mask, src + i)));
+    }
+}
+
+
+JCKY_AVX512 void copy_vectors_avx512(nn_type *trgt, nn_type *src, const unsigned long int len) {
+    unsigned long int i;
+    for (i=0; i+LANES<=len; i+=LANES) {
+        vec_store(trgt + i, vec_load(src + i));
+    }
+    if (i < len) {
+        vec_mask_store(trgt + i, tail_mask(len - i), vec_maskz_load(tail_mask(len - i), src + i));
+    }
+}
+
+JCKY_AVX512 static inline void momentum_lanes_avx512(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *velocity,
+    const vec_mask mask,
+    const vec vmomentum,
+    const vec veta)
+{
+    vec v = vec_fmadd(vmomentum, vec_maskz_load(mask, velocity), vec_mul(veta, vec_maskz_load(mask, step)));
+    vec_mask_store(velocity, mask, v);
+    vec_mask_store(weight, mask, vec_add(vec_maskz_load(mask, weight), v));
+    vec_mask_store(step, mask, vec_zero());
+}
+
+
+JCKY_AVX512 void momentum_update_avx512(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *velocity,
+    const unsigned long int len,
+    const nn_type momentum,
+    const nn_type eta)
+{
+    unsigned long int i;
+    const vec vmomentum = vec_set1(momentum);
+    const vec veta = vec_set1(eta);
+
+    for (i=0; i+LANES<=len; i+=LANES) {
+        momentum_lanes_avx512(weight + i, step + i, velocity + i, tail_mask(LANES), vmomentum, veta);
+    }
+    if (i < len) {
+        momentum_lanes_avx512(weight + i, step + i, velocity + i, tail_mask(len - i), vmomentum, veta);
+    }
+}
+
+
+JCKY_AVX512 static inline void adam_lanes_avx512(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *moment,
+    nn_type *second_moment,
+    const vec_mask mask,
+    const nn_type beta1,
+    const nn_type beta2,
+    const vec vstep_size,
+    const vec vepsilon)
+{
+    vec g = vec_maskz_load(mask, step);
+    vec m = vec_fmadd(vec_set1(beta1), vec_maskz_load(mask, moment), vec_mul(vec_set1(1.0 - beta1), g));
+    vec v = vec_fmadd(vec_set1(beta2), vec_maskz_load(mask, second_moment), vec_mul(vec_set1(1.0 - beta2), vec_mul(g, g)));
+
+    vec_mask_store(moment, mask, m);
+    vec_mask_store(second_moment, mask, v);
+    vec_mask_store(weight, mask,
+                   vec_fmadd(vstep_size, vec_div(m, vec_add(vec_sqrt(v), vepsilon)), vec_maskz_load(mask, weight)));
+    vec_mask_store(step, mask, vec_zero());
+}
+
+
+JCKY_AVX512 void adam_update_avx512(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *moment,
+    nn_type *second_moment,
+    const unsigned long int len,
+    const nn_type beta1,
+    const nn_type beta2,
+    const nn_type step_size,
+    const nn_type epsilon)
+{
+    unsigned long int i;
+    const vec vstep_size = vec_set1(step_size);
+    const vec vepsilon = vec_set1(epsilon);
+
+    for (i=0; i+LANES<=len; i+=LANES) {
+        adam_lanes_avx512(weight + i, step + i, moment + i, second_moment + i, tail_mask(LANES),
+                          beta1, beta2, vstep_size, vepsilon);
+    }
+    if (i < len) {
+        adam_lanes_avx512(weight + i, step + i, moment + i, second_moment + i, tail_mask(len - i),
+                          beta1, beta2, vstep_size, vepsilon);
+    }
+}
+
+
+JCKY_ACTIVATION_KERNELS(JCKY_AVX512, avx512)
+
+#endif
@@ -1,18 +1,25 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
 #include "batch.h"
 #include "constants.h"
 #include "file_helpers.h"
 #include "helpers.h"
 #include "hooks.h"
+#include "kernels.h"
 #include "matrix_helpers.h"
 #include "model_helpers.h"
 #include "mpi_helper.h"
 #include "neural_net.h"
+#include "prefetch.h"
+#include "quantize.h"
 #include "randomizing_helpers.h"
+#include "threads.h"
 #include "timing_helpers.h"
+#include "workers.h"
 
 
 int main(int argc, char **argv) {
@@ -23,20 +30,37 @@ int main(int argc, char **argv) {
     jcky_cli cli;
     jcky_file training_file, testing_file;
     struct meta_neural_net neural_net;
+    jcky_quantized_net quantized_net;
+    jcky_workers workers;
+    jcky_prefetch prefetch;
+    jcky_prefetch_slot *slot = NULL;
+    jcky_placement net_placement, batch_placement;
     mpi_manager mpi_manager;
 
     unsigned short int epoch;
     double total_score, local_score = 0;
+    double total_reference_score, local_reference_score = 0;
+    double start_time;
+    unsigned char reached_target = 0;
+    unsigned char sigmoid, storage;
     unsigned short int percent_done, last_percent_done = 0;
 
     unsigned int *sequence;
     nn_type *batch, *result, *targets;
+    nn_type *batch_data, *batch_targets;
     //-----------------------------------------------------
 
     remove(JCKY_TIMING_FILENAME);
     mpi_manager = mpi_init(argc, argv);
 
     err = process_command_line(argc, argv, &cli, mpi_manager.master);
+    if (err == 0) err = jcky_select_kernels(cli.kernels, mpi_manager.master);
+    if (err == 0 && cli.threads == JCKY_THREADS_AUTO_ID) cli.threads = jcky_auto_threads(mpi_manager.node_ranks);
+    if (err == 0) err = jcky_select_threads(cli.threads, cli.thread_mode, mpi_manager.master);
+    if (err == 0) {
+        err = mpi_check_thread_support(&mpi_manager, jcky_threads + ((cli.prefetch > 0) ? cli.prefetch_threads : 0));
+    }
+    if (err == 0) err = jcky_select_memory(cli.pages, cli.numa, mpi_manager.master);
     if (err != 0) goto finalize;
     else if (cli.action == JCKY_ACTION_WRITE) {
         if (mpi_manager.master) write_file();
@@ -51,6 +75,19 @@ int main(int argc, char **argv) {
             jcky_close_file(&training_file);
             goto finalize;
         }
+
+        if (cli.reader == JCKY_READER_MMAP_ID) {
+            err = jcky_map_file(&training_file, cli.training_filename) ||
+                  jcky_map_file(&testing_file, cli.testing_filename);
+            if (err != 0) {
+                jcky_close_file(&training_file);
+                jcky_close_file(&testing_file);
+                goto finalize;
+            }
+            // Every epoch reads the training file in a new shuffled order
+            jcky_advise_file(&training_file, JCKY_ACCESS_RANDOM);
+            jcky_advise_file(&testing_file, JCKY_ACCESS_SEQUENTIAL);
+        }
     }
 
     welcome(&cli, mpi_manager.master);
@@ -79,6 +116,10 @@ int main(int argc, char **argv) {
 
     jcky_sync_neural_net(&neural_net, &mpi_manager, 0);
 
+    if (cli.thread_mode != JCKY_THREAD_MODE_KERNELS_ID) {
+        workers = create_workers(&neural_net, jcky_threads, cli.thread_mode);
+    }
+
     if (mpi_manager.master) {
         printf("\n--------------------------------------\n");
         printf("Configuration:\n");
@@ -86,14 +127,75 @@ int main(int argc, char **argv) {
     	printf("    Hidden Layers:          %i\n", neural_net.number_of_hidden_layers);
     	printf("    Inputs:                 %i\n", neural_net.number_of_inputs);
     	printf("    Outputs:                %i\n", neural_net.number_of_outputs);
-    	printf("    Nodes in Hidden Layers: %i\n", neural_net.number_of_nodes_in_hidden_layers);
+    	printf("    Nodes in Hidden Layers: %i", nn_rows(&neural_net, 0));
+        for (i=1; i<neural_net.number_of_hidden_layers; i++) printf(",%i", nn_rows(&neural_net, i));
+        printf("\n");
+        printf("    Activations:            ");
+        for (i=0; i<neural_net.number_of_hidden_layers; i++) {
+            printf("%s%s", (i > 0) ? "," : "",
+                (neural_net.layer_activation[i] == JCKY_ACTIVATION_RELU_ID) ? JCKY_ACTIVATION_RELU :
+                (neural_net.layer_activation[i] == JCKY_ACTIVATION_LEAKY_RELU_ID) ? JCKY_ACTIVATION_LEAKY_RELU :
+                (neural_net.layer_activation[i] == JCKY_ACTIVATION_TANH_ID) ? JCKY_ACTIVATION_TANH :
+                JCKY_ACTIVATION_SIGMOID);
+        }
+        printf("\n");
     	printf("    Batch Size:             %i\n", neural_net.batch_size);
     	printf("    Learning Rate:          %f\n", neural_net.eta);
+        printf("    Optimizer:              %s",
+            (neural_net.optimizer == JCKY_OPTIMIZER_ADAM_ID) ? JCKY_OPTIMIZER_ADAM :
+            (neural_net.optimizer == JCKY_OPTIMIZER_MOMENTUM_ID) ? JCKY_OPTIMIZER_MOMENTUM : JCKY_OPTIMIZER_SGD);
+        if (neural_net.optimizer == JCKY_OPTIMIZER_MOMENTUM_ID) printf(" (momentum %f)", neural_net.momentum);
+        printf("\n");
         printf("    Initialization Seed:    ");
         if (neural_net.seed != -1) printf("%i\n", neural_net.seed);
         else printf("N/A\n");
         printf("    Initialization File:    %s\n", (neural_net.seed == -1) ? cli.init_model_filename : "N/A");
         printf("    Epochs:                 %i\n", cli.epochs);
+        printf("    Precision:              %s\n", (JCKY_NN_TYPE == JCKY_FLOAT) ? "float" : "double");
+        printf("    Kernels:                %s\n", jcky_kernels->name);
+        printf("    Backend:                %s\n", neural_net.backend->name);
+        printf("    Threads:                %i\n", jcky_threads);
+        printf("    Thread Mode:            %s\n",
+            (cli.thread_mode == JCKY_THREAD_MODE_HOGWILD_ID) ? JCKY_THREAD_MODE_HOGWILD :
+            (cli.thread_mode == JCKY_THREAD_MODE_DATA_ID) ? JCKY_THREAD_MODE_DATA : JCKY_THREAD_MODE_KERNELS);
+        printf("    MPI Ranks:              %i\n", mpi_manager.world_size);
+        printf("    MPI Thread Level:       %s\n", mpi_thread_level_name(mpi_manager.thread_support));
+        printf("    Backward:               %s\n",
+            (neural_net.backward == JCKY_BACKWARD_FUSED_ID) ? JCKY_BACKWARD_FUSED : JCKY_BACKWARD_SPLIT);
+        printf("    Transposed Shadow:      %s\n", neural_net.transposed_shadow ? "yes" : "no");
+        printf("    Batch Layout:           %s\n",
+            (neural_net.batch_layout == JCKY_BATCH_MAJOR_LAYOUT_ID) ? JCKY_BATCH_MAJOR_LAYOUT : JCKY_FEATURE_MAJOR_LAYOUT);
+        printf("    Storage:                %s\n",
+            (neural_net.storage == JCKY_STORAGE_BF16_ID) ? JCKY_STORAGE_BF16 :
+            (neural_net.storage == JCKY_STORAGE_FP16_ID) ? JCKY_STORAGE_FP16 : JCKY_STORAGE_NATIVE);
+        printf("    Inference:              %s\n",
+            (cli.inference == JCKY_INFERENCE_INT8_ID) ? JCKY_INFERENCE_INT8 : JCKY_INFERENCE_NATIVE);
+        printf("    Output:                 %s\n",
+            (neural_net.output == JCKY_OUTPUT_SOFTMAX_ID) ? JCKY_OUTPUT_SOFTMAX : JCKY_OUTPUT_SIGMOID);
+        printf("    Sigmoid:                %s\n",
+            (neural_net.sigmoid == JCKY_SIGMOID_POLY_ID) ? JCKY_SIGMOID_POLY :
+            (neural_net.sigmoid == JCKY_SIGMOID_TABLE_ID) ? JCKY_SIGMOID_TABLE : JCKY_SIGMOID_EXACT);
+        printf("    Pages:                  %s\n",
+            (jcky_pages == JCKY_PAGES_EXPLICIT_ID) ? JCKY_PAGES_EXPLICIT :
+            (jcky_pages == JCKY_PAGES_TRANSPARENT_ID) ? JCKY_PAGES_TRANSPARENT : JCKY_PAGES_DEFAULT);
+        printf("    NUMA:                   %s\n",
+            (jcky_numa == JCKY_NUMA_INTERLEAVE_ID) ? JCKY_NUMA_INTERLEAVE :
+            (jcky_numa == JCKY_NUMA_LOCAL_ID) ? JCKY_NUMA_LOCAL : JCKY_NUMA_DEFAULT);
+        printf("    Reader:                 %s\n",
+            (cli.reader == JCKY_READER_MMAP_ID) ? JCKY_READER_MMAP : JCKY_READER_STDIO);
+        printf("    Prefetch:               ");
+        if (cli.prefetch > 0) {
+            printf("%i batches, %i loader threads\n", cli.prefetch, cli.prefetch_threads);
+        }
+        else printf("no\n");
+        memset(&net_placement, 0, sizeof( jcky_placement ));
+        memset(&batch_placement, 0, sizeof( jcky_placement ));
+        nn_placement(&neural_net, JCKY_NN_BASE, &net_placement, &batch_placement);
+        if (cli.thread_mode != JCKY_THREAD_MODE_KERNELS_ID) {
+            workers_placement(&workers, &net_placement, &batch_placement);
+        }
+        print_placement("Net Memory:", &net_placement);
+        print_placement("Batch Memory:", &batch_placement);
     	printf("--------------------------------------\n\n");
     }
     jcky_waitall(&(mpi_manager.neural_net));
@@ -102,11 +204,15 @@ int main(int argc, char **argv) {
     batch = malloc(neural_net.number_of_inputs * neural_net.batch_size * sizeof(nn_type));
     targets = malloc(neural_net.number_of_outputs * neural_net.batch_size * sizeof(nn_type));
     result = malloc(neural_net.number_of_outputs * neural_net.batch_size * sizeof(nn_type));
-
+    prefetch = create_prefetch(&neural_net, cli.prefetch, cli.prefetch_threads);
+    batch_data = batch;
+    batch_targets = targets;
+    if (cli.inference == JCKY_INFERENCE_INT8_ID) quantized_net = create_quantized_net(&neural_net);
     setbuf(stdout, NULL);
     INIT_TIMERS
+    start_time = MPI_Wtime();
 
-	for (epoch=0; epoch<cli.epochs; epoch++) {
+	for (epoch=0; epoch<cli.epochs && !reached_target; epoch++) {
         GET_TIMER
         START_TIME_EPOCH
 
@@ -126,30 +232,59 @@ int main(int argc, char **argv) {
 
         if (mpi_manager.master) printf("    Training");
 		START_TIME_TRAINING
-		for (i=0; i<training_batches; i++) {
-            START_TIME_TRAINING_BATCH
-			create_batch_with_sequence_file(batch, targets, &training_file, neural_net.batch_size, i, sequence);
-            END_TIME_TRAINING_BATCH
-
+        if (cli.thread_mode != JCKY_THREAD_MODE_KERNELS_ID) {
+            // The workers read their own batches as they go, so the run
+            // includes building them
             START_TIME_TRAINING_RUN
-            feed_forward(&neural_net, result, batch, targets, JCKY_TRAIN, &local_score);
+            train_workers(&neural_net, &workers, &training_file, sequence, training_batches,
+                          cli.verbose && mpi_manager.master);
             END_TIME_TRAINING_RUN
-
-            if (cli.verbose && mpi_manager.master) {
-                percent_done = (unsigned short int)((((i+1)*1.0) / training_batches) * 100);
-                if (percent_done > last_percent_done) {
-                    printf("\r    Training - ");
-                    print_number(percent_done, 3);
-                    printf("%%");
+            END_TIME_WORKER_BATCHES
+        }
+        else {
+            if (prefetch.depth > 0) prefetch_start(&prefetch, &training_file, sequence, training_batches, 0, 0);
+            for (i=0; i<training_batches; i++) {
+                START_TIME_TRAINING_BATCH
+                if (prefetch.depth > 0) {
+                    slot = prefetch_next(&prefetch);
+                    batch_data = slot->batch;
+                    batch_targets = slot->targets;
+                }
+                else {
+                    create_batch_with_sequence_file(batch, targets, &training_file, neural_net.batch_size, i, sequence,
+                                                    &(neural_net.batch_builder), nn_sparse_batch(&neural_net));
+                }
+                END_TIME_TRAINING_BATCH
+
+                START_TIME_TRAINING_RUN
+                feed_forward(&neural_net, result, batch_data, batch_targets, JCKY_TRAIN, &local_score);
+                END_TIME_TRAINING_RUN
+                if (prefetch.depth > 0) prefetch_release(&prefetch, slot);
+
+                if (cli.verbose && mpi_manager.master) {
+                    percent_done = (unsigned short int)((((i+1)*1.0) / training_batches) * 100);
+                    if (percent_done > last_percent_done) {
+                        printf("\r    Training - ");
+                        print_number(percent_done, 3);
+                        printf("%%");
+                    }
                 }
             }
-		}
+        }
         END_TIME_TRAINING
+        END_TIME_TRAINING_PREFETCH
         if (mpi_manager.master) {
             printf("\n");
             last_percent_done = 0;
         }
 
+        // The testing batches don't depend on the weights, so they're
+        // built while the changes are synced
+        if (prefetch.depth > 0) {
+            prefetch_start(&prefetch, &testing_file, NULL, testing_batches, mpi_manager.rank,
+                           mpi_manager.testing_samples.base);
+        }
+
         START_TIME_SYNC
         neural_net.functions->get_change(&neural_net);
         jcky_sync_changes(&neural_net, &mpi_manager);
@@ -165,15 +300,46 @@ int main(int argc, char **argv) {
 
 		START_TIME_TESTING
         if (mpi_manager.master) printf("    Testing");
+        if (cli.inference == JCKY_INFERENCE_INT8_ID) {
+            quantize_neural_net(&neural_net, &(neural_net.nns[JCKY_NN_BASE]), &quantized_net);
+        }
 		for (i=0; i<testing_batches; i++) {
             START_TIME_TESTING_BATCH
-			create_batch_no_sequence_file(batch, targets, &testing_file, neural_net.batch_size, i, mpi_manager.rank, mpi_manager.testing_samples.base);
+            if (prefetch.depth > 0) {
+                slot = prefetch_next(&prefetch);
+                batch_data = slot->batch;
+                batch_targets = slot->targets;
+            }
+            else {
+                create_batch_no_sequence_file(batch, targets, &testing_file, neural_net.batch_size, i,
+                                              mpi_manager.rank, mpi_manager.testing_samples.base,
+                                              &(neural_net.batch_builder), nn_sparse_batch(&neural_net));
+            }
             END_TIME_TESTING_BATCH
 
             START_TIME_TESTING_RUN
-            feed_forward(&neural_net, result, batch, targets, JCKY_TEST, &local_score);
+            if (cli.inference == JCKY_INFERENCE_INT8_ID) {
+                quantized_feed_forward(&neural_net, &quantized_net, result, batch_data, batch_targets, &local_score);
+            }
+            else {
+                feed_forward(&neural_net, result, batch_data, batch_targets, JCKY_TEST, &local_score);
+            }
             END_TIME_TESTING_RUN
 
+            // Score the same batch again with the exact sigmoid and the
+            // native weights, outside of the timers, to measure the drift
+            // of the selected sigmoid tier, storage and inference engine.
+            if (cli.report_drift) {
+                sigmoid = neural_net.sigmoid;
+                storage = neural_net.storage;
+                neural_net.sigmoid = JCKY_SIGMOID_EXACT_ID;
+                neural_net.storage = JCKY_STORAGE_NATIVE_ID;
+                feed_forward(&neural_net, result, batch_data, batch_targets, JCKY_TEST, &local_reference_score);
+                neural_net.sigmoid = sigmoid;
+                neural_net.storage = storage;
+            }
+            if (prefetch.depth > 0) prefetch_release(&prefetch, slot);
+
             if (cli.verbose && mpi_manager.master) {
                 percent_done = (unsigned short int)((((i+1)*1.0) / testing_batches) * 100);
                 if (percent_done > last_percent_done) {
@@ -184,6 +350,7 @@ int main(int argc, char **argv) {
             }
 		}
         END_TIME_TESTING
+        END_TIME_TESTING_PREFETCH
         if (mpi_manager.master) {
             printf("\n");
             last_percent_done = 0;
@@ -193,16 +360,45 @@ int main(int argc, char **argv) {
         if (mpi_manager.master) printf("    Total Score: %f\n", total_score);
 		local_score = 0.0;
 
+        if (cli.report_drift) {
+            MPI_Reduce(&local_reference_score, &total_reference_score, 1, MPI_DOUBLE, MPI_SUM, JCKY_MASTER, MPI_COMM_WORLD);
+            if (mpi_manager.master) {
+                printf("    Reference Score: %f (drift %+f)\n", total_reference_score, total_score - total_reference_score);
+            }
+            local_reference_score = 0.0;
+        }
+
+        // Only the master has the total score, so it decides for every rank
+        if (cli.target_score > 0.0) {
+            reached_target = mpi_manager.master && total_score >= cli.target_score;
+            MPI_Bcast(&reached_target, 1, MPI_UNSIGNED_CHAR, JCKY_MASTER, MPI_COMM_WORLD);
+            if (reached_target && mpi_manager.master) {
+                printf("    Reached the target score of %f after %i epochs, in %f seconds\n",
+                       cli.target_score, epoch + 1, MPI_Wtime() - start_time);
+                if (cli.no_save && epoch != cli.epochs-1) write_model(&neural_net, cli.model_filename);
+            }
+        }
+
         END_TIME_EPOCH
+        END_TIME_LAYERS
+        END_TIME_BACKPROP
+        END_TIME_THREADS
         WRITE_TIME
 	}
 
+    if (cli.target_score > 0.0 && !reached_target && mpi_manager.master) {
+        printf("Did not reach the target score of %f in %i epochs\n", cli.target_score, cli.epochs);
+    }
+
     WRITE_TIMES
 
     free(sequence);
     free(batch);
     free(targets);
     free(result);
+    destroy_prefetch(&prefetch);
+    if (cli.inference == JCKY_INFERENCE_INT8_ID) destroy_quantized_net(&quantized_net);
+    if (cli.thread_mode != JCKY_THREAD_MODE_KERNELS_ID) destroy_workers(&workers);
     FREE_TIMERS
     destroy_mpi_manager(&mpi_manager);
     destroy_meta_nn(&neural_net);
@@ -1,35 +1,83 @@
+#include <math.h>
 #include <stdio.h>
 
+#include "backend.h"
+#include "kernels.h"
 #include "matrix_helpers.h"
 #include "neural_net.h"
+#include "threads.h"
 
 
 inline void calculate_z_matrix(
+    backend *backend,
     nn_type *z_matrix,
     nn_type *weight,
+    jcky_half *weight_half,
+    unsigned char storage,
     nn_type *activation,
     nn_type *bias,
     int weight_rows,
     int weight_cols,
-    int activation_cols)
+    int activation_cols,
+    unsigned char layout)
 {
-    int Act_col, W_row, W_col;
+    if (storage == JCKY_STORAGE_NATIVE_ID) {
+        backend->forward(z_matrix, weight, activation, bias, weight_rows, weight_cols, activation_cols, layout);
+    }
+    else {
+        backend->forward_half(z_matrix, weight_half, storage, activation, bias,
+                              weight_rows, weight_cols, activation_cols, layout);
+    }
+}
 
-    for (Act_col=0; Act_col<activation_cols; Act_col++) {
-        for (W_row=0; W_row<weight_rows; W_row++) {
-            nn_type accum = 0.0;
-            int weight_offset = W_row*weight_cols;
-            for (W_col=0; W_col<weight_cols; W_col++) {
-                accum += weight[weight_offset + W_col] * activation[(W_col * activation_cols) + Act_col];
-            }
-            accum += bias[W_row];
-            z_matrix[(W_row*activation_cols) + Act_col] = accum;
+
+// Large matrices are split into contiguous ranges across the threads.
+// Sigmoid layers go through the sigmoidify kernel of 'tier', the others
+// through their own kernel (see activation.h).
+inline void activate(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols,
+    unsigned char function,
+    unsigned char tier)
+{
+    double start;
+    const long int size = (long int)rows * cols;
+    void (*kernel)(nn_type *, nn_type *, int, int) = (function == JCKY_ACTIVATION_SIGMOID_ID) ?
+        jcky_kernels->sigmoidify[tier] : jcky_kernels->activate[function];
+
+    if (jcky_kernel_threads == 1 || size < JCKY_PARALLEL_MIN_ELEMENTS) {
+        kernel(activation, z_matrix, rows, cols);
+        return;
+    }
+
+    start = jcky_parallel_start();
+    #pragma omp parallel num_threads(jcky_kernel_threads)
+    {
+        long int first, last;
+        jcky_thread_range(size, JCKY_THREAD_RANGE_ALIGN, &first, &last);
+        if (first < last) {
+            kernel(activation + first, z_matrix + first, (int)(last - first), 1);
         }
+        jcky_thread_barrier();
     }
+    jcky_parallel_end(start);
 }
 
 
 inline void sigmoidify(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols,
+    unsigned char tier)
+{
+    activate(activation, z_matrix, rows, cols, JCKY_ACTIVATION_SIGMOID_ID, tier);
+}
+
+
+void sigmoidify_scalar(
     nn_type *activation,
     nn_type *z_matrix,
     int rows,
@@ -45,77 +93,236 @@ inline void sigmoidify(
 inline void delta_output_layer(
     nn_type *delta,
     nn_type *activation,
-    nn_type *z_matrix,
+    nn_type *derivative_source,
+    unsigned char derivative,
     nn_type *target_values,
     int outputs,
-    int batch_size)
+    int batch_size,
+    unsigned char layout)
 {
     int i, j, offset, target, index;
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+    const int sample_stride = JCKY_SAMPLE_STRIDE(layout, outputs);
+
+    if (derivative == JCKY_DERIVATIVE_ACTIVATION_ID) {
+        for (i=0; i<batch_size; i++) {
+            offset = i * outputs;
+            for (j=0; j<outputs; j++) {
+                index = (j*node_stride) + (i*sample_stride);
+                delta[index] = (activation[index] - target_values[offset + j]) *
+                               sigmoidPrimeFromActivation(derivative_source[index]);
+            }
+        }
+    }
+    else {
+        for (i=0; i<batch_size; i++) {
+            offset = i * outputs;
+            for (j=0; j<outputs; j++) {
+                index = (j*node_stride) + (i*sample_stride);
+                delta[index] = (activation[index] - target_values[offset + j]) *
+                               sigmoidPrime(derivative_source[index]);
+            }
+        }
+    }
+}
+
+
+// Each sample's outputs are read three times: for their largest z, for
+// the exponentials and their sum, and to normalize them. Subtracting the
+// largest z keeps every exponential in (0, 1], so none can overflow, and
+// the sum is at least 1. With the cross-entropy cost the delta of the
+// output layer is (activation - target), so it's written in the last
+// sweep, and no derivative of the softmax is ever computed.
+void softmax_output_layer(
+    nn_type *activation,
+    nn_type *z_matrix,
+    nn_type *delta,
+    nn_type *target_values,
+    int outputs,
+    int batch_size,
+    unsigned char layout)
+{
+    int i, j, index;
+    nn_type max, sum, scale;
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+    const int sample_stride = JCKY_SAMPLE_STRIDE(layout, outputs);
 
     for (i=0; i<batch_size; i++) {
-        offset = i * outputs;
+        max = z_matrix[i*sample_stride];
+        for (j=1; j<outputs; j++) {
+            index = (j*node_stride) + (i*sample_stride);
+            if (z_matrix[index] > max) max = z_matrix[index];
+        }
+
+        sum = 0.0;
+        for (j=0; j<outputs; j++) {
+            index = (j*node_stride) + (i*sample_stride);
+            activation[index] = exp(z_matrix[index] - max);
+            sum += activation[index];
+        }
+
+        scale = 1.0 / sum;
         for (j=0; j<outputs; j++) {
-            index = (j*batch_size) + i;
-            delta[index] = (activation[index] - target_values[offset + j]) * sigmoidPrime(z_matrix[index]);
+            index = (j*node_stride) + (i*sample_stride);
+            activation[index] *= scale;
+            if (delta != NULL) delta[index] = activation[index] - target_values[(i*outputs) + j];
         }
     }
 }
 
 
+// The product of the transposed downstream weight matrix and the
+// downstream deltas is done by the backend, reading the 16 bit copy
+// of the weights unless 'storage' is native.
 inline void delta_hidden_layers(
+    backend *backend,
     nn_type *delta,
     nn_type *weight_downstream,
+    nn_type *weight_downstream_transposed,
+    jcky_half *weight_downstream_half,
+    unsigned char storage,
     nn_type *delta_downstream,
-    nn_type *z_matrix,
+    nn_type *derivative_source,
+    unsigned char derivative,
+    unsigned char function,
     int weight_rows,
     int weight_cols,
-    int batch_size)
+    int batch_size,
+    unsigned char layout)
 {
-    int weight_row, weight_col, delta_col;
+    int size = weight_cols*batch_size;
 
-    for (delta_col=0; delta_col<batch_size; delta_col++) {
-        for (weight_col=0; weight_col<weight_cols; weight_col++) {
-            nn_type accum = 0.0;
-            for (weight_row=0; weight_row<weight_rows; weight_row++) {
-                accum += weight_downstream[(weight_cols*weight_row) + weight_col] *
-                         delta_downstream[(weight_row*batch_size) + delta_col];
-            }
-            accum *= sigmoidPrime(z_matrix[(weight_col*batch_size)+delta_col]);
-            delta[(weight_col*batch_size)+delta_col] = accum;
-        }
+    if (weight_downstream_transposed != NULL) {
+        backend->delta_transposed(delta, weight_downstream_transposed, delta_downstream,
+                                  weight_rows, weight_cols, batch_size, layout);
+    }
+    else if (storage == JCKY_STORAGE_NATIVE_ID) {
+        backend->delta(delta, weight_downstream, delta_downstream, weight_rows, weight_cols, batch_size, layout);
     }
+    else {
+        backend->delta_half(delta, weight_downstream_half, storage, delta_downstream,
+                            weight_rows, weight_cols, batch_size, layout);
+    }
+
+    apply_activation_derivative(delta, derivative_source, derivative, function, size);
 }
 
 
+// Backpropagates through one layer with the backend's fused backward
+// pass. Unlike delta_hidden_layers this takes the layer's own weights
+// and delta, and produces the delta of the layer upstream, which is
+// NULL for the first hidden layer.
+inline void backward_layer(
+    backend *backend,
+    nn_type *delta_upstream,
+    nn_type *weight,
+    nn_type *delta,
+    nn_type *activation,
+    nn_type *bias,
+    nn_type *derivative_source,
+    unsigned char derivative,
+    unsigned char function,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout)
+{
+    backend->backward(delta_upstream, weight, delta, activation, bias, weight_rows, weight_cols, batch_size, eta, layout);
+
+    if (delta_upstream != NULL) {
+        apply_activation_derivative(delta_upstream, derivative_source, derivative, function, weight_cols*batch_size);
+    }
+}
+
+
+// delta = delta . f'(z) for the activation function 'function', from
+// whichever source 'derivative' names. Split across the threads like
+// activate.
+inline void apply_activation_derivative(
+    nn_type *delta,
+    nn_type *derivative_source,
+    unsigned char derivative,
+    unsigned char function,
+    int size)
+{
+    double start;
+    void (*kernel)(nn_type *, nn_type *, const long int) = jcky_kernels->derive[function][derivative];
+
+    if (jcky_kernel_threads == 1 || size < JCKY_PARALLEL_MIN_ELEMENTS) {
+        kernel(delta, derivative_source, size);
+        return;
+    }
+
+    start = jcky_parallel_start();
+    #pragma omp parallel num_threads(jcky_kernel_threads)
+    {
+        long int first, last;
+        jcky_thread_range(size, JCKY_THREAD_RANGE_ALIGN, &first, &last);
+        if (first < last) kernel(delta + first, derivative_source + first, last - first);
+        jcky_thread_barrier();
+    }
+    jcky_parallel_end(start);
+}
+
+
+// The rank 'batch size' update of the weights is done by the
+// backend, accumulating straight into the weight matrix.
 inline void adjust_weight(
+    backend *backend,
     nn_type *activation,
     nn_type *weight,
     nn_type *delta,
     int weight_rows,
     int weight_cols,
     int batch_size,
+    nn_type eta,
+    unsigned char layout)
+{
+    backend->update(activation, weight, delta, weight_rows, weight_cols, batch_size, eta, layout);
+}
+
+
+inline void adjust_bias(
+    nn_type *bias,
+    nn_type *delta,
+    int dim,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout)
+{
+    if (layout == JCKY_BATCH_MAJOR_LAYOUT_ID) {
+        adjust_bias_batch_major(bias, delta, dim, batch_size, eta);
+    }
+    else {
+        jcky_kernels->adjust_bias(bias, delta, dim, batch_size, eta);
+    }
+}
+
+
+// In the batch-major layout each sample's deltas are contiguous, so the
+// biases take one sample at a time, which runs along the nodes and
+// vectorizes as is.
+void adjust_bias_batch_major(
+    nn_type *bias,
+    nn_type *delta,
+    int dim,
+    int batch_size,
     nn_type eta)
 {
-    int i, j, k;
-    nn_type accum;
-    double scale = eta / batch_size;
+    int i, j;
+    const nn_type scale = eta / batch_size;
 
-    for (i=0; i<weight_rows; i++) {
-        int offset = i*weight_cols;
-        for (j=0; j<weight_cols; j++) {
-            accum = 0.0;
-            int activation_offset = j*batch_size;
-            int delta_offset = i*batch_size;
-            for(k=0; k<batch_size; k++) {
-                accum += activation[activation_offset + k] * delta[delta_offset + k];
-            }
-            weight[offset + j] -= scale * accum;
+    for (j=0; j<batch_size; j++) {
+        for (i=0; i<dim; i++) {
+            bias[i] -= scale * delta[i];
         }
+        delta += dim;
     }
 }
 
 
-inline void adjust_bias(
+void adjust_bias_scalar(
     nn_type *bias,
     nn_type *delta,
     int dim,
@@ -137,6 +344,109 @@ inline void adjust_bias(
 }
 
 
+// The optimizer updates are split into contiguous ranges across the
+// threads, like the activations.
+inline void momentum_update(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *velocity,
+    const unsigned long int len,
+    const nn_type momentum,
+    const nn_type eta)
+{
+    double start;
+
+    if (jcky_kernel_threads == 1 || len < JCKY_PARALLEL_MIN_ELEMENTS) {
+        jcky_kernels->momentum_update(weight, step, velocity, len, momentum, eta);
+        return;
+    }
+
+    start = jcky_parallel_start();
+    #pragma omp parallel num_threads(jcky_kernel_threads)
+    {
+        long int first, last;
+        jcky_thread_range(len, JCKY_THREAD_RANGE_ALIGN, &first, &last);
+        if (first < last) {
+            jcky_kernels->momentum_update(weight + first, step + first, velocity + first, last - first,
+                                          momentum, eta);
+        }
+        jcky_thread_barrier();
+    }
+    jcky_parallel_end(start);
+}
+
+
+void momentum_update_scalar(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *velocity,
+    const unsigned long int len,
+    const nn_type momentum,
+    const nn_type eta)
+{
+    unsigned long int i;
+    for (i=0; i<len; i++) {
+        velocity[i] = (momentum * velocity[i]) + (eta * step[i]);
+        weight[i] += velocity[i];
+        step[i] = 0.0;
+    }
+}
+
+
+inline void adam_update(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *moment,
+    nn_type *second_moment,
+    const unsigned long int len,
+    const nn_type beta1,
+    const nn_type beta2,
+    const nn_type step_size,
+    const nn_type epsilon)
+{
+    double start;
+
+    if (jcky_kernel_threads == 1 || len < JCKY_PARALLEL_MIN_ELEMENTS) {
+        jcky_kernels->adam_update(weight, step, moment, second_moment, len, beta1, beta2, step_size, epsilon);
+        return;
+    }
+
+    start = jcky_parallel_start();
+    #pragma omp parallel num_threads(jcky_kernel_threads)
+    {
+        long int first, last;
+        jcky_thread_range(len, JCKY_THREAD_RANGE_ALIGN, &first, &last);
+        if (first < last) {
+            jcky_kernels->adam_update(weight + first, step + first, moment + first, second_moment + first,
+                                      last - first, beta1, beta2, step_size, epsilon);
+        }
+        jcky_thread_barrier();
+    }
+    jcky_parallel_end(start);
+}
+
+
+void adam_update_scalar(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *moment,
+    nn_type *second_moment,
+    const unsigned long int len,
+    const nn_type beta1,
+    const nn_type beta2,
+    const nn_type step_size,
+    const nn_type epsilon)
+{
+    unsigned long int i;
+    for (i=0; i<len; i++) {
+        moment[i] = (beta1 * moment[i]) + ((1.0 - beta1) * step[i]);
+        second_moment[i] = (beta2 * second_moment[i]) + ((1.0 - beta2) * step[i] * step[i]);
+        weight[i] += step_size * moment[i] / (sqrt(second_moment[i]) + epsilon);
+        step[i] = 0.0;
+    }
+}
+
+
 inline nn_type sigmoid(nn_type z) {
     return 1.0 / (1.0 + exp(-z));
 }
@@ -148,7 +458,18 @@ inline nn_type sigmoidPrime(nn_type z) {
 }
 
 
+// Same value as sigmoidPrime(z), given a = sigmoid(z).
+inline nn_type sigmoidPrimeFromActivation(nn_type a) {
+    return a * (1.0 - a);
+}
+
+
 inline void add_vectors(nn_type *trgt, nn_type *src, const unsigned int len) {
+    jcky_kernels->add_vectors(trgt, src, len);
+}
+
+
+void add_vectors_scalar(nn_type *trgt, nn_type *src, const unsigned int len) {
     unsigned int i;
     for (i=0; i<len; i++) {
         trgt[i] += src[i];
@@ -157,6 +478,11 @@ inline void add_vectors(nn_type *trgt, nn_type *src, const unsigned int len) {
 
 
 inline void subtract_vectors(nn_type *trgt, nn_type *src, const unsigned long int len) {
+    jcky_kernels->subtract_vectors(trgt, src, len);
+}
+
+
+void subtract_vectors_scalar(nn_type *trgt, nn_type *src, const unsigned long int len) {
     unsigned long int i;
     for (i=0; i<len; i++) {
         trgt[i] -= src[i];
@@ -165,6 +491,31 @@ inline void subtract_vectors(nn_type *trgt, nn_type *src, const unsigned long in
 
 
 inline void copy_vectors(nn_type *trgt, nn_type *src, const unsigned long int len) {
+    jcky_kernels->copy_vectors(trgt, src, len);
+}
+
+
+// trgt = transpose(src), where src is rows x cols. The copy goes a
+// small square block at a time so that the strided side of each block
+// stays within a few cache lines.
+void transpose_matrix(nn_type *trgt, nn_type *src, const int rows, const int cols) {
+    int i, j, block_i, block_j, i_end, j_end;
+
+    for (block_i=0; block_i<rows; block_i+=JCKY_TRANSPOSE_BLOCK) {
+        i_end = (rows - block_i < JCKY_TRANSPOSE_BLOCK) ? rows : block_i + JCKY_TRANSPOSE_BLOCK;
+        for (block_j=0; block_j<cols; block_j+=JCKY_TRANSPOSE_BLOCK) {
+            j_end = (cols - block_j < JCKY_TRANSPOSE_BLOCK) ? cols : block_j + JCKY_TRANSPOSE_BLOCK;
+            for (i=block_i; i<i_end; i++) {
+                for (j=block_j; j<j_end; j++) {
+                    trgt[(j * rows) + i] = src[(i * cols) + j];
+                }
+            }
+        }
+    }
+}
+
+
+void copy_vectors_scalar(nn_type *trgt, nn_type *src, const unsigned long int len) {
     unsigned long int i;
     for (i=0; i<len; i++) {
         trgt[i] = src[i];
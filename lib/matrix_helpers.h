@@ -1,67 +1,188 @@
 #ifndef MATRIXHELPERS_H
 #define MATRIXHELPERS_H
 
+#include "backend.h"
 #include "neural_net.h"
 
 
 // This method multiplies the weight matrix by the
 // preivous layers activation matrix, and adds the
 // bias matrix to the result. The result is the
-// layers so-called 'z_vector'
+// layers so-called 'z_vector'. The matrix products
+// here and in the delta and weight functions are done
+// by the given backend (see backend.h). Unless
+// 'storage' is native, the product reads 'weight_half',
+// the 16 bit copy of 'weight' (see half.h). Weight
+// updates always go to the nn_type weights.
 void calculate_z_matrix(
+    backend *backend,
     nn_type *z_matrix,
     nn_type *weight,
+    jcky_half *weight_half,
+    unsigned char storage,
     nn_type *activation,
     nn_type *bias,
     int weight_rows,
     int weight_cols,
-    int activation_cols);
+    int activation_cols,
+    unsigned char layout);
 
+// Applies the activation function 'function' (see the
+// activations enum) to the z-matrix. 'tier' picks the
+// accuracy of the sigmoid (see the sigmoid_tiers enum and
+// sigmoid.h), and is ignored by the other functions.
+inline void activate(
+    nn_type *activation,
+    nn_type *z_vector,
+    int rows,
+    int cols,
+    unsigned char function,
+    unsigned char tier);
 inline void sigmoidify(
     nn_type *activation,
     nn_type *z_vector,
     int rows,
-    int cols);
+    int cols,
+    unsigned char tier);
 
+// The 'derivative_source' in the delta functions is either
+// the layer's z-matrix or its activation, as told by
+// 'derivative' (see the derivative_sources enum). The
+// output layer is always a sigmoid layer, and 'function'
+// is the activation function of the hidden layer whose
+// delta is being computed.
 inline void delta_output_layer(
     nn_type *delta,
+    nn_type *activation,
+    nn_type *derivative_source,
+    unsigned char derivative,
+    nn_type *target_values,
+    int outputs,
+    int batch_size,
+    unsigned char layout);
+
+// Applies the softmax to the outputs of each sample, and
+// writes the delta of the cross-entropy cost to 'delta'
+// in the same sweep, unless it's NULL. 'activation' may
+// be 'z_matrix'.
+void softmax_output_layer(
     nn_type *activation,
     nn_type *z_matrix,
+    nn_type *delta,
     nn_type *target_values,
     int outputs,
-    int batch_size);
+    int batch_size,
+    unsigned char layout);
 
+// When 'weight_downstream_transposed' isn't NULL the
+// product reads it instead of 'weight_downstream'.
 void delta_hidden_layers(
+    backend *backend,
     nn_type *delta,
     nn_type *weight_downstream,
+    nn_type *weight_downstream_transposed,
+    jcky_half *weight_downstream_half,
+    unsigned char storage,
     nn_type *delta_downstream,
-    nn_type *z_matrix,
+    nn_type *derivative_source,
+    unsigned char derivative,
+    unsigned char function,
     int weight_rows,
     int weight_cols,
-    int batch_size);
+    int batch_size,
+    unsigned char layout);
+
+// With the fused backward pass (see backend.h) the delta
+// of the upstream layer and the update of this layer's
+// weights and biases are done in one sweep over 'weight'.
+// The delta always reads the nn_type weights here.
+void backward_layer(
+    backend *backend,
+    nn_type *delta_upstream,
+    nn_type *weight,
+    nn_type *delta,
+    nn_type *activation,
+    nn_type *bias,
+    nn_type *derivative_source,
+    unsigned char derivative,
+    unsigned char function,
+    int weight_rows,
+    int weight_cols,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout);
+
+inline void apply_activation_derivative(
+    nn_type *delta,
+    nn_type *derivative_source,
+    unsigned char derivative,
+    unsigned char function,
+    int size);
 
 inline void adjust_weight(
+    backend *backend,
     nn_type *activation_initial,
     nn_type *weight,
     nn_type *delta,
     int weight_rows,
     int weight_cols,
     int batch_size,
-    nn_type eta);
+    nn_type eta,
+    unsigned char layout);
 
 inline void adjust_bias(
+    nn_type *bias,
+    nn_type *delta,
+    int dim,
+    int batch_size,
+    nn_type eta,
+    unsigned char layout);
+void adjust_bias_batch_major(
     nn_type *bias,
     nn_type *delta,
     int dim,
     int batch_size,
     nn_type eta);
 
+// One fused pass of an optimizer over an array of weights or biases
+// (see --optimizer). 'step' holds the step plain gradient descent would
+// take, -(mean gradient), and is zeroed for the next batch:
+//    momentum:  velocity = momentum * velocity + eta * step
+//               weight += velocity
+//    adam:      moment = beta1 * moment + (1 - beta1) * step
+//               second_moment = beta2 * second_moment + (1 - beta2) * step^2
+//               weight += step_size * moment / (sqrt(second_moment) + epsilon)
+// Adam's bias correction is folded into 'step_size' and 'epsilon' by the
+// caller.
+inline void momentum_update(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *velocity,
+    const unsigned long int len,
+    const nn_type momentum,
+    const nn_type eta);
+inline void adam_update(
+    nn_type *weight,
+    nn_type *step,
+    nn_type *moment,
+    nn_type *second_moment,
+    const unsigned long int len,
+    const nn_type beta1,
+    const nn_type beta2,
+    const nn_type step_size,
+    const nn_type epsilon);
+
 inline nn_type sigmoid(nn_type z);
 inline nn_type sigmoidPrime(nn_type z);
+inline nn_type sigmoidPrimeFromActivation(nn_type a);
 
 inline void add_vectors(nn_type *trgt, nn_type *src, const unsigned int len);
 inline void subtract_vectors(nn_type *trgt, nn_type *src, const unsigned long int len);
 inline void copy_vectors(nn_type *trgt, nn_type *src, const unsigned long int len);
 
+// Side of the square blocks transpose_matrix copies at a time.
+#define JCKY_TRANSPOSE_BLOCK 8
+void transpose_matrix(nn_type *trgt, nn_type *src, const int rows, const int cols);
+
 
 #endif
@@ -1,15 +1,33 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "constants.h"
+#include "file_helpers.h"
+#include "model_helpers.h"
 #include "neural_net.h"
 
 
+// Writes the layer list that follows the header: the number of layers,
+// inputs and outputs included, then the number of nodes in each.
+static void write_model_layers(struct meta_neural_net *meta, FILE *stream) {
+    const unsigned int layers = meta->number_of_hidden_layers + 2;
+    unsigned int i, width;
+
+    fwrite(&layers, sizeof(unsigned int), 1, stream);
+    for (i=0; i<layers; i++) {
+        width = (unsigned int)meta->layer_width[i];
+        fwrite(&width, sizeof(unsigned int), 1, stream);
+    }
+}
+
+
 void write_model(struct meta_neural_net *meta, char *filename) {
     unsigned int i;
-    unsigned int number_of_matrix_elements;
 
     FILE *stream = fopen(filename, "w+");
     if (stream != NULL) {
+        jcky_write_header(stream, JCKY_MODEL_IDENTIFIER);
+        write_model_layers(meta, stream);
         if (meta->memory_layout == JCKY_CONTIGUOUS_LAYOUT_ID) {
             fwrite(
                 meta->nns[JCKY_NN_BASE].container,
@@ -19,55 +37,14 @@ void write_model(struct meta_neural_net *meta, char *filename) {
             );
         }
         else if (meta->memory_layout == JCKY_LOGICAL_LAYOUT_ID) {
-            // -- Biases ----------------------------------------------------
-            // Hidden layers
-            int tmp_pos = 0;
-            for (i=0; i<meta->number_of_hidden_layers; i++) {
-                fwrite(
-                    meta->nns[JCKY_NN_BASE].bias[i],
-                    sizeof(nn_type),
-                    meta->number_of_nodes_in_hidden_layers,
-                    stream
-                );
+            // The biases of every layer, then the weights of every layer,
+            // as they sit in the contiguous container
+            for (i=0; i<=meta->number_of_hidden_layers; i++) {
+                fwrite(meta->nns[JCKY_NN_BASE].bias[i], sizeof(nn_type), nn_rows(meta, i), stream);
             }
-
-            // Output layer
-            fwrite(
-                meta->nns[JCKY_NN_BASE].bias[meta->number_of_hidden_layers],
-                sizeof(nn_type),
-                meta->number_of_outputs,
-                stream
-            );
-            //--------------------------------------------------------------
-
-            // -- Weights --------------------------------------------------
-            // Input layer to first hidden layer
-            fwrite(
-                meta->nns[JCKY_NN_BASE].weight[0],
-                sizeof(nn_type),
-                meta->number_of_inputs * meta->number_of_nodes_in_hidden_layers,
-                stream
-            );
-
-            // Between hidden layers
-            number_of_matrix_elements = meta->number_of_nodes_in_hidden_layers * meta->number_of_nodes_in_hidden_layers;
-            for (i=1; i<meta->number_of_hidden_layers; i++) {
-                fwrite(
-                    meta->nns[JCKY_NN_BASE].weight[i],
-                    sizeof(nn_type),
-                    number_of_matrix_elements,
-                    stream
-                );
+            for (i=0; i<=meta->number_of_hidden_layers; i++) {
+                fwrite(meta->nns[JCKY_NN_BASE].weight[i], sizeof(nn_type), nn_weight_len(meta, i), stream);
             }
-
-            // Last hidden layer to output layer
-            fwrite(
-                meta->nns[JCKY_NN_BASE].weight[meta->number_of_hidden_layers],
-                sizeof(nn_type),
-                meta->number_of_outputs * meta->number_of_nodes_in_hidden_layers,
-                stream
-            );
-            //--------------------------------------------------------------
         }
         fclose(stream);
     }
@@ -76,56 +53,106 @@ void write_model(struct meta_neural_net *meta, char *filename) {
     }
 }
 
+// Checks the identifier of a model file and reads its layer list into
+// 'model_file', leaving the stream at the first value. Sets the size of
+// the values the file holds, or 0 if it isn't a model file.
+static void read_model_header(FILE *stream, char *filename, jcky_model_file *model_file) {
+    char identifier[4];
+    unsigned char type_byte;
+    unsigned int i, layers, width;
+
+    model_file->datum_size = 0;
+    model_file->layers = 0;
+
+    if (fread(identifier, sizeof(char), 4, stream) == 4 &&
+        strncmp(identifier, JCKY_MODEL_IDENTIFIER, 4) == 0 &&
+        fread(&type_byte, sizeof(unsigned char), 1, stream) == 1 &&
+        fseek(stream, JCKY_HEADER_LEN, SEEK_SET) == 0 &&
+        fread(&layers, sizeof(unsigned int), 1, stream) == 1 &&
+        layers >= 3 && layers <= JCKY_MAX_HIDDEN_LAYERS + 2) {
+        for (i=0; i<layers; i++) {
+            if (fread(&width, sizeof(unsigned int), 1, stream) != 1) break;
+            model_file->layer_width[i] = (int)width;
+        }
+        if (i == layers) {
+            model_file->layers = (int)layers;
+            model_file->datum_size = jcky_datum_size(type_byte);
+        }
+    }
+    if (model_file->datum_size == 0) {
+        printf(KYEL "\nWARNING: %s is not a valid jockey model file. " KNRM, filename);
+    }
+}
+
 char read_model_bulk(struct meta_neural_net *meta, char *filename) {
     char err = 1;
 
-    FILE *stream = fopen(filename, "rb");
-    if (stream != NULL) {
-        fread(
+    jcky_model_file model_file = open_model_file(filename);
+    if (model_file.stream != NULL) {
+        read_model_file(
             meta->nns[JCKY_NN_BASE].container,
-            sizeof(nn_type),
             meta->nns[JCKY_NN_BASE].container_len,
-            stream
+            &model_file
         );
         err = 0;
-        fclose(stream);
-    }
-    else {
-        printf(KYEL "\nWARNING: Unabled to read model file %s\n. " KNRM, filename);
+        fclose(model_file.stream);
     }
 
     return err;
 }
 
-FILE * open_model_file(char *filename) {
-    FILE *stream = fopen(filename, "rb");
-    if (stream == NULL) {
+// Opens a model file for reading, past its header and layer list. The
+// values are converted if the file was written with a different nn_type.
+jcky_model_file open_model_file(char *filename) {
+    jcky_model_file model_file;
+
+    model_file.stream = fopen(filename, "rb");
+    if (model_file.stream == NULL) {
         printf(KYEL "\nWARNING: Unabled to read model file %s\n. " KNRM, filename);
     }
+    else {
+        read_model_header(model_file.stream, filename, &model_file);
+        if (model_file.datum_size == 0) {
+            fclose(model_file.stream);
+            model_file.stream = NULL;
+        }
+    }
 
-    return stream;
+    return model_file;
 }
 
-void read_model_file(nn_type *dest, unsigned long int len, FILE *model_file) {
-    fread(dest, sizeof(nn_type), len, model_file);
+void read_model_file(nn_type *dest, unsigned long int len, jcky_model_file *model_file) {
+    jcky_fread_nn_type(dest, model_file->datum_size, len, model_file->stream);
 }
 
+// Checks that the layers of the model file match the neural net, and
+// that the file holds all of its values.
 char validate_model_file(struct meta_neural_net *meta, char *filename) {
     char err = 1;
+    int i;
+    long int values_start;
     unsigned long int file_length, expected_length;
+    jcky_model_file model_file = open_model_file(filename);
 
-    FILE *stream = fopen(filename, "rb");
-    if (stream != NULL) {
-        fseek(stream, 0, SEEK_END);
-        file_length = (unsigned long int)ftell(stream);
-        expected_length = container_length(meta) * sizeof(nn_type);
+    if (model_file.stream != NULL) {
+        err = (model_file.layers != meta->number_of_hidden_layers + 2);
+        for (i=0; i<model_file.layers && !err; i++) {
+            if (model_file.layer_width[i] != meta->layer_width[i]) err = 1;
+        }
 
-        if (file_length == expected_length) err = 0;
-        else printf(KYEL "\nWARNING: The architecture of the neural network in the %s model "\
-                    "file does not match the current neural network architecture. " KNRM, filename);
-    }
-    else {
-        printf(KYEL "\nWARNGING: Unabled to read model file %s. " KNRM, filename);
+        if (!err) {
+            values_start = ftell(model_file.stream);
+            fseek(model_file.stream, 0, SEEK_END);
+            file_length = (unsigned long int)ftell(model_file.stream);
+            expected_length = values_start + (container_length(meta) * model_file.datum_size);
+            err = (file_length != expected_length);
+        }
+
+        if (err) {
+            printf(KYEL "\nWARNING: The architecture of the neural network in the %s model "\
+                   "file does not match the current neural network architecture. " KNRM, filename);
+        }
+        fclose(model_file.stream);
     }
 
     return err;
@@ -1,13 +1,28 @@
 #ifndef MODELHELPERS_H
 #define MODELHELPERS_H
 
+#include <stdio.h>
+
 #include "neural_net.h"
 
 
+// Model files start with the header described in file_helpers.h,
+// which records the type the values were written with. Then comes the
+// layer list: an unsigned int with the number of layers (the inputs and
+// outputs included), and an unsigned int with the number of nodes in
+// each, from the inputs to the outputs. Then the values, as they sit in
+// the contiguous container.
+typedef struct jcky_model_file {
+    FILE *stream;
+    unsigned char datum_size;
+    int layers;
+    int layer_width[JCKY_MAX_HIDDEN_LAYERS + 2];
+} jcky_model_file;
+
 void write_model(struct meta_neural_net *meta, char *filename);
 char read_model_bulk(struct meta_neural_net *meta, char *filename);
-FILE * open_model_file(char *filename);
-void read_model_file(nn_type *dest, unsigned long int len, FILE *model_file);
+jcky_model_file open_model_file(char *filename);
+void read_model_file(nn_type *dest, unsigned long int len, jcky_model_file *model_file);
 char validate_model_file(struct meta_neural_net *meta, char *filename);
 
 
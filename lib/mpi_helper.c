@@ -5,6 +5,7 @@
 #include "constants.h"
 #include "helpers.h"
 #include "mpi_helper.h"
+#include "threads.h"
 
 
 void (*JCKY_SEND_NN_ASYNC_FUNCS[2])(struct meta_neural_net *, neural_net *, int, mpi_manager *) = {
@@ -22,10 +23,12 @@ void (*JCKY_RECV_NN_ASYNC_FUNCS[2])(struct meta_neural_net *, neural_net *, int,
 // TODO: this should handle errors
 mpi_manager mpi_init(int argc, char **argv) {
     mpi_manager manager;
-    int name_len, world_size, rank, thread_support;
+    int name_len, world_size, rank, thread_support, node_ranks;
+    MPI_Comm node_comm;
 
     // Initialize MPI
-    MPI_Init_thread(&argc, &argv, MPI_THREAD_SINGLE, &thread_support);
+    MPI_Init_thread(&argc, &argv, JCKY_MPI_THREAD_LEVEL, &thread_support);
+    manager.thread_support = thread_support;
 
     // Get the number of processes
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
@@ -37,6 +40,13 @@ mpi_manager mpi_init(int argc, char **argv) {
     manager.master = !rank;
     manager.child_procs = manager.world_size - 1;
 
+    // Count the ranks that share this node, which split its cores
+    // between them with --threads auto
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_size(node_comm, &node_ranks);
+    MPI_Comm_free(&node_comm);
+    manager.node_ranks = (unsigned short int)node_ranks;
+
     // Get the name of the processor
     MPI_Get_processor_name(manager.processor_name, &name_len);
 
@@ -47,9 +57,35 @@ mpi_manager mpi_init(int argc, char **argv) {
 void mpi_announce(jcky_cli *cli, mpi_manager *manager) {
     if (cli->verbose) {
         MPI_Barrier(MPI_COMM_WORLD);
-        printf("Reporting from processor %s, rank %u of %u\n",
-            manager->processor_name, manager->rank, manager->world_size);
+        printf("Reporting from processor %s, rank %u of %u, running %i threads\n",
+            manager->processor_name, manager->rank, manager->world_size, jcky_threads);
+    }
+}
+
+
+// Running more than one thread in a rank needs at least the threading
+// level jockey asks MPI for. Libraries that only provide
+// MPI_THREAD_SINGLE don't allow any other threads in the process.
+// 'threads' counts every thread of the rank, the prefetch loaders
+// included, although only the rank's own thread calls MPI.
+unsigned char mpi_check_thread_support(mpi_manager *manager, const int threads) {
+    if (threads > 1 && manager->thread_support < JCKY_MPI_THREAD_LEVEL) {
+        if (manager->master) {
+            printf(KRED "Error: The MPI library only provides '%s' threading, "
+                   "so each rank can only run one thread (no --threads above 1 or --prefetch).\n" KNRM,
+                   mpi_thread_level_name(manager->thread_support));
+        }
+        return 1;
     }
+    return 0;
+}
+
+
+const char * mpi_thread_level_name(const int level) {
+    if (level == MPI_THREAD_SINGLE) return "single";
+    else if (level == MPI_THREAD_FUNNELED) return "funneled";
+    else if (level == MPI_THREAD_SERIALIZED) return "serialized";
+    else return "multiple";
 }
 
 
@@ -209,6 +245,7 @@ void jcky_sync_neural_net(struct meta_neural_net *meta, mpi_manager *manager, co
     }
     else {
         manager->recv_nn_async_func(meta, &(meta->nns[JCKY_NN_BASE]), 0, manager);
+        nn_mark_stale(&(meta->nns[JCKY_NN_BASE]));
     }
 
     if (waitall) {
@@ -223,6 +260,11 @@ void jcky_sync_changes(struct meta_neural_net *meta, mpi_manager *manager) {
     unsigned short int i;
     const unsigned short int child_procs = manager->child_procs;
 
+    if (meta->storage != JCKY_STORAGE_NATIVE_ID) {
+        jcky_sync_changes_half(meta, manager);
+        return;
+    }
+
     if (manager->master) {
         for (i=0; i<child_procs; i++) {
             manager->recv_nn_async_func(meta, &(meta->cms[i]), i+1, manager);
@@ -235,6 +277,44 @@ void jcky_sync_changes(struct meta_neural_net *meta, mpi_manager *manager) {
 }
 
 
+// With 16 bit storage the changes are sent in the 16 bit copy of each
+// neural net, which halves (or quarters) the bytes on the wire. The
+// changes are converted on the way out, and widened again by the master
+// before they're applied. Each child sends one message.
+// TODO:
+//  - handle errors
+void jcky_sync_changes_half(struct meta_neural_net *meta, mpi_manager *manager) {
+    unsigned short int i;
+    const unsigned short int child_procs = manager->child_procs;
+    unsigned short int *request_num = &(manager->neural_net.request_num);
+    MPI_Request *request = manager->neural_net.request;
+    neural_net *scratch = &(meta->nns[JCKY_NN_SCRATCH]);
+    const int len = (int)scratch->container_len;
+
+    if (manager->master) {
+        for (i=0; i<child_procs; i++) {
+            MPI_Irecv(meta->cms[i].half_container, len, MPI_UNSIGNED_SHORT, i+1, 1, MPI_COMM_WORLD, request + (*request_num)++);
+        }
+    }
+    else {
+        nn_to_half(meta, scratch, 1);
+        scratch->half_stale = 1;
+        MPI_Isend(scratch->half_container, len, MPI_UNSIGNED_SHORT, JCKY_MASTER, 1, MPI_COMM_WORLD, request + (*request_num)++);
+    }
+
+    // This posts fewer requests than the request manager holds, so only
+    // wait on the ones posted.
+    MPI_Waitall(*request_num, request, manager->neural_net.status);
+    *request_num = 0;
+
+    if (manager->master) {
+        for (i=0; i<child_procs; i++) {
+            nn_from_half(meta, &(meta->cms[i]));
+        }
+    }
+}
+
+
 void jcky_send_nn_async_contiguous(struct meta_neural_net *meta, neural_net *nn, int dest, mpi_manager *manager) {
     unsigned short int *request_num = &(manager->neural_net.request_num);
     MPI_Request *request = manager->neural_net.request;
@@ -244,10 +324,10 @@ void jcky_send_nn_async_contiguous(struct meta_neural_net *meta, neural_net *nn,
     nn_type *container = nn->container;
 
     for(i=0; i<requests; i++) {
-        MPI_Isend(container, elements_per_request, MPI_DOUBLE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
+        MPI_Isend(container, elements_per_request, JCKY_MPI_NN_TYPE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
         container += elements_per_request;
     }
-    MPI_Isend(container, manager->elements_in_last_request, MPI_DOUBLE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
+    MPI_Isend(container, manager->elements_in_last_request, JCKY_MPI_NN_TYPE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
 }
 
 
@@ -260,10 +340,10 @@ void jcky_recv_nn_async_contiguous(struct meta_neural_net *meta, neural_net *nn,
     nn_type *container = nn->container;
 
     for(i=0; i<requests; i++) {
-        MPI_Irecv(container, elements_per_request, MPI_DOUBLE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
+        MPI_Irecv(container, elements_per_request, JCKY_MPI_NN_TYPE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
         container += elements_per_request;
     }
-    MPI_Irecv(container, manager->elements_in_last_request, MPI_DOUBLE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
+    MPI_Irecv(container, manager->elements_in_last_request, JCKY_MPI_NN_TYPE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
 }
 
 
@@ -274,40 +354,15 @@ void jcky_send_nn_async_logical(struct meta_neural_net *meta, neural_net *nn, in
     unsigned short int *request_num = &((*manager).neural_net.request_num);
     MPI_Request *request = (*manager).neural_net.request;
     const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
-    const unsigned int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const unsigned int number_of_inputs = meta->number_of_inputs;
-    const unsigned int number_of_outputs = meta->number_of_outputs;
-    unsigned int number_of_matrix_elements = number_of_inputs * number_of_nodes_in_hidden_layers;
     unsigned int i;
 
-    //---------------------------------------------------------------------------
-    // Send each bias vector
-    //
-    // Each hidden layer
-    for (i=0; i<number_of_hidden_layers; i++) {
-        MPI_Isend(nn->bias[i], number_of_nodes_in_hidden_layers, MPI_DOUBLE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
+    // Send each bias vector, then each weight matrix
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        MPI_Isend(nn->bias[i], nn_rows(meta, i), JCKY_MPI_NN_TYPE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
     }
-
-    // Output layer
-    MPI_Isend(nn->bias[number_of_hidden_layers], number_of_outputs, MPI_DOUBLE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
-    //---------------------------------------------------------------------------
-
-    //---------------------------------------------------------------------------
-    // Send each weight vectors
-    //
-    // Input layer to first hidden layer
-    MPI_Isend(nn->weight[0], number_of_matrix_elements, MPI_DOUBLE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
-
-    // Between hidden layers
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=1; i<number_of_hidden_layers; i++) {
-        MPI_Isend(nn->weight[i], number_of_matrix_elements, MPI_DOUBLE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        MPI_Isend(nn->weight[i], nn_weight_len(meta, i), JCKY_MPI_NN_TYPE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
     }
-
-    // Last hidden layer to output layer
-    number_of_matrix_elements = number_of_outputs * number_of_nodes_in_hidden_layers;
-    MPI_Isend(nn->weight[number_of_hidden_layers], number_of_matrix_elements, MPI_DOUBLE, dest, 1, MPI_COMM_WORLD, request + (*request_num)++);
-    //---------------------------------------------------------------------------
 }
 
 
@@ -318,40 +373,15 @@ void jcky_recv_nn_async_logical(struct meta_neural_net *meta, neural_net *nn, in
     unsigned short int *request_num = &((*manager).neural_net.request_num);
     MPI_Request *request = (*manager).neural_net.request;
     const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
-    const unsigned int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const unsigned int number_of_inputs = meta->number_of_inputs;
-    const unsigned int number_of_outputs = meta->number_of_outputs;
-    unsigned int number_of_matrix_elements = number_of_inputs * number_of_nodes_in_hidden_layers;
     unsigned int i;
 
-    //---------------------------------------------------------------------------
-    // Send each bias vector
-    //
-    // Each hidden layer
-    for (i=0; i<number_of_hidden_layers; i++) {
-        MPI_Irecv(nn->bias[i], number_of_nodes_in_hidden_layers, MPI_DOUBLE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
+    // Receive each bias vector, then each weight matrix
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        MPI_Irecv(nn->bias[i], nn_rows(meta, i), JCKY_MPI_NN_TYPE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
     }
-
-    // Output layer
-    MPI_Irecv(nn->bias[number_of_hidden_layers], number_of_outputs, MPI_DOUBLE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
-    //---------------------------------------------------------------------------
-
-    //---------------------------------------------------------------------------
-    // Send each weight vectors
-    //
-    // Input layer to first hidden layer
-    MPI_Irecv(nn->weight[0], number_of_matrix_elements, MPI_DOUBLE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
-
-    // Between hidden layers
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=1; i<number_of_hidden_layers; i++) {
-        MPI_Irecv(nn->weight[i], number_of_matrix_elements, MPI_DOUBLE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        MPI_Irecv(nn->weight[i], nn_weight_len(meta, i), JCKY_MPI_NN_TYPE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
     }
-
-    // Last hidden layer to output layer
-    number_of_matrix_elements = number_of_outputs * number_of_nodes_in_hidden_layers;
-    MPI_Irecv(nn->weight[number_of_hidden_layers], number_of_matrix_elements, MPI_DOUBLE, source, 1, MPI_COMM_WORLD, request + (*request_num)++);
-    //---------------------------------------------------------------------------
 }
 
 
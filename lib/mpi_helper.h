@@ -10,6 +10,12 @@
 #define TRAINING_DATA 0
 #define TESTING_DATA 1
 
+// Every MPI call is made by the thread that initialized MPI. The threads
+// started for --threads only compute (see threads.h), which is all that
+// MPI_THREAD_FUNNELED allows, and it spares the library the locking it
+// may need for MPI_THREAD_MULTIPLE.
+#define JCKY_MPI_THREAD_LEVEL MPI_THREAD_FUNNELED
+
 
 typedef struct request_manager {
     unsigned short int number_of_requests;
@@ -33,6 +39,8 @@ typedef struct mpi_manager {
     unsigned short int rank;
     unsigned char master;
     unsigned short int child_procs;
+    unsigned short int node_ranks;   // ranks sharing this rank's node
+    int thread_support;              // threading level the MPI library provides
     int elements_per_request;
     int elements_in_last_request;
     unsigned short int requests_per_transaction;
@@ -48,6 +56,8 @@ typedef struct mpi_manager {
 
 mpi_manager mpi_init(int argc, char **argv);
 void mpi_announce(jcky_cli *cli, mpi_manager *manager);
+unsigned char mpi_check_thread_support(mpi_manager *manager, const int threads);
+const char * mpi_thread_level_name(const int level);
 void update_mpi_manager(struct meta_neural_net *nn, mpi_manager *manager,
                         unsigned int training_samples, unsigned int testing_samples,
                         jcky_cli *cli, unsigned char *err);
@@ -63,6 +73,7 @@ void jcky_waitall(request_manager *request_manager);
 
 void jcky_sync_neural_net(struct meta_neural_net *meta, mpi_manager *manager, const char waitall);
 void jcky_sync_changes(struct meta_neural_net *meta, mpi_manager *manager);
+void jcky_sync_changes_half(struct meta_neural_net *meta, mpi_manager *manager);
 void jcky_send_nn_async_contiguous(struct meta_neural_net *meta, neural_net *nn, int dest, mpi_manager *manager);
 void jcky_recv_nn_async_contiguous(struct meta_neural_net *meta, neural_net *nn, int source, mpi_manager *manager);
 void jcky_send_nn_async_logical(struct meta_neural_net *meta, neural_net *nn, int dest, mpi_manager *manager);
@@ -1,14 +1,18 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "backend.h"
 #include "constants.h"
+#include "gemm.h"
 #include "hooks.h"
 #include "matrix_helpers.h"
 #include "model_helpers.h"
 #include "mpi_helper.h"
 #include "neural_net.h"
 #include "randomizing_helpers.h"
+#include "sigmoid.h"
 
 
 functions contiguous_functions = {
@@ -38,6 +42,7 @@ struct meta_neural_net create_neural_net(
     int number_of_inputs,
     int number_of_outputs)
 {
+    int i;
     struct meta_neural_net nn;
     struct functions *NN_FUNCTIONS[2] = {
         &contiguous_functions,
@@ -45,161 +50,314 @@ struct meta_neural_net create_neural_net(
     };
 
     nn.number_of_hidden_layers = cli->number_of_hidden_layers;
-    nn.number_of_nodes_in_hidden_layers = cli->number_of_nodes_in_hidden_layers;
     nn.number_of_inputs = number_of_inputs;
     nn.number_of_outputs = number_of_outputs;
+    nn.layer_width[0] = number_of_inputs;
+    for (i=0; i<cli->number_of_hidden_layers; i++) {
+        nn.layer_width[i+1] = cli->hidden_layer_widths[i];
+        nn.layer_activation[i] = cli->hidden_activations[i];
+    }
+    nn.layer_width[cli->number_of_hidden_layers+1] = number_of_outputs;
+    nn.layer_activation[cli->number_of_hidden_layers] = JCKY_ACTIVATION_SIGMOID_ID;
+    nn.output = cli->output;
     nn.batch_size = cli->batch_size;
     nn.eta = cli->learning_rate;
+    nn.optimizer = cli->optimizer;
+    nn.momentum = cli->momentum;
     nn.cms_len = 0;
     nn.memory_layout = cli->memory_layout;
+    nn.derivative = cli->derivative;
+    nn.sigmoid = cli->sigmoid;
+    nn.storage = cli->storage;
+    nn.backward = cli->backward;
+    nn.transposed_shadow = cli->transposed_shadow;
+    nn.batch_layout = cli->batch_layout;
+    nn.input_format = cli->input_format;
+    nn.backend = jcky_get_backend(cli->backend);
     nn.num_blocks = cli->num_blocks;
     nn.block_size = cli->block_size;
     nn.functions = NN_FUNCTIONS[cli->memory_layout];
     nn.seed = -1;
 
+    init_sigmoid_table();
     meta_nn_alloc(&nn);
 
     return nn;
 }
 
 
+int nn_widest_layer(const struct meta_neural_net *meta) {
+    int i, widest = 0;
+
+    for (i=0; i<=meta->number_of_hidden_layers+1; i++) {
+        if (meta->layer_width[i] > widest) widest = meta->layer_width[i];
+    }
+
+    return widest;
+}
+
+
 // This allocates space in memory for the neural net
 void meta_nn_alloc(struct meta_neural_net *meta) {
+    meta_nn_alloc_batch(meta);
+    nn_alloc_optimizer(meta);
+
+    meta->functions->alloc(meta, &(meta->nns[JCKY_NN_BASE]));
+    meta->functions->alloc(meta, &(meta->nns[JCKY_NN_SCRATCH]));
+}
+
+
+// This allocates the matrices a batch is pushed through, the batch builder
+// and the timers from one arena sized for all of them
+void meta_nn_alloc_batch(struct meta_neural_net *meta) {
     int i;
     const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
-    const unsigned int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const unsigned int number_of_inputs = meta->number_of_inputs;
-    const unsigned int number_of_outputs = meta->number_of_outputs;
     const unsigned int batch_size = meta->batch_size;
-    unsigned int number_of_matrix_elements = number_of_inputs * number_of_nodes_in_hidden_layers;
+    const size_t pointers_size = jcky_arena_slice_size( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+    const int matrices = (meta->derivative == JCKY_DERIVATIVE_Z_ID) ? 3 : 2;
+    size_t arena_size;
+    unsigned long int len;
+
+    arena_size = (3 * pointers_size) + jcky_arena_slice_size( (number_of_hidden_layers+1) * sizeof( jcky_layer_timer ) ) +
+                 batch_builder_size(meta->number_of_inputs, meta->batch_layout);
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        len = (unsigned long int)nn_rows(meta, i) * batch_size;
+        arena_size += matrices * jcky_arena_slice_size( len * sizeof( nn_type ) );
+    }
+    meta->batch_arena = create_arena(arena_size);
 
     //---------------------------------------------------------------------------
-    // allocate space for bias, z_vector, activation and delta arrays
-    meta->z_matrix = malloc( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
-    meta->activation = malloc( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
-    meta->delta = malloc( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
-
-    // hidden layers
-    for (i=0; i<number_of_hidden_layers; i++) {
-        meta->delta[i] = (nn_type *)malloc( number_of_nodes_in_hidden_layers * batch_size * sizeof( nn_type ) );
-        meta->z_matrix[i] = (nn_type *)malloc( number_of_nodes_in_hidden_layers * batch_size * sizeof( nn_type ) );
-        meta->activation[i] = (nn_type *)malloc( number_of_nodes_in_hidden_layers * batch_size * sizeof( nn_type ) );
-    }
-
-    // output layer
-    meta->delta[number_of_hidden_layers] = (nn_type *)malloc( number_of_outputs * batch_size * sizeof( nn_type ) );
-    meta->z_matrix[number_of_hidden_layers] = (nn_type *)malloc( number_of_outputs * batch_size * sizeof( nn_type ) );
-    meta->activation[number_of_hidden_layers] = (nn_type *)malloc( number_of_outputs * batch_size * sizeof( nn_type ) );
+    // allocate space for z_vector, activation and delta arrays, one per
+    // hidden layer and one for the output layer
+    meta->z_matrix = arena_alloc(&(meta->batch_arena), (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+    meta->activation = arena_alloc(&(meta->batch_arena), (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+    meta->delta = arena_alloc(&(meta->batch_arena), (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        len = (unsigned long int)nn_rows(meta, i) * batch_size;
+        meta->delta[i] = (nn_type *)arena_alloc(&(meta->batch_arena), len * sizeof( nn_type ) );
+        meta->activation[i] = (nn_type *)arena_alloc(&(meta->batch_arena), len * sizeof( nn_type ) );
+
+        // z-matrices are only stored when the derivative is taken from them
+        meta->z_matrix[i] = (meta->derivative == JCKY_DERIVATIVE_Z_ID) ?
+            (nn_type *)arena_alloc(&(meta->batch_arena), len * sizeof( nn_type ) ) :
+            meta->activation[i];
+    }
     //---------------------------------------------------------------------------
 
-    meta->functions->alloc(meta, &(meta->nns[JCKY_NN_BASE]));
-    meta->functions->alloc(meta, &(meta->nns[JCKY_NN_SCRATCH]));
+    meta->batch_builder = create_batch_builder(&(meta->batch_arena), meta->number_of_inputs, meta->batch_layout);
+    if (meta->input_format == JCKY_INPUT_SPARSE_ID) {
+        meta->sparse_batch = create_sparse_batch(meta->number_of_inputs, batch_size);
+    }
+
+    meta->layer_timers = arena_alloc(&(meta->batch_arena), (number_of_hidden_layers+1) * sizeof( jcky_layer_timer ) );
+    memset(meta->layer_timers, 0, (number_of_hidden_layers+1) * sizeof( jcky_layer_timer ));
+    meta->backprop_timer.seconds = 0.0;
+    meta->backprop_timer.flops = 0.0;
+    meta->batch_timer.seconds = 0.0;
+    meta->batch_timer.flops = 0.0;
 }
 
 
+// The container holds every bias vector, in order, followed by every
+// weight matrix, in order.
 unsigned long int container_length(struct meta_neural_net *meta) {
-    const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
-    const unsigned int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const unsigned int number_of_inputs = meta->number_of_inputs;
-    const unsigned int number_of_outputs = meta->number_of_outputs;
-    unsigned long int container_length = (
-        (number_of_hidden_layers * number_of_nodes_in_hidden_layers) + // bias matrices in hidden layers
-        number_of_outputs + // bias vector for output layer
-        number_of_nodes_in_hidden_layers * ( // weights
-            number_of_inputs + // input layer
-            ((number_of_hidden_layers-1) * number_of_nodes_in_hidden_layers) + // hidden layers
-            number_of_outputs // output layer
-        )
-    );
+    int i;
+    unsigned long int container_length = 0;
+
+    for (i=0; i<=meta->number_of_hidden_layers; i++) {
+        container_length += nn_rows(meta, i) + nn_weight_len(meta, i);
+    }
 
     return container_length;
 }
 
 
+// The room the arrays of bias and weight pointers of a net take up in
+// its arena
+static size_t nn_pointers_size(struct meta_neural_net *meta) {
+    return 2 * jcky_arena_slice_size( (meta->number_of_hidden_layers+1) * sizeof( nn_type* ) );
+}
+
+
+static void nn_alloc_pointers(struct meta_neural_net *meta, neural_net *nn) {
+    const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
+
+    nn->bias = arena_alloc(&(nn->arena), (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+    nn->weight = arena_alloc(&(nn->arena), (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+}
+
+
 void nn_alloc_logical(struct meta_neural_net *meta, neural_net *nn) {
     int i;
     const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
-    const unsigned int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const unsigned int number_of_inputs = meta->number_of_inputs;
-    const unsigned int number_of_outputs = meta->number_of_outputs;
-    unsigned int number_of_matrix_elements = number_of_inputs * number_of_nodes_in_hidden_layers;
+    size_t arena_size = nn_pointers_size(meta);
+
     nn->container_len = container_length(meta);
 
-    //---------------------------------------------------------------------------
-    // allocate space for bias, z_vector, activation and delta arrays
-    nn->bias = malloc( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        arena_size += jcky_arena_slice_size( nn_rows(meta, i) * sizeof( nn_type ) ) +
+                      jcky_arena_slice_size( nn_weight_len(meta, i) * sizeof( nn_type ) );
+    }
+    nn->arena = create_arena(arena_size);
+    nn_alloc_pointers(meta, nn);
 
-    // hidden layers
-    for (i=0; i<number_of_hidden_layers; i++) {
-        nn->bias[i] = (nn_type *)malloc( number_of_nodes_in_hidden_layers * sizeof( nn_type ) );
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        nn->bias[i] = (nn_type *)arena_alloc(&(nn->arena), nn_rows(meta, i) * sizeof( nn_type ) );
+        nn->weight[i] = (nn_type *)arena_alloc(&(nn->arena), nn_weight_len(meta, i) * sizeof( nn_type ) );
     }
 
-    // output layer
-    nn->bias[number_of_hidden_layers] = (nn_type *)malloc( number_of_outputs * sizeof( nn_type ) );
-    //---------------------------------------------------------------------------
+    nn_alloc_half(meta, nn);
+}
 
-    //---------------------------------------------------------------------------
-    // allocate space for weight array
-    nn->weight = malloc( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
 
-    // input layer to first hidden layer
-    nn->weight[0] = (nn_type *)malloc( number_of_matrix_elements * sizeof( nn_type ) );
+// Allocates the container of nn and points its bias and weight arrays
+// into it
+static void nn_alloc_container(struct meta_neural_net *meta, neural_net *nn) {
+    const unsigned long int number_of_hidden_layers = meta->number_of_hidden_layers;
+    unsigned long int offset = 0;
+    unsigned short int i;
+    const unsigned long int container_len = container_length(meta);
 
-    // between hidden layers
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=1; i<number_of_hidden_layers; i++) {
-        nn->weight[i] = (nn_type *)malloc( number_of_matrix_elements * sizeof( nn_type ) );
+    nn->container_len = container_len;
+    nn->arena = create_arena(nn_pointers_size(meta) + jcky_arena_slice_size( container_len * sizeof( nn_type ) ));
+    nn_alloc_pointers(meta, nn);
+    nn->container = (nn_type*)arena_alloc(&(nn->arena), container_len * sizeof( nn_type ) );
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        nn->bias[i] = nn->container + offset;
+        offset += nn_rows(meta, i);
     }
 
-    // last hidden layer to output layer
-    number_of_matrix_elements = number_of_outputs * number_of_nodes_in_hidden_layers;
-    nn->weight[number_of_hidden_layers] = (nn_type *)malloc( number_of_matrix_elements * sizeof( nn_type ) );
-    //---------------------------------------------------------------------------
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        nn->weight[i] = nn->container + offset;
+        offset += nn_weight_len(meta, i);
+    }
 }
 
 
 void nn_alloc_contiguous(struct meta_neural_net *meta, neural_net *nn) {
+    nn_alloc_container(meta, nn);
+    nn_alloc_half(meta, nn);
+}
+
+
+// The step, then one net per moment the optimizer keeps
+static int optimizer_nets_len(const unsigned char optimizer) {
+    if (optimizer == JCKY_OPTIMIZER_MOMENTUM_ID) return 2;
+    if (optimizer == JCKY_OPTIMIZER_ADAM_ID) return 3;
+    return 0;
+}
+
+
+// The state starts at zero, and only the weights are ever read in 16
+// bits, so the nets have no 16 bit copy.
+void nn_alloc_optimizer(struct meta_neural_net *meta) {
+    int i;
+    const int len = optimizer_nets_len(meta->optimizer);
+    neural_net *nn;
+
+    meta->optimizer_steps = 0;
+    meta->optimizer_nets = NULL;
+    if (len == 0) return;
+
+    meta->optimizer_nets = malloc( len * sizeof( neural_net ) );
+    for (i=0; i<len; i++) {
+        nn = &(meta->optimizer_nets[i]);
+        nn_alloc_container(meta, nn);
+        memset(nn->container, 0, nn->container_len * sizeof( nn_type ));
+    }
+}
+
+
+// Allocates the 16 bit copy of the neural net, when one is used. The
+// weight matrices sit at the same offsets as in the contiguous layout.
+void nn_alloc_half(struct meta_neural_net *meta, neural_net *nn) {
     const unsigned long int number_of_hidden_layers = meta->number_of_hidden_layers;
-    const unsigned long int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const unsigned long int number_of_inputs = meta->number_of_inputs;
-    const unsigned long int number_of_outputs = meta->number_of_outputs;
-    unsigned long int number_of_matrix_elements = number_of_inputs * number_of_nodes_in_hidden_layers;
     unsigned long int offset = 0;
     unsigned short int i;
-    const unsigned long int container_len = container_length(meta);
 
-    nn->container_len = container_len;
-    nn->container = (nn_type*)malloc( container_len * sizeof( nn_type ) );
+    nn->half_stale = 1;
+    nn->half_container = NULL;
+    nn->half_weight = calloc( number_of_hidden_layers+1, sizeof( jcky_half* ) );
 
-    nn->bias = malloc( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
-    nn->weight = malloc( (number_of_hidden_layers+1) * sizeof( nn_type* ) );
+    nn->transposed_stale = 1;
+    nn->transposed_container = NULL;
+    nn->transposed_weight = NULL;
+    if (meta->storage == JCKY_STORAGE_NATIVE_ID) return;
 
-    //--BIAS---------------------------------------------------------------------
-    // Hidden Layers
-    for (i=0; i<number_of_hidden_layers; i++) {
-        nn->bias[i] = nn->container + offset;
-        offset += number_of_nodes_in_hidden_layers;
+    nn->half_container = (jcky_half*)malloc( nn->container_len * sizeof( jcky_half ) );
+
+    for (i=0; i<=number_of_hidden_layers; i++) offset += nn_rows(meta, i);
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        nn->half_weight[i] = nn->half_container + offset;
+        offset += nn_weight_len(meta, i);
     }
+}
 
-    // Output Layer
-    nn->bias[number_of_hidden_layers] = nn->container + offset;
-    offset += number_of_outputs;
-    //---------------------------------------------------------------------------
 
-    //--WEIGHT-------------------------------------------------------------------
-    // Input layer to first hidden layer
-    nn->weight[0] = nn->container + offset;
-    offset += number_of_matrix_elements;
+// Converts the weights of nn, and the biases too when 'biases' is set,
+// into its 16 bit copy. This works for either memory layout.
+void nn_to_half(struct meta_neural_net *meta, neural_net *nn, const unsigned char biases) {
+    const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
+    const unsigned char storage = meta->storage;
+    jcky_half *half_bias = nn->half_container;
+    unsigned int i;
 
-    // Between hidden layers
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=1; i<number_of_hidden_layers; i++) {
-        nn->weight[i] = nn->container + offset;
-        offset += number_of_matrix_elements;
+    if (biases) {
+        for (i=0; i<=number_of_hidden_layers; i++) {
+            jcky_to_half(half_bias, nn->bias[i], nn_rows(meta, i), storage);
+            half_bias += nn_rows(meta, i);
+        }
+    }
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        jcky_to_half(nn->half_weight[i], nn->weight[i], nn_weight_len(meta, i), storage);
+    }
+}
+
+
+// Widens the whole 16 bit copy of nn, biases and weights, back into nn.
+void nn_from_half(struct meta_neural_net *meta, neural_net *nn) {
+    const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
+    const unsigned char storage = meta->storage;
+    jcky_half *half_bias = nn->half_container;
+    unsigned int i;
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        jcky_from_half(nn->bias[i], half_bias, nn_rows(meta, i), storage);
+        half_bias += nn_rows(meta, i);
+    }
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        jcky_from_half(nn->weight[i], nn->half_weight[i], nn_weight_len(meta, i), storage);
     }
+}
+
 
-    // Last hidden layer to output layer
-    nn->weight[number_of_hidden_layers] = nn->container + offset;
+// Refreshes the transposed shadow of W[1..L], allocating it the first
+// time. Each copy is cols x rows, so transpose(W) * delta reads it with
+// unit stride.
+void nn_transpose(struct meta_neural_net *meta, neural_net *nn) {
+    const unsigned long int number_of_hidden_layers = meta->number_of_hidden_layers;
+    unsigned long int offset = 0;
+    unsigned short int i;
+
+    if (nn->transposed_container == NULL) {
+        for (i=1; i<=number_of_hidden_layers; i++) offset += nn_weight_len(meta, i);
+        nn->transposed_container = (nn_type*)malloc( offset * sizeof( nn_type ) );
+        nn->transposed_weight = calloc( number_of_hidden_layers+1, sizeof( nn_type* ) );
+
+        offset = 0;
+        for (i=1; i<=number_of_hidden_layers; i++) {
+            nn->transposed_weight[i] = nn->transposed_container + offset;
+            offset += nn_weight_len(meta, i);
+        }
+    }
+
+    for (i=1; i<=number_of_hidden_layers; i++) {
+        transpose_matrix(nn->transposed_weight[i], nn->weight[i], nn_rows(meta, i), nn_cols(meta, i));
+    }
 }
 
 
@@ -214,91 +372,77 @@ void nn_alloc_cms(struct meta_neural_net *meta, const unsigned short int len) {
 }
 
 
-void init_from_gaussian_or_file(char init_gaussian, nn_type *dest, int len, FILE *model_file) {
+void init_from_gaussian_or_file(char init_gaussian, nn_type *dest, int len, jcky_model_file *model_file) {
     if (init_gaussian) generate_guassian_distribution(dest, len);
     else read_model_file(dest, len, model_file);
 }
 
 
+// The unit Gaussian suits sigmoid layers, which saturate rather than
+// grow, but the sum of several hundred unit weights drives a ReLU layer
+// far out along its linear part, and a tanh layer into its flat tails.
+// Their weights are scaled to keep the variance of z near that of the
+// layer's inputs: by sqrt(2 / fan in) for the ReLU functions (He), and
+// sqrt(1 / fan in) for tanh (Xavier).
+static void scale_gaussian_weights(struct meta_neural_net *meta) {
+    int i;
+    unsigned long int j, len;
+    nn_type scale;
+    nn_type *weight;
+
+    for (i=0; i<=meta->number_of_hidden_layers; i++) {
+        if (meta->layer_activation[i] == JCKY_ACTIVATION_SIGMOID_ID) continue;
+
+        scale = sqrt(((meta->layer_activation[i] == JCKY_ACTIVATION_TANH_ID) ? 1.0 : 2.0) / nn_cols(meta, i));
+        weight = meta->nns[JCKY_NN_BASE].weight[i];
+        len = nn_weight_len(meta, i);
+        for (j=0; j<len; j++) weight[j] *= scale;
+    }
+}
+
+
 // Initialize the bias and weight vectors
 void nn_init_logical(struct meta_neural_net *meta, jcky_cli *cli) {
     const unsigned int number_of_hidden_layers = meta->number_of_hidden_layers;
-    const unsigned int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const unsigned int number_of_inputs = meta->number_of_inputs;
-    const unsigned int number_of_outputs = meta->number_of_outputs;
-    unsigned int number_of_matrix_elements = number_of_inputs * number_of_nodes_in_hidden_layers;
 
-    int i, j, random_count = 0;
+    int i;
     char init_gaussian = 1;
-    FILE *model_file = NULL;
+    jcky_model_file model_file;
 
+    model_file.stream = NULL;
     if (strlen(cli->init_model_filename) != 0) {
         init_gaussian = validate_model_file(meta, cli->init_model_filename);
         if (!init_gaussian) {
             model_file = open_model_file(cli->init_model_filename);
         }
-        if (model_file == NULL) {
+        if (model_file.stream == NULL) {
             init_gaussian = 1;
             printf(KYEL "Initializing neural net with a random gaussian distribution.\n" KNRM);
         }
     }
     if (init_gaussian) meta->seed = set_seed(cli->seed);
 
-    //---------------------------------------------------------------------------
-    // Initialize bias vectors
-
-    // Hidden layers
-    for (i=0; i<number_of_hidden_layers; i++) {
+    // Bias vectors, then weight matrices, in the order of the model file
+    for (i=0; i<=number_of_hidden_layers; i++) {
         init_from_gaussian_or_file(
             init_gaussian,
             meta->nns[JCKY_NN_BASE].bias[i],
-            number_of_nodes_in_hidden_layers,
-            model_file
+            nn_rows(meta, i),
+            &model_file
         );
     }
 
-    // Output layer
-    init_from_gaussian_or_file(
-        init_gaussian,
-        meta->nns[JCKY_NN_BASE].bias[number_of_hidden_layers],
-        number_of_outputs,
-        model_file
-    );
-    //---------------------------------------------------------------------------
-
-    //---------------------------------------------------------------------------
-    // Initialize weight vectors
-
-    // Input layer to first hidden layer
-    init_from_gaussian_or_file(
-        init_gaussian,
-        meta->nns[JCKY_NN_BASE].weight[0],
-        number_of_matrix_elements,
-        model_file
-    );
-
-    // Between hidden layers
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=1; i<number_of_hidden_layers; i++) {
+    for (i=0; i<=number_of_hidden_layers; i++) {
         init_from_gaussian_or_file(
             init_gaussian,
             meta->nns[JCKY_NN_BASE].weight[i],
-            number_of_matrix_elements,
-            model_file
+            nn_weight_len(meta, i),
+            &model_file
         );
     }
 
-    // Last hidden layer to output layer
-    number_of_matrix_elements = number_of_outputs * number_of_nodes_in_hidden_layers;
-    init_from_gaussian_or_file(
-        init_gaussian,
-        meta->nns[JCKY_NN_BASE].weight[number_of_hidden_layers],
-        number_of_matrix_elements,
-        model_file
-    );
-    //---------------------------------------------------------------------------
-
-    if (!init_gaussian) fclose(model_file);
+    if (init_gaussian) scale_gaussian_weights(meta);
+    else fclose(model_file.stream);
 }
 
 
@@ -319,23 +463,18 @@ void nn_init_contiguous(struct meta_neural_net *meta, jcky_cli *cli) {
             meta->nns[JCKY_NN_BASE].container,
             meta->nns[JCKY_NN_BASE].container_len
         );
+        scale_gaussian_weights(meta);
     }
 }
 
 
 void destroy_meta_nn(struct meta_neural_net *meta) {
     unsigned int i;
-    const int number_of_hidden_layers = meta->number_of_hidden_layers;
     const unsigned short int cms_len = meta->cms_len;
 
-    for (i=0; i<=number_of_hidden_layers; i++) {
-        free(meta->z_matrix[i]);
-        free(meta->activation[i]);
-        free(meta->delta[i]);
-    }
-    free (meta->z_matrix);
-    free (meta->activation);
-    free (meta->delta);
+    destroy_meta_nn_batch(meta);
+    destroy_nn_optimizer(meta);
+    jcky_gemm_free_workspace();
 
     destroy_nn(meta, &(meta->nns[JCKY_NN_BASE]));
     destroy_nn(meta, &(meta->nns[JCKY_NN_SCRATCH]));
@@ -348,51 +487,63 @@ void destroy_meta_nn(struct meta_neural_net *meta) {
 }
 
 
+void destroy_meta_nn_batch(struct meta_neural_net *meta) {
+    destroy_arena(&(meta->batch_arena));
+    if (meta->input_format == JCKY_INPUT_SPARSE_ID) destroy_sparse_batch(&(meta->sparse_batch));
+}
+
+
+// Either layout's arrays all live in the arena of nn
 void destroy_nn(struct meta_neural_net *meta, neural_net *nn) {
-    unsigned int i;
-    const int number_of_hidden_layers = meta->number_of_hidden_layers;
+    destroy_arena(&(nn->arena));
+    destroy_nn_copies(nn);
+}
 
-    if (meta->memory_layout == JCKY_CONTIGUOUS_LAYOUT_ID) {
-        free(nn->container);
-    }
-    else if (meta->memory_layout == JCKY_LOGICAL_LAYOUT_ID) {
-        for (i=0; i<=number_of_hidden_layers; i++) {
-            free(nn->bias[i]);
-            free(nn->weight[i]);
-        }
-    }
 
-    free (nn->bias);
-    free (nn->weight);
+void destroy_nn_optimizer(struct meta_neural_net *meta) {
+    int i;
+    const int len = optimizer_nets_len(meta->optimizer);
+
+    for (i=0; i<len; i++) destroy_arena(&(meta->optimizer_nets[i].arena));
+    free(meta->optimizer_nets);
+}
+
+
+void nn_placement(struct meta_neural_net *meta, const unsigned char first_nn, jcky_placement *nets,
+                  jcky_placement *batch)
+{
+    int i;
+
+    for (i=first_nn; i<=JCKY_NN_SCRATCH; i++) arena_placement(&(meta->nns[i].arena), nets);
+    for (i=0; i<meta->cms_len; i++) arena_placement(&(meta->cms[i].arena), nets);
+    for (i=0; i<optimizer_nets_len(meta->optimizer); i++) arena_placement(&(meta->optimizer_nets[i].arena), nets);
+    arena_placement(&(meta->batch_arena), batch);
+}
+
+
+void destroy_nn_copies(neural_net *nn) {
+    free (nn->half_container);
+    free (nn->half_weight);
+    free (nn->transposed_container);
+    free (nn->transposed_weight);
 }
 
 
 void nn_copy_contiguous(struct meta_neural_net *meta, const unsigned char trgt, const unsigned char src) {
     copy_vectors(meta->nns[trgt].container, meta->nns[src].container, meta->nns[trgt].container_len);
+    nn_mark_stale(&(meta->nns[trgt]));
 }
 
 
 void nn_copy_logical(struct meta_neural_net *meta, const unsigned char trgt, const unsigned char src) {
     unsigned int i;
-    const int number_of_hidden_layers          = meta->number_of_hidden_layers;
-    const int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const int number_of_inputs                 = meta->number_of_inputs;
-    const int number_of_outputs                = meta->number_of_outputs;
-    int number_of_matrix_elements              = number_of_inputs * number_of_nodes_in_hidden_layers;
-
-    for (i=0; i<number_of_hidden_layers; i++) {
-        copy_vectors(meta->nns[trgt].bias[i], meta->nns[src].bias[i], number_of_nodes_in_hidden_layers);
-    }
-    copy_vectors(meta->nns[trgt].bias[number_of_hidden_layers], meta->nns[src].bias[number_of_hidden_layers], number_of_outputs);
-    copy_vectors(meta->nns[trgt].weight[0], meta->nns[src].weight[0], number_of_matrix_elements);
+    const int number_of_hidden_layers = meta->number_of_hidden_layers;
 
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=1; i<number_of_hidden_layers; i++) {
-        copy_vectors(meta->nns[trgt].weight[i], meta->nns[src].weight[i], number_of_matrix_elements);
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        copy_vectors(meta->nns[trgt].bias[i], meta->nns[src].bias[i], nn_rows(meta, i));
+        copy_vectors(meta->nns[trgt].weight[i], meta->nns[src].weight[i], nn_weight_len(meta, i));
     }
-
-    number_of_matrix_elements = number_of_outputs * number_of_nodes_in_hidden_layers;
-    copy_vectors(meta->nns[trgt].weight[number_of_hidden_layers], meta->nns[src].weight[number_of_hidden_layers], number_of_matrix_elements);
+    nn_mark_stale(&(meta->nns[trgt]));
 }
 
 
@@ -403,25 +554,12 @@ void nn_get_change_contiguous(struct meta_neural_net *meta) {
 
 void nn_get_change_logical(struct meta_neural_net *meta) {
     unsigned int i;
-    const int number_of_hidden_layers          = meta->number_of_hidden_layers;
-    const int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const int number_of_inputs                 = meta->number_of_inputs;
-    const int number_of_outputs                = meta->number_of_outputs;
-    int number_of_matrix_elements              = number_of_inputs * number_of_nodes_in_hidden_layers;
-
-    for (i=0; i<number_of_hidden_layers; i++) {
-        subtract_vectors(meta->nns[JCKY_NN_SCRATCH].bias[i], meta->nns[JCKY_NN_BASE].bias[i], number_of_nodes_in_hidden_layers);
-    }
-    subtract_vectors(meta->nns[JCKY_NN_SCRATCH].bias[number_of_hidden_layers], meta->nns[JCKY_NN_BASE].bias[number_of_hidden_layers], number_of_outputs);
-    subtract_vectors(meta->nns[JCKY_NN_SCRATCH].weight[0], meta->nns[JCKY_NN_BASE].weight[0], number_of_matrix_elements);
+    const int number_of_hidden_layers = meta->number_of_hidden_layers;
 
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=1; i<number_of_hidden_layers; i++) {
-        subtract_vectors(meta->nns[JCKY_NN_SCRATCH].weight[i], meta->nns[JCKY_NN_BASE].weight[i], number_of_matrix_elements);
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        subtract_vectors(meta->nns[JCKY_NN_SCRATCH].bias[i], meta->nns[JCKY_NN_BASE].bias[i], nn_rows(meta, i));
+        subtract_vectors(meta->nns[JCKY_NN_SCRATCH].weight[i], meta->nns[JCKY_NN_BASE].weight[i], nn_weight_len(meta, i));
     }
-
-    number_of_matrix_elements = number_of_outputs * number_of_nodes_in_hidden_layers;
-    subtract_vectors(meta->nns[JCKY_NN_SCRATCH].weight[number_of_hidden_layers], meta->nns[JCKY_NN_BASE].weight[number_of_hidden_layers], number_of_matrix_elements);
 }
 
 
@@ -440,65 +578,47 @@ void nn_apply_changes_contiguous(struct meta_neural_net *meta) {
         }
         meta->nns[JCKY_NN_BASE].container[i] += accum / divisor;
     }
+    nn_mark_stale(&(meta->nns[JCKY_NN_BASE]));
 }
 
 
-void nn_apply_changes_logical(struct meta_neural_net *meta) {
-    unsigned int i, j, k;
-    const int number_of_hidden_layers          = meta->number_of_hidden_layers;
-    const int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-    const int number_of_inputs                 = meta->number_of_inputs;
-    const int number_of_outputs                = meta->number_of_outputs;
-    const int change_matrices                  = meta->cms_len;
-    const nn_type divisor                      = (nn_type)(change_matrices + 1);
-    int number_of_matrix_elements              = number_of_inputs * number_of_nodes_in_hidden_layers;
+// Adds the mean of the scratch change and the received changes of one
+// array (the weights or the biases of 'layer') to that array of the base.
+static void apply_changes_array(
+    struct meta_neural_net *meta,
+    nn_type *base,
+    nn_type *scratch,
+    const unsigned int layer,
+    const unsigned char weights,
+    const unsigned long int len)
+{
+    unsigned long int i;
+    unsigned int k;
+    const int change_matrices = meta->cms_len;
+    const nn_type divisor = (nn_type)(change_matrices + 1);
     nn_type accum;
 
-    for (i=0; i<number_of_hidden_layers; i++) {
-        for (j=0; j<number_of_nodes_in_hidden_layers; j++) {
-            accum = meta->nns[JCKY_NN_SCRATCH].bias[i][j];
-            for (k=0; k<change_matrices; k++) {
-                accum += meta->cms[k].bias[i][j];
-            }
-            meta->nns[JCKY_NN_BASE].bias[i][j] += accum / divisor;
-        }
-    }
-
-    for (i=0; i<number_of_outputs; i++) {
-        accum = meta->nns[JCKY_NN_SCRATCH].bias[number_of_hidden_layers][i];
+    for (i=0; i<len; i++) {
+        accum = scratch[i];
         for (k=0; k<change_matrices; k++) {
-            accum += meta->cms[k].bias[number_of_hidden_layers][i];
+            accum += weights ? meta->cms[k].weight[layer][i] : meta->cms[k].bias[layer][i];
         }
-        meta->nns[JCKY_NN_BASE].bias[number_of_hidden_layers][i] += accum / divisor;
+        base[i] += accum / divisor;
     }
+}
 
-    for (i=0; i<number_of_matrix_elements; i++) {
-        accum = meta->nns[JCKY_NN_SCRATCH].weight[0][i];
-        for (k=0; k<change_matrices; k++) {
-            accum += meta->cms[k].weight[0][i];
-        }
-        meta->nns[JCKY_NN_BASE].weight[0][i] += accum / divisor;
-    }
 
-    number_of_matrix_elements = number_of_nodes_in_hidden_layers * number_of_nodes_in_hidden_layers;
-    for (i=0; i<number_of_hidden_layers; i++) {
-        for (j=0; j<number_of_matrix_elements; j++) {
-            accum = meta->nns[JCKY_NN_SCRATCH].weight[i][j];
-            for (k=0; k<change_matrices; k++) {
-                accum += meta->cms[k].weight[i][j];
-            }
-            meta->nns[JCKY_NN_BASE].weight[i][j] += accum / divisor;
-        }
-    }
+void nn_apply_changes_logical(struct meta_neural_net *meta) {
+    unsigned int i;
+    const int number_of_hidden_layers = meta->number_of_hidden_layers;
 
-    number_of_matrix_elements = number_of_outputs * number_of_nodes_in_hidden_layers;
-    for (i=0; i<number_of_matrix_elements; i++) {
-        accum = meta->nns[JCKY_NN_SCRATCH].weight[number_of_hidden_layers][i];
-        for (k=0; k<change_matrices; k++) {
-            accum += meta->cms[k].weight[number_of_hidden_layers][i];
-        }
-        meta->nns[JCKY_NN_BASE].weight[number_of_hidden_layers][i] += accum / divisor;
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        apply_changes_array(meta, meta->nns[JCKY_NN_BASE].bias[i], meta->nns[JCKY_NN_SCRATCH].bias[i],
+                            i, 0, nn_rows(meta, i));
+        apply_changes_array(meta, meta->nns[JCKY_NN_BASE].weight[i], meta->nns[JCKY_NN_SCRATCH].weight[i],
+                            i, 1, nn_weight_len(meta, i));
     }
+    nn_mark_stale(&(meta->nns[JCKY_NN_BASE]));
 }
 
 
@@ -509,72 +629,78 @@ void feed_forward(struct meta_neural_net *meta,
                   char training,
                   double *score)
 {
-  int i, j;
-  int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-  int number_of_inputs                 = meta->number_of_inputs;
+  int i;
   int number_of_hidden_layers          = meta->number_of_hidden_layers;
   int number_of_outputs                = meta->number_of_outputs;
   int batch_size                       = meta->batch_size;
+  unsigned char storage                = meta->storage;
+  neural_net *nn                       = &(meta->nns[training]);
+
+  // refresh the 16 bit copy of the weights if they've changed
+  if (storage != JCKY_STORAGE_NATIVE_ID && nn->half_stale) {
+    nn_to_half(meta, nn, 0);
+    nn->half_stale = 0;
+  }
 
   //---------------------------------------------------------------------------
-  // feed from input layer -> first hidden layer
+  // feed from the input layer through each hidden layer to the output layer
   //  do matrix multiply
   //    Dimensions:
   //      Weight Matrix:      'Nodes in target layer' rows X 'Nodes in source layer' columns
   //      Activation Matric:  'Nodes in source layer' rows X 'Batch size' columns
-  //  Get the z-matrix
-  calculate_z_matrix(meta->z_matrix[0],
-                     meta->nns[training].weight[0],
-                     activation_initial,
-                     meta->nns[training].bias[0],
-                     number_of_nodes_in_hidden_layers,
-                     number_of_inputs,
-                     batch_size);
-
-  //  Compute activation
-  sigmoidify(meta->activation[0],
-             meta->z_matrix[0],
-             number_of_nodes_in_hidden_layers,
-             batch_size);
-  //---------------------------------------------------------------------------
-
-  //---------------------------------------------------------------------------
-  // feed through the hidden layers
-  for(i=1; i<number_of_hidden_layers; i++) {
+  for (i=0; i<=number_of_hidden_layers; i++) {
     //  Get the z-matrix
-    calculate_z_matrix(meta->z_matrix[i],
-                       meta->nns[training].weight[i],
-                       meta->activation[i-1],
-                       meta->nns[training].bias[i],
-                       number_of_nodes_in_hidden_layers,
-                       number_of_nodes_in_hidden_layers,
-                       batch_size);
-    //  Compute activation
-    sigmoidify(meta->activation[i],
+    START_TIME_LAYER(&(meta->layer_timers[i]))
+    if (i == 0 && meta->input_format == JCKY_INPUT_SPARSE_ID) {
+      sparse_z_matrix(meta->z_matrix[0],
+                      meta->nns[training].weight[0],
+                      nn->half_weight[0],
+                      storage,
+                      &(meta->sparse_batch),
+                      meta->nns[training].bias[0],
+                      nn_rows(meta, 0),
+                      meta->batch_layout);
+      END_TIME_LAYER(&(meta->layer_timers[0]),
+                     2.0 * nn_rows(meta, 0) * JCKY_SPARSE_NNZ(&(meta->sparse_batch)))
+    }
+    else {
+      calculate_z_matrix(meta->backend,
+                         meta->z_matrix[i],
+                         meta->nns[training].weight[i],
+                         nn->half_weight[i],
+                         storage,
+                         (i == 0) ? activation_initial : meta->activation[i-1],
+                         meta->nns[training].bias[i],
+                         nn_rows(meta, i),
+                         nn_cols(meta, i),
+                         batch_size,
+                         meta->batch_layout);
+      END_TIME_LAYER(&(meta->layer_timers[i]),
+                     2.0 * nn_weight_len(meta, i) * batch_size)
+    }
+
+    //  Compute activation. When training, the softmax also writes
+    //  the output delta, which backpropagate starts from.
+    if (i == number_of_hidden_layers && meta->output == JCKY_OUTPUT_SOFTMAX_ID) {
+      softmax_output_layer(meta->activation[i],
+                           meta->z_matrix[i],
+                           (training == JCKY_TRAIN) ? meta->delta[i] : NULL,
+                           target_values,
+                           number_of_outputs,
+                           batch_size,
+                           meta->batch_layout);
+    }
+    else {
+      activate(meta->activation[i],
                meta->z_matrix[i],
-               number_of_nodes_in_hidden_layers,
-               batch_size);
+               nn_rows(meta, i),
+               batch_size,
+               meta->layer_activation[i],
+               meta->sigmoid);
+    }
   }
   //---------------------------------------------------------------------------
 
-  //---------------------------------------------------------------------------
-  // feed from the last hidden layer -> output layer
-  //  Get the z-matrix
-  calculate_z_matrix(meta->z_matrix[number_of_hidden_layers],
-                     meta->nns[training].weight[number_of_hidden_layers],
-                     meta->activation[number_of_hidden_layers-1],
-                     meta->nns[training].bias[number_of_hidden_layers],
-                     number_of_outputs,
-                     number_of_nodes_in_hidden_layers,
-                     batch_size);
-
-  //  compute activation
-  sigmoidify(meta->activation[number_of_hidden_layers],
-             meta->z_matrix[number_of_hidden_layers],
-             number_of_outputs,
-             batch_size);
-  //---------------------------------------------------------------------------
-
   int num_outputs = number_of_outputs * batch_size;
   for (i=0; i<num_outputs; i++) {
     result[i] = meta->activation[number_of_hidden_layers][i];
@@ -584,98 +710,180 @@ void feed_forward(struct meta_neural_net *meta,
         backpropagate(meta, activation_initial, target_values);
     }
   else {
-        *score += get_score(batch_size, number_of_outputs, meta->activation[number_of_hidden_layers], target_values);
+        *score += get_score(batch_size, number_of_outputs, meta->activation[number_of_hidden_layers], target_values,
+                            meta->batch_layout);
   }
 }
 
+// Takes the optimizer's step for the biases and weights of layer i of
+// nn, from the plain gradient descent step left in the step net. Adam's
+// 'step_size' and 'epsilon' already hold its bias correction.
+static void optimizer_step(
+    struct meta_neural_net *meta,
+    neural_net *nn,
+    const int i,
+    const nn_type step_size,
+    const nn_type epsilon)
+{
+  neural_net *state = meta->optimizer_nets;
+
+  if (meta->optimizer == JCKY_OPTIMIZER_MOMENTUM_ID) {
+    momentum_update(nn->bias[i], state[JCKY_OPTIMIZER_STEP].bias[i], state[JCKY_OPTIMIZER_VELOCITY].bias[i],
+                    nn_rows(meta, i), meta->momentum, meta->eta);
+    momentum_update(nn->weight[i], state[JCKY_OPTIMIZER_STEP].weight[i], state[JCKY_OPTIMIZER_VELOCITY].weight[i],
+                    nn_weight_len(meta, i), meta->momentum, meta->eta);
+  }
+  else {
+    adam_update(nn->bias[i], state[JCKY_OPTIMIZER_STEP].bias[i], state[JCKY_OPTIMIZER_MOMENT].bias[i],
+                state[JCKY_OPTIMIZER_SECOND_MOMENT].bias[i], nn_rows(meta, i),
+                JCKY_ADAM_BETA1, JCKY_ADAM_BETA2, step_size, epsilon);
+    adam_update(nn->weight[i], state[JCKY_OPTIMIZER_STEP].weight[i], state[JCKY_OPTIMIZER_MOMENT].weight[i],
+                state[JCKY_OPTIMIZER_SECOND_MOMENT].weight[i], nn_weight_len(meta, i),
+                JCKY_ADAM_BETA1, JCKY_ADAM_BETA2, step_size, epsilon);
+  }
+}
+
+
 void backpropagate(struct meta_neural_net *meta,
                    nn_type *activation_initial,
                    nn_type *target_values)
 {
   int i;
   int number_of_hidden_layers          = meta->number_of_hidden_layers;
-  int number_of_nodes_in_hidden_layers = meta->number_of_nodes_in_hidden_layers;
-  int number_of_inputs                 = meta->number_of_inputs;
   int number_of_outputs                = meta->number_of_outputs;
   int batch_size                       = meta->batch_size;
   nn_type eta                          = meta->eta;
+  unsigned char derivative             = meta->derivative;
+  unsigned char storage                = meta->storage;
+  neural_net *nn                       = &(meta->nns[JCKY_NN_SCRATCH]);
+  neural_net *update                   = nn;
+  nn_type update_eta                   = eta;
+  double correction, step_size = 0.0, epsilon = 0.0;
+
+  // the derivatives are computed either from the activations
+  // or from the z-matrices
+  nn_type **derivative_source = (derivative == JCKY_DERIVATIVE_ACTIVATION_ID) ?
+                                meta->activation :
+                                meta->z_matrix;
+
+  START_TIME_LAYER(&(meta->backprop_timer))
+
+  // find the delta value in the output layer, unless the softmax
+  // already wrote it
+  if (meta->output == JCKY_OUTPUT_SIGMOID_ID) {
+    delta_output_layer(meta->delta[number_of_hidden_layers],
+                       meta->activation[number_of_hidden_layers],
+                       derivative_source[number_of_hidden_layers],
+                       derivative,
+                       target_values,
+                       number_of_outputs,
+                       batch_size,
+                       meta->batch_layout);
+  }
 
-  // find the delta value in the output layer
-  delta_output_layer(meta->delta[number_of_hidden_layers],
-                     meta->activation[number_of_hidden_layers],
-                     meta->z_matrix[number_of_hidden_layers],
-                     target_values,
-                     number_of_outputs,
-                     batch_size);
-
-  // backpropagate delta -> last hidden layer
-  //  Note that row, col dimensions here are for the matrix W
-  //  NOT the transpose of W. The transpose will be taken care
-  //  of in the function.
-  delta_hidden_layers(meta->delta[number_of_hidden_layers-1],
-                      meta->nns[JCKY_NN_SCRATCH].weight[number_of_hidden_layers],
-                      meta->delta[number_of_hidden_layers],
-                      meta->z_matrix[number_of_hidden_layers-1],
-                      number_of_outputs,
-                      number_of_nodes_in_hidden_layers,
-                      batch_size);
-
-  // backpropagate delta -> hidden layers
-  for (i=number_of_hidden_layers-2; i>=0; i--) {
-    delta_hidden_layers(meta->delta[i],
-                        meta->nns[JCKY_NN_SCRATCH].weight[i+1],
-                        meta->delta[i+1],
-                        meta->z_matrix[i],
-                        number_of_nodes_in_hidden_layers,
-                        number_of_nodes_in_hidden_layers,
-                        batch_size);
+  if (meta->backward == JCKY_BACKWARD_FUSED_ID) {
+    // each layer's weights are swept once, from the output layer down,
+    // producing the upstream delta and updating the weights and biases
+    for (i=number_of_hidden_layers; i>=0; i--) {
+      if (i == 0 && meta->input_format == JCKY_INPUT_SPARSE_ID) {
+        sparse_adjust_weight(&(meta->sparse_batch), nn->weight[0], meta->delta[0],
+                             nn_rows(meta, 0), eta, meta->batch_layout);
+        adjust_bias(nn->bias[0], meta->delta[0], nn_rows(meta, 0), batch_size, eta,
+                    meta->batch_layout);
+        continue;
+      }
+      backward_layer(meta->backend,
+                     (i > 0) ? meta->delta[i-1] : NULL,
+                     nn->weight[i],
+                     meta->delta[i],
+                     (i > 0) ? meta->activation[i-1] : activation_initial,
+                     nn->bias[i],
+                     (i > 0) ? derivative_source[i-1] : NULL,
+                     derivative,
+                     (i > 0) ? meta->layer_activation[i-1] : JCKY_ACTIVATION_SIGMOID_ID,
+                     nn_rows(meta, i),
+                     nn_cols(meta, i),
+                     batch_size,
+                     eta,
+                     meta->batch_layout);
+    }
   }
+  else {
+    // refresh the transposed shadow of the weights if they've changed
+    if (meta->transposed_shadow && nn->transposed_stale) {
+      nn_transpose(meta, nn);
+      nn->transposed_stale = 0;
+    }
 
-  // -----------------------------------------------------------------
-  // now that we have all of our deltas, adjust the weights and biases
-  //  adjust the first hidden layer
-  adjust_weight(activation_initial,
-                meta->nns[JCKY_NN_SCRATCH].weight[0],
-                meta->delta[0],
-                number_of_nodes_in_hidden_layers,
-                number_of_inputs,
-                batch_size,
-                eta);
-
-  adjust_bias(meta->nns[JCKY_NN_SCRATCH].bias[0],
-              meta->delta[0],
-              number_of_nodes_in_hidden_layers,
-              batch_size,
-              eta);
-  //
-  //  adjust the hidden layers
-  for (i=1; i<number_of_hidden_layers; i++) {
-    adjust_weight(meta->activation[i-1],
-                  meta->nns[JCKY_NN_SCRATCH].weight[i],
+    // backpropagate delta -> each hidden layer, from the last one down
+    //  Note that row, col dimensions here are for the matrix W
+    //  NOT the transpose of W. The transpose will be taken care
+    //  of in the function.
+    for (i=number_of_hidden_layers; i>0; i--) {
+      delta_hidden_layers(meta->backend,
+                          meta->delta[i-1],
+                          nn->weight[i],
+                          meta->transposed_shadow ? nn->transposed_weight[i] : NULL,
+                          nn->half_weight[i],
+                          storage,
+                          meta->delta[i],
+                          derivative_source[i-1],
+                          derivative,
+                          meta->layer_activation[i-1],
+                          nn_rows(meta, i),
+                          nn_cols(meta, i),
+                          batch_size,
+                          meta->batch_layout);
+    }
+
+    // -----------------------------------------------------------------
+    // now that we have all of our deltas, adjust the weights and biases.
+    // With momentum or Adam the plain gradient descent step is taken on
+    // the zeroed step net instead, and the optimizer then folds it into
+    // the weights and biases in one pass per array.
+    if (meta->optimizer != JCKY_OPTIMIZER_SGD_ID) {
+      update = &(meta->optimizer_nets[JCKY_OPTIMIZER_STEP]);
+      update_eta = 1.0;
+      meta->optimizer_steps++;
+      correction = sqrt(1.0 - pow(JCKY_ADAM_BETA2, meta->optimizer_steps));
+      step_size = eta * correction / (1.0 - pow(JCKY_ADAM_BETA1, meta->optimizer_steps));
+      epsilon = JCKY_ADAM_EPSILON * correction;
+    }
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+      if (i == 0 && meta->input_format == JCKY_INPUT_SPARSE_ID) {
+        sparse_adjust_weight(&(meta->sparse_batch),
+                             update->weight[0],
+                             meta->delta[0],
+                             nn_rows(meta, 0),
+                             update_eta,
+                             meta->batch_layout);
+      }
+      else {
+        adjust_weight(meta->backend,
+                      (i == 0) ? activation_initial : meta->activation[i-1],
+                      update->weight[i],
+                      meta->delta[i],
+                      nn_rows(meta, i),
+                      nn_cols(meta, i),
+                      batch_size,
+                      update_eta,
+                      meta->batch_layout);
+      }
+      adjust_bias(update->bias[i],
                   meta->delta[i],
-                  number_of_nodes_in_hidden_layers,
-                  number_of_nodes_in_hidden_layers,
+                  nn_rows(meta, i),
                   batch_size,
-                  eta);
-    adjust_bias(meta->nns[JCKY_NN_SCRATCH].bias[i],
-                meta->delta[i],
-                number_of_nodes_in_hidden_layers,
-                batch_size,
-                eta);
+                  update_eta,
+                  meta->batch_layout);
+
+      if (meta->optimizer != JCKY_OPTIMIZER_SGD_ID) optimizer_step(meta, nn, i, step_size, epsilon);
+    }
+    // -----------------------------------------------------------------
   }
-  //
-  //  adjust the output hidden layer
-  adjust_weight(meta->activation[number_of_hidden_layers-1],
-                meta->nns[JCKY_NN_SCRATCH].weight[number_of_hidden_layers],
-                meta->delta[number_of_hidden_layers],
-                number_of_outputs,
-                number_of_nodes_in_hidden_layers,
-                batch_size,
-                eta);
-  adjust_bias(meta->nns[JCKY_NN_SCRATCH].bias[number_of_hidden_layers],
-              meta->delta[number_of_hidden_layers],
-              number_of_outputs,
-              batch_size,
-              eta);
-  // -----------------------------------------------------------------
+
+  // the copies of the weights no longer match
+  nn_mark_stale(nn);
+
+  END_TIME_LAYER(&(meta->backprop_timer), 0.0)
 }
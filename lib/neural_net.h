@@ -4,8 +4,13 @@
 
 #include "math.h"
 
+#include "arena.h"
+#include "batch.h"
 #include "constants.h"
+#include "half.h"
 #include "helpers.h"
+#include "sparse.h"
+#include "timing_helpers.h"
 
 
 // This base object defines the neural_net and contains
@@ -30,38 +35,111 @@ typedef struct neural_net {
     // represents the weights connecting two layers of neurons.
     nn_type **weight;
 
+    // The arena the bias and weight arrays (or the container) and the
+    // arrays of pointers to them are sliced from, so the net is freed in
+    // one call. In the logical layout each array gets its own slice, and
+    // so starts on a cache line.
+    jcky_arena arena;
+
+    // When the weights are stored in 16 bits (see half.h), 'half_container'
+    // holds a 16 bit copy of 'container', laid out as in the contiguous
+    // layout, and each entry in 'half_weight' points at a weight matrix in
+    // it. The matrix products read these instead of 'weight'. The copy is
+    // refreshed before the next feed forward once 'half_stale' is set,
+    // which is done whenever the weights change. With native storage
+    // 'half_container' is NULL and every entry in 'half_weight' is NULL.
+    jcky_half *half_container;
+    jcky_half **half_weight;
+    unsigned char half_stale;
+
+    // With --transposed-shadow, each entry in 'transposed_weight' past
+    // the first points at a transposed copy of that weight matrix in
+    // 'transposed_container', which the split backward pass reads to
+    // push the deltas upstream. W[0] has no upstream delta and so no
+    // copy. The copy is allocated the first time it's needed and is
+    // refreshed before the next delta pass once 'transposed_stale' is
+    // set. Otherwise both are NULL.
+    nn_type *transposed_container;
+    nn_type **transposed_weight;
+    unsigned char transposed_stale;
+
     // The manger manages MPI calls for the neural net.
     struct request_manager *manager;
 } neural_net;
 
 struct meta_neural_net {
     int number_of_hidden_layers;
-    int number_of_nodes_in_hidden_layers;
     int number_of_inputs;
     int number_of_outputs;
+    // The number of nodes in each layer: the inputs, then each hidden
+    // layer, then the outputs. Use nn_rows and nn_cols to get the shape
+    // of a weight matrix.
+    int layer_width[JCKY_MAX_HIDDEN_LAYERS + 2];
+    // The activation function of each layer (see the activations enum).
+    // The output layer's is always the sigmoid.
+    unsigned char layer_activation[JCKY_MAX_HIDDEN_LAYERS + 1];
+    // The output layer and cost function (see the outputs enum). With the
+    // softmax the output layer's entry in layer_activation is unused.
+    unsigned char output;
     int batch_size;
     nn_type eta;   // eta is the learning rate
+    // The optimizer of the weights and biases (see the optimizers enum),
+    // and the momentum of the momentum optimizer.
+    //
+    // With momentum or Adam, 'optimizer_nets' holds the optimizer's state:
+    // the step of the current batch (JCKY_OPTIMIZER_STEP), then the
+    // velocity, or Adam's two moments, each a zeroed neural net laid out
+    // as in the contiguous layout, whatever the memory layout is. With
+    // plain gradient descent it's NULL. 'optimizer_steps' counts the
+    // batches taken, for Adam's bias correction.
+    //
+    // The state belongs to the rank, or to the worker thread, that trains
+    // the scratch net, and lasts from one epoch to the next. It's never
+    // averaged or synced: the change of an epoch (scratch - base) already
+    // holds every step the optimizer took, so nn_get_change_* and
+    // nn_apply_changes_* average the steps of the ranks as they are. Nor
+    // is it saved with the model, so training resumed from a model file
+    // starts the optimizer afresh.
+    unsigned char optimizer;
+    nn_type momentum;
+    unsigned long int optimizer_steps;
+    neural_net *optimizer_nets;
     int seed;
     neural_net nns[2];
     unsigned short int cms_len;
     neural_net *cms;
 
     unsigned char memory_layout;
+    unsigned char derivative;
+    unsigned char sigmoid;
+    unsigned char storage;
+    unsigned char backward;
+    unsigned char transposed_shadow;
+    unsigned char batch_layout;
+    unsigned char input_format;
     unsigned char num_blocks;
     unsigned int block_size;
     struct functions *functions;
+    struct backend *backend;
 
     // Each entry in 'z_vector' is a pointer to an array of the
     // z-values for the corresponding layer in the neural net.
     // The z-value is:
     //    weights * activation(previous level) + biases
-    // This value is passed through the sigmoid function to get
-    // the layer's activation.
+    // This value is passed through the layer's activation function
+    // to get the layer's activation.
+    // When the derivatives are taken from the activations
+    // the z-values aren't needed after the activation is computed,
+    // so each entry aliases the layer's activation array and the
+    // activation function is applied in place.
     nn_type **z_matrix;
 
     // Each entry in 'activation' is a pointer to an array of
     // the activations for the layer. The activation is the
-    // z-vector passed through the sigmoid function.
+    // z-vector passed through the activation function.
+    // The batch matrices ('z_matrix', 'activation', 'delta' and the
+    // input batch) are laid out as 'batch_layout' says: one row per
+    // node, or one row per sample in the batch (see batch_layouts).
     nn_type **activation;
 
     // Each entry in 'delta' is a pointer to an array of the
@@ -70,8 +148,33 @@ struct meta_neural_net {
     //      = (Activation - y) . sigmoidPrime(z)
     // where the "." is the Hadamard product (element-wise
     // multiplication) and y is the expected output of the
-    // neural net for a given input.
+    // neural net for a given input. With the softmax output and
+    // the cross-entropy cost it's just (Activation - y).
     nn_type **delta;
+
+    // With the sparse input format, the batch builder also fills this
+    // with the nonzero inputs of the batch, and the first layer reads it
+    // in place of the dense batch (see sparse.h).
+    jcky_sparse_batch sparse_batch;
+
+    // Builds the input batches in 'batch_layout' (see batch.h)
+    jcky_batch_builder batch_builder;
+
+    // One timer per layer, accumulating the wall time and
+    // floating point operations spent in the forward pass.
+    jcky_layer_timer *layer_timers;
+
+    // The arena the batch matrices, their arrays of pointers, the tile of
+    // the batch builder and the layer timers are sliced from (see
+    // meta_nn_alloc_batch).
+    jcky_arena batch_arena;
+
+    // Accumulates the wall time spent in backpropagate.
+    jcky_layer_timer backprop_timer;
+
+    // Accumulates the wall time a worker spends building its batches
+    // (see workers.h).
+    jcky_layer_timer batch_timer;
 };
 
 typedef struct functions {
@@ -84,13 +187,26 @@ typedef struct functions {
 
 unsigned long int container_length(struct meta_neural_net *meta);
 void meta_nn_alloc(struct meta_neural_net *meta);
+void meta_nn_alloc_batch(struct meta_neural_net *meta);
 void nn_alloc_cms(struct meta_neural_net *meta, const unsigned short int num);
 void nn_init_contiguous(struct meta_neural_net *meta, jcky_cli *cli);
 void nn_init_logical(struct meta_neural_net *meta, jcky_cli *cli);
 void nn_copy_contiguous(struct meta_neural_net *meta, const unsigned char trgt, const unsigned char src);
 void nn_copy_logical(struct meta_neural_net *meta, const unsigned char trgt, const unsigned char src);
 void destroy_meta_nn(struct meta_neural_net *meta);
+void destroy_meta_nn_batch(struct meta_neural_net *meta);
 void destroy_nn(struct meta_neural_net *meta, neural_net *nn);
+// Frees only the 16 bit copy and the transposed shadow of nn
+void destroy_nn_copies(neural_net *nn);
+// Adds where the pages of nns[first_nn] onwards, the change nets and the
+// optimizer state landed to 'nets', and those of the batch matrices to
+// 'batch' (see arena_placement). A worker's base, and its scratch in the
+// hogwild mode, are the rank's, so the workers start further in.
+void nn_placement(struct meta_neural_net *meta, const unsigned char first_nn, jcky_placement *nets,
+                  jcky_placement *batch);
+// Allocates and frees the optimizer state in meta->optimizer_nets
+void nn_alloc_optimizer(struct meta_neural_net *meta);
+void destroy_nn_optimizer(struct meta_neural_net *meta);
 void nn_get_change_contiguous(struct meta_neural_net *meta);
 void nn_get_change_logical(struct meta_neural_net *meta);
 void nn_apply_changes_contiguous(struct meta_neural_net *meta);
@@ -99,6 +215,42 @@ void nn_apply_changes_logical(struct meta_neural_net *meta);
 //void nn_alloc_optimized(struct meta_neural_net *meta, neural_net *nn);
 void nn_alloc_contiguous(struct meta_neural_net *meta, neural_net *nn);
 void nn_alloc_logical(struct meta_neural_net *meta, neural_net *nn);
+void nn_alloc_half(struct meta_neural_net *meta, neural_net *nn);
+void nn_to_half(struct meta_neural_net *meta, neural_net *nn, const unsigned char biases);
+void nn_from_half(struct meta_neural_net *meta, neural_net *nn);
+void nn_transpose(struct meta_neural_net *meta, neural_net *nn);
+
+// Marks the copies derived from the weights of nn (the 16 bit copy and
+// the transposed shadow) as out of date.
+static inline void nn_mark_stale(neural_net *nn) {
+    nn->half_stale = 1;
+    nn->transposed_stale = 1;
+}
+
+// Weight matrix i (and bias vector i) feed layer i+1 from layer i. The
+// matrix has a row per node of layer i+1 and a column per node of layer
+// i, so nn_rows is also the length of bias i and the number of nodes
+// behind activation i, z_matrix i and delta i.
+static inline int nn_rows(const struct meta_neural_net *meta, const int i) {
+    return meta->layer_width[i + 1];
+}
+
+static inline int nn_cols(const struct meta_neural_net *meta, const int i) {
+    return meta->layer_width[i];
+}
+
+static inline unsigned long int nn_weight_len(const struct meta_neural_net *meta, const int i) {
+    return (unsigned long int)meta->layer_width[i + 1] * meta->layer_width[i];
+}
+
+// The number of nodes in the widest layer, the inputs included
+int nn_widest_layer(const struct meta_neural_net *meta);
+
+// The sparse batch for the batch builder to fill, or NULL when the
+// first layer reads the dense batch.
+static inline jcky_sparse_batch * nn_sparse_batch(struct meta_neural_net *meta) {
+    return (meta->input_format == JCKY_INPUT_SPARSE_ID) ? &(meta->sparse_batch) : NULL;
+}
 
 struct meta_neural_net create_neural_net(
     jcky_cli *cli,
@@ -115,6 +267,8 @@ void feed_forward(
     double *score
 );
 
+// With the softmax output, the output delta must already have been
+// written by feed_forward, as it is when training.
 void backpropagate(
     struct meta_neural_net *meta,
     nn_type *activation_initial,
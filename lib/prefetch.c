@@ -0,0 +1,238 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "arena.h"
+#include "batch.h"
+#include "constants.h"
+#include "file_helpers.h"
+#include "neural_net.h"
+#include "prefetch.h"
+#include "sparse.h"
+#include "timing_helpers.h"
+
+
+typedef struct jcky_loader {
+    jcky_prefetch *prefetch;
+    int id;
+} jcky_loader;
+
+
+// Builds batch 'number' of the pass into 'slot'
+static void load_batch(jcky_prefetch *prefetch, jcky_batch_builder *builder, jcky_prefetch_slot *slot,
+                       const unsigned int number)
+{
+    struct meta_neural_net *meta = prefetch->meta;
+    jcky_sparse_batch *sparse = (meta->input_format == JCKY_INPUT_SPARSE_ID) ? &(slot->sparse) : NULL;
+
+    if (prefetch->file->map == NULL) pthread_mutex_lock(&(prefetch->file_lock));
+    if (prefetch->sequence != NULL) {
+        create_batch_with_sequence_file(slot->batch, slot->targets, prefetch->file, meta->batch_size, number,
+                                        prefetch->sequence, builder, sparse);
+    }
+    else {
+        create_batch_no_sequence_file(slot->batch, slot->targets, prefetch->file, meta->batch_size, number,
+                                      prefetch->rank, prefetch->process_offset, builder, sparse);
+    }
+    if (prefetch->file->map == NULL) pthread_mutex_unlock(&(prefetch->file_lock));
+}
+
+
+// Each loader takes the next batch of the pass once its slot is free,
+// until the ring is destroyed.
+static void * run_loader(void *arg) {
+    jcky_loader *loader = (jcky_loader *)arg;
+    jcky_prefetch *prefetch = loader->prefetch;
+    jcky_batch_builder *builder = &(prefetch->builder[loader->id]);
+    jcky_prefetch_slot *slot;
+    unsigned int number;
+
+    free(loader);
+
+    pthread_mutex_lock(&(prefetch->lock));
+    while (1) {
+        while (!prefetch->stop &&
+               (prefetch->next_load >= prefetch->batches ||
+                prefetch->slot[prefetch->next_load % prefetch->depth].state != JCKY_SLOT_FREE)) {
+            pthread_cond_wait(&(prefetch->work), &(prefetch->lock));
+        }
+        if (prefetch->stop) break;
+
+        number = prefetch->next_load++;
+        slot = &(prefetch->slot[number % prefetch->depth]);
+        slot->state = JCKY_SLOT_LOADING;
+        pthread_mutex_unlock(&(prefetch->lock));
+
+        load_batch(prefetch, builder, slot, number);
+
+        pthread_mutex_lock(&(prefetch->lock));
+        slot->state = JCKY_SLOT_READY;
+        pthread_cond_broadcast(&(prefetch->filled));
+    }
+    pthread_mutex_unlock(&(prefetch->lock));
+
+    return NULL;
+}
+
+
+jcky_prefetch create_prefetch(struct meta_neural_net *meta, const int depth, const int threads) {
+    int i;
+    jcky_prefetch prefetch;
+    const unsigned long int batch_len = (unsigned long int)meta->number_of_inputs * meta->batch_size;
+    const unsigned long int targets_len = (unsigned long int)meta->number_of_outputs * meta->batch_size;
+
+    prefetch.depth = depth;
+    prefetch.threads = (depth > 0) ? threads : 0;
+    prefetch.meta = meta;
+    prefetch.slot = NULL;
+    prefetch.arena = create_arena(0);
+    prefetch.stop = 0;
+    prefetch.file = NULL;
+    prefetch.sequence = NULL;
+    prefetch.batches = prefetch.next_load = prefetch.next_use = 0;
+    prefetch.stall_seconds = 0.0;
+    prefetch.requests = prefetch.ready_sum = 0;
+    if (depth == 0) return prefetch;
+
+    prefetch.arena = create_arena(
+        (prefetch.threads * batch_builder_size(meta->number_of_inputs, meta->batch_layout)) +
+        (depth * (jcky_arena_slice_size(batch_len * sizeof( nn_type )) +
+                  jcky_arena_slice_size(targets_len * sizeof( nn_type )))));
+    for (i=0; i<prefetch.threads; i++) {
+        prefetch.builder[i] = create_batch_builder(&(prefetch.arena), meta->number_of_inputs, meta->batch_layout);
+    }
+
+    prefetch.slot = malloc( depth * sizeof( jcky_prefetch_slot ) );
+    for (i=0; i<depth; i++) {
+        prefetch.slot[i].batch = arena_alloc(&(prefetch.arena), batch_len * sizeof( nn_type ));
+        prefetch.slot[i].targets = arena_alloc(&(prefetch.arena), targets_len * sizeof( nn_type ));
+        if (meta->input_format == JCKY_INPUT_SPARSE_ID) {
+            prefetch.slot[i].sparse = create_sparse_batch(meta->number_of_inputs, meta->batch_size);
+        }
+        prefetch.slot[i].state = JCKY_SLOT_FREE;
+    }
+
+    return prefetch;
+}
+
+
+// The loaders hold a pointer to the ring, and a mutex can't be copied,
+// so both are set up once the ring is at its final address, by the first
+// pass.
+static void start_loaders(jcky_prefetch *prefetch) {
+    int i;
+    jcky_loader *loader;
+
+    pthread_mutex_init(&(prefetch->lock), NULL);
+    pthread_mutex_init(&(prefetch->file_lock), NULL);
+    pthread_cond_init(&(prefetch->work), NULL);
+    pthread_cond_init(&(prefetch->filled), NULL);
+
+    for (i=0; i<prefetch->threads; i++) {
+        loader = malloc( sizeof( jcky_loader ) );
+        loader->prefetch = prefetch;
+        loader->id = i;
+        pthread_create(&(prefetch->loader[i]), NULL, run_loader, loader);
+    }
+}
+
+
+void destroy_prefetch(jcky_prefetch *prefetch) {
+    int i;
+
+    if (prefetch->depth == 0) return;
+
+    if (prefetch->file != NULL) {
+        pthread_mutex_lock(&(prefetch->lock));
+        prefetch->stop = 1;
+        pthread_cond_broadcast(&(prefetch->work));
+        pthread_mutex_unlock(&(prefetch->lock));
+        for (i=0; i<prefetch->threads; i++) pthread_join(prefetch->loader[i], NULL);
+        pthread_mutex_destroy(&(prefetch->lock));
+        pthread_mutex_destroy(&(prefetch->file_lock));
+        pthread_cond_destroy(&(prefetch->work));
+        pthread_cond_destroy(&(prefetch->filled));
+    }
+
+    if (prefetch->meta->input_format == JCKY_INPUT_SPARSE_ID) {
+        for (i=0; i<prefetch->depth; i++) destroy_sparse_batch(&(prefetch->slot[i].sparse));
+    }
+    free(prefetch->slot);
+    destroy_arena(&(prefetch->arena));
+}
+
+
+void prefetch_start(
+    jcky_prefetch *prefetch,
+    jcky_file *file,
+    unsigned int *sequence,
+    const unsigned int batches,
+    const unsigned short int rank,
+    const unsigned int process_offset)
+{
+    if (prefetch->file == NULL) start_loaders(prefetch);
+
+    pthread_mutex_lock(&(prefetch->lock));
+    prefetch->file = file;
+    prefetch->sequence = sequence;
+    prefetch->batches = batches;
+    prefetch->rank = rank;
+    prefetch->process_offset = process_offset;
+    prefetch->next_load = 0;
+    prefetch->next_use = 0;
+    pthread_cond_broadcast(&(prefetch->work));
+    pthread_mutex_unlock(&(prefetch->lock));
+}
+
+
+jcky_prefetch_slot * prefetch_next(jcky_prefetch *prefetch) {
+    int i;
+    struct timespec start, end;
+    jcky_prefetch_slot *slot;
+    jcky_sparse_batch sparse;
+
+    pthread_mutex_lock(&(prefetch->lock));
+    slot = &(prefetch->slot[prefetch->next_use % prefetch->depth]);
+
+    prefetch->requests++;
+    for (i=0; i<prefetch->depth; i++) {
+        if (prefetch->slot[i].state == JCKY_SLOT_READY) prefetch->ready_sum++;
+    }
+
+    if (slot->state != JCKY_SLOT_READY) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (slot->state != JCKY_SLOT_READY) pthread_cond_wait(&(prefetch->filled), &(prefetch->lock));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        prefetch->stall_seconds += timespec_seconds(diff_time(start, end));
+    }
+
+    slot->state = JCKY_SLOT_IN_USE;
+    prefetch->next_use++;
+    pthread_mutex_unlock(&(prefetch->lock));
+
+    if (prefetch->meta->input_format == JCKY_INPUT_SPARSE_ID) {
+        sparse = prefetch->meta->sparse_batch;
+        prefetch->meta->sparse_batch = slot->sparse;
+        slot->sparse = sparse;
+    }
+
+    return slot;
+}
+
+
+void prefetch_release(jcky_prefetch *prefetch, jcky_prefetch_slot *slot) {
+    pthread_mutex_lock(&(prefetch->lock));
+    slot->state = JCKY_SLOT_FREE;
+    pthread_cond_broadcast(&(prefetch->work));
+    pthread_mutex_unlock(&(prefetch->lock));
+}
+
+
+void prefetch_stats(jcky_prefetch *prefetch, double *stall_seconds, double *queue_depth) {
+    *stall_seconds = prefetch->stall_seconds;
+    *queue_depth = (prefetch->requests > 0) ? (double)prefetch->ready_sum / prefetch->requests : 0.0;
+    prefetch->stall_seconds = 0.0;
+    prefetch->requests = 0;
+    prefetch->ready_sum = 0;
+}
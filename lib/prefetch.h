@@ -0,0 +1,104 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+
+#include <pthread.h>
+
+#include "arena.h"
+#include "batch.h"
+#include "constants.h"
+#include "file_helpers.h"
+#include "neural_net.h"
+#include "sparse.h"
+
+
+// Builds the batches of a pass over a file ahead of the thread that
+// trains or tests on them (see --prefetch). The batches of a pass are
+// known before it starts (the training pass reads them in the order of
+// the epoch's sequence), so 'threads' loader threads build them, in
+// order, into a ring of 'depth' slots while the rank's own thread runs
+// the batches before them. Batch n goes into slot n % depth once batch
+// n - depth has been released, so at most 'depth' batches are built
+// ahead, and every buffer is allocated once, when the ring is created.
+//
+// Each slot has its own batch, targets and, with the sparse input
+// format, sparse batch. The rank's thread reads the batch and targets of
+// the slot in place, and prefetch_next swaps the slot's sparse batch
+// with the meta net's, so the first layer reads it where it always does.
+//
+// The loaders don't call MPI, so the MPI thread level isn't affected.
+// With the stdio reader they take turns at the file, which has one
+// position; a mapped file (see --reader) is read by all of them at once.
+#define JCKY_MAX_PREFETCH_THREADS 8
+
+enum prefetch_slot_states{JCKY_SLOT_FREE, JCKY_SLOT_LOADING, JCKY_SLOT_READY, JCKY_SLOT_IN_USE};
+
+typedef struct jcky_prefetch_slot {
+    nn_type *batch, *targets;
+    jcky_sparse_batch sparse;
+    unsigned char state;
+} jcky_prefetch_slot;
+
+typedef struct jcky_prefetch {
+    int depth, threads;
+    struct meta_neural_net *meta;
+    jcky_prefetch_slot *slot;
+    // The tile of each loader's batch builder and the batches and targets
+    // of the slots are sliced from the arena.
+    jcky_arena arena;
+    jcky_batch_builder builder[JCKY_MAX_PREFETCH_THREADS];
+    pthread_t loader[JCKY_MAX_PREFETCH_THREADS];
+
+    // 'lock' guards everything below. Loaders wait on 'work' for a batch
+    // to build and a free slot to build it in, the rank's thread waits on
+    // 'filled' for the next batch.
+    pthread_mutex_t lock, file_lock;
+    pthread_cond_t work, filled;
+    unsigned char stop;
+
+    // The pass: the file, the sequence of the training pass or NULL, the
+    // rank's share of the testing pass, and how far the loaders and the
+    // rank's thread have got through its batches.
+    jcky_file *file;
+    unsigned int *sequence;
+    unsigned short int rank;
+    unsigned int process_offset;
+    unsigned int batches, next_load, next_use;
+
+    // For the timing file: the wall time the rank's thread spent waiting
+    // for a batch, and the number of batches that were ready, summed over
+    // each call to prefetch_next.
+    double stall_seconds;
+    unsigned long int requests, ready_sum;
+} jcky_prefetch;
+
+// A ring of 'depth' slots filled by 'threads' loaders. With a depth of 0
+// nothing is allocated and no thread is started.
+jcky_prefetch create_prefetch(struct meta_neural_net *meta, const int depth, const int threads);
+void destroy_prefetch(jcky_prefetch *prefetch);
+
+// Starts building the batches of a pass. The training pass reads the
+// batches of 'sequence', the testing pass (when 'sequence' is NULL) the
+// rank's share of the file, as create_batch_no_sequence_file does. Every
+// batch of the previous pass must have been released.
+void prefetch_start(
+    jcky_prefetch *prefetch,
+    jcky_file *file,
+    unsigned int *sequence,
+    const unsigned int batches,
+    const unsigned short int rank,
+    const unsigned int process_offset
+);
+
+// Waits for the next batch of the pass, and hands its slot over to the
+// caller until it's released.
+jcky_prefetch_slot * prefetch_next(jcky_prefetch *prefetch);
+void prefetch_release(jcky_prefetch *prefetch, jcky_prefetch_slot *slot);
+
+// The seconds spent waiting in prefetch_next, and the mean number of
+// batches ready when it was called, since the last call. Both are 0
+// without prefetching.
+void prefetch_stats(jcky_prefetch *prefetch, double *stall_seconds, double *queue_depth);
+
+
+#endif
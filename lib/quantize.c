@@ -0,0 +1,181 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "hooks.h"
+#include "kernels.h"
+#include "matrix_helpers.h"
+#include "neural_net.h"
+#include "quantize.h"
+
+#define JCKY_INT8_MAX 127
+
+
+// Rounds half away from zero. Weights are as often negative as not, so
+// this avoids branching on the sign.
+static inline signed char quantize_value(const nn_type value, const nn_type inverse_scale) {
+    nn_type q = value * inverse_scale;
+    return (signed char)(int)(q + copysign(0.5, q));
+}
+
+
+// Quantizes 'len' values, 'stride' apart, into dest and returns the
+// scale they were quantized with.
+static nn_type quantize_vector(signed char *dest, const nn_type *src, const int len, const int stride) {
+    int i;
+    nn_type max_abs = 0.0, scale, inverse_scale;
+
+    for (i=0; i<len; i++) {
+        if (fabs(src[i * stride]) > max_abs) max_abs = fabs(src[i * stride]);
+    }
+
+    scale = (max_abs > 0.0) ? max_abs / JCKY_INT8_MAX : 1.0;
+    inverse_scale = 1.0 / scale;
+    for (i=0; i<len; i++) {
+        dest[i] = quantize_value(src[i * stride], inverse_scale);
+    }
+
+    return scale;
+}
+
+
+jcky_quantized_net create_quantized_net(struct meta_neural_net *meta) {
+    int i;
+    const int number_of_hidden_layers = meta->number_of_hidden_layers;
+    const int widest_input = nn_widest_layer(meta);
+    jcky_quantized_net qnet;
+
+    qnet.number_of_layers = number_of_hidden_layers + 1;
+    qnet.layer = malloc( qnet.number_of_layers * sizeof( jcky_quantized_layer ) );
+
+    for (i=0; i<qnet.number_of_layers; i++) {
+        qnet.layer[i].rows = nn_rows(meta, i);
+        qnet.layer[i].cols = nn_cols(meta, i);
+        qnet.layer[i].weight = (signed char *)malloc( qnet.layer[i].rows * qnet.layer[i].cols * sizeof( signed char ) );
+        qnet.layer[i].scale = (nn_type *)malloc( qnet.layer[i].rows * sizeof( nn_type ) );
+        qnet.layer[i].bias = NULL;
+    }
+
+    qnet.activation = (signed char *)malloc( widest_input * meta->batch_size * sizeof( signed char ) );
+    qnet.activation_scale = (nn_type *)malloc( meta->batch_size * sizeof( nn_type ) );
+    qnet.accum = (int *)malloc( meta->batch_size * sizeof( int ) );
+
+    return qnet;
+}
+
+
+void quantize_neural_net(struct meta_neural_net *meta, neural_net *nn, jcky_quantized_net *qnet) {
+    int i, j;
+    jcky_quantized_layer *layer;
+
+    for (i=0; i<qnet->number_of_layers; i++) {
+        layer = &(qnet->layer[i]);
+        for (j=0; j<layer->rows; j++) {
+            layer->scale[j] = quantize_vector(layer->weight + (j * layer->cols),
+                                              nn->weight[i] + (j * layer->cols),
+                                              layer->cols, 1);
+        }
+        layer->bias = nn->bias[i];
+    }
+}
+
+
+void destroy_quantized_net(jcky_quantized_net *qnet) {
+    int i;
+
+    for (i=0; i<qnet->number_of_layers; i++) {
+        free(qnet->layer[i].weight);
+        free(qnet->layer[i].scale);
+    }
+    free(qnet->layer);
+    free(qnet->activation);
+    free(qnet->activation_scale);
+    free(qnet->accum);
+}
+
+
+// z = W * input + bias for one layer, where 'input' holds 'cols' values
+// per entry in the batch, laid out as in feed_forward (see 'layout').
+static void quantized_z_matrix(
+    jcky_quantized_net *qnet,
+    jcky_quantized_layer *layer,
+    nn_type *z_matrix,
+    nn_type *input,
+    int batch_size,
+    unsigned char layout)
+{
+    int i, j;
+    const int cols = layer->cols;
+    const int node_stride = JCKY_NODE_STRIDE(layout, batch_size);
+    const int input_sample_stride = JCKY_SAMPLE_STRIDE(layout, cols);
+    const int z_sample_stride = JCKY_SAMPLE_STRIDE(layout, layer->rows);
+
+    for (j=0; j<batch_size; j++) {
+        qnet->activation_scale[j] = quantize_vector(qnet->activation + (j * cols),
+                                                    input + (j * input_sample_stride), cols, node_stride);
+    }
+
+    for (i=0; i<layer->rows; i++) {
+        jcky_kernels->dot_int8(layer->weight + (i * cols), qnet->activation, cols, batch_size, qnet->accum);
+        for (j=0; j<batch_size; j++) {
+            z_matrix[(i * node_stride) + (j * z_sample_stride)] =
+                (layer->scale[i] * qnet->activation_scale[j] * qnet->accum[j]) + layer->bias[i];
+        }
+    }
+}
+
+
+// The activations are written to meta->activation, as feed_forward
+// would, and the activation functions are applied in place.
+void quantized_feed_forward(
+    struct meta_neural_net *meta,
+    jcky_quantized_net *qnet,
+    nn_type *result,
+    nn_type *activation_initial,
+    nn_type *target_values,
+    double *score)
+{
+    int i;
+    const int number_of_hidden_layers = meta->number_of_hidden_layers;
+    const int number_of_outputs = meta->number_of_outputs;
+    const int batch_size = meta->batch_size;
+    nn_type *input = activation_initial;
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        quantized_z_matrix(qnet, &(qnet->layer[i]), meta->activation[i], input, batch_size, meta->batch_layout);
+        if (i == number_of_hidden_layers && meta->output == JCKY_OUTPUT_SOFTMAX_ID) {
+            softmax_output_layer(meta->activation[i], meta->activation[i], NULL, target_values,
+                                 number_of_outputs, batch_size, meta->batch_layout);
+        }
+        else {
+            activate(meta->activation[i], meta->activation[i], qnet->layer[i].rows, batch_size,
+                     meta->layer_activation[i], meta->sigmoid);
+        }
+        input = meta->activation[i];
+    }
+
+    copy_vectors(result, meta->activation[number_of_hidden_layers], number_of_outputs * batch_size);
+
+    if (target_values != NULL) {
+        *score += get_score(batch_size, number_of_outputs, meta->activation[number_of_hidden_layers], target_values,
+                            meta->batch_layout);
+    }
+}
+
+
+void dot_int8_scalar(
+    const signed char *weight,
+    const signed char *vectors,
+    const int len,
+    const int count,
+    int *dest)
+{
+    int i, j, accum;
+    for (j=0; j<count; j++) {
+        accum = 0;
+        for (i=0; i<len; i++) {
+            accum += weight[i] * vectors[(j * len) + i];
+        }
+        dest[j] = accum;
+    }
+}
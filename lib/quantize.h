@@ -0,0 +1,56 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+
+#include "constants.h"
+#include "neural_net.h"
+
+
+// An int8 copy of a neural net, used to score the testing data (see the
+// --inference option). It's rebuilt from the base neural net after each
+// sync, and only runs the forward pass.
+//
+// Each weight matrix is quantized symmetrically per row: row r holds
+// round(W[r][k] / scale[r]) with scale[r] = max|W[r]| / 127. The input
+// of each layer is quantized the same way per sample in the batch, so
+//    z[r][b] = scale[r] * activation_scale[b] * (Wq[r] . Aq[b]) + bias[r]
+// with the dot product of int8 values accumulated in an int. The biases
+// and the sigmoid stay in nn_type.
+typedef struct jcky_quantized_layer {
+    int rows, cols;
+    signed char *weight;
+    nn_type *scale;
+    nn_type *bias;
+} jcky_quantized_layer;
+
+typedef struct jcky_quantized_net {
+    int number_of_layers;
+    jcky_quantized_layer *layer;
+
+    // The quantized input of the layer being computed, stored one
+    // sample after another so each dot product reads contiguous memory.
+    signed char *activation;
+    nn_type *activation_scale;
+
+    // The integer dot products of one weight row with each sample.
+    int *accum;
+} jcky_quantized_net;
+
+jcky_quantized_net create_quantized_net(struct meta_neural_net *meta);
+void quantize_neural_net(struct meta_neural_net *meta, neural_net *nn, jcky_quantized_net *qnet);
+void destroy_quantized_net(jcky_quantized_net *qnet);
+
+// Same as feed_forward with JCKY_TEST, on the quantized neural net. The
+// outputs go to 'result', and are scored into 'score' when
+// 'target_values' isn't NULL.
+void quantized_feed_forward(
+    struct meta_neural_net *meta,
+    jcky_quantized_net *qnet,
+    nn_type *result,
+    nn_type *activation_initial,
+    nn_type *target_values,
+    double *score
+);
+
+
+#endif
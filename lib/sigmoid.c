@@ -0,0 +1,80 @@
+#include <math.h>
+
+#include "constants.h"
+#include "sigmoid.h"
+
+
+nn_type jcky_sigmoid_table[JCKY_SIGMOID_TABLE_LEN];
+
+
+void init_sigmoid_table() {
+    int i;
+    for (i=0; i<JCKY_SIGMOID_TABLE_LEN-1; i++) {
+        jcky_sigmoid_table[i] = 1.0 / (1.0 + exp(-((nn_type)i / JCKY_SIGMOID_TABLE_STEPS_PER_UNIT)));
+    }
+    // Repeat the last entry, so that an input clamped to the end of
+    // the table can still interpolate towards the next entry.
+    jcky_sigmoid_table[JCKY_SIGMOID_TABLE_LEN-1] = jcky_sigmoid_table[JCKY_SIGMOID_TABLE_LEN-2];
+}
+
+
+inline nn_type sigmoid_poly(nn_type z) {
+    union { nn_type d; nn_type_bits i; } t, scale;
+    nn_type x, n, r, p;
+
+    // exp(-z) = 2^n * exp(r)
+    x = -z;
+    if (x > JCKY_SIGMOID_POLY_CLAMP) x = JCKY_SIGMOID_POLY_CLAMP;
+    if (x < -JCKY_SIGMOID_POLY_CLAMP) x = -JCKY_SIGMOID_POLY_CLAMP;
+    t.d = (x * (nn_type)JCKY_LOG2E) + (nn_type)JCKY_EXP_MAGIC;
+    n = t.d - (nn_type)JCKY_EXP_MAGIC;
+    r = (x - (n * (nn_type)JCKY_LN2_HI)) - (n * (nn_type)JCKY_LN2_LO);
+
+    p = 1.0 + r * (1.0 + r * (1.0/2 + r * (1.0/6 + r * (1.0/24 + r * (1.0/120 + r * (1.0/720))))));
+    scale.i = t.i << JCKY_EXP_SHIFT;
+
+    return 1.0 / (1.0 + (p * scale.d));
+}
+
+
+inline nn_type sigmoid_table(nn_type z) {
+    nn_type u = fabs(z) * JCKY_SIGMOID_TABLE_STEPS_PER_UNIT;
+    nn_type fraction, value;
+    int index;
+
+    if (u > JCKY_SIGMOID_TABLE_RANGE * JCKY_SIGMOID_TABLE_STEPS_PER_UNIT) {
+        u = JCKY_SIGMOID_TABLE_RANGE * JCKY_SIGMOID_TABLE_STEPS_PER_UNIT;
+    }
+    index = (int)u;
+    fraction = u - index;
+    value = jcky_sigmoid_table[index] +
+            (fraction * (jcky_sigmoid_table[index + 1] - jcky_sigmoid_table[index]));
+
+    return (z < 0) ? 1.0 - value : value;
+}
+
+
+void sigmoidify_poly_scalar(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols)
+{
+    int i, size = rows*cols;
+    for (i=0; i<size; i++) {
+        activation[i] = sigmoid_poly(z_matrix[i]);
+    }
+}
+
+
+void sigmoidify_table_scalar(
+    nn_type *activation,
+    nn_type *z_matrix,
+    int rows,
+    int cols)
+{
+    int i, size = rows*cols;
+    for (i=0; i<size; i++) {
+        activation[i] = sigmoid_table(z_matrix[i]);
+    }
+}
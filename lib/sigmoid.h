@@ -0,0 +1,58 @@
+#ifndef SIGMOID_H
+#define SIGMOID_H
+
+
+#include "constants.h"
+
+
+// Sigmoid accuracy tiers. Each tier has a kernel in every kernel set
+// (see kernels.h). The maximum errors are absolute errors against the
+// libm sigmoid, over all finite inputs, and are checked by the tests.
+// In single precision they include the rounding of the result to float.
+//
+//   exact - 1 / (1 + exp(-z)) with libm's exp. This is the reference.
+//   poly  - exp(-z) range-reduced to 2^n * exp(r), |r| <= ln(2)/2, with a
+//           degree 6 Taylor polynomial for exp(r). Inputs are clamped to
+//           [-JCKY_SIGMOID_POLY_CLAMP, JCKY_SIGMOID_POLY_CLAMP].
+//           Maximum error: JCKY_SIGMOID_POLY_MAX_ERROR.
+//   table - Linear interpolation in a table of sigmoid(z) for z in
+//           [0, JCKY_SIGMOID_TABLE_RANGE], using sigmoid(-z) = 1 - sigmoid(z)
+//           for negative inputs. Inputs beyond the table take its last value.
+//           Maximum error: JCKY_SIGMOID_TABLE_MAX_ERROR.
+#define JCKY_SIGMOID_POLY_CLAMP 40.0
+
+#define JCKY_SIGMOID_TABLE_RANGE 16
+#define JCKY_SIGMOID_TABLE_STEPS_PER_UNIT 128
+#define JCKY_SIGMOID_TABLE_LEN ((JCKY_SIGMOID_TABLE_RANGE * JCKY_SIGMOID_TABLE_STEPS_PER_UNIT) + 2)
+
+// Constants for the range reduction of the poly tier. Adding
+// JCKY_EXP_MAGIC to x rounds x to an integer held in the low bits of
+// the mantissa, already offset by the exponent bias; shifting those
+// bits up by JCKY_EXP_SHIFT gives 2^x.
+#define JCKY_LOG2E 1.4426950408889634
+#ifdef JCKY_SINGLE_PRECISION
+#define JCKY_SIGMOID_POLY_MAX_ERROR 2e-7
+#define JCKY_SIGMOID_TABLE_MAX_ERROR 1e-6
+#define JCKY_LN2_HI 6.93359375e-1
+#define JCKY_LN2_LO -2.12194440e-4
+#define JCKY_EXP_MAGIC (12582912.0 + 127.0)
+#define JCKY_EXP_SHIFT 23
+typedef unsigned int nn_type_bits;
+#else
+#define JCKY_SIGMOID_POLY_MAX_ERROR 5e-8
+#define JCKY_SIGMOID_TABLE_MAX_ERROR 1e-6
+#define JCKY_LN2_HI 6.93145751953125e-1
+#define JCKY_LN2_LO 1.42860682030941723212e-6
+#define JCKY_EXP_MAGIC (6755399441055744.0 + 1023.0)
+#define JCKY_EXP_SHIFT 52
+typedef unsigned long long int nn_type_bits;
+#endif
+
+extern nn_type jcky_sigmoid_table[JCKY_SIGMOID_TABLE_LEN];
+
+void init_sigmoid_table();
+inline nn_type sigmoid_poly(nn_type z);
+inline nn_type sigmoid_table(nn_type z);
+
+
+#endif
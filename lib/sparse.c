@@ -0,0 +1,217 @@
+#include <stdlib.h>
+
+#include "constants.h"
+#include "half.h"
+#include "sparse.h"
+
+
+jcky_sparse_batch create_sparse_batch(const int inputs, const int samples) {
+    jcky_sparse_batch sparse;
+    const unsigned long int capacity = (unsigned long int)inputs * samples;
+
+    sparse.inputs = inputs;
+    sparse.samples = 0;
+
+    sparse.sample_start = (int *)malloc( (samples + 1) * sizeof( int ) );
+    sparse.input = (int *)malloc( capacity * sizeof( int ) );
+    sparse.value = (nn_type *)malloc( capacity * sizeof( nn_type ) );
+
+    sparse.active_len = 0;
+    sparse.active = (int *)malloc( inputs * sizeof( int ) );
+    sparse.active_start = (int *)malloc( (inputs + 1) * sizeof( int ) );
+    sparse.active_sample = (int *)malloc( capacity * sizeof( int ) );
+    sparse.active_value = (nn_type *)malloc( capacity * sizeof( nn_type ) );
+
+    sparse.position = (int *)calloc( inputs, sizeof( int ) );
+    sparse.sample_start[0] = 0;
+
+    return sparse;
+}
+
+
+void destroy_sparse_batch(jcky_sparse_batch *sparse) {
+    free(sparse->sample_start);
+    free(sparse->input);
+    free(sparse->value);
+    free(sparse->active);
+    free(sparse->active_start);
+    free(sparse->active_sample);
+    free(sparse->active_value);
+    free(sparse->position);
+}
+
+
+void sparse_batch_clear(jcky_sparse_batch *sparse) {
+    sparse->samples = 0;
+    sparse->active_len = 0;
+}
+
+
+void sparse_batch_add_sample(jcky_sparse_batch *sparse, const nn_type *record) {
+    int k;
+    int nnz = sparse->sample_start[sparse->samples];
+
+    for (k=0; k<sparse->inputs; k++) {
+        if (record[k] != 0.0) {
+            sparse->input[nnz] = k;
+            sparse->value[nnz] = record[k];
+            nnz++;
+        }
+    }
+
+    sparse->samples++;
+    sparse->sample_start[sparse->samples] = nnz;
+}
+
+
+// A counting sort of the values by input. 'position' starts out holding
+// the number of values of each input, and ends up back at zero, ready
+// for the next batch.
+void sparse_batch_finish(jcky_sparse_batch *sparse) {
+    int j, k, p, a, start;
+    const int nnz = JCKY_SPARSE_NNZ(sparse);
+
+    for (p=0; p<nnz; p++) sparse->position[sparse->input[p]]++;
+
+    sparse->active_len = 0;
+    start = 0;
+    for (k=0; k<sparse->inputs; k++) {
+        if (sparse->position[k] == 0) continue;
+        a = sparse->active_len++;
+        sparse->active[a] = k;
+        sparse->active_start[a] = start;
+        start += sparse->position[k];
+        sparse->position[k] = sparse->active_start[a];
+    }
+    sparse->active_start[sparse->active_len] = start;
+
+    // The samples are visited in order, so each input's values stay in
+    // the order of the samples.
+    for (j=0; j<sparse->samples; j++) {
+        for (p=sparse->sample_start[j]; p<sparse->sample_start[j+1]; p++) {
+            k = sparse->input[p];
+            sparse->active_sample[sparse->position[k]] = j;
+            sparse->active_value[sparse->position[k]] = sparse->value[p];
+            sparse->position[k]++;
+        }
+    }
+
+    for (a=0; a<sparse->active_len; a++) sparse->position[sparse->active[a]] = 0;
+}
+
+
+// Both kernels work on this many rows of W at a time, so each index
+// and value of the batch is loaded once for all of them, and the rows'
+// sums don't wait on one another.
+#define JCKY_SPARSE_ROWS 4
+
+
+static inline nn_type sparse_weight(
+    const nn_type *weight,
+    const jcky_half *weight_half,
+    const unsigned char storage,
+    const long int index)
+{
+    return (storage == JCKY_STORAGE_NATIVE_ID) ? weight[index] : jcky_half_to_nn_type(weight_half[index], storage);
+}
+
+
+void sparse_z_matrix(
+    nn_type *z_matrix,
+    nn_type *weight,
+    jcky_half *weight_half,
+    unsigned char storage,
+    jcky_sparse_batch *sparse,
+    nn_type *bias,
+    int weight_rows,
+    unsigned char layout)
+{
+    int i, j, p, r, k;
+    nn_type value;
+    nn_type accum[JCKY_SPARSE_ROWS];
+    const long int weight_cols = sparse->inputs;
+    const int node_stride = JCKY_NODE_STRIDE(layout, sparse->samples);
+    const int sample_stride = JCKY_SAMPLE_STRIDE(layout, weight_rows);
+
+    for (i=0; i+JCKY_SPARSE_ROWS<=weight_rows && storage == JCKY_STORAGE_NATIVE_ID; i+=JCKY_SPARSE_ROWS) {
+        const nn_type *row = weight + (i * weight_cols);
+        for (j=0; j<sparse->samples; j++) {
+            accum[0] = accum[1] = accum[2] = accum[3] = 0.0;
+            for (p=sparse->sample_start[j]; p<sparse->sample_start[j+1]; p++) {
+                k = sparse->input[p];
+                value = sparse->value[p];
+                accum[0] += row[k] * value;
+                accum[1] += row[weight_cols + k] * value;
+                accum[2] += row[(2 * weight_cols) + k] * value;
+                accum[3] += row[(3 * weight_cols) + k] * value;
+            }
+            for (r=0; r<JCKY_SPARSE_ROWS; r++) {
+                z_matrix[((i + r) * node_stride) + (j * sample_stride)] = accum[r] + bias[i + r];
+            }
+        }
+    }
+
+    // The rows left over, and every row of 16 bit weights
+    for (; i<weight_rows; i++) {
+        for (j=0; j<sparse->samples; j++) {
+            accum[0] = 0.0;
+            for (p=sparse->sample_start[j]; p<sparse->sample_start[j+1]; p++) {
+                accum[0] += sparse_weight(weight, weight_half, storage, (i * weight_cols) + sparse->input[p]) *
+                            sparse->value[p];
+            }
+            z_matrix[(i * node_stride) + (j * sample_stride)] = accum[0] + bias[i];
+        }
+    }
+}
+
+
+void sparse_adjust_weight(
+    jcky_sparse_batch *sparse,
+    nn_type *weight,
+    nn_type *delta,
+    int weight_rows,
+    nn_type eta,
+    unsigned char layout)
+{
+    int i, a, p, r;
+    nn_type value;
+    nn_type accum[JCKY_SPARSE_ROWS];
+    const nn_type *node_delta[JCKY_SPARSE_ROWS];
+    nn_type *row;
+    const nn_type scale = -(eta / sparse->samples);
+    const long int weight_cols = sparse->inputs;
+    const int node_stride = JCKY_NODE_STRIDE(layout, sparse->samples);
+    const int sample_stride = JCKY_SAMPLE_STRIDE(layout, weight_rows);
+    long int offset;
+
+    for (i=0; i+JCKY_SPARSE_ROWS<=weight_rows; i+=JCKY_SPARSE_ROWS) {
+        row = weight + (i * weight_cols);
+        for (r=0; r<JCKY_SPARSE_ROWS; r++) node_delta[r] = delta + ((i + r) * node_stride);
+        for (a=0; a<sparse->active_len; a++) {
+            accum[0] = accum[1] = accum[2] = accum[3] = 0.0;
+            for (p=sparse->active_start[a]; p<sparse->active_start[a+1]; p++) {
+                offset = sparse->active_sample[p] * sample_stride;
+                value = sparse->active_value[p];
+                accum[0] += node_delta[0][offset] * value;
+                accum[1] += node_delta[1][offset] * value;
+                accum[2] += node_delta[2][offset] * value;
+                accum[3] += node_delta[3][offset] * value;
+            }
+            for (r=0; r<JCKY_SPARSE_ROWS; r++) {
+                row[(r * weight_cols) + sparse->active[a]] += scale * accum[r];
+            }
+        }
+    }
+
+    for (; i<weight_rows; i++) {
+        row = weight + (i * weight_cols);
+        node_delta[0] = delta + (i * node_stride);
+        for (a=0; a<sparse->active_len; a++) {
+            accum[0] = 0.0;
+            for (p=sparse->active_start[a]; p<sparse->active_start[a+1]; p++) {
+                accum[0] += node_delta[0][sparse->active_sample[p] * sample_stride] * sparse->active_value[p];
+            }
+            row[sparse->active[a]] += scale * accum[0];
+        }
+    }
+}
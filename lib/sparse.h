@@ -0,0 +1,78 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+
+#include "constants.h"
+#include "half.h"
+
+
+// A batch of inputs that only keeps their nonzero values (see
+// --input-format). The values are stored twice: by sample (CSR), which
+// the forward pass of the first layer walks, and by input (CSC), which
+// its weight update walks. Only the inputs that are nonzero in at least
+// one sample of the batch get a column in the CSC copy, so the update
+// never touches the weights of an input that's zero across the batch.
+//
+// The batch builder fills it next to the dense batch: clear it, add the
+// samples in order, then finish it to build the CSC copy.
+typedef struct jcky_sparse_batch {
+    int inputs, samples;
+
+    // The values of sample j are value[sample_start[j]] up to
+    // value[sample_start[j+1]], for the inputs in 'input', in order.
+    int *sample_start;
+    int *input;
+    nn_type *value;
+
+    // The values of input active[a] are active_value[active_start[a]] up
+    // to active_value[active_start[a+1]], for the samples in
+    // 'active_sample', in order.
+    int active_len;
+    int *active;
+    int *active_start;
+    int *active_sample;
+    nn_type *active_value;
+
+    // Where the next value of each input goes while the CSC copy is built
+    int *position;
+} jcky_sparse_batch;
+
+jcky_sparse_batch create_sparse_batch(const int inputs, const int samples);
+void destroy_sparse_batch(jcky_sparse_batch *sparse);
+
+void sparse_batch_clear(jcky_sparse_batch *sparse);
+// Adds the nonzero values of the 'inputs' values in 'record' as the
+// next sample of the batch.
+void sparse_batch_add_sample(jcky_sparse_batch *sparse, const nn_type *record);
+void sparse_batch_finish(jcky_sparse_batch *sparse);
+
+// The number of nonzero values in the batch
+#define JCKY_SPARSE_NNZ(sparse) ((sparse)->sample_start[(sparse)->samples])
+
+// z = W * input + bias for the first layer, reading only the weights of
+// each sample's nonzero inputs. 'weight_half' is read instead of
+// 'weight' when the storage isn't native. z is laid out as 'layout' says.
+void sparse_z_matrix(
+    nn_type *z_matrix,
+    nn_type *weight,
+    jcky_half *weight_half,
+    unsigned char storage,
+    jcky_sparse_batch *sparse,
+    nn_type *bias,
+    int weight_rows,
+    unsigned char layout
+);
+
+// W -= (eta / batch size) * delta * input^T for the first layer, only
+// for the columns of W of the inputs that are nonzero in the batch.
+void sparse_adjust_weight(
+    jcky_sparse_batch *sparse,
+    nn_type *weight,
+    nn_type *delta,
+    int weight_rows,
+    nn_type eta,
+    unsigned char layout
+);
+
+
+#endif
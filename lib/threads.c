@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "constants.h"
+#include "threads.h"
+
+
+int jcky_threads = 1;
+int jcky_kernel_threads = 1;
+
+// Each thread's idle time lives on its own cache line, since every
+// thread writes its own entry at every barrier.
+typedef struct jcky_thread_idle {
+    double seconds;
+    char pad[64 - sizeof(double)];
+} jcky_thread_idle;
+
+static jcky_thread_idle idle[JCKY_MAX_THREADS];
+static double parallel_seconds = 0.0;
+
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + ((double)time.tv_nsec / 1000000000.0);
+}
+
+
+unsigned char jcky_threads_supported(const int threads) {
+#ifdef _OPENMP
+    return (threads >= 1 && threads <= JCKY_MAX_THREADS);
+#else
+    return (threads == 1);
+#endif
+}
+
+
+unsigned char jcky_select_threads(const int requested, const unsigned char mode, const unsigned char master) {
+    if (!jcky_threads_supported(requested)) {
+        if (master) {
+#ifdef _OPENMP
+            printf(KRED "Error: The number of threads must be between 1 and %i.\n" KNRM, JCKY_MAX_THREADS);
+#else
+            printf(KRED "Error: Jockey was built without OpenMP, so it can only run one thread.\n" KNRM);
+#endif
+        }
+        return 1;
+    }
+
+    if (mode == JCKY_THREAD_MODE_HOGWILD_ID && !JCKY_HOGWILD_SUPPORTED) {
+        if (master) printf(KRED "Error: The hogwild thread mode isn't supported on this platform.\n" KNRM);
+        return 1;
+    }
+
+    jcky_threads = requested;
+    jcky_kernel_threads = (mode == JCKY_THREAD_MODE_KERNELS_ID) ? requested : 1;
+    return 0;
+}
+
+
+int jcky_auto_threads(const int node_ranks) {
+    int threads = 1;
+
+#ifdef _OPENMP
+    threads = omp_get_num_procs() / ((node_ranks > 0) ? node_ranks : 1);
+    if (threads < 1) threads = 1;
+    if (threads > JCKY_MAX_THREADS) threads = JCKY_MAX_THREADS;
+#endif
+
+    return threads;
+}
+
+
+void jcky_thread_range(const long int len, const int align, long int *first, long int *last) {
+    long int blocks = (len + align - 1) / align;
+    int thread = 0, threads = 1;
+
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+    threads = omp_get_num_threads();
+#endif
+
+    *first = ((blocks * thread) / threads) * align;
+    *last = ((blocks * (thread + 1)) / threads) * align;
+    if (*first > len) *first = len;
+    if (*last > len) *last = len;
+}
+
+
+void jcky_thread_barrier() {
+#ifdef _OPENMP
+    double start;
+
+    if (omp_get_num_threads() == 1) return;
+
+    start = now();
+    #pragma omp barrier
+    idle[omp_get_thread_num()].seconds += now() - start;
+#endif
+}
+
+
+double jcky_parallel_start() {
+    return now();
+}
+
+
+void jcky_parallel_end(const double start) {
+    parallel_seconds += now() - start;
+}
+
+
+double jcky_thread_utilization(double *utilization) {
+    int i;
+    double seconds = parallel_seconds;
+
+    for (i=0; i<jcky_threads; i++) {
+        utilization[i] = (seconds > 0.0) ? (seconds - idle[i].seconds) / seconds : 0.0;
+        idle[i].seconds = 0.0;
+    }
+    parallel_seconds = 0.0;
+
+    return seconds;
+}
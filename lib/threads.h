@@ -0,0 +1,72 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+
+#include "constants.h"
+
+
+// Threads within a rank (see --threads and --thread-mode). In the
+// kernels mode the GEMM and the elementwise kernels split each call
+// across 'jcky_kernel_threads' OpenMP threads once the
+// call has enough work to pay for waking them up: the GEMM hands each
+// thread a share of its register tiles, which run along the rows of W
+// and the columns of the batch, and the elementwise kernels hand each
+// thread a contiguous range. Each tile and each element is computed by
+// exactly one thread, in the same order as a single thread would, so
+// the results don't depend on the number of threads. In the data mode
+// and the hogwild mode each of the 'jcky_threads' threads trains on its
+// own batches instead (see workers.h), and the kernels run on the thread
+// that calls them.
+//
+// Without OpenMP (make OPENMP=0) the pragmas are ignored and only one
+// thread is available.
+#define JCKY_MAX_THREADS 64
+
+// The smallest GEMM (in flops) and elementwise kernel (in elements) that
+// are split across threads.
+#define JCKY_PARALLEL_MIN_FLOPS (2.0 * 64 * 64 * 64)
+#define JCKY_PARALLEL_MIN_ELEMENTS 8192
+
+// Thread ranges of elementwise kernels start on a multiple of this many
+// elements, so no two threads write to the same cache line.
+#define JCKY_THREAD_RANGE_ALIGN 16
+
+// The hogwild mode lets threads update the shared weights without any
+// synchronization. That's only sound where aligned loads and stores of
+// nn_type can't tear, which makes them the relaxed atomic accesses the
+// mode relies on without any special instructions.
+#if defined(__x86_64__) || defined(__aarch64__) || defined(__powerpc64__)
+#define JCKY_HOGWILD_SUPPORTED 1
+#else
+#define JCKY_HOGWILD_SUPPORTED 0
+#endif
+
+extern int jcky_threads;
+extern int jcky_kernel_threads;
+
+unsigned char jcky_threads_supported(const int threads);
+unsigned char jcky_select_threads(const int requested, const unsigned char mode, const unsigned char master);
+
+// The number of threads that gives each of 'node_ranks' ranks on a node
+// an equal share of its cores.
+int jcky_auto_threads(const int node_ranks);
+
+// Inside a parallel region, the [first, last) share of 'len' items
+// that belongs to the calling thread, with 'first' a multiple of 'align'.
+void jcky_thread_range(const long int len, const int align, long int *first, long int *last);
+
+// A barrier that adds the time the calling thread waits at it to the
+// thread's idle time.
+void jcky_thread_barrier();
+
+// Bracket each parallel region, from the thread that starts it, to add
+// its wall time to the parallel time.
+double jcky_parallel_start();
+void jcky_parallel_end(const double start);
+
+// Fills 'utilization' with the share of the parallel time each thread
+// spent working since the last call, and returns the parallel time.
+double jcky_thread_utilization(double *utilization);
+
+
+#endif
@@ -1,10 +1,13 @@
 #include <stdio.h>
 
 #include "constants.h"
+#include "neural_net.h"
 #include "timing_helpers.h"
 
 
-inline void write_headers(FILE *stream) {
+inline void write_headers(FILE *stream, unsigned short int layers, int threads) {
+    unsigned short int i;
+
     fprintf(stream, "epoch,");
     fprintf(stream, "epoch_time,");
     fprintf(stream, "copy_time,");
@@ -15,27 +18,84 @@ inline void write_headers(FILE *stream) {
     fprintf(stream, "sync_time,");
     fprintf(stream, "testing_time,");
     fprintf(stream, "testing_batch_time,");
-    fprintf(stream, "testing_run_time");
+    fprintf(stream, "testing_run_time,");
+    fprintf(stream, "backprop_time,");
+    fprintf(stream, "training_stall_time,");
+    fprintf(stream, "training_queue_depth,");
+    fprintf(stream, "testing_stall_time,");
+    fprintf(stream, "testing_queue_depth");
+    for (i=0; i<layers; i++) fprintf(stream, ",forward_gflops_layer_%i", i);
+    fprintf(stream, ",parallel_time");
+    for (i=0; i<threads; i++) fprintf(stream, ",thread_utilization_%i", i);
     fprintf(stream, "\n");
 }
 
 
 inline void write_record(unsigned short int epoch, jcky_timer *timer, FILE *stream) {
+    unsigned short int i;
     fprintf(stream, "%i,", epoch+1);
-    fprintf(stream, "%i.%i,", timer->epoch.tv_sec, timer->epoch.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->copy.tv_sec, timer->copy.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->shuffle.tv_sec, timer->shuffle.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->training.tv_sec, timer->training.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->training_batch.tv_sec, timer->training_batch.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->training_run.tv_sec, timer->training_run.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->sync.tv_sec, timer->sync.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->testing.tv_sec, timer->testing.tv_nsec);
-    fprintf(stream, "%i.%i,", timer->testing_batch.tv_sec, timer->testing_batch.tv_nsec);
-    fprintf(stream, "%i.%i", timer->testing_run.tv_sec, timer->testing_run.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->epoch.tv_sec, timer->epoch.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->copy.tv_sec, timer->copy.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->shuffle.tv_sec, timer->shuffle.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->training.tv_sec, timer->training.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->training_batch.tv_sec, timer->training_batch.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->training_run.tv_sec, timer->training_run.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->sync.tv_sec, timer->sync.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->testing.tv_sec, timer->testing.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->testing_batch.tv_sec, timer->testing_batch.tv_nsec);
+    fprintf(stream, "%li.%09li,", (long int)timer->testing_run.tv_sec, timer->testing_run.tv_nsec);
+    fprintf(stream, "%f,", timer->backprop);
+    fprintf(stream, "%f,", timer->training_stall);
+    fprintf(stream, "%f,", timer->training_queue);
+    fprintf(stream, "%f,", timer->testing_stall);
+    fprintf(stream, "%f", timer->testing_queue);
+    for (i=0; i<timer->layers; i++) fprintf(stream, ",%f", timer->layer_gflops[i]);
+    fprintf(stream, ",%f", timer->parallel);
+    for (i=0; i<timer->threads; i++) fprintf(stream, ",%f", timer->thread_utilization[i]);
     fprintf(stream, "\n");
 }
 
 
+double timespec_seconds(struct timespec time) {
+    return (double)time.tv_sec + ((double)time.tv_nsec / 1000000000.0);
+}
+
+
+// Turns the flops and wall time accumulated by each layer's forward pass
+// during the epoch into GFLOP/s, and resets the layer timers.
+void record_layer_gflops(struct meta_neural_net *meta, jcky_timer *timer) {
+    unsigned short int i;
+    jcky_layer_timer *layer_timer;
+
+    for (i=0; i<timer->layers; i++) {
+        layer_timer = &(meta->layer_timers[i]);
+        timer->layer_gflops[i] = (layer_timer->seconds > 0.0) ?
+                                 (layer_timer->flops / layer_timer->seconds) / 1000000000.0 :
+                                 0.0;
+        layer_timer->seconds = 0.0;
+        layer_timer->flops = 0.0;
+    }
+}
+
+
+// Takes the wall time accumulated in backpropagate during the epoch,
+// and resets the timer.
+void record_backprop_time(struct meta_neural_net *meta, jcky_timer *timer) {
+    timer->backprop = meta->backprop_timer.seconds;
+    meta->backprop_timer.seconds = 0.0;
+}
+
+
+// Takes the wall time the workers spent building their batches during
+// the epoch as the epoch's training batch time, and resets the timer.
+void record_worker_batch_time(struct meta_neural_net *meta, jcky_timer *timer) {
+    timer->training_batch.tv_sec = (time_t)meta->batch_timer.seconds;
+    timer->training_batch.tv_nsec =
+        (long int)((meta->batch_timer.seconds - (double)timer->training_batch.tv_sec) * 1000000000.0);
+    meta->batch_timer.seconds = 0.0;
+}
+
+
 void write_timing(unsigned short int epochs, jcky_timer *timers) {
     FILE *stream;
     unsigned short int i;
@@ -43,7 +103,7 @@ void write_timing(unsigned short int epochs, jcky_timer *timers) {
     if (epochs > 0) {
         stream = fopen(JCKY_TIMING_FILENAME, "w+");
         if (stream != NULL) {
-            write_headers(stream);
+            write_headers(stream, timers[0].layers, timers[0].threads);
             for(i=0; i<epochs; i++) write_record(i, &timers[i], stream);
             fclose(stream);
         }
@@ -58,7 +118,7 @@ void write_timing_record(unsigned short int epoch, jcky_timer *timer) {
     char *mode = (epoch == 0) ? "w+" : "a+";
     FILE *stream = fopen(JCKY_TIMING_FILENAME, mode);
     if (stream != NULL) {
-        if (epoch == 0) write_headers(stream);
+        if (epoch == 0) write_headers(stream, timer->layers, timer->threads);
         write_record(epoch, timer, stream);
         fclose(stream);
     }
@@ -5,63 +5,96 @@
 #include <time.h>
 
 #include "constants.h"
+#include "threads.h"
 
 
 struct timespec diff_time(struct timespec start, struct timespec end);
+struct timespec add_time(struct timespec total, struct timespec time);
 
 #ifdef JCKY_TIMING
-#define INIT_TIMERS jcky_timer *timers = malloc(cli.epochs * sizeof(jcky_timer));
-#define GET_TIMER jcky_timer timer;
-
-#define START_TIME_EPOCH clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.epoch_start));
+#define INIT_TIMERS \
+    jcky_timer *timers = malloc(cli.epochs * sizeof(jcky_timer));\
+    double *layer_gflops = malloc(cli.epochs * (neural_net.number_of_hidden_layers + 1) * sizeof(double));\
+    double *thread_utilization = malloc(cli.epochs * jcky_threads * sizeof(double));
+#define GET_TIMER \
+    jcky_timer timer;\
+    timer.layers = neural_net.number_of_hidden_layers + 1;\
+    timer.layer_gflops = layer_gflops + (epoch * timer.layers);\
+    timer.threads = jcky_threads;\
+    timer.thread_utilization = thread_utilization + (epoch * timer.threads);\
+    timer.training_batch.tv_sec = timer.training_batch.tv_nsec = 0;\
+    timer.training_run.tv_sec = timer.training_run.tv_nsec = 0;\
+    timer.testing_batch.tv_sec = timer.testing_batch.tv_nsec = 0;\
+    timer.testing_run.tv_sec = timer.testing_run.tv_nsec = 0;
+
+// Every timer measures wall time. The process CPU time would add up
+// every thread of the rank, so it would grow with --threads and
+// --prefetch instead of showing how long each step took.
+#define START_TIME_EPOCH clock_gettime(CLOCK_MONOTONIC, &(timer.epoch_start));
 #define END_TIME_EPOCH \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.epoch_end));\
+    clock_gettime(CLOCK_MONOTONIC, &(timer.epoch_end));\
     timer.epoch = diff_time(timer.epoch_start, timer.epoch_end);
 
-#define START_TIME_COPY clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.copy_start));
+#define START_TIME_COPY clock_gettime(CLOCK_MONOTONIC, &(timer.copy_start));
 #define END_TIME_COPY \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.copy_end));\
+    clock_gettime(CLOCK_MONOTONIC, &(timer.copy_end));\
     timer.copy = diff_time(timer.copy_start, timer.copy_end);
 
-#define START_TIME_SHUFFLE clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.shuffle_start));
+#define START_TIME_SHUFFLE clock_gettime(CLOCK_MONOTONIC, &(timer.shuffle_start));
 #define END_TIME_SHUFFLE \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.shuffle_end));\
+    clock_gettime(CLOCK_MONOTONIC, &(timer.shuffle_end));\
     timer.shuffle = diff_time(timer.shuffle_start, timer.shuffle_end);
 
-#define START_TIME_TRAINING clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.training_start));
+#define START_TIME_TRAINING clock_gettime(CLOCK_MONOTONIC, &(timer.training_start));
 #define END_TIME_TRAINING \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.training_end));\
+    clock_gettime(CLOCK_MONOTONIC, &(timer.training_end));\
     timer.training = diff_time(timer.training_start, timer.training_end);
 
-#define START_TIME_TRAINING_BATCH clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.training_batch_start));
+// The batch and run timers are taken once per batch, and add up over the
+// epoch.
+#define START_TIME_TRAINING_BATCH clock_gettime(CLOCK_MONOTONIC, &(timer.training_batch_start));
 #define END_TIME_TRAINING_BATCH \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.training_batch_end));\
-    timer.training_batch = diff_time(timer.training_batch_start, timer.training_batch_end);
+    clock_gettime(CLOCK_MONOTONIC, &(timer.training_batch_end));\
+    timer.training_batch = add_time(timer.training_batch, diff_time(timer.training_batch_start, timer.training_batch_end));
 
-#define START_TIME_TRAINING_RUN clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.training_run_start));
+#define START_TIME_TRAINING_RUN clock_gettime(CLOCK_MONOTONIC, &(timer.training_run_start));
 #define END_TIME_TRAINING_RUN \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.training_run_end));\
-    timer.training_run = diff_time(timer.training_run_start, timer.training_run_end);
+    clock_gettime(CLOCK_MONOTONIC, &(timer.training_run_end));\
+    timer.training_run = add_time(timer.training_run, diff_time(timer.training_run_start, timer.training_run_end));
 
-#define START_TIME_SYNC clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.sync_start));
+#define START_TIME_SYNC clock_gettime(CLOCK_MONOTONIC, &(timer.sync_start));
 #define END_TIME_SYNC \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.sync_end));\
+    clock_gettime(CLOCK_MONOTONIC, &(timer.sync_end));\
     timer.sync = diff_time(timer.sync_start, timer.sync_end);
 
-#define START_TIME_TESTING clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.testing_start));
+#define START_TIME_TESTING clock_gettime(CLOCK_MONOTONIC, &(timer.testing_start));
 #define END_TIME_TESTING \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.testing_end));\
+    clock_gettime(CLOCK_MONOTONIC, &(timer.testing_end));\
     timer.testing = diff_time(timer.testing_start, timer.testing_end);
 
-#define START_TIME_TESTING_BATCH clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.testing_batch_start));
+#define START_TIME_TESTING_BATCH clock_gettime(CLOCK_MONOTONIC, &(timer.testing_batch_start));
 #define END_TIME_TESTING_BATCH \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.testing_batch_end));\
-    timer.testing_batch = diff_time(timer.testing_batch_start, timer.testing_batch_end);
+    clock_gettime(CLOCK_MONOTONIC, &(timer.testing_batch_end));\
+    timer.testing_batch = add_time(timer.testing_batch, diff_time(timer.testing_batch_start, timer.testing_batch_end));
 
-#define START_TIME_TESTING_RUN clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.testing_run_start));
+#define START_TIME_TESTING_RUN clock_gettime(CLOCK_MONOTONIC, &(timer.testing_run_start));
 #define END_TIME_TESTING_RUN \
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &(timer.testing_run_end));\
-    timer.testing_run = diff_time(timer.testing_run_start, timer.testing_run_end);
+    clock_gettime(CLOCK_MONOTONIC, &(timer.testing_run_end));\
+    timer.testing_run = add_time(timer.testing_run, diff_time(timer.testing_run_start, timer.testing_run_end));
+
+// The per-layer timers live on the meta_neural_net so that feed_forward
+// can reach them, and are used to compute a throughput.
+#define START_TIME_LAYER(layer_timer) clock_gettime(CLOCK_MONOTONIC, &((layer_timer)->start));
+#define END_TIME_LAYER(layer_timer, ops) \
+    clock_gettime(CLOCK_MONOTONIC, &((layer_timer)->end));\
+    (layer_timer)->seconds += timespec_seconds(diff_time((layer_timer)->start, (layer_timer)->end));\
+    (layer_timer)->flops += (ops);
+#define END_TIME_LAYERS record_layer_gflops(&neural_net, &timer);
+#define END_TIME_BACKPROP record_backprop_time(&neural_net, &timer);
+#define END_TIME_WORKER_BATCHES record_worker_batch_time(&neural_net, &timer);
+#define END_TIME_THREADS timer.parallel = jcky_thread_utilization(timer.thread_utilization);
+#define END_TIME_TRAINING_PREFETCH prefetch_stats(&prefetch, &(timer.training_stall), &(timer.training_queue));
+#define END_TIME_TESTING_PREFETCH prefetch_stats(&prefetch, &(timer.testing_stall), &(timer.testing_queue));
 
 #define WRITE_TIME \
     if (mpi_manager.master) { \
@@ -69,8 +102,8 @@ struct timespec diff_time(struct timespec start, struct timespec end);
         else timers[epoch] = timer; \
     }
 #define WRITE_TIMES \
-    if (mpi_manager.master && cli.no_timing) write_timing(cli.epochs, timers);
-#define FREE_TIMERS free(timers);
+    if (mpi_manager.master && cli.no_timing) write_timing(epoch, timers);
+#define FREE_TIMERS free(timers); free(layer_gflops); free(thread_utilization);
 
 #else
 #define INIT_TIMERS
@@ -95,6 +128,14 @@ struct timespec diff_time(struct timespec start, struct timespec end);
 #define END_TIME_TESTING_BATCH
 #define START_TIME_TESTING_RUN
 #define END_TIME_TESTING_RUN
+#define START_TIME_LAYER(layer_timer)
+#define END_TIME_LAYER(layer_timer, ops)
+#define END_TIME_LAYERS
+#define END_TIME_BACKPROP
+#define END_TIME_WORKER_BATCHES
+#define END_TIME_THREADS
+#define END_TIME_TRAINING_PREFETCH
+#define END_TIME_TESTING_PREFETCH
 #define RECORD_TIME
 #define FREE_TIMERS
 #define WRITE_TIME
@@ -112,8 +153,31 @@ typedef struct jcky_timer {
     struct timespec testing, testing_start, testing_end;
     struct timespec testing_batch, testing_batch_start, testing_batch_end;
     struct timespec testing_run, testing_run_start, testing_run_end;
+    double backprop;
+    // The wall time spent waiting for a prefetched batch, and the mean
+    // number of batches ready when one was asked for (see prefetch.h).
+    double training_stall, training_queue, testing_stall, testing_queue;
+    unsigned short int layers;
+    double *layer_gflops;
+    // Wall time spent in parallel regions, and the share of it each
+    // thread spent working (see threads.h).
+    double parallel;
+    int threads;
+    double *thread_utilization;
 } jcky_timer;
 
+typedef struct jcky_layer_timer {
+    struct timespec start, end;
+    double seconds;
+    double flops;
+} jcky_layer_timer;
+
+struct meta_neural_net;
+
+double timespec_seconds(struct timespec time);
+void record_layer_gflops(struct meta_neural_net *meta, jcky_timer *timer);
+void record_backprop_time(struct meta_neural_net *meta, jcky_timer *timer);
+void record_worker_batch_time(struct meta_neural_net *meta, jcky_timer *timer);
 void write_timing(unsigned short int epochs, jcky_timer *timers);
 void write_timing_record(unsigned short int epoch, jcky_timer *timer);
 
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "batch.h"
+#include "constants.h"
+#include "gemm.h"
+#include "helpers.h"
+#include "matrix_helpers.h"
+#include "neural_net.h"
+#include "threads.h"
+#include "workers.h"
+
+
+// Each worker's buffers are allocated by its own thread, so their pages
+// are first touched there and land on that thread's node.
+jcky_workers create_workers(struct meta_neural_net *meta, const int count, const unsigned char mode) {
+    jcky_workers workers;
+
+    workers.count = count;
+    workers.mode = mode;
+    workers.worker = malloc( count * sizeof( jcky_worker ) );
+
+    #pragma omp parallel num_threads(count)
+    {
+        int i;
+        jcky_worker *worker;
+
+        for (i=0; i<count; i++) {
+#ifdef _OPENMP
+            if (i % omp_get_num_threads() != omp_get_thread_num()) continue;
+#endif
+            worker = &(workers.worker[i]);
+            worker->meta = *meta;
+            worker->meta.cms_len = 0;
+            worker->meta.cms = NULL;
+            meta_nn_alloc_batch(&(worker->meta));
+            nn_alloc_optimizer(&(worker->meta));
+            if (mode == JCKY_THREAD_MODE_HOGWILD_ID) {
+                nn_alloc_half(&(worker->meta), &(worker->meta.nns[JCKY_NN_SCRATCH]));
+            }
+            else {
+                meta->functions->alloc(&(worker->meta), &(worker->meta.nns[JCKY_NN_SCRATCH]));
+            }
+
+            worker->batch = malloc( meta->number_of_inputs * meta->batch_size * sizeof( nn_type ) );
+            worker->targets = malloc( meta->number_of_outputs * meta->batch_size * sizeof( nn_type ) );
+            worker->result = malloc( meta->number_of_outputs * meta->batch_size * sizeof( nn_type ) );
+        }
+    }
+
+    return workers;
+}
+
+
+void destroy_workers(jcky_workers *workers) {
+    int i;
+    jcky_worker *worker;
+
+    for (i=0; i<workers->count; i++) {
+        worker = &(workers->worker[i]);
+        destroy_meta_nn_batch(&(worker->meta));
+        destroy_nn_optimizer(&(worker->meta));
+        if (workers->mode == JCKY_THREAD_MODE_HOGWILD_ID) destroy_nn_copies(&(worker->meta.nns[JCKY_NN_SCRATCH]));
+        else destroy_nn(&(worker->meta), &(worker->meta.nns[JCKY_NN_SCRATCH]));
+        free(worker->batch);
+        free(worker->targets);
+        free(worker->result);
+    }
+    free(workers->worker);
+}
+
+
+void workers_placement(jcky_workers *workers, jcky_placement *nets, jcky_placement *batch) {
+    int i;
+    const unsigned char first_nn = (workers->mode == JCKY_THREAD_MODE_DATA_ID) ? JCKY_NN_SCRATCH : JCKY_NN_SCRATCH + 1;
+
+    for (i=0; i<workers->count; i++) nn_placement(&(workers->worker[i].meta), first_nn, nets, batch);
+}
+
+
+// Adds the forward, backprop and batch building time of each worker to
+// the rank's timers, so they're reported as if the rank had done the
+// work.
+static void collect_worker_timers(struct meta_neural_net *meta, jcky_workers *workers) {
+    int i, j;
+    struct meta_neural_net *worker;
+
+    for (i=0; i<workers->count; i++) {
+        worker = &(workers->worker[i].meta);
+        for (j=0; j<=meta->number_of_hidden_layers; j++) {
+            meta->layer_timers[j].seconds += worker->layer_timers[j].seconds;
+            meta->layer_timers[j].flops += worker->layer_timers[j].flops;
+            worker->layer_timers[j].seconds = 0.0;
+            worker->layer_timers[j].flops = 0.0;
+        }
+        meta->backprop_timer.seconds += worker->backprop_timer.seconds;
+        worker->backprop_timer.seconds = 0.0;
+        meta->batch_timer.seconds += worker->batch_timer.seconds;
+        worker->batch_timer.seconds = 0.0;
+    }
+}
+
+
+// Worker 'index' trains on its share of the epoch's batches, whichever
+// thread runs it.
+static void train_worker(
+    jcky_workers *workers,
+    const int index,
+    jcky_file *file,
+    unsigned int *sequence,
+    const unsigned int batches,
+    const unsigned char verbose)
+{
+    long int i, first, last;
+    double score = 0.0;
+    unsigned short int percent_done, last_percent_done = 0;
+    jcky_worker *worker = &(workers->worker[index]);
+    struct meta_neural_net *meta = &(worker->meta);
+
+    if (workers->mode == JCKY_THREAD_MODE_DATA_ID) {
+        meta->functions->copy(meta, JCKY_NN_SCRATCH, JCKY_NN_BASE);
+    }
+    else {
+        // The rank's scratch was changed by the last epoch and reset
+        nn_mark_stale(&(meta->nns[JCKY_NN_SCRATCH]));
+    }
+
+    first = ((long int)batches * index) / workers->count;
+    last = ((long int)batches * (index + 1)) / workers->count;
+    for (i=first; i<last; i++) {
+        // The workers share the file, and reading a record seeks it,
+        // unless it's mapped
+        START_TIME_LAYER(&(meta->batch_timer))
+        if (file->map != NULL) {
+            create_batch_with_sequence_file(worker->batch, worker->targets, file, meta->batch_size, i, sequence,
+                                            &(meta->batch_builder), nn_sparse_batch(meta));
+        }
+        else {
+            #pragma omp critical (jcky_workers_file)
+            create_batch_with_sequence_file(worker->batch, worker->targets, file, meta->batch_size, i, sequence,
+                                            &(meta->batch_builder), nn_sparse_batch(meta));
+        }
+        END_TIME_LAYER(&(meta->batch_timer), 0.0)
+
+        feed_forward(meta, worker->result, worker->batch, worker->targets, JCKY_TRAIN, &score);
+
+        if (verbose) {
+            percent_done = (unsigned short int)((((i-first+1)*1.0) / (last-first)) * 100);
+            if (percent_done > last_percent_done) {
+                printf("\r    Training - ");
+                print_number(percent_done, 3);
+                printf("%%");
+                last_percent_done = percent_done;
+            }
+        }
+    }
+}
+
+
+void train_workers(
+    struct meta_neural_net *meta,
+    jcky_workers *workers,
+    jcky_file *file,
+    unsigned int *sequence,
+    const unsigned int batches,
+    const unsigned char verbose)
+{
+    double start = jcky_parallel_start();
+
+    // OpenMP may give the region fewer threads than workers, so each
+    // thread runs every worker whose index it's dealt, as in
+    // create_workers, and every worker's net is ready for the reduction.
+    #pragma omp parallel num_threads(workers->count)
+    {
+        int i, thread = 0, threads = 1;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+        threads = omp_get_num_threads();
+#endif
+
+        for (i=thread; i<workers->count; i+=threads) {
+            train_worker(workers, i, file, sequence, batches, verbose && i == 0);
+        }
+        jcky_thread_barrier();
+        if (workers->mode == JCKY_THREAD_MODE_DATA_ID) {
+            reduce_workers(meta, workers, &(meta->nns[JCKY_NN_SCRATCH]));
+        }
+
+        // The rank's own thread keeps its packing buffers for testing
+        if (thread != 0) jcky_gemm_free_workspace();
+    }
+
+    jcky_parallel_end(start);
+    collect_worker_timers(meta, workers);
+    nn_mark_stale(&(meta->nns[JCKY_NN_SCRATCH]));
+}
+
+
+// The tree pairs worker w with worker w + stride, for stride = 1, 2, 4,
+// ..., so each sum has about log2(count) additions. The block of each
+// scratch net is first turned into the change from the base, so the
+// sums stay small next to the weights.
+static void reduce_range(
+    jcky_workers *workers,
+    nn_type **scratch,
+    nn_type *base,
+    nn_type *target,
+    const long int first,
+    const long int last)
+{
+    long int block, i;
+    int w, stride, len;
+    const int count = workers->count;
+    const nn_type scale = 1.0 / count;
+
+    for (block=first; block<last; block+=JCKY_REDUCE_BLOCK) {
+        len = (last - block < JCKY_REDUCE_BLOCK) ? (int)(last - block) : JCKY_REDUCE_BLOCK;
+
+        for (w=0; w<count; w++) {
+            subtract_vectors(scratch[w] + block, base + block, len);
+        }
+        for (stride=1; stride<count; stride*=2) {
+            for (w=0; w+stride<count; w+=2*stride) {
+                add_vectors(scratch[w] + block, scratch[w + stride] + block, len);
+            }
+        }
+        for (i=block; i<block+len; i++) {
+            target[i] = base[i] + (scratch[0][i] * scale);
+        }
+    }
+}
+
+
+// Each thread takes the same share of the array at every level of the
+// tree, so the levels need no barrier between them, and the blocks a
+// thread added up at one level are still in its cache at the next.
+static void reduce_array(
+    jcky_workers *workers,
+    nn_type **scratch,
+    nn_type *base,
+    nn_type *target,
+    const long int len)
+{
+    long int first, last;
+
+    jcky_thread_range(len, JCKY_THREAD_RANGE_ALIGN, &first, &last);
+    if (first >= last) return;
+
+    if (workers->count == 1) {
+        copy_vectors(target + first, scratch[0] + first, last - first);
+    }
+    else {
+        reduce_range(workers, scratch, base, target, first, last);
+    }
+}
+
+
+void reduce_workers(struct meta_neural_net *meta, jcky_workers *workers, neural_net *target) {
+    int i, w;
+    nn_type *scratch[JCKY_MAX_THREADS];
+    neural_net *base = &(meta->nns[JCKY_NN_BASE]);
+    const int number_of_hidden_layers = meta->number_of_hidden_layers;
+
+    for (i=0; i<=number_of_hidden_layers; i++) {
+        for (w=0; w<workers->count; w++) scratch[w] = workers->worker[w].meta.nns[JCKY_NN_SCRATCH].bias[i];
+        reduce_array(workers, scratch, base->bias[i], target->bias[i], nn_rows(meta, i));
+
+        for (w=0; w<workers->count; w++) scratch[w] = workers->worker[w].meta.nns[JCKY_NN_SCRATCH].weight[i];
+        reduce_array(workers, scratch, base->weight[i], target->weight[i], nn_weight_len(meta, i));
+    }
+
+    jcky_thread_barrier();
+}
@@ -0,0 +1,67 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+
+#include "constants.h"
+#include "file_helpers.h"
+#include "neural_net.h"
+
+
+// The threads of a rank in the data and hogwild modes (see
+// --thread-mode). Each worker has its own copy of the batch matrices
+// and shares the base neural net of the rank, which it only reads. Every
+// epoch each worker trains on a contiguous share of the rank's batches.
+//
+// In the data mode each worker has its own scratch neural net, which it
+// copies the base into and trains the same way each rank trains its own
+// scratch. The scratch nets are then averaged into the rank's scratch,
+// so the rank syncs the mean change of its threads and the sync between
+// ranks is unchanged.
+//
+// In the hogwild mode every worker's scratch is the rank's scratch: the
+// workers share its weights and biases, and only have their own 16 bit
+// copy and transposed shadow of them. The threads update the weights
+// without any synchronization, so an update that lands between another
+// thread's read and write of the same weight is lost. The rank's scratch
+// is trained in place, so there's nothing to reduce.
+typedef struct jcky_worker {
+    struct meta_neural_net meta;
+    nn_type *batch, *targets, *result;
+} jcky_worker;
+
+typedef struct jcky_workers {
+    int count;
+    unsigned char mode;
+    jcky_worker *worker;
+} jcky_workers;
+
+// The averaging walks the container in blocks of this many values, so
+// the block of every worker's scratch stays in cache while the tree
+// adds them up.
+#define JCKY_REDUCE_BLOCK 2048
+
+jcky_workers create_workers(struct meta_neural_net *meta, const int count, const unsigned char mode);
+void destroy_workers(jcky_workers *workers);
+// Adds where the pages of the workers' own buffers landed (see nn_placement)
+void workers_placement(jcky_workers *workers, jcky_placement *nets, jcky_placement *batch);
+
+// Trains one epoch over 'batches' batches of 'file', in the order given
+// by 'sequence', and leaves the trained scratch in meta->nns[JCKY_NN_SCRATCH],
+// which must hold a copy of the base. The first worker reports its
+// progress when 'verbose' is set.
+void train_workers(
+    struct meta_neural_net *meta,
+    jcky_workers *workers,
+    jcky_file *file,
+    unsigned int *sequence,
+    const unsigned int batches,
+    const unsigned char verbose
+);
+
+// Averages the scratch nets of the workers into 'target':
+//    target = base + (sum(scratch - base) / count)
+// Must be called by every thread of a parallel region.
+void reduce_workers(struct meta_neural_net *meta, jcky_workers *workers, neural_net *target);
+
+
+#endif
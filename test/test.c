@@ -1,10 +1,28 @@
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../lib/arena.h"
+#include "../lib/backend.h"
 #include "../lib/batch.h"
 #include "../lib/file_helpers.h"
+#include "../lib/gemm.h"
+#include "../lib/half.h"
+#include "../lib/kernels.h"
+#include "../lib/matrix_helpers.h"
+#include "../lib/model_helpers.h"
 #include "../lib/neural_net.h"
+#include "../lib/prefetch.h"
+#include "../lib/sigmoid.h"
+#include "../lib/sparse.h"
+#include "../lib/threads.h"
+#include "../lib/workers.h"
 
 #define RECORDS 6
 #define DATA_LEN 3
@@ -12,6 +30,18 @@
 #define INCREMENT 0.1
 #define BATCH 3
 #define FILENAME "test_file.jockey"
+#define MODEL_FILENAME "test_model.jockey"
+#define CONVERTED_FILENAME "test_file_converted.jockey"
+#define GEMM_M 37
+#define GEMM_N 11
+#define GEMM_K 300
+#define BACKWARD_COLS 4096
+#ifdef JCKY_SINGLE_PRECISION
+#define GEMM_TOLERANCE 1e-3
+#else
+#define GEMM_TOLERANCE 1e-9
+#endif
+#define SIGMOID_RANGE 50.0
 
 
 int main(int argc, char **argv) {
@@ -67,6 +97,11 @@ int main(int argc, char **argv) {
     assert((file.targets_len == TARGETS_LEN) && "Incorrect file targets length.\n");
     printf(".");
 
+    jcky_arena builder_arena = create_arena(batch_builder_size(DATA_LEN, JCKY_FEATURE_MAJOR_LAYOUT_ID));
+    jcky_batch_builder feature_major = create_batch_builder(&builder_arena, DATA_LEN, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+    jcky_batch_builder batch_major = create_batch_builder(&builder_arena, DATA_LEN, JCKY_BATCH_MAJOR_LAYOUT_ID);
+    assert((feature_major.tile != NULL) && (batch_major.tile == NULL) && "Invalid batch builders\n");
+
     sequence[0] = 5;
     sequence[1] = 1;
     sequence[2] = 4;
@@ -74,7 +109,8 @@ int main(int argc, char **argv) {
     sequence[4] = 2;
     sequence[5] = 3;
     for(i=0; i<RECORDS / BATCH; i++) {
-        create_batch_with_sequence_file(batch_data, batch_targets, &file, BATCH, i, sequence);
+        create_batch_with_sequence_file(batch_data, batch_targets, &file, BATCH, i, sequence, &feature_major,
+                                        NULL);
         for(j=0; j<(BATCH * DATA_LEN); j++) {
             assert((batch_data[j] == test_data[sequence[(i * BATCH) + (j % DATA_LEN)]][j / DATA_LEN]) &&
                    "Invalid data batch from sequence\n");
@@ -87,7 +123,8 @@ int main(int argc, char **argv) {
     printf(".");
 
     for(i=0; i<RECORDS / BATCH; i++) {
-        create_batch_no_sequence_file(batch_data, batch_targets, &file, BATCH, i, 0, RECORDS);
+        create_batch_no_sequence_file(batch_data, batch_targets, &file, BATCH, i, 0, RECORDS, &feature_major,
+                                      NULL);
         for(j=0; j<(BATCH * DATA_LEN); j++) {
             assert((batch_data[j] == test_data[(i * BATCH) + (j % DATA_LEN)][j / DATA_LEN]) &&
                    "Invalid data batch without sequence\n");
@@ -99,10 +136,1078 @@ int main(int argc, char **argv) {
     }
     printf(".");
 
+    // Batch-major batches hold each record as it was read.
+    for(i=0; i<RECORDS / BATCH; i++) {
+        create_batch_with_sequence_file(batch_data, batch_targets, &file, BATCH, i, sequence, &batch_major,
+                                        NULL);
+        for(j=0; j<(BATCH * DATA_LEN); j++) {
+            assert((batch_data[j] == test_data[sequence[(i * BATCH) + (j / DATA_LEN)]][j % DATA_LEN]) &&
+                   "Invalid batch-major data batch from sequence\n");
+        }
+        for(j=0; j<(BATCH * TARGETS_LEN); j++) {
+            assert((batch_targets[j] == test_targets[sequence[(i * BATCH) + (j / TARGETS_LEN)]][j % TARGETS_LEN]) &&
+                   "Invalid batch-major targets batch from sequence\n");
+        }
+    }
+    printf(".");
+
+    // The sparse batch keeps each record's nonzero values, by sample and
+    // by input. Only the first value of the first record is zero.
+    jcky_sparse_batch sparse = create_sparse_batch(DATA_LEN, BATCH);
+    unsigned int p;
+    for(i=0; i<RECORDS / BATCH; i++) {
+        create_batch_with_sequence_file(batch_data, batch_targets, &file, BATCH, i, sequence, &batch_major,
+                                        &sparse);
+        assert((sparse.samples == BATCH) && "Invalid sparse batch size\n");
+        assert((JCKY_SPARSE_NNZ(&sparse) == BATCH * DATA_LEN - ((i == 1) ? 1 : 0)) && "Invalid sparse batch count\n");
+        assert((sparse.active_len == DATA_LEN) && "Invalid sparse batch inputs\n");
+        for(j=0; j<BATCH; j++) {
+            for(p=sparse.sample_start[j]; p<sparse.sample_start[j+1]; p++) {
+                assert((sparse.value[p] == batch_data[(j * DATA_LEN) + sparse.input[p]]) &&
+                       "Invalid sparse batch by sample\n");
+            }
+        }
+        for(j=0; j<sparse.active_len; j++) {
+            for(p=sparse.active_start[j]; p<sparse.active_start[j+1]; p++) {
+                assert((sparse.active_value[p] == batch_data[(sparse.active_sample[p] * DATA_LEN) + sparse.active[j]]) &&
+                       "Invalid sparse batch by input\n");
+            }
+        }
+    }
+    destroy_sparse_batch(&sparse);
+    printf(".");
+
+    // A mapped file gives the same batches as a read one.
+    ret = jcky_map_file(&file, FILENAME);
+    assert((ret == 0) && (file.map_size == file.offset + (RECORDS * file.bytes_per_record)) &&
+           "Jockey file failed to map.\n");
+    jcky_advise_file(&file, JCKY_ACCESS_RANDOM);
+    for(i=0; i<RECORDS / BATCH; i++) {
+        create_batch_with_sequence_file(batch_data, batch_targets, &file, BATCH, i, sequence, &feature_major,
+                                        NULL);
+        for(j=0; j<(BATCH * DATA_LEN); j++) {
+            assert((batch_data[j] == test_data[sequence[(i * BATCH) + (j % DATA_LEN)]][j / DATA_LEN]) &&
+                   "Invalid data batch from mapped file\n");
+        }
+        for(j=0; j<(BATCH * TARGETS_LEN); j++) {
+            assert((batch_targets[j] == test_targets[sequence[(i * BATCH) + (j / TARGETS_LEN)]][j % TARGETS_LEN]) &&
+                   "Invalid targets batch from mapped file\n");
+        }
+    }
+    printf(".");
+
     ret = jcky_close_file(&file);
     assert((ret == 0) && "Unable to close jockey file.\n");
     printf(".");
 
+    // A file written with the other floating point type is converted
+    // to nn_type as it's read.
+    FILE *converted_stream = fopen(CONVERTED_FILENAME, "wb");
+    unsigned char other_type = (unsigned char)((JCKY_NN_TYPE == JCKY_FLOAT) ? JCKY_DOUBLE : JCKY_FLOAT) << 4;
+    unsigned char version_byte = 0;
+    unsigned int header_value;
+    float float_value;
+    double double_value;
+
+    fwrite(JCKY_DATA_IDENTIFIER, sizeof(char), 4, converted_stream);
+    fwrite(&other_type, sizeof(unsigned char), 1, converted_stream);
+    for(i=0; i<3; i++) fwrite(&version_byte, sizeof(unsigned char), 1, converted_stream);
+    header_value = DATA_LEN;
+    fwrite(&header_value, sizeof(unsigned int), 1, converted_stream);
+    header_value = TARGETS_LEN;
+    fwrite(&header_value, sizeof(unsigned int), 1, converted_stream);
+    header_value = RECORDS;
+    fwrite(&header_value, sizeof(unsigned int), 1, converted_stream);
+    for(i=0; i<RECORDS; i++) {
+        for(j=0; j<DATA_LEN+TARGETS_LEN; j++) {
+            double_value = (j < DATA_LEN) ? test_data[i][j] : test_targets[i][j - DATA_LEN];
+            float_value = (float)double_value;
+            if (JCKY_NN_TYPE == JCKY_FLOAT) fwrite(&double_value, sizeof(double), 1, converted_stream);
+            else fwrite(&float_value, sizeof(float), 1, converted_stream);
+        }
+    }
+    fclose(converted_stream);
+
+    file = jcky_open_file(CONVERTED_FILENAME);
+    assert((file.stream != NULL) && "Converted jockey file failed to open.\n");
+    assert((file.datum_size != sizeof(nn_type)) && "Incorrect converted file datum size.\n");
+    unsigned int pass;
+    for(pass=0; pass<2; pass++) {
+        // The second pass reads the mapped file
+        if (pass == 1) {
+            ret = jcky_map_file(&file, CONVERTED_FILENAME);
+            assert((ret == 0) && "Converted jockey file failed to map.\n");
+        }
+        for(i=0; i<RECORDS / BATCH; i++) {
+            create_batch_no_sequence_file(batch_data, batch_targets, &file, BATCH, i, 0, RECORDS, &feature_major,
+                                          NULL);
+            for(j=0; j<(BATCH * DATA_LEN); j++) {
+                assert((batch_data[j] == (nn_type)(float)test_data[(i * BATCH) + (j % DATA_LEN)][j / DATA_LEN]) &&
+                       "Invalid data batch from converted file\n");
+            }
+            for(j=0; j<(BATCH * TARGETS_LEN); j++) {
+                assert((batch_targets[j] == (nn_type)(float)test_targets[(i * BATCH) + (j / TARGETS_LEN)][j % TARGETS_LEN]) &&
+                       "Invalid targets batch from converted file\n");
+            }
+        }
+    }
+    jcky_close_file(&file);
+    remove(CONVERTED_FILENAME);
+    destroy_arena(&builder_arena);
+    printf(".");
+
+    // A feature-major batch of more records than a tile, each longer than
+    // a block of the tile, is built through several tiles and blocks.
+    const unsigned int tiled_records = JCKY_BATCH_TILE + 5;
+    const unsigned int tiled_len = (2 * JCKY_BATCH_TILE_INPUTS) + 3;
+    nn_type **tiled_data = malloc( tiled_records * sizeof( nn_type* ) );
+    nn_type **tiled_targets = malloc( tiled_records * sizeof( nn_type* ) );
+    nn_type *tiled_batch = malloc( tiled_records * tiled_len * sizeof( nn_type ) );
+    nn_type *tiled_batch_targets = malloc( tiled_records * sizeof( nn_type ) );
+    for(i=0; i<tiled_records; i++) {
+        tiled_data[i] = malloc( tiled_len * sizeof( nn_type ) );
+        tiled_targets[i] = malloc( sizeof( nn_type ) );
+        for(j=0; j<tiled_len; j++) tiled_data[i][j] = (nn_type)((i * tiled_len) + j);
+        tiled_targets[i][0] = (nn_type)i;
+    }
+    ret = jcky_write_file(tiled_data, tiled_targets, tiled_records, tiled_len, 1, FILENAME);
+    assert((ret == 0) && "Tiled jockey file failed to write.\n");
+    file = jcky_open_file(FILENAME);
+    builder_arena = create_arena(batch_builder_size(tiled_len, JCKY_FEATURE_MAJOR_LAYOUT_ID));
+    feature_major = create_batch_builder(&builder_arena, tiled_len, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+    create_batch_no_sequence_file(tiled_batch, tiled_batch_targets, &file, tiled_records, 0, 0, 0, &feature_major, NULL);
+    for(i=0; i<tiled_records; i++) {
+        for(j=0; j<tiled_len; j++) {
+            assert((tiled_batch[(j * tiled_records) + i] == tiled_data[i][j]) && "Invalid tiled data batch\n");
+        }
+        assert((tiled_batch_targets[i] == tiled_targets[i][0]) && "Invalid tiled targets batch\n");
+    }
+    printf(".");
+
+    // The prefetched batches of a training pass and of a testing pass are
+    // the batches of the sequence and of the file, in order, with the
+    // sparse batch of each swapped into the meta net.
+    const unsigned int prefetch_batch = 3;
+    unsigned int *prefetch_sequence = malloc( tiled_records * sizeof( unsigned int ) );
+    unsigned int record, s;
+    double stall_seconds, queue_depth;
+    struct meta_neural_net prefetch_meta;
+    jcky_prefetch prefetch;
+    jcky_prefetch_slot *slot;
+    for(i=0; i<tiled_records; i++) prefetch_sequence[i] = tiled_records - 1 - i;
+    memset(&prefetch_meta, 0, sizeof( struct meta_neural_net ));
+    prefetch_meta.number_of_inputs = tiled_len;
+    prefetch_meta.number_of_outputs = 1;
+    prefetch_meta.batch_size = prefetch_batch;
+    prefetch_meta.batch_layout = JCKY_FEATURE_MAJOR_LAYOUT_ID;
+    prefetch_meta.input_format = JCKY_INPUT_SPARSE_ID;
+    prefetch_meta.sparse_batch = create_sparse_batch(tiled_len, prefetch_batch);
+    prefetch = create_prefetch(&prefetch_meta, 2, 2);
+    for(pass=0; pass<2; pass++) {
+        prefetch_start(&prefetch, &file, (pass == 0) ? prefetch_sequence : NULL, tiled_records / prefetch_batch, 0, 0);
+        for(i=0; i<tiled_records / prefetch_batch; i++) {
+            slot = prefetch_next(&prefetch);
+            for(s=0; s<prefetch_batch; s++) {
+                record = (pass == 0) ? prefetch_sequence[(i * prefetch_batch) + s] : (i * prefetch_batch) + s;
+                for(j=0; j<tiled_len; j++) {
+                    assert((slot->batch[(j * prefetch_batch) + s] == tiled_data[record][j]) &&
+                           "Invalid prefetched data batch\n");
+                }
+                assert((slot->targets[s] == tiled_targets[record][0]) && "Invalid prefetched targets batch\n");
+            }
+            // Only the first value of the first record is zero
+            assert((prefetch_meta.sparse_batch.samples == prefetch_batch) &&
+                   (JCKY_SPARSE_NNZ(&(prefetch_meta.sparse_batch)) ==
+                    prefetch_batch * tiled_len - (((pass == 0) ? (i == (tiled_records / prefetch_batch) - 1) : (i == 0)) ? 1 : 0)) &&
+                   "Invalid prefetched sparse batch\n");
+            prefetch_release(&prefetch, slot);
+        }
+    }
+    prefetch_stats(&prefetch, &stall_seconds, &queue_depth);
+    assert((stall_seconds >= 0.0) && (queue_depth >= 0.0) && (queue_depth <= 2.0) && "Invalid prefetch stats\n");
+    destroy_prefetch(&prefetch);
+    destroy_sparse_batch(&(prefetch_meta.sparse_batch));
+    free(prefetch_sequence);
+    jcky_close_file(&file);
+    remove(FILENAME);
+    destroy_arena(&builder_arena);
+    for(i=0; i<tiled_records; i++) {
+        free(tiled_data[i]);
+        free(tiled_targets[i]);
+    }
+    free(tiled_data);
+    free(tiled_targets);
+    free(tiled_batch);
+    free(tiled_batch_targets);
+    printf(".");
+
+    // The blocked GEMM must agree with a naive triple loop, including
+    // edge tiles, more than one block along k, transposed operands,
+    // accumulation into C and the bias epilogue. This is checked for
+    // every kernel set the CPU supports, as are the vector kernels.
+    nn_type *gemm_a = malloc( GEMM_M * GEMM_K * sizeof( nn_type ) );
+    nn_type *gemm_a_transposed = malloc( GEMM_K * GEMM_M * sizeof( nn_type ) );
+    nn_type *gemm_b = malloc( GEMM_K * GEMM_N * sizeof( nn_type ) );
+    nn_type *gemm_c = malloc( GEMM_M * GEMM_N * sizeof( nn_type ) );
+    nn_type *gemm_expected = malloc( GEMM_M * GEMM_N * sizeof( nn_type ) );
+    nn_type *gemm_bias = malloc( GEMM_M * sizeof( nn_type ) );
+    nn_type *vector_expected = malloc( GEMM_M * GEMM_N * sizeof( nn_type ) );
+    nn_type *sigmoid_z = malloc( GEMM_M * GEMM_N * sizeof( nn_type ) );
+    nn_type bias_expected[GEMM_M];
+    unsigned int k;
+    unsigned char kernel_id, function, source;
+    nn_type accum, expected;
+
+    nn_type optimizer_expected[4][GEMM_M * GEMM_N], optimizer_result[4][GEMM_M * GEMM_N];
+    signed char int8_row[GEMM_K], int8_vectors[GEMM_K * GEMM_N];
+    int int8_expected[GEMM_N], int8_result[GEMM_N];
+
+    for(i=0; i<GEMM_K; i++) int8_row[i] = (signed char)(((i * 37) % 255) - 127);
+    for(i=0; i<GEMM_K*GEMM_N; i++) int8_vectors[i] = (signed char)(((i * 91) % 255) - 127);
+
+    init_sigmoid_table();
+    for(i=0; i<GEMM_M*GEMM_N; i++) {
+        sigmoid_z[i] = -SIGMOID_RANGE + ((2.0 * SIGMOID_RANGE * i) / (GEMM_M * GEMM_N - 1));
+    }
+    for(i=0; i<GEMM_M*GEMM_K; i++) gemm_a[i] = (nn_type)((int)(i % 17) - 8) / 8.0;
+    for(i=0; i<GEMM_K*GEMM_N; i++) gemm_b[i] = (nn_type)((int)(i % 13) - 6) / 6.0;
+    for(i=0; i<GEMM_M; i++) gemm_bias[i] = (nn_type)i / GEMM_M;
+    for(i=0; i<GEMM_M; i++) {
+        for(k=0; k<GEMM_K; k++) gemm_a_transposed[(k * GEMM_M) + i] = gemm_a[(i * GEMM_K) + k];
+        for(j=0; j<GEMM_N; j++) {
+            accum = gemm_bias[i];
+            for(k=0; k<GEMM_K; k++) accum += gemm_a[(i * GEMM_K) + k] * gemm_b[(k * GEMM_N) + j];
+            gemm_expected[(i * GEMM_N) + j] = accum;
+        }
+    }
+
+    for(kernel_id=JCKY_KERNELS_SCALAR_ID; kernel_id<=JCKY_KERNELS_AVX512_ID; kernel_id++) {
+        if (!jcky_kernels_supported(kernel_id)) continue;
+        jcky_kernels = jcky_get_kernels(kernel_id);
+
+        jcky_gemm(GEMM_M, GEMM_N, GEMM_K, 1.0, gemm_a, GEMM_K, 1, gemm_b, GEMM_N, 1,
+                  0.0, gemm_c, GEMM_N, 1, gemm_bias);
+        for(i=0; i<GEMM_M*GEMM_N; i++) {
+            assert((fabs(gemm_c[i] - gemm_expected[i]) < GEMM_TOLERANCE) && "Invalid GEMM result\n");
+        }
+        printf(".");
+
+        // C = C - 0.5 * A * B, with A read through its transpose and C
+        // stored column-major.
+        for(i=0; i<GEMM_M; i++) {
+            for(j=0; j<GEMM_N; j++) gemm_c[(j * GEMM_M) + i] = gemm_expected[(i * GEMM_N) + j];
+        }
+        jcky_gemm(GEMM_M, GEMM_N, GEMM_K, -0.5, gemm_a_transposed, 1, GEMM_M, gemm_b, GEMM_N, 1,
+                  1.0, gemm_c, 1, GEMM_M, NULL);
+        for(i=0; i<GEMM_M; i++) {
+            for(j=0; j<GEMM_N; j++) {
+                accum = gemm_expected[(i * GEMM_N) + j];
+                accum -= 0.5 * (gemm_expected[(i * GEMM_N) + j] - gemm_bias[i]);
+                assert((fabs(gemm_c[(j * GEMM_M) + i] - accum) < GEMM_TOLERANCE) && "Invalid transposed GEMM result\n");
+            }
+        }
+        printf(".");
+
+        // Odd lengths exercise the vector tails.
+        copy_vectors_scalar(vector_expected, gemm_expected, GEMM_M * GEMM_N);
+        subtract_vectors_scalar(vector_expected, gemm_b, GEMM_M * GEMM_N);
+        copy_vectors(gemm_c, gemm_expected, GEMM_M * GEMM_N);
+        subtract_vectors(gemm_c, gemm_b, GEMM_M * GEMM_N);
+        for(i=0; i<GEMM_M*GEMM_N; i++) {
+            assert((gemm_c[i] == vector_expected[i]) && "Invalid vector kernel result\n");
+        }
+        copy_vectors_scalar(bias_expected, gemm_bias, GEMM_M);
+        adjust_bias_scalar(bias_expected, gemm_expected, GEMM_M, GEMM_N, 0.5);
+        copy_vectors(vector_expected, gemm_bias, GEMM_M);
+        adjust_bias(vector_expected, gemm_expected, GEMM_M, GEMM_N, 0.5, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_M; i++) {
+            assert((fabs(vector_expected[i] - bias_expected[i]) < GEMM_TOLERANCE) && "Invalid bias kernel result\n");
+        }
+        printf(".");
+
+        // The fast sigmoid tiers must stay within their documented
+        // error of the exact sigmoid, well past both ends of the table.
+        sigmoidify(vector_expected, sigmoid_z, GEMM_M, GEMM_N, JCKY_SIGMOID_EXACT_ID);
+        sigmoidify(gemm_c, sigmoid_z, GEMM_M, GEMM_N, JCKY_SIGMOID_POLY_ID);
+        for(i=0; i<GEMM_M*GEMM_N; i++) {
+            assert((fabs(gemm_c[i] - vector_expected[i]) <= JCKY_SIGMOID_POLY_MAX_ERROR) && "Invalid poly sigmoid result\n");
+        }
+        sigmoidify(gemm_c, sigmoid_z, GEMM_M, GEMM_N, JCKY_SIGMOID_TABLE_ID);
+        for(i=0; i<GEMM_M*GEMM_N; i++) {
+            assert((fabs(gemm_c[i] - vector_expected[i]) <= JCKY_SIGMOID_TABLE_MAX_ERROR) && "Invalid table sigmoid result\n");
+        }
+        printf(".");
+
+        // Every other activation function and every derivative must
+        // match libm, from either derivative source.
+        for(function=JCKY_ACTIVATION_RELU_ID; function<JCKY_ACTIVATIONS; function++) {
+            activate(gemm_c, sigmoid_z, GEMM_M, GEMM_N, function, JCKY_SIGMOID_EXACT_ID);
+            for(i=0; i<GEMM_M*GEMM_N; i++) {
+                expected = (function == JCKY_ACTIVATION_TANH_ID) ? tanh(sigmoid_z[i]) :
+                           (sigmoid_z[i] > 0.0) ? sigmoid_z[i] :
+                           (function == JCKY_ACTIVATION_LEAKY_RELU_ID) ? JCKY_LEAKY_RELU_SLOPE * sigmoid_z[i] : 0.0;
+                assert((fabs(gemm_c[i] - expected) < GEMM_TOLERANCE) && "Invalid activation kernel result\n");
+            }
+        }
+        for(function=JCKY_ACTIVATION_SIGMOID_ID; function<JCKY_ACTIVATIONS; function++) {
+            for(source=JCKY_DERIVATIVE_ACTIVATION_ID; source<JCKY_DERIVATIVE_SOURCES; source++) {
+                activate(vector_expected, sigmoid_z, GEMM_M, GEMM_N, function, JCKY_SIGMOID_EXACT_ID);
+                copy_vectors(gemm_c, gemm_expected, GEMM_M * GEMM_N);
+                apply_activation_derivative(gemm_c, (source == JCKY_DERIVATIVE_Z_ID) ? sigmoid_z : vector_expected,
+                                            source, function, GEMM_M * GEMM_N);
+                for(i=0; i<GEMM_M*GEMM_N; i++) {
+                    expected = (function == JCKY_ACTIVATION_SIGMOID_ID) ? sigmoid(sigmoid_z[i]) * (1.0 - sigmoid(sigmoid_z[i])) :
+                               (function == JCKY_ACTIVATION_TANH_ID) ? 1.0 - (tanh(sigmoid_z[i]) * tanh(sigmoid_z[i])) :
+                               (sigmoid_z[i] > 0.0) ? 1.0 :
+                               (function == JCKY_ACTIVATION_LEAKY_RELU_ID) ? JCKY_LEAKY_RELU_SLOPE : 0.0;
+                    assert((fabs(gemm_c[i] - (gemm_expected[i] * expected)) < GEMM_TOLERANCE) &&
+                           "Invalid activation derivative\n");
+                }
+            }
+        }
+        printf(".");
+
+        // The int8 dot products are exact, so every kernel set must
+        // match the scalar kernel, across the vector tails too.
+        dot_int8_scalar(int8_row, int8_vectors, GEMM_K - 1, GEMM_N, int8_expected);
+        jcky_kernels->dot_int8(int8_row, int8_vectors, GEMM_K - 1, GEMM_N, int8_result);
+        for(i=0; i<GEMM_N; i++) {
+            assert((int8_result[i] == int8_expected[i]) && "Invalid int8 dot product\n");
+        }
+        printf(".");
+
+        // The fused optimizer updates must match the scalar kernels, and
+        // leave the step zeroed for the next batch. The arrays are the
+        // weight, the step, then the optimizer's state.
+        for(k=0; k<2; k++) {
+            for(i=0; i<GEMM_M*GEMM_N; i++) {
+                optimizer_expected[0][i] = optimizer_result[0][i] = gemm_expected[i];
+                optimizer_expected[1][i] = optimizer_result[1][i] = sigmoid_z[i] / SIGMOID_RANGE;
+                optimizer_expected[2][i] = optimizer_result[2][i] = gemm_b[i];
+                optimizer_expected[3][i] = optimizer_result[3][i] = gemm_b[i] * gemm_b[i];
+            }
+            if (k == 0) {
+                momentum_update_scalar(optimizer_expected[0], optimizer_expected[1], optimizer_expected[2],
+                                       GEMM_M * GEMM_N, 0.9, 0.1);
+                momentum_update(optimizer_result[0], optimizer_result[1], optimizer_result[2],
+                                GEMM_M * GEMM_N, 0.9, 0.1);
+            }
+            else {
+                adam_update_scalar(optimizer_expected[0], optimizer_expected[1], optimizer_expected[2],
+                                   optimizer_expected[3], GEMM_M * GEMM_N, JCKY_ADAM_BETA1, JCKY_ADAM_BETA2,
+                                   0.01, JCKY_ADAM_EPSILON);
+                adam_update(optimizer_result[0], optimizer_result[1], optimizer_result[2], optimizer_result[3],
+                            GEMM_M * GEMM_N, JCKY_ADAM_BETA1, JCKY_ADAM_BETA2, 0.01, JCKY_ADAM_EPSILON);
+            }
+            for(i=0; i<GEMM_M*GEMM_N; i++) {
+                assert((fabs(optimizer_result[0][i] - optimizer_expected[0][i]) < GEMM_TOLERANCE) &&
+                       (fabs(optimizer_result[2][i] - optimizer_expected[2][i]) < GEMM_TOLERANCE) &&
+                       (fabs(optimizer_result[3][i] - optimizer_expected[3][i]) < GEMM_TOLERANCE) &&
+                       "Invalid optimizer update\n");
+                assert((optimizer_result[1][i] == 0.0) && "Optimizer step not cleared\n");
+            }
+        }
+        printf(".");
+    }
+    jcky_kernels = jcky_get_kernels(JCKY_KERNELS_SCALAR_ID);
+
+    // Every backend that was built must agree with the reference
+    // backend on the forward, delta and weight update products.
+    nn_type *delta_expected = malloc( GEMM_K * GEMM_N * sizeof( nn_type ) );
+    nn_type *delta_result = malloc( GEMM_K * GEMM_N * sizeof( nn_type ) );
+    nn_type *weight_expected = malloc( GEMM_M * GEMM_K * sizeof( nn_type ) );
+    nn_type *weight_result = malloc( GEMM_M * GEMM_K * sizeof( nn_type ) );
+    backend *backend;
+    unsigned char backend_id;
+
+    // The shadow the transposed delta reads must be an exact transpose,
+    // across the edge blocks too.
+    transpose_matrix(weight_result, gemm_a, GEMM_M, GEMM_K);
+    for(i=0; i<GEMM_M*GEMM_K; i++) {
+        assert((weight_result[i] == gemm_a_transposed[i]) && "Invalid transpose\n");
+    }
+    printf(".");
+
+    delta_reference(delta_expected, gemm_a, gemm_expected, GEMM_M, GEMM_K, GEMM_N, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+    copy_vectors(weight_expected, gemm_a, GEMM_M * GEMM_K);
+    update_reference(gemm_b, weight_expected, gemm_expected, GEMM_M, GEMM_K, GEMM_N, 0.5, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+
+    for(backend_id=JCKY_BACKEND_REFERENCE_ID; backend_id<=JCKY_BACKEND_CBLAS_ID; backend_id++) {
+        if (!jcky_backend_supported(backend_id)) continue;
+        backend = jcky_get_backend(backend_id);
+
+        backend->forward(gemm_c, gemm_a, gemm_b, gemm_bias, GEMM_M, GEMM_K, GEMM_N, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_M*GEMM_N; i++) {
+            assert((fabs(gemm_c[i] - gemm_expected[i]) < GEMM_TOLERANCE) && "Invalid backend forward result\n");
+        }
+        backend->delta(delta_result, gemm_a, gemm_expected, GEMM_M, GEMM_K, GEMM_N, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_K*GEMM_N; i++) {
+            assert((fabs(delta_result[i] - delta_expected[i]) < GEMM_TOLERANCE) && "Invalid backend delta result\n");
+        }
+        backend->delta_transposed(delta_result, gemm_a_transposed, gemm_expected, GEMM_M, GEMM_K, GEMM_N,
+                                  JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_K*GEMM_N; i++) {
+            assert((fabs(delta_result[i] - delta_expected[i]) < GEMM_TOLERANCE) && "Invalid backend transposed delta result\n");
+        }
+        copy_vectors(weight_result, gemm_a, GEMM_M * GEMM_K);
+        backend->update(gemm_b, weight_result, gemm_expected, GEMM_M, GEMM_K, GEMM_N, 0.5, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_M*GEMM_K; i++) {
+            assert((fabs(weight_result[i] - weight_expected[i]) < GEMM_TOLERANCE) && "Invalid backend update result\n");
+        }
+        printf(".");
+    }
+
+    // The sparse first layer kernels must match the dense products on a
+    // batch with mostly zero inputs, some of them zero across the batch,
+    // in both batch layouts.
+    nn_type *sparse_b = malloc( GEMM_K * GEMM_N * sizeof( nn_type ) );
+    nn_type *sparse_record = malloc( GEMM_K * sizeof( nn_type ) );
+    nn_type *sparse_delta = malloc( GEMM_M * GEMM_N * sizeof( nn_type ) );
+    nn_type *sparse_expected = malloc( GEMM_M * GEMM_N * sizeof( nn_type ) );
+    nn_type *sparse_weight_expected = malloc( GEMM_M * GEMM_K * sizeof( nn_type ) );
+    unsigned char sparse_layout;
+    jcky_sparse_batch sparse_batch = create_sparse_batch(GEMM_K, GEMM_N);
+
+    for(i=0; i<GEMM_K; i++) {
+        for(j=0; j<GEMM_N; j++) {
+            sparse_b[(i * GEMM_N) + j] = (i % 4 == 1 || (i * 7 + j) % 3 == 0) ? 0.0 : gemm_b[(i * GEMM_N) + j];
+        }
+    }
+    sparse_batch_clear(&sparse_batch);
+    for(j=0; j<GEMM_N; j++) {
+        for(i=0; i<GEMM_K; i++) sparse_record[i] = sparse_b[(i * GEMM_N) + j];
+        sparse_batch_add_sample(&sparse_batch, sparse_record);
+    }
+    sparse_batch_finish(&sparse_batch);
+    assert((sparse_batch.active_len == GEMM_K - (GEMM_K + 2) / 4) && "Invalid sparse active inputs\n");
+
+    forward_reference(sparse_expected, gemm_a, sparse_b, gemm_bias, GEMM_M, GEMM_K, GEMM_N, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+    copy_vectors(sparse_weight_expected, gemm_a, GEMM_M * GEMM_K);
+    update_reference(sparse_b, sparse_weight_expected, sparse_expected, GEMM_M, GEMM_K, GEMM_N, 0.5, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+
+    for(sparse_layout=JCKY_FEATURE_MAJOR_LAYOUT_ID; sparse_layout<=JCKY_BATCH_MAJOR_LAYOUT_ID; sparse_layout++) {
+        sparse_z_matrix(gemm_c, gemm_a, NULL, JCKY_STORAGE_NATIVE_ID, &sparse_batch, gemm_bias, GEMM_M, sparse_layout);
+        for(i=0; i<GEMM_M; i++) {
+            for(j=0; j<GEMM_N; j++) {
+                assert((fabs(gemm_c[(i * JCKY_NODE_STRIDE(sparse_layout, GEMM_N)) + (j * JCKY_SAMPLE_STRIDE(sparse_layout, GEMM_M))] -
+                             sparse_expected[(i * GEMM_N) + j]) < GEMM_TOLERANCE) && "Invalid sparse forward result\n");
+                sparse_delta[(i * JCKY_NODE_STRIDE(sparse_layout, GEMM_N)) + (j * JCKY_SAMPLE_STRIDE(sparse_layout, GEMM_M))] =
+                    sparse_expected[(i * GEMM_N) + j];
+            }
+        }
+
+        copy_vectors(weight_result, gemm_a, GEMM_M * GEMM_K);
+        sparse_adjust_weight(&sparse_batch, weight_result, sparse_delta, GEMM_M, 0.5, sparse_layout);
+        for(i=0; i<GEMM_M*GEMM_K; i++) {
+            assert((fabs(weight_result[i] - sparse_weight_expected[i]) < GEMM_TOLERANCE) && "Invalid sparse update result\n");
+            if ((i % GEMM_K) % 4 == 1) {
+                assert((weight_result[i] == gemm_a[i]) && "Sparse update touched an inactive input\n");
+            }
+        }
+        printf(".");
+    }
+
+    destroy_sparse_batch(&sparse_batch);
+    free(sparse_b);
+    free(sparse_record);
+    free(sparse_delta);
+    free(sparse_expected);
+    free(sparse_weight_expected);
+
+    // A batch-major batch matrix is the transpose of the feature-major
+    // one, so every backend must give the transposed results.
+    nn_type *batch_b = malloc( GEMM_K * GEMM_N * sizeof( nn_type ) );
+    nn_type *batch_expected = malloc( GEMM_M * GEMM_N * sizeof( nn_type ) );
+    transpose_matrix(batch_b, gemm_b, GEMM_K, GEMM_N);
+    transpose_matrix(batch_expected, gemm_expected, GEMM_M, GEMM_N);
+
+    copy_vectors(bias_expected, gemm_bias, GEMM_M);
+    adjust_bias(bias_expected, gemm_expected, GEMM_M, GEMM_N, 0.5, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+    copy_vectors(vector_expected, gemm_bias, GEMM_M);
+    adjust_bias(vector_expected, batch_expected, GEMM_M, GEMM_N, 0.5, JCKY_BATCH_MAJOR_LAYOUT_ID);
+    for(i=0; i<GEMM_M; i++) {
+        assert((fabs(vector_expected[i] - bias_expected[i]) < GEMM_TOLERANCE) && "Invalid batch-major bias result\n");
+    }
+    printf(".");
+
+    for(backend_id=JCKY_BACKEND_REFERENCE_ID; backend_id<=JCKY_BACKEND_CBLAS_ID; backend_id++) {
+        if (!jcky_backend_supported(backend_id)) continue;
+        backend = jcky_get_backend(backend_id);
+
+        backend->forward(gemm_c, gemm_a, batch_b, gemm_bias, GEMM_M, GEMM_K, GEMM_N, JCKY_BATCH_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_M; i++) {
+            for(j=0; j<GEMM_N; j++) {
+                assert((fabs(gemm_c[(j * GEMM_M) + i] - gemm_expected[(i * GEMM_N) + j]) < GEMM_TOLERANCE) &&
+                       "Invalid batch-major forward result\n");
+            }
+        }
+        backend->delta(delta_result, gemm_a, batch_expected, GEMM_M, GEMM_K, GEMM_N, JCKY_BATCH_MAJOR_LAYOUT_ID);
+        for(k=0; k<GEMM_K; k++) {
+            for(j=0; j<GEMM_N; j++) {
+                assert((fabs(delta_result[(j * GEMM_K) + k] - delta_expected[(k * GEMM_N) + j]) < GEMM_TOLERANCE) &&
+                       "Invalid batch-major delta result\n");
+            }
+        }
+        backend->delta_transposed(delta_result, gemm_a_transposed, batch_expected, GEMM_M, GEMM_K, GEMM_N,
+                                  JCKY_BATCH_MAJOR_LAYOUT_ID);
+        for(k=0; k<GEMM_K; k++) {
+            for(j=0; j<GEMM_N; j++) {
+                assert((fabs(delta_result[(j * GEMM_K) + k] - delta_expected[(k * GEMM_N) + j]) < GEMM_TOLERANCE) &&
+                       "Invalid batch-major transposed delta result\n");
+            }
+        }
+        copy_vectors(weight_result, gemm_a, GEMM_M * GEMM_K);
+        backend->update(batch_b, weight_result, batch_expected, GEMM_M, GEMM_K, GEMM_N, 0.5, JCKY_BATCH_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_M*GEMM_K; i++) {
+            assert((fabs(weight_result[i] - weight_expected[i]) < GEMM_TOLERANCE) && "Invalid batch-major update result\n");
+        }
+        printf(".");
+    }
+
+    // The fused backward pass must match the split products. The weight
+    // matrix is wide enough that it's swept in more than one tile.
+    nn_type *backward_weight = malloc( GEMM_M * BACKWARD_COLS * sizeof( nn_type ) );
+    nn_type *backward_weight_expected = malloc( GEMM_M * BACKWARD_COLS * sizeof( nn_type ) );
+    nn_type *backward_activation = malloc( BACKWARD_COLS * GEMM_N * sizeof( nn_type ) );
+    nn_type *backward_delta = malloc( BACKWARD_COLS * GEMM_N * sizeof( nn_type ) );
+    nn_type *backward_delta_expected = malloc( BACKWARD_COLS * GEMM_N * sizeof( nn_type ) );
+    nn_type *backward_bias = malloc( GEMM_M * sizeof( nn_type ) );
+    nn_type *backward_bias_expected = malloc( GEMM_M * sizeof( nn_type ) );
+    nn_type *batch_activation = malloc( BACKWARD_COLS * GEMM_N * sizeof( nn_type ) );
+
+    for(i=0; i<GEMM_M*BACKWARD_COLS; i++) backward_weight_expected[i] = (nn_type)((int)(i % 13) - 6) / 8.0;
+    for(i=0; i<BACKWARD_COLS*GEMM_N; i++) backward_activation[i] = (nn_type)(i % 7) / 8.0;
+    for(i=0; i<GEMM_M; i++) backward_bias_expected[i] = 0.0;
+
+    delta_reference(backward_delta_expected, backward_weight_expected, gemm_expected, GEMM_M, BACKWARD_COLS, GEMM_N,
+                    JCKY_FEATURE_MAJOR_LAYOUT_ID);
+    jcky_kernels->adjust_bias(backward_bias_expected, gemm_expected, GEMM_M, GEMM_N, 0.5);
+    transpose_matrix(batch_activation, backward_activation, BACKWARD_COLS, GEMM_N);
+    update_reference(backward_activation, backward_weight_expected, gemm_expected, GEMM_M, BACKWARD_COLS, GEMM_N, 0.5,
+                     JCKY_FEATURE_MAJOR_LAYOUT_ID);
+
+    for(backend_id=JCKY_BACKEND_REFERENCE_ID; backend_id<=JCKY_BACKEND_CBLAS_ID; backend_id++) {
+        if (!jcky_backend_supported(backend_id)) continue;
+        backend = jcky_get_backend(backend_id);
+
+        for(i=0; i<GEMM_M*BACKWARD_COLS; i++) backward_weight[i] = (nn_type)((int)(i % 13) - 6) / 8.0;
+        for(i=0; i<GEMM_M; i++) backward_bias[i] = 0.0;
+        backend->backward(backward_delta, backward_weight, gemm_expected, backward_activation, backward_bias,
+                          GEMM_M, BACKWARD_COLS, GEMM_N, 0.5, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<BACKWARD_COLS*GEMM_N; i++) {
+            assert((fabs(backward_delta[i] - backward_delta_expected[i]) < GEMM_TOLERANCE) && "Invalid backend backward delta\n");
+        }
+        for(i=0; i<GEMM_M*BACKWARD_COLS; i++) {
+            assert((fabs(backward_weight[i] - backward_weight_expected[i]) < GEMM_TOLERANCE) && "Invalid backend backward weight\n");
+        }
+        for(i=0; i<GEMM_M; i++) {
+            assert((fabs(backward_bias[i] - backward_bias_expected[i]) < GEMM_TOLERANCE) && "Invalid backend backward bias\n");
+        }
+        printf(".");
+
+        for(i=0; i<GEMM_M*BACKWARD_COLS; i++) backward_weight[i] = (nn_type)((int)(i % 13) - 6) / 8.0;
+        for(i=0; i<GEMM_M; i++) backward_bias[i] = 0.0;
+        backend->backward(backward_delta, backward_weight, batch_expected, batch_activation, backward_bias,
+                          GEMM_M, BACKWARD_COLS, GEMM_N, 0.5, JCKY_BATCH_MAJOR_LAYOUT_ID);
+        for(k=0; k<BACKWARD_COLS; k++) {
+            for(j=0; j<GEMM_N; j++) {
+                assert((fabs(backward_delta[(j * BACKWARD_COLS) + k] - backward_delta_expected[(k * GEMM_N) + j]) <
+                        GEMM_TOLERANCE) && "Invalid batch-major backward delta\n");
+            }
+        }
+        for(i=0; i<GEMM_M*BACKWARD_COLS; i++) {
+            assert((fabs(backward_weight[i] - backward_weight_expected[i]) < GEMM_TOLERANCE) &&
+                   "Invalid batch-major backward weight\n");
+        }
+        for(i=0; i<GEMM_M; i++) {
+            assert((fabs(backward_bias[i] - backward_bias_expected[i]) < GEMM_TOLERANCE) &&
+                   "Invalid batch-major backward bias\n");
+        }
+        printf(".");
+    }
+
+    // Splitting the products and the sigmoids across threads must not
+    // change them at all, since each tile and element is still computed
+    // by one thread in the same order.
+    if (jcky_threads_supported(2)) {
+        double utilization[2];
+
+        jcky_select_threads(2, JCKY_THREAD_MODE_KERNELS_ID, 0);
+        for(i=0; i<GEMM_M*BACKWARD_COLS; i++) backward_weight[i] = (nn_type)((int)(i % 13) - 6) / 8.0;
+        delta_reference(backward_delta, backward_weight, gemm_expected, GEMM_M, BACKWARD_COLS, GEMM_N,
+                        JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<BACKWARD_COLS*GEMM_N; i++) {
+            assert((backward_delta[i] == backward_delta_expected[i]) && "Invalid threaded delta\n");
+        }
+        update_reference(backward_activation, backward_weight, gemm_expected, GEMM_M, BACKWARD_COLS, GEMM_N, 0.5,
+                         JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_M*BACKWARD_COLS; i++) {
+            assert((backward_weight[i] == backward_weight_expected[i]) && "Invalid threaded update\n");
+        }
+        sigmoidify(backward_delta, backward_delta_expected, BACKWARD_COLS, GEMM_N, JCKY_SIGMOID_EXACT_ID);
+        for(i=0; i<BACKWARD_COLS*GEMM_N; i++) {
+            assert((backward_delta[i] == sigmoid(backward_delta_expected[i])) && "Invalid threaded sigmoid\n");
+        }
+        assert((jcky_thread_utilization(utilization) > 0.0) && "Missing parallel time\n");
+        for(i=0; i<2; i++) {
+            assert((utilization[i] >= 0.0 && utilization[i] <= 1.0) && "Invalid thread utilization\n");
+        }
+        jcky_select_threads(1, JCKY_THREAD_MODE_KERNELS_ID, 0);
+        printf(".");
+    }
+
+    // In the data mode each thread runs products of its own, which must
+    // not be shared out to the other threads of the region.
+    if (jcky_threads_supported(2)) {
+        nn_type *thread_c = malloc( 2 * GEMM_M * GEMM_N * sizeof( nn_type ) );
+
+        jcky_select_threads(2, JCKY_THREAD_MODE_DATA_ID, 0);
+        #pragma omp parallel num_threads(2)
+        {
+            int thread = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+#endif
+            jcky_gemm(GEMM_M, GEMM_N, GEMM_K, 1.0, gemm_a, GEMM_K, 1, gemm_b, GEMM_N, 1,
+                      0.0, thread_c + (thread * GEMM_M * GEMM_N), GEMM_N, 1, gemm_bias);
+            jcky_gemm_free_workspace();
+        }
+        for(i=0; i<2*GEMM_M*GEMM_N; i++) {
+            assert((fabs(thread_c[i] - gemm_expected[i % (GEMM_M*GEMM_N)]) < GEMM_TOLERANCE) &&
+                   "Invalid GEMM within a data parallel thread\n");
+        }
+        jcky_select_threads(1, JCKY_THREAD_MODE_KERNELS_ID, 0);
+        free(thread_c);
+        printf(".");
+    }
+
+    free(backward_weight);
+    free(backward_weight_expected);
+    free(backward_activation);
+    free(backward_delta);
+    free(backward_delta_expected);
+    free(backward_bias);
+    free(backward_bias_expected);
+    free(batch_activation);
+    free(batch_b);
+    free(batch_expected);
+
+    // Both 16 bit formats must round trip within half an ulp, and the
+    // products on 16 bit weights must match the native ones. The test
+    // matrices are multiples of 1/8, which both formats hold exactly.
+    jcky_half *half_a = malloc( GEMM_M * GEMM_K * sizeof( jcky_half ) );
+    nn_type half_value, half_ulp;
+    unsigned char storage;
+
+    for(storage=JCKY_STORAGE_BF16_ID; storage<=JCKY_STORAGE_FP16_ID; storage++) {
+        half_ulp = (storage == JCKY_STORAGE_BF16_ID) ? 1.0 / 128 : 1.0 / 1024;
+        for(i=0; i<GEMM_M*GEMM_N; i++) {
+            half_value = jcky_half_to_nn_type(jcky_nn_type_to_half(gemm_expected[i], storage), storage);
+            assert((fabs(half_value - gemm_expected[i]) <= 0.5 * half_ulp * fabs(gemm_expected[i])) &&
+                   "Invalid 16 bit round trip\n");
+        }
+
+        jcky_to_half(half_a, gemm_a, GEMM_M * GEMM_K, storage);
+        forward_half_reference(gemm_c, half_a, storage, gemm_b, gemm_bias, GEMM_M, GEMM_K, GEMM_N, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_M*GEMM_N; i++) {
+            assert((fabs(gemm_c[i] - gemm_expected[i]) < GEMM_TOLERANCE) && "Invalid 16 bit forward result\n");
+        }
+        delta_half_reference(delta_result, half_a, storage, gemm_expected, GEMM_M, GEMM_K, GEMM_N, JCKY_FEATURE_MAJOR_LAYOUT_ID);
+        for(i=0; i<GEMM_K*GEMM_N; i++) {
+            assert((fabs(delta_result[i] - delta_expected[i]) < GEMM_TOLERANCE) && "Invalid 16 bit delta result\n");
+        }
+        printf(".");
+    }
+
+    free(half_a);
+
+    // Averaging the workers' scratch nets must give the base plus their
+    // mean change, in either memory layout, for a number of workers that
+    // doesn't fill the tree, and with the arrays split across threads.
+    jcky_cli workers_cli;
+    struct meta_neural_net workers_meta;
+    jcky_workers workers;
+    neural_net *workers_scratch;
+    unsigned long int workers_len;
+    int worker, reduce_threads;
+    unsigned char memory_layout;
+
+    workers_cli.number_of_hidden_layers = 2;
+    workers_cli.hidden_layer_widths[0] = 70;
+    workers_cli.hidden_layer_widths[1] = 30;
+    workers_cli.hidden_activations[0] = JCKY_ACTIVATION_SIGMOID_ID;
+    workers_cli.hidden_activations[1] = JCKY_ACTIVATION_SIGMOID_ID;
+    workers_cli.batch_size = BATCH;
+    workers_cli.learning_rate = 0.5;
+    workers_cli.optimizer = JCKY_OPTIMIZER_SGD_ID;
+    workers_cli.output = JCKY_OUTPUT_SIGMOID_ID;
+    workers_cli.derivative = JCKY_DERIVATIVE_ACTIVATION_ID;
+    workers_cli.sigmoid = JCKY_SIGMOID_EXACT_ID;
+    workers_cli.storage = JCKY_STORAGE_BF16_ID;
+    workers_cli.backward = JCKY_BACKWARD_SPLIT_ID;
+    workers_cli.transposed_shadow = 0;
+    workers_cli.batch_layout = JCKY_FEATURE_MAJOR_LAYOUT_ID;
+    workers_cli.input_format = JCKY_INPUT_DENSE_ID;
+    workers_cli.backend = JCKY_BACKEND_REFERENCE_ID;
+    workers_cli.num_blocks = 0;
+    workers_cli.block_size = 0;
+
+    for(memory_layout=JCKY_CONTIGUOUS_LAYOUT_ID; memory_layout<=JCKY_LOGICAL_LAYOUT_ID; memory_layout++) {
+        workers_cli.memory_layout = memory_layout;
+        workers_meta = create_neural_net(&workers_cli, 50, DATA_LEN);
+        workers = create_workers(&workers_meta, 3, JCKY_THREAD_MODE_DATA_ID);
+
+        for(reduce_threads=1; reduce_threads<=2; reduce_threads++) {
+            if (!jcky_threads_supported(reduce_threads)) continue;
+
+            for(i=0; i<=workers_meta.number_of_hidden_layers; i++) {
+                workers_len = nn_weight_len(&workers_meta, i);
+                for(j=0; j<workers_len; j++) {
+                    workers_meta.nns[JCKY_NN_BASE].weight[i][j] = (nn_type)((int)(j % 7) - 3) / 8.0;
+                    for(worker=0; worker<workers.count; worker++) {
+                        workers_scratch = &(workers.worker[worker].meta.nns[JCKY_NN_SCRATCH]);
+                        workers_scratch->weight[i][j] = workers_meta.nns[JCKY_NN_BASE].weight[i][j] + (worker + 1) / 16.0;
+                    }
+                }
+                workers_len = nn_rows(&workers_meta, i);
+                for(j=0; j<workers_len; j++) {
+                    workers_meta.nns[JCKY_NN_BASE].bias[i][j] = (nn_type)j / 8.0;
+                    for(worker=0; worker<workers.count; worker++) {
+                        workers_scratch = &(workers.worker[worker].meta.nns[JCKY_NN_SCRATCH]);
+                        workers_scratch->bias[i][j] = workers_meta.nns[JCKY_NN_BASE].bias[i][j] - (worker + 1) / 16.0;
+                    }
+                }
+            }
+
+            #pragma omp parallel num_threads(reduce_threads)
+            reduce_workers(&workers_meta, &workers, &(workers_meta.nns[JCKY_NN_SCRATCH]));
+
+            for(i=0; i<=workers_meta.number_of_hidden_layers; i++) {
+                workers_len = nn_weight_len(&workers_meta, i);
+                for(j=0; j<workers_len; j++) {
+                    assert((fabs(workers_meta.nns[JCKY_NN_SCRATCH].weight[i][j] -
+                                 (workers_meta.nns[JCKY_NN_BASE].weight[i][j] + 1.0 / 8.0)) < GEMM_TOLERANCE) &&
+                           "Invalid worker weight average\n");
+                }
+                workers_len = nn_rows(&workers_meta, i);
+                for(j=0; j<workers_len; j++) {
+                    assert((fabs(workers_meta.nns[JCKY_NN_SCRATCH].bias[i][j] -
+                                 (workers_meta.nns[JCKY_NN_BASE].bias[i][j] - 1.0 / 8.0)) < GEMM_TOLERANCE) &&
+                           "Invalid worker bias average\n");
+                }
+            }
+            printf(".");
+        }
+
+        destroy_workers(&workers);
+
+        // Hogwild workers train the rank's scratch itself, but each
+        // keeps a 16 bit copy of its own.
+        workers = create_workers(&workers_meta, 2, JCKY_THREAD_MODE_HOGWILD_ID);
+        for(worker=0; worker<workers.count; worker++) {
+            workers_scratch = &(workers.worker[worker].meta.nns[JCKY_NN_SCRATCH]);
+            for(i=0; i<=workers_meta.number_of_hidden_layers; i++) {
+                assert((workers_scratch->weight[i] == workers_meta.nns[JCKY_NN_SCRATCH].weight[i]) &&
+                       (workers_scratch->bias[i] == workers_meta.nns[JCKY_NN_SCRATCH].bias[i]) &&
+                       "Hogwild worker doesn't share the scratch\n");
+            }
+            assert((workers_scratch->half_container != workers_meta.nns[JCKY_NN_SCRATCH].half_container) &&
+                   "Hogwild worker shares the 16 bit copy\n");
+        }
+        destroy_workers(&workers);
+        destroy_meta_nn(&workers_meta);
+    }
+
+    // A layer list on the command line gives each hidden layer its own
+    // width, and a malformed list is refused. So does an activation
+    // list, which must name one function or one per hidden layer.
+    jcky_cli layers_cli;
+    char layers_arg[6][16] = {"jockey", "--write", "--layers", "40,20,10", "--activation", "relu"};
+    char *layers_argv[6];
+
+    for(i=0; i<6; i++) layers_argv[i] = layers_arg[i];
+    ret = process_command_line(4, layers_argv, &layers_cli, 0);
+    assert(!ret && (layers_cli.number_of_hidden_layers == 3) && (layers_cli.hidden_layer_widths[0] == 40) &&
+           (layers_cli.hidden_layer_widths[1] == 20) && (layers_cli.hidden_layer_widths[2] == 10) &&
+           (layers_cli.hidden_activations[2] == JCKY_ACTIVATION_SIGMOID_ID) && "Invalid layer list\n");
+    // The list wins over --hidden-layers, on either side of it
+    char mixed_arg[6][16] = {"jockey", "--write", "--layers", "40,20", "--hidden-layers", "4"};
+    char *mixed_argv[6];
+
+    for(i=0; i<6; i++) mixed_argv[i] = mixed_arg[i];
+    ret = process_command_line(6, mixed_argv, &layers_cli, 0);
+    assert(!ret && (layers_cli.number_of_hidden_layers == 2) && (layers_cli.hidden_layer_widths[1] == 20) &&
+           "Layer list overridden by --hidden-layers\n");
+    mixed_argv[2] = mixed_arg[4];
+    mixed_argv[3] = mixed_arg[5];
+    mixed_argv[4] = mixed_arg[2];
+    mixed_argv[5] = mixed_arg[3];
+    ret = process_command_line(6, mixed_argv, &layers_cli, 0);
+    assert(!ret && (layers_cli.number_of_hidden_layers == 2) && (layers_cli.hidden_layer_widths[1] == 20) &&
+           "Layer list overridden by --hidden-layers\n");
+    ret = process_command_line(6, layers_argv, &layers_cli, 0);
+    assert(!ret && (layers_cli.hidden_activations[0] == JCKY_ACTIVATION_RELU_ID) &&
+           (layers_cli.hidden_activations[2] == JCKY_ACTIVATION_RELU_ID) && "Invalid activation\n");
+    strcpy(layers_arg[5], "relu,tanh");
+    assert(process_command_line(6, layers_argv, &layers_cli, 0) && "Short activation list accepted\n");
+    strcpy(layers_arg[5], "relu,,tanh");
+    assert(process_command_line(6, layers_argv, &layers_cli, 0) && "Malformed activation list accepted\n");
+    strcpy(layers_arg[3], "40,,10");
+    assert(process_command_line(4, layers_argv, &layers_cli, 0) && "Malformed layer list accepted\n");
+    strcpy(layers_arg[3], "40,0");
+    assert(process_command_line(4, layers_argv, &layers_cli, 0) && "Empty layer accepted\n");
+
+    // Only the kernels thread mode prefetches, so asking for it in the
+    // others is refused rather than ignored.
+    char prefetch_arg[6][16] = {"jockey", "--write", "--prefetch", "2", "--thread-mode", "data"};
+    char *prefetch_argv[6];
+
+    for(i=0; i<6; i++) prefetch_argv[i] = prefetch_arg[i];
+    assert(process_command_line(6, prefetch_argv, &layers_cli, 0) && "Prefetch accepted in the data mode\n");
+    strcpy(prefetch_arg[5], "kernels");
+    ret = process_command_line(6, prefetch_argv, &layers_cli, 0);
+    assert(!ret && (layers_cli.prefetch == 2) && "Prefetch refused in the kernels mode\n");
+
+    // Only 'auto' asks for the automatic thread count, not 0 or a word
+    char threads_arg[4][16] = {"jockey", "--write", "--threads", "abc"};
+    char *threads_argv[4];
+
+    for(i=0; i<4; i++) threads_argv[i] = threads_arg[i];
+    assert(process_command_line(4, threads_argv, &layers_cli, 0) && "Non-numeric thread count accepted\n");
+    strcpy(threads_arg[3], "0");
+    assert(process_command_line(4, threads_argv, &layers_cli, 0) && "Zero threads accepted\n");
+    strcpy(threads_arg[3], JCKY_THREADS_AUTO);
+    ret = process_command_line(4, threads_argv, &layers_cli, 0);
+    assert(!ret && (layers_cli.threads == JCKY_THREADS_AUTO_ID) && "Invalid auto thread count\n");
+    strcpy(threads_arg[3], "3");
+    ret = process_command_line(4, threads_argv, &layers_cli, 0);
+    assert(!ret && (layers_cli.threads == 3) && "Invalid thread count\n");
+    printf(".");
+
+    // A net with hidden layers of different widths and activation
+    // functions must train the same way in either memory layout and with
+    // either backward pass, and its model file must record the widths
+    // and load into either layout.
+    struct meta_neural_net layers_ref, layers_meta;
+    jcky_model_file layers_model;
+    nn_type *layers_batch = malloc( 50 * BATCH * sizeof( nn_type ) );
+    nn_type *layers_targets = malloc( DATA_LEN * BATCH * sizeof( nn_type ) );
+    nn_type *layers_result = malloc( DATA_LEN * BATCH * sizeof( nn_type ) );
+    double layers_score = 0.0;
+    unsigned char backward;
+
+    for(i=0; i<50*BATCH; i++) layers_batch[i] = (nn_type)((int)(i % 5) - 2) / 4.0;
+    for(i=0; i<DATA_LEN*BATCH; i++) layers_targets[i] = (nn_type)(i % 2);
+
+    strcpy(layers_arg[3], "40,10");
+    strcpy(layers_arg[5], "leaky-relu,tanh");
+    ret = process_command_line(6, layers_argv, &layers_cli, 0);
+    assert(!ret && "Invalid layer list\n");
+    layers_cli.seed = 3;
+    layers_cli.batch_size = BATCH;
+    layers_ref = create_neural_net(&layers_cli, 50, DATA_LEN);
+    layers_ref.functions->init(&layers_ref, &layers_cli);
+    write_model(&layers_ref, MODEL_FILENAME);
+    layers_ref.functions->copy(&layers_ref, JCKY_NN_SCRATCH, JCKY_NN_BASE);
+    feed_forward(&layers_ref, layers_result, layers_batch, layers_targets, JCKY_TRAIN, &layers_score);
+
+    layers_model = open_model_file(MODEL_FILENAME);
+    assert((layers_model.stream != NULL) && (layers_model.layers == 4) && (layers_model.layer_width[0] == 50) &&
+           (layers_model.layer_width[1] == 40) && (layers_model.layer_width[2] == 10) &&
+           (layers_model.layer_width[3] == DATA_LEN) && "Invalid model file layers\n");
+    fclose(layers_model.stream);
+    assert(!validate_model_file(&layers_ref, MODEL_FILENAME) && "Invalid model file length\n");
+
+    strcpy(layers_cli.init_model_filename, MODEL_FILENAME);
+    for(memory_layout=JCKY_CONTIGUOUS_LAYOUT_ID; memory_layout<=JCKY_LOGICAL_LAYOUT_ID; memory_layout++) {
+        for(backward=JCKY_BACKWARD_SPLIT_ID; backward<=JCKY_BACKWARD_FUSED_ID; backward++) {
+            layers_cli.memory_layout = memory_layout;
+            layers_cli.backward = backward;
+            layers_meta = create_neural_net(&layers_cli, 50, DATA_LEN);
+            layers_meta.functions->init(&layers_meta, &layers_cli);
+            layers_meta.functions->copy(&layers_meta, JCKY_NN_SCRATCH, JCKY_NN_BASE);
+            feed_forward(&layers_meta, layers_result, layers_batch, layers_targets, JCKY_TRAIN, &layers_score);
+
+            for(i=0; i<=layers_meta.number_of_hidden_layers; i++) {
+                for(j=0; j<nn_rows(&layers_meta, i); j++) {
+                    assert((fabs(layers_meta.nns[JCKY_NN_SCRATCH].bias[i][j] -
+                                 layers_ref.nns[JCKY_NN_SCRATCH].bias[i][j]) < GEMM_TOLERANCE) &&
+                           "Invalid bias of uneven layers\n");
+                }
+                for(j=0; j<nn_weight_len(&layers_meta, i); j++) {
+                    assert((fabs(layers_meta.nns[JCKY_NN_SCRATCH].weight[i][j] -
+                                 layers_ref.nns[JCKY_NN_SCRATCH].weight[i][j]) < GEMM_TOLERANCE) &&
+                           "Invalid weight of uneven layers\n");
+                }
+            }
+            destroy_meta_nn(&layers_meta);
+            printf(".");
+        }
+    }
+
+    // Momentum and Adam must train the same way in either memory layout,
+    // over a few batches so their state carries over, and momentum with
+    // none of it must take the same steps as plain gradient descent.
+    struct meta_neural_net optimizer_ref;
+    unsigned char optimizer;
+    unsigned int l;
+
+    layers_cli.backward = JCKY_BACKWARD_SPLIT_ID;
+    layers_cli.momentum = 0.5;
+    for(optimizer=JCKY_OPTIMIZER_MOMENTUM_ID; optimizer<=JCKY_OPTIMIZER_ADAM_ID + 1; optimizer++) {
+        for(memory_layout=JCKY_CONTIGUOUS_LAYOUT_ID; memory_layout<=JCKY_LOGICAL_LAYOUT_ID; memory_layout++) {
+            // The last round is plain gradient descent against momentum 0
+            layers_cli.optimizer = (optimizer <= JCKY_OPTIMIZER_ADAM_ID) ? optimizer :
+                                   (memory_layout == JCKY_CONTIGUOUS_LAYOUT_ID) ? JCKY_OPTIMIZER_SGD_ID :
+                                   JCKY_OPTIMIZER_MOMENTUM_ID;
+            layers_cli.momentum = (optimizer <= JCKY_OPTIMIZER_ADAM_ID) ? 0.5 : 0.0;
+            layers_cli.learning_rate = (optimizer == JCKY_OPTIMIZER_ADAM_ID) ? 0.01 : 0.5;
+            layers_cli.memory_layout = memory_layout;
+            layers_meta = create_neural_net(&layers_cli, 50, DATA_LEN);
+            layers_meta.functions->init(&layers_meta, &layers_cli);
+            layers_meta.functions->copy(&layers_meta, JCKY_NN_SCRATCH, JCKY_NN_BASE);
+            for(k=0; k<3; k++) {
+                feed_forward(&layers_meta, layers_result, layers_batch, layers_targets, JCKY_TRAIN, &layers_score);
+            }
+            l = layers_meta.number_of_hidden_layers;
+            assert((layers_meta.nns[JCKY_NN_SCRATCH].bias[l][0] != layers_meta.nns[JCKY_NN_BASE].bias[l][0]) &&
+                   "Optimizer took no step\n");
+            if (memory_layout == JCKY_CONTIGUOUS_LAYOUT_ID) {
+                optimizer_ref = layers_meta;
+                continue;
+            }
+
+            for(i=0; i<=l; i++) {
+                for(j=0; j<nn_rows(&layers_meta, i); j++) {
+                    assert((fabs(layers_meta.nns[JCKY_NN_SCRATCH].bias[i][j] -
+                                 optimizer_ref.nns[JCKY_NN_SCRATCH].bias[i][j]) < GEMM_TOLERANCE) &&
+                           "Invalid bias of optimizer\n");
+                }
+                for(j=0; j<nn_weight_len(&layers_meta, i); j++) {
+                    assert((fabs(layers_meta.nns[JCKY_NN_SCRATCH].weight[i][j] -
+                                 optimizer_ref.nns[JCKY_NN_SCRATCH].weight[i][j]) < GEMM_TOLERANCE) &&
+                           "Invalid weight of optimizer\n");
+                }
+            }
+            destroy_meta_nn(&layers_meta);
+            destroy_meta_nn(&optimizer_ref);
+            printf(".");
+        }
+    }
+    layers_cli.optimizer = JCKY_OPTIMIZER_SGD_ID;
+
+    // The arena hands out cache line aligned, padded slices until it's
+    // full, and every batch matrix and every array of a logical net is
+    // one of them.
+    jcky_arena arena = create_arena(3 * JCKY_ARENA_ALIGN);
+    char *slice[3];
+
+    slice[0] = arena_alloc(&arena, 1);
+    slice[1] = arena_alloc(&arena, JCKY_ARENA_ALIGN + 1);
+    assert((slice[0] != NULL) && (slice[1] == slice[0] + JCKY_ARENA_ALIGN) &&
+           ((unsigned long int)slice[0] % JCKY_ARENA_ALIGN == 0) && "Invalid arena slice\n");
+    slice[2] = arena_alloc(&arena, 1);
+    assert((slice[2] == NULL) && "Arena overrun\n");
+    destroy_arena(&arena);
+
+    // With huge pages an arena big enough is mapped by itself, aligned to
+    // and rounded up to whole huge pages, and every one of its pages is
+    // either on a node or reported as unknown.
+#ifdef __linux__
+    jcky_placement placement;
+    unsigned long int node_pages = 0;
+
+    assert(!jcky_select_memory(JCKY_PAGES_TRANSPARENT_ID, JCKY_NUMA_LOCAL_ID, 0) && "Invalid page policy\n");
+    arena = create_arena(JCKY_ARENA_MAP_MIN + 1);
+    assert((arena.block != NULL) && (arena.map_size == JCKY_HUGE_PAGE_SIZE) &&
+           ((unsigned long int)arena.block % JCKY_HUGE_PAGE_SIZE == 0) && "Invalid mapped arena\n");
+    memset(arena_alloc(&arena, JCKY_ARENA_MAP_MIN + 1), 1, JCKY_ARENA_MAP_MIN + 1);
+    memset(&placement, 0, sizeof( jcky_placement ));
+    arena_placement(&arena, &placement);
+    for(i=0; i<JCKY_MAX_NUMA_NODES; i++) node_pages += placement.node_pages[i];
+    assert((placement.mapped_bytes == JCKY_HUGE_PAGE_SIZE) && (placement.huge_bytes <= JCKY_HUGE_PAGE_SIZE) &&
+           (placement.pages == (JCKY_ARENA_MAP_MIN / JCKY_PAGE_SIZE) + 1) &&
+           (node_pages + placement.unknown_pages == placement.pages) && "Invalid arena placement\n");
+    destroy_arena(&arena);
+    jcky_select_memory(JCKY_PAGES_DEFAULT_ID, JCKY_NUMA_DEFAULT_ID, 0);
+#endif
+
+    layers_cli.memory_layout = JCKY_LOGICAL_LAYOUT_ID;
+    layers_cli.derivative = JCKY_DERIVATIVE_Z_ID;
+    layers_meta = create_neural_net(&layers_cli, 50, DATA_LEN);
+    for(i=0; i<=layers_meta.number_of_hidden_layers; i++) {
+        assert(((unsigned long int)layers_meta.z_matrix[i] % JCKY_ARENA_ALIGN == 0) &&
+               ((unsigned long int)layers_meta.activation[i] % JCKY_ARENA_ALIGN == 0) &&
+               ((unsigned long int)layers_meta.delta[i] % JCKY_ARENA_ALIGN == 0) &&
+               ((unsigned long int)layers_meta.nns[JCKY_NN_SCRATCH].bias[i] % JCKY_ARENA_ALIGN == 0) &&
+               ((unsigned long int)layers_meta.nns[JCKY_NN_SCRATCH].weight[i] % JCKY_ARENA_ALIGN == 0) &&
+               "Unaligned arena slice\n");
+    }
+    destroy_meta_nn(&layers_meta);
+    layers_cli.memory_layout = JCKY_CONTIGUOUS_LAYOUT_ID;
+    layers_cli.derivative = JCKY_DERIVATIVE_ACTIVATION_ID;
+    printf(".");
+
+    destroy_meta_nn(&layers_ref);
+    free(layers_batch);
+    free(layers_targets);
+    free(layers_result);
+    remove(MODEL_FILENAME);
+
+    // The softmax must sum to one over each sample's outputs, in either
+    // batch layout and in place, survive z far beyond the range of exp,
+    // and write the cross-entropy delta only when asked to.
+    nn_type softmax_z[DATA_LEN * BATCH], softmax_a[DATA_LEN * BATCH], softmax_delta[DATA_LEN * BATCH];
+    nn_type softmax_targets[DATA_LEN * BATCH], softmax_sum;
+    unsigned char batch_layout;
+    int node_stride, sample_stride, index;
+
+    for(i=0; i<DATA_LEN*BATCH; i++) softmax_targets[i] = (nn_type)((i % DATA_LEN) == 1);
+    for(batch_layout=JCKY_FEATURE_MAJOR_LAYOUT_ID; batch_layout<=JCKY_BATCH_MAJOR_LAYOUT_ID; batch_layout++) {
+        node_stride = JCKY_NODE_STRIDE(batch_layout, BATCH);
+        sample_stride = JCKY_SAMPLE_STRIDE(batch_layout, DATA_LEN);
+        for(i=0; i<DATA_LEN*BATCH; i++) softmax_z[i] = (nn_type)i * ((i % 2) ? 400.0 : 0.25);
+        copy_vectors(softmax_a, softmax_z, DATA_LEN * BATCH);
+
+        softmax_output_layer(softmax_a, softmax_a, softmax_delta, softmax_targets, DATA_LEN, BATCH, batch_layout);
+        for(i=0; i<BATCH; i++) {
+            softmax_sum = 0.0;
+            for(j=0; j<DATA_LEN; j++) {
+                index = (j * node_stride) + (i * sample_stride);
+                softmax_sum += softmax_a[index];
+                accum = 0.0;
+                for(k=0; k<DATA_LEN; k++) {
+                    accum += exp(softmax_z[(k * node_stride) + (i * sample_stride)] - softmax_z[index]);
+                }
+                assert((fabs(softmax_a[index] - (1.0 / accum)) < GEMM_TOLERANCE) && "Invalid softmax\n");
+                assert((softmax_delta[index] == softmax_a[index] - softmax_targets[(i * DATA_LEN) + j]) &&
+                       "Invalid softmax delta\n");
+            }
+            assert((fabs(softmax_sum - 1.0) < GEMM_TOLERANCE) && "Softmax doesn't sum to one\n");
+        }
+
+        for(i=0; i<DATA_LEN*BATCH; i++) softmax_delta[i] = 7.0;
+        softmax_output_layer(softmax_z, softmax_z, NULL, softmax_targets, DATA_LEN, BATCH, batch_layout);
+        for(i=0; i<DATA_LEN*BATCH; i++) {
+            assert((softmax_z[i] == softmax_a[i]) && (softmax_delta[i] == 7.0) && "Invalid softmax without delta\n");
+        }
+    }
+    printf(".");
+
+    free(delta_expected);
+    free(delta_result);
+    free(weight_expected);
+    free(weight_result);
+    free(gemm_a);
+    free(gemm_a_transposed);
+    free(gemm_b);
+    free(gemm_c);
+    free(gemm_expected);
+    free(gemm_bias);
+    free(vector_expected);
+    free(sigmoid_z);
+    jcky_gemm_free_workspace();
+
     printf("\nAll tests passed!\n");
     remove(FILENAME);
 